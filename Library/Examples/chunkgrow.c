@@ -0,0 +1,320 @@
+/*
+**	@(#) $Id$
+**
+**	Other libwww samples can be found at "http://www.w3.org/Library/Examples"
+**
+**	Copyright (c) 1995-1998 World Wide Web Consortium, (Massachusetts
+**	Institute of Technology, Institut National de Recherche en
+**	Informatique et en Automatique, Keio University). All Rights
+**	Reserved. This program is distributed under the W3C's Software
+**	Intellectual Property License. This program is distributed in the hope
+**	that it will be useful, but WITHOUT ANY WARRANTY; without even the
+**	implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+**	PURPOSE. See W3C License http://www.w3.org/Consortium/Legal/ for more
+**	details.
+**
+**	Fills chunks the way the MIME parser collects header tokens and the
+**	SGML parser collects tag names, one character at a time and cleared
+**	after each token, and the way a response body is collected in big
+**	blocks. The same is done with a copy of the original chunk code which
+**	grew by a fixed amount and zero filled the new memory, so that the
+**	two can be compared. Note that the old code is compiled into this
+**	program and may be inlined, which favours it in the character by
+**	character cases, and that how much the fixed increments cost depends
+**	a lot on how well realloc() can grow a block in place.
+*/
+
+#include "WWWLib.h"
+
+#define DEFAULT_MBYTES	16
+#define DEFAULT_REPEATS	20
+#define BODY_ROUNDS	10		/* Bodies are quick so do more of them */
+
+/* ------------------------------------------------------------------------- */
+/*		The original chunk: fixed increments and zero filled	     */
+/* ------------------------------------------------------------------------- */
+
+typedef struct _OldChunk {
+    int		size;
+    int		growby;
+    int		allocated;
+    char *	data;
+} OldChunk;
+
+PRIVATE OldChunk * OldChunk_new (int grow)
+{
+    OldChunk * ch;
+    if ((ch = (OldChunk *) HT_CALLOC(1, sizeof(OldChunk))) == NULL)
+        HT_OUTOFMEM("OldChunk_new");
+    ch->growby = grow;
+    return ch;
+}
+
+PRIVATE void OldChunk_delete (OldChunk * ch)
+{
+    HT_FREE(ch->data);
+    HT_FREE(ch);
+}
+
+PRIVATE void OldChunk_clear (OldChunk * ch)
+{
+    ch->size = 0;
+    if (ch->data) memset((void *) ch->data, '\0', ch->allocated);
+}
+
+PRIVATE void OldChunk_truncate (OldChunk * ch, int length)
+{
+    if (length >= 0 && length < ch->size) {
+	memset(ch->data+length, '\0', ch->size-length);
+	ch->size = length;
+    }
+}
+
+PRIVATE void OldChunk_putc (OldChunk * ch, char c)
+{
+    if (!ch->data || ch->size >= ch->allocated-1) {
+	if (ch->data) {
+	    if ((ch->data = (char *) HT_REALLOC(ch->data,ch->allocated+ch->growby)) == NULL)
+		HT_OUTOFMEM("OldChunk_putc");
+	    memset((void *) (ch->data + ch->allocated), '\0', ch->growby);
+	} else {
+	    if ((ch->data = (char *) HT_CALLOC(1, ch->allocated+ch->growby)) == NULL)
+		HT_OUTOFMEM("OldChunk_putc");
+	}
+	ch->allocated += ch->growby;
+    }
+    *(ch->data+ch->size++) = c;
+}
+
+PRIVATE void OldChunk_putb (OldChunk * ch, const char * block, int len)
+{
+    int needed = ch->size+len;
+    if (needed >= ch->allocated) {
+	ch->allocated = needed - needed%ch->growby + ch->growby;
+	if (ch->data) {
+	    if ((ch->data = (char *) HT_REALLOC(ch->data, ch->allocated)) == NULL)
+		HT_OUTOFMEM("OldChunk_putb");
+	    memset((void *) (ch->data + needed), '\0', ch->allocated-needed);
+	} else {
+	    if ((ch->data = (char *) HT_CALLOC(1, ch->allocated)) == NULL)
+		HT_OUTOFMEM("OldChunk_putb");
+	}
+    }
+    memcpy((void *) (ch->data+ch->size), block, len);
+    ch->size = needed;
+}
+
+/* ------------------------------------------------------------------------- */
+
+PRIVATE const char * headers[] = {
+    "Date: Mon, 12 Oct 2026 10:24:12 GMT",
+    "Server: Apache/2.4.58 (Unix)",
+    "Last-Modified: Fri, 09 Oct 2026 17:01:44 GMT",
+    "ETag: \"3f80f-1b6-3e1cb03b\"",
+    "Content-Type: text/html; charset=ISO-8859-1",
+    "Content-Length: 43871",
+    "Cache-Control: max-age=3600, must-revalidate",
+    "Set-Cookie: session=4f1b2c3d4e5f60718293a4b5c6d7e8f9; path=/; HttpOnly",
+    NULL
+};
+
+PRIVATE const char * tags[] = {
+    "html", "head", "title", "body", "div", "p", "a", "img", "table",
+    "tr", "td", "span", "blockquote", "address", NULL
+};
+
+PRIVATE ms_t start;
+
+PRIVATE void report (const char * chunk, const char * what, double mbytes,
+		     ms_t spent)
+{
+    HTPrint("%-8s %-28s %7.1f MB in %6lu ms (%.1f MB per sec)\n",
+	    chunk, what, mbytes, spent, spent ? mbytes * 1000.0 / spent : 0.0);
+}
+
+/*
+**	Collect a body of total bytes in blocks, growing by 4K like
+**	HTLoadToChunk, and return the time it took
+*/
+PRIVATE ms_t old_body (const char * block, int len, int total)
+{
+    OldChunk * body = OldChunk_new(4096);
+    int cnt;
+    start = HTGetTimeInMillis();
+    for (cnt = 0; cnt < total; cnt += len)
+	OldChunk_putb(body, block, len);
+    OldChunk_delete(body);
+    return HTGetTimeInMillis() - start;
+}
+
+PRIVATE ms_t new_body (const char * block, int len, int total)
+{
+    HTChunk * body = HTChunk_new(4096);
+    int cnt;
+    start = HTGetTimeInMillis();
+    for (cnt = 0; cnt < total; cnt += len)
+	HTChunk_putb(body, block, len);
+    HTChunk_delete(body);
+    return HTGetTimeInMillis() - start;
+}
+
+PRIVATE ms_t steal_body (int len, int total)
+{
+    HTChunk * body = HTChunk_new(4096);
+    char * data;
+    int cnt;
+    start = HTGetTimeInMillis();
+    for (cnt = 0; cnt < total; cnt += len) {
+	char * space = HTChunk_reserve(body, len);
+	memset(space, 'x', len);
+	HTChunk_setSize(body, HTChunk_size(body) + len);
+    }
+    data = HTChunk_steal(body);
+    HT_FREE(data);
+    HTChunk_delete(body);
+    return HTGetTimeInMillis() - start;
+}
+
+int main (int argc, char ** argv)
+{
+    int mbytes = argc > 1 ? atoi(argv[1]) : DEFAULT_MBYTES;
+    int repeats = argc > 2 ? atoi(argv[2]) : DEFAULT_REPEATS;
+    int total;
+    double limit;
+    char block[4096];
+    int cnt, round;
+    if (mbytes <= 0 || repeats <= 0) {
+	HTPrint("Type the number of MBytes to put into each chunk and the number of times\n");
+	HTPrint("\t%s [<mbytes> [<repeats>]]\n", argv[0]);
+	return -1;
+    }
+    total = mbytes * 1024 * 1024;
+    limit = (double) total * repeats;
+    memset(block, 'x', sizeof(block));
+
+    /* Header lines split into token and value like HTMIME does */
+    {
+	OldChunk * token = OldChunk_new(128);
+	OldChunk * value = OldChunk_new(128);
+	double done = 0;
+	start = HTGetTimeInMillis();
+	while (done < limit) {
+	    const char ** h;
+	    for (h = headers; *h; h++) {
+		const char * p = *h;
+		while (*p && *p != ':') OldChunk_putc(token, *p++);
+		for (p++; *p; p++) OldChunk_putc(value, *p);
+		done += p - *h;
+		OldChunk_truncate(token, 0);
+		OldChunk_truncate(value, 0);
+	    }
+	}
+	report("old", "header tokens (putc)", done / 1048576.0,
+	       HTGetTimeInMillis() - start);
+	OldChunk_delete(token);
+	OldChunk_delete(value);
+    }
+    {
+	HTChunk * token = HTChunk_new(128);
+	HTChunk * value = HTChunk_new(128);
+	double done = 0;
+	start = HTGetTimeInMillis();
+	while (done < limit) {
+	    const char ** h;
+	    for (h = headers; *h; h++) {
+		const char * p = *h;
+		while (*p && *p != ':') HTChunk_putc(token, *p++);
+		for (p++; *p; p++) HTChunk_putc(value, *p);
+		done += p - *h;
+		HTChunk_truncate(token, 0);
+		HTChunk_truncate(value, 0);
+	    }
+	}
+	report("HTChunk", "header tokens (putc)", done / 1048576.0,
+	       HTGetTimeInMillis() - start);
+	HTChunk_delete(token);
+	HTChunk_delete(value);
+    }
+
+    /* Tag names cleared after each tag like SGML does */
+    {
+	OldChunk * string = OldChunk_new(128);
+	double done = 0;
+	start = HTGetTimeInMillis();
+	while (done < limit) {
+	    const char ** t;
+	    for (t = tags; *t; t++) {
+		const char * p;
+		for (p = *t; *p; p++) OldChunk_putc(string, *p);
+		done += p - *t;
+		OldChunk_clear(string);
+	    }
+	}
+	report("old", "tag names (putc)", done / 1048576.0,
+	       HTGetTimeInMillis() - start);
+	OldChunk_delete(string);
+    }
+    {
+	HTChunk * string = HTChunk_new(128);
+	double done = 0;
+	start = HTGetTimeInMillis();
+	while (done < limit) {
+	    const char ** t;
+	    for (t = tags; *t; t++) {
+		const char * p;
+		for (p = *t; *p; p++) HTChunk_putc(string, *p);
+		done += p - *t;
+		HTChunk_clear(string);
+	    }
+	}
+	report("HTChunk", "tag names (putc)", done / 1048576.0,
+	       HTGetTimeInMillis() - start);
+	HTChunk_delete(string);
+    }
+
+    /* Long tokens, a character at a time, in new chunks */
+    {
+	double done = 0;
+	start = HTGetTimeInMillis();
+	while (done < limit) {
+	    OldChunk * string = OldChunk_new(128);
+	    for (cnt = 0; cnt < 65536; cnt++) OldChunk_putc(string, 'x');
+	    done += cnt;
+	    OldChunk_delete(string);
+	}
+	report("old", "64K tokens (putc)", done / 1048576.0,
+	       HTGetTimeInMillis() - start);
+    }
+    {
+	double done = 0;
+	start = HTGetTimeInMillis();
+	while (done < limit) {
+	    HTChunk * string = HTChunk_new(128);
+	    for (cnt = 0; cnt < 65536; cnt++) HTChunk_putc(string, 'x');
+	    done += cnt;
+	    HTChunk_delete(string);
+	}
+	report("HTChunk", "64K tokens (putc)", done / 1048576.0,
+	       HTGetTimeInMillis() - start);
+    }
+
+    /*
+    **  Bodies. The three ways take turns so that they all see the heap in
+    **  the same state, as how realloc() behaves depends on what has been
+    **  allocated and freed before.
+    */
+    {
+	ms_t old_spent = 0, new_spent = 0, steal_spent = 0;
+	limit *= BODY_ROUNDS;
+	for (round = 0; round < repeats * BODY_ROUNDS; round++) {
+	    old_spent += old_body(block, sizeof(block), total);
+	    new_spent += new_body(block, sizeof(block), total);
+	    steal_spent += steal_body(sizeof(block), total);
+	}
+	report("old", "body (putb)", limit / 1048576.0, old_spent);
+	report("HTChunk", "body (putb)", limit / 1048576.0, new_spent);
+	report("HTChunk", "body (reserve and steal)", limit / 1048576.0,
+	       steal_spent);
+    }
+    return 0;
+}
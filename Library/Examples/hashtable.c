@@ -0,0 +1,198 @@
+/*
+**	@(#) $Id$
+**
+**	Other libwww samples can be found at "http://www.w3.org/Library/Examples"
+**
+**	Copyright (c) 1995-1998 World Wide Web Consortium, (Massachusetts
+**	Institute of Technology, Institut National de Recherche en
+**	Informatique et en Automatique, Keio University). All Rights
+**	Reserved. This program is distributed under the W3C's Software
+**	Intellectual Property License. This program is distributed in the hope
+**	that it will be useful, but WITHOUT ANY WARRANTY; without even the
+**	implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+**	PURPOSE. See W3C License http://www.w3.org/Consortium/Legal/ for more
+**	details.
+**
+**	Inserts a number of URL like keys into a hash table and looks them
+**	up again, along with the same number of keys that are not in the
+**	table. The same is done with a copy of the original libwww hash
+**	table which used a fixed number of buckets with a list in each, so
+**	that the two can be compared.
+*/
+
+#include "WWWLib.h"
+#include "HTHash.h"
+
+#define DEFAULT_COUNT	100000
+
+/* ------------------------------------------------------------------------- */
+/*	   The original table: HT_L_HASH_SIZE buckets of key/object lists	     */
+/* ------------------------------------------------------------------------- */
+
+typedef struct _ListTable {
+    HTList ** table;
+    int size;
+} ListTable;
+
+PRIVATE int list_hash (const char * key, int size)
+{
+    int hash = 0;
+    const char * ptr = key;
+    for(; *ptr; ptr++)
+	hash = (int) ((hash*3 + (*(unsigned char*)ptr)) % size);
+    return hash;
+}
+
+PRIVATE ListTable * ListTable_new (void)
+{
+    ListTable * me;
+    if ((me = (ListTable *) HT_CALLOC(1, sizeof(ListTable))) == NULL ||
+	(me->table = (HTList **) HT_CALLOC(HT_L_HASH_SIZE, sizeof(HTList *))) == NULL)
+	HT_OUTOFMEM("ListTable_new");
+    me->size = HT_L_HASH_SIZE;
+    return me;
+}
+
+PRIVATE void ListTable_add (ListTable * me, const char * key, void * object)
+{
+    int i = list_hash(key, me->size);
+    keynode * kn;
+    if (!me->table[i]) me->table[i] = HTList_new();
+    if ((kn = (keynode *) HT_CALLOC(1, sizeof(keynode))) == NULL)
+	HT_OUTOFMEM("ListTable_add");
+    StrAllocCopy(kn->key, key);
+    kn->object = object;
+    HTList_addObject(me->table[i], kn);
+}
+
+PRIVATE void * ListTable_object (ListTable * me, const char * key)
+{
+    HTList * cur = me->table[list_hash(key, me->size)];
+    keynode * kn;
+    while ((kn = (keynode *) HTList_nextObject(cur)))
+	if (!strcmp(key, kn->key)) return kn->object;
+    return NULL;
+}
+
+PRIVATE void ListTable_delete (ListTable * me)
+{
+    int i;
+    for (i = 0; i < me->size; i++) {
+	HTList * cur = me->table[i];
+	keynode * kn;
+	while ((kn = (keynode *) HTList_nextObject(cur))) {
+	    HT_FREE(kn->key);
+	    HT_FREE(kn);
+	}
+	HTList_delete(me->table[i]);
+    }
+    HT_FREE(me->table);
+    HT_FREE(me);
+}
+
+/* ------------------------------------------------------------------------- */
+
+PRIVATE ms_t start;
+
+PRIVATE void report (const char * table, const char * what, int count, int found)
+{
+    ms_t spent = HTGetTimeInMillis() - start;
+    HTPrint("%-12s %-18s %8d keys in %6lu ms (%.0f per sec), %d found\n",
+	    table, what, count, spent,
+	    spent ? count * 1000.0 / spent : 0.0, found);
+}
+
+int main (int argc, char ** argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+    char ** keys;
+    char ** missing;
+    char ** atoms;
+    int cnt;
+    int found;
+
+    if (count <= 0) {
+	HTPrint("Type the number of keys to add\n");
+	HTPrint("\t%s <count>\n", argv[0]);
+	return -1;
+    }
+    if ((keys = (char **) HT_CALLOC(count, sizeof(char *))) == NULL)
+	HT_OUTOFMEM("keys");
+    if ((missing = (char **) HT_CALLOC(count, sizeof(char *))) == NULL)
+	HT_OUTOFMEM("keys");
+    if ((atoms = (char **) HT_CALLOC(count, sizeof(char *))) == NULL)
+	HT_OUTOFMEM("keys");
+    for (cnt = 0; cnt < count; cnt++) {
+	char buf[128];
+	sprintf(buf, "http://www.site%d.org/dir%d/page%d.html", cnt % 977, cnt % 31, cnt);
+	StrAllocCopy(keys[cnt], buf);
+	sprintf(buf, "http://www.site%d.org/dir%d/other%d.html", cnt % 977, cnt % 31, cnt);
+	StrAllocCopy(missing[cnt], buf);
+    }
+
+    /* The original implementation */
+    {
+	ListTable * table = ListTable_new();
+	start = HTGetTimeInMillis();
+	for (cnt = 0; cnt < count; cnt++)
+	    ListTable_add(table, keys[cnt], keys[cnt]);
+	report("lists", "insert", count, count);
+	start = HTGetTimeInMillis();
+	for (cnt = 0, found = 0; cnt < count; cnt++)
+	    if (ListTable_object(table, keys[cnt])) found++;
+	report("lists", "lookup (hit)", count, found);
+	start = HTGetTimeInMillis();
+	for (cnt = 0, found = 0; cnt < count; cnt++)
+	    if (ListTable_object(table, missing[cnt])) found++;
+	report("lists", "lookup (miss)", count, found);
+	ListTable_delete(table);
+    }
+
+    /* HTHashtable */
+    {
+	HTHashtable * table = HTHashtable_new(0);
+	start = HTGetTimeInMillis();
+	for (cnt = 0; cnt < count; cnt++)
+	    HTHashtable_addObject(table, keys[cnt], keys[cnt]);
+	report("HTHashtable", "insert", count, HTHashtable_count(table));
+	start = HTGetTimeInMillis();
+	for (cnt = 0, found = 0; cnt < count; cnt++)
+	    if (HTHashtable_object(table, keys[cnt]) == keys[cnt]) found++;
+	report("HTHashtable", "lookup (hit)", count, found);
+	start = HTGetTimeInMillis();
+	for (cnt = 0, found = 0; cnt < count; cnt++)
+	    if (HTHashtable_object(table, missing[cnt])) found++;
+	report("HTHashtable", "lookup (miss)", count, found);
+	start = HTGetTimeInMillis();
+	for (cnt = 0; cnt < count; cnt += 2)
+	    HTHashtable_removeObject(table, keys[cnt]);
+	report("HTHashtable", "remove half", (count+1)/2, HTHashtable_count(table));
+	HTHashtable_delete(table);
+    }
+
+    /* HTHashtable with keys borrowed from atoms */
+    {
+	HTHashtable * table = HTHashtable_newInterned(0);
+	for (cnt = 0; cnt < count; cnt++)
+	    atoms[cnt] = HTAtom_name(HTAtom_for(keys[cnt]));
+	start = HTGetTimeInMillis();
+	for (cnt = 0; cnt < count; cnt++)
+	    HTHashtable_addObject(table, atoms[cnt], keys[cnt]);
+	report("interned", "insert", count, HTHashtable_count(table));
+	start = HTGetTimeInMillis();
+	for (cnt = 0, found = 0; cnt < count; cnt++)
+	    if (HTHashtable_object(table, atoms[cnt]) == keys[cnt]) found++;
+	report("interned", "lookup (hit)", count, found);
+	HTHashtable_delete(table);
+    }
+
+    for (cnt = 0; cnt < count; cnt++) {
+	HT_FREE(keys[cnt]);
+	HT_FREE(missing[cnt]);
+    }
+    HT_FREE(keys);
+    HT_FREE(missing);
+    HT_FREE(atoms);
+    HTAtom_deleteAll();
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+**	@(#) $Id$
+**
+**	Other libwww samples can be found at "http://www.w3.org/Library/Examples"
+**
+**	Copyright (c) 1995-1998 World Wide Web Consortium, (Massachusetts
+**	Institute of Technology, Institut National de Recherche en
+**	Informatique et en Automatique, Keio University). All Rights
+**	Reserved. This program is distributed under the W3C's Software
+**	Intellectual Property License. This program is distributed in the hope
+**	that it will be useful, but WITHOUT ANY WARRANTY; without even the
+**	implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+**	PURPOSE. See W3C License http://www.w3.org/Consortium/Legal/ for more
+**	details.
+**
+**	Loads the same URL a number of times, a few requests at a time, in
+**	rounds without and with request arenas, and prints the number of
+**	requests per second along with the number of allocations and frees
+**	done per request by the memory module and by the arenas. Use a server
+**	on the loopback interface so that the network doesn't hide the time
+**	spent in the library. As the server is often slower than the client,
+**	the processor time used by this program is printed as well.
+*/
+
+#include "WWWLib.h"
+#include "WWWInit.h"
+
+#define DEFAULT_COUNT		2000
+#define DEFAULT_PARALLEL	8
+#define DEFAULT_ROUNDS		3
+#define ARENA_SIZE		2048
+
+PRIVATE char * url = NULL;
+PRIVATE int left = 0;				  /* Requests not yet issued */
+PRIVATE int running = 0;
+PRIVATE int failed = 0;
+
+PRIVATE BOOL issue (void)
+{
+    HTRequest * request = HTRequest_new();
+    HTChunk * chunk;
+    HTRequest_setOutputFormat(request, WWW_SOURCE);
+    HTRequest_setPreemptive(request, NO);
+    if ((chunk = HTLoadToChunk(url, request)) == NULL) {
+	HTRequest_delete(request);
+	failed++;
+	return NO;
+    }
+    HTRequest_setContext(request, chunk);
+    left--;
+    running++;
+    return YES;
+}
+
+PRIVATE int terminate_handler (HTRequest * request, HTResponse * response,
+			       void * param, int status)
+{
+    HTChunk * chunk = (HTChunk *) HTRequest_context(request);
+    if (status != HT_LOADED) failed++;
+    HTChunk_delete(chunk);
+    HTRequest_delete(request);
+    running--;
+    while (left > 0 && running < DEFAULT_PARALLEL && issue());
+    if (!running) HTEventList_stopLoop();
+    return HT_OK;
+}
+
+PRIVATE clock_t run (const char * label, int count, size_t arena)
+{
+    unsigned long allocs = HTMemory_allocations();
+    unsigned long frees = HTMemory_frees();
+    unsigned long arena_allocs = HTArena_allocations();
+    ms_t start = HTGetTimeInMillis();
+    clock_t cpu = clock();
+    ms_t spent;
+
+    HTRequest_setArenaSize(arena);
+    failed = 0;
+    left = count;
+    while (left > 0 && running < DEFAULT_PARALLEL && issue());
+    if (running) HTEventList_loop(NULL);
+    spent = HTGetTimeInMillis() - start;
+    cpu = clock() - cpu;
+
+    HTPrint("%-10s %6d requests in %5ld ms, %7.1f req/s, %5.1f us cpu, %5.1f mallocs, %5.1f frees, %5.1f from arena per request%s\n",
+	    label, count, spent,
+	    spent ? count * 1000.0 / spent : 0.0,
+	    cpu * 1000000.0 / CLOCKS_PER_SEC / count,
+	    (double) (HTMemory_allocations() - allocs) / count,
+	    (double) (HTMemory_frees() - frees) / count,
+	    (double) (HTArena_allocations() - arena_allocs) / count,
+	    failed ? " (some failed)" : "");
+    return cpu;
+}
+
+int main (int argc, char ** argv)
+{
+    int count = argc > 2 ? atoi(argv[2]) : DEFAULT_COUNT;
+    int rounds = argc > 3 ? atoi(argv[3]) : DEFAULT_ROUNDS;
+    ms_t heap = 0, arena = 0;
+    clock_t heap_cpu = 0, arena_cpu = 0;
+    int round;
+
+    if (argc < 2 || count <= 0 || rounds <= 0) {
+	HTPrint("Type the URL to load and optionally the number of requests\n");
+	HTPrint("and the number of rounds with and without arenas\n");
+	HTPrint("\t%s <url> [<count> [<rounds>]]\n", argv[0]);
+	return -1;
+    }
+    url = argv[1];
+
+    HTProfile_newNoCacheClient("ReqAlloc", "1.0");
+    HTAlert_setInteractive(NO);
+    HTNet_addAfter(terminate_handler, NULL, NULL, HT_ALL, HT_FILTER_LAST);
+
+    /* Warm up the connections and DNS cache before measuring */
+    run("Warm up", DEFAULT_PARALLEL * 4, 0);
+
+    /* Take turns so that both see the same state of the machine */
+    for (round = 0; round < rounds; round++) {
+	ms_t start = HTGetTimeInMillis();
+	heap_cpu += run("No arenas", count, 0);
+	heap += HTGetTimeInMillis() - start;
+	start = HTGetTimeInMillis();
+	arena_cpu += run("Arenas", count, ARENA_SIZE);
+	arena += HTGetTimeInMillis() - start;
+    }
+    HTPrint("%d rounds without arenas: %.1f req/s, %.1f us cpu per request\n",
+	    rounds, heap ? rounds * count * 1000.0 / heap : 0.0,
+	    heap_cpu * 1000000.0 / CLOCKS_PER_SEC / (rounds * count));
+    HTPrint("%d rounds with arenas:    %.1f req/s, %.1f us cpu per request\n",
+	    rounds, arena ? rounds * count * 1000.0 / arena : 0.0,
+	    arena_cpu * 1000000.0 / CLOCKS_PER_SEC / (rounds * count));
+
+    HTProfile_delete();
+    return 0;
+}
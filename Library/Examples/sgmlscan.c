@@ -0,0 +1,291 @@
+/*
+**	@(#) $Id$
+**
+**	Other libwww samples can be found at "http://www.w3.org/Library/Examples"
+**
+**	Copyright (c) 1995-1998 World Wide Web Consortium, (Massachusetts
+**	Institute of Technology, Institut National de Recherche en
+**	Informatique et en Automatique, Keio University). All Rights
+**	Reserved. This program is distributed under the W3C's Software
+**	Intellectual Property License. This program is distributed in the hope
+**	that it will be useful, but WITHOUT ANY WARRANTY; without even the
+**	implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+**	PURPOSE. See W3C License http://www.w3.org/Consortium/Legal/ for more
+**	details.
+**
+**	Runs local HTML files through the SGML parser and prints every event
+**	it sends to the structured stream, one per line. The files are fed
+**	to the parser in blocks of the given size. Running two versions of
+**	the library with the same options on a set of documents and comparing
+**	the output shows whether the parser still behaves the same:
+**
+**		old/sgmlscan -b 1 *.html > old.out
+**		new/sgmlscan -b 1 *.html > new.out
+**		cmp old.out new.out
+**
+**	Text is printed as one event until the next element or entity, as
+**	the parser may split it differently. Use -x to print each call.
+**	With -n the files are parsed that many times without printing and
+**	the speed of the parser is shown instead.
+*/
+
+#include "WWWLib.h"
+#include "WWWHTML.h"
+
+#define DEFAULT_BLOCK	4096
+
+struct _HTStructured {
+    const HTStructuredClass *	isa;
+    SGML_dtd *			dtd;
+    HTChunk *			text;
+    BOOL			quiet;
+    BOOL			exact;
+    long			events;
+};
+
+struct _HTStream {				 /* All we need of the parser */
+    const HTStreamClass *	isa;
+};
+
+PRIVATE void put_text (const char * str, int len)
+{
+    HTPrint("text \"");
+    for (; len > 0; str++, len--) {
+	unsigned char ch = (unsigned char) *str;
+	if (ch == '\n')
+	    HTPrint("\\n");
+	else if (ch == '"' || ch == '\\')
+	    HTPrint("\\%c", ch);
+	else if (ch < ' ' || ch >= 127)
+	    HTPrint("\\%03o", ch);
+	else
+	    HTPrint("%c", ch);
+    }
+    HTPrint("\"\n");
+}
+
+/*
+**	Print any text collected so far before the next event
+*/
+PRIVATE void flush_text (HTStructured * me)
+{
+    if (HTChunk_size(me->text) > 0) {
+	if (!me->quiet) put_text(HTChunk_data(me->text), HTChunk_size(me->text));
+	HTChunk_clear(me->text);
+    }
+}
+
+PRIVATE int scan_put_block (HTStructured * me, const char * str, int len)
+{
+    me->events++;
+    if (me->quiet) return HT_OK;
+    if (me->exact)
+	put_text(str, len);
+    else
+	HTChunk_putb(me->text, str, len);
+    return HT_OK;
+}
+
+PRIVATE int scan_put_character (HTStructured * me, char ch)
+{
+    return scan_put_block(me, &ch, 1);
+}
+
+PRIVATE int scan_put_string (HTStructured * me, const char * str)
+{
+    return scan_put_block(me, str, (int) strlen(str));
+}
+
+PRIVATE void scan_start_element (HTStructured * me, int element_number,
+				 const BOOL * present, const char ** value)
+{
+    HTTag * tag = SGML_findTag(me->dtd, element_number);
+    int maxcnt = HTTag_attributes(tag);
+    int cnt;
+    me->events++;
+    if (me->quiet) return;
+    flush_text(me);
+    HTPrint("start <%s", HTTag_name(tag));
+    for (cnt = 0; cnt < maxcnt; cnt++) {
+	if (present[cnt]) {
+	    HTPrint(" %s", HTTag_attributeName(tag, cnt));
+	    if (value[cnt]) HTPrint("=\"%s\"", value[cnt]);
+	}
+    }
+    HTPrint(">\n");
+}
+
+PRIVATE void scan_end_element (HTStructured * me, int element_number)
+{
+    me->events++;
+    if (me->quiet) return;
+    flush_text(me);
+    HTPrint("end </%s>\n", SGML_findTagName(me->dtd, element_number));
+}
+
+PRIVATE void scan_put_entity (HTStructured * me, int entity_number)
+{
+    me->events++;
+    if (me->quiet) return;
+    flush_text(me);
+    HTPrint("entity &%s;\n", me->dtd->entity_names[entity_number]);
+}
+
+PRIVATE int scan_unparsed_begin_element (HTStructured * me,
+					 const char * str, int len)
+{
+    me->events++;
+    if (me->quiet) return HT_OK;
+    flush_text(me);
+    HTPrint("unknown start <%.*s>\n", len, str);
+    return HT_OK;
+}
+
+PRIVATE int scan_unparsed_end_element (HTStructured * me,
+				       const char * str, int len)
+{
+    me->events++;
+    if (me->quiet) return HT_OK;
+    flush_text(me);
+    HTPrint("unknown end </%.*s>\n", len, str);
+    return HT_OK;
+}
+
+PRIVATE int scan_unparsed_entity (HTStructured * me, const char * str, int len)
+{
+    me->events++;
+    if (me->quiet) return HT_OK;
+    flush_text(me);
+    HTPrint("unknown entity &%.*s;\n", len, str);
+    return HT_OK;
+}
+
+PRIVATE int scan_flush (HTStructured * me)
+{
+    return HT_OK;
+}
+
+PRIVATE int scan_free (HTStructured * me)
+{
+    flush_text(me);
+    return HT_OK;
+}
+
+PRIVATE int scan_abort (HTStructured * me, HTList * e)
+{
+    return HT_ERROR;
+}
+
+PRIVATE const HTStructuredClass ScanClass = {
+    "SGMLScan",
+    scan_flush,
+    scan_free,
+    scan_abort,
+    scan_put_character,
+    scan_put_string,
+    scan_put_block,
+    scan_start_element,
+    scan_end_element,
+    scan_put_entity,
+    scan_unparsed_begin_element,
+    scan_unparsed_end_element,
+    scan_unparsed_entity
+};
+
+PRIVATE HTChunk * load_file (const char * name)
+{
+    FILE * fp = fopen(name, "rb");
+    HTChunk * chunk;
+    char buf[8192];
+    size_t len;
+    if (!fp) return NULL;
+    chunk = HTChunk_new(sizeof(buf));
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+	HTChunk_putb(chunk, buf, (int) len);
+    fclose(fp);
+    return chunk;
+}
+
+PRIVATE void parse (HTStructured * target, HTChunk * doc, int block)
+{
+    HTStream * parser = SGML_new(target->dtd, target);
+    const char * data = HTChunk_data(doc);
+    int left = HTChunk_size(doc);
+    while (left > 0) {
+	int len = left < block ? left : block;
+	(*parser->isa->put_block)(parser, data, len);
+	data += len;
+	left -= len;
+    }
+    (*parser->isa->_free)(parser);
+}
+
+int main (int argc, char ** argv)
+{
+    HTStructured target;
+    int block = DEFAULT_BLOCK;
+    int rounds = 0;
+    int arg;
+
+    memset(&target, 0, sizeof(target));
+    target.isa = &ScanClass;
+    target.dtd = HTML_dtd();
+    target.text = HTChunk_new(512);
+
+    for (arg = 1; arg < argc && *argv[arg] == '-'; arg++) {
+	if (!strcmp(argv[arg], "-b") && arg+1 < argc)
+	    block = atoi(argv[++arg]);
+	else if (!strcmp(argv[arg], "-n") && arg+1 < argc)
+	    rounds = atoi(argv[++arg]);
+	else if (!strcmp(argv[arg], "-x"))
+	    target.exact = YES;
+	else
+	    break;
+    }
+    if (arg >= argc || block <= 0 || rounds < 0) {
+	HTPrint("Type the HTML files to parse\n");
+	HTPrint("\t%s [-b <block size>] [-n <rounds>] [-x] <file>...\n",
+		argv[0]);
+	return -1;
+    }
+
+    if (rounds) {
+	int count = argc - arg;
+	HTChunk ** docs = (HTChunk **) HT_CALLOC(count, sizeof(HTChunk *));
+	long bytes = 0;
+	ms_t start;
+	ms_t spent;
+	int cnt, round;
+	if (!docs) HT_OUTOFMEM("sgmlscan");
+	for (cnt = 0; cnt < count; cnt++) {
+	    if ((docs[cnt] = load_file(argv[arg+cnt])) != NULL)
+		bytes += HTChunk_size(docs[cnt]);
+	}
+	target.quiet = YES;
+	start = HTGetTimeInMillis();
+	for (round = 0; round < rounds; round++) {
+	    for (cnt = 0; cnt < count; cnt++)
+		if (docs[cnt]) parse(&target, docs[cnt], block);
+	}
+	spent = HTGetTimeInMillis() - start;
+	HTPrint("Parsed %ld bytes %d times in %ld ms, %.1f MB/s, %ld events\n",
+		bytes, rounds, spent,
+		spent ? (double) bytes * rounds / 1000.0 / spent : 0.0,
+		target.events);
+	for (cnt = 0; cnt < count; cnt++)
+	    HTChunk_delete(docs[cnt]);
+	HT_FREE(docs);
+    } else {
+	for (; arg < argc; arg++) {
+	    HTChunk * doc = load_file(argv[arg]);
+	    HTPrint("file %s\n", argv[arg]);
+	    if (doc) {
+		parse(&target, doc, block);
+		HTChunk_delete(doc);
+	    } else
+		HTPrint("error can't read file\n");
+	}
+    }
+    HTChunk_delete(target.text);
+    return 0;
+}
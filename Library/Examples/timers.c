@@ -0,0 +1,105 @@
+/*
+**	@(#) $Id$
+**
+**	Other libwww samples can be found at "http://www.w3.org/Library/Examples"
+**
+**	Copyright (c) 1995-1998 World Wide Web Consortium, (Massachusetts
+**	Institute of Technology, Institut National de Recherche en
+**	Informatique et en Automatique, Keio University). All Rights
+**	Reserved. This program is distributed under the W3C's Software
+**	Intellectual Property License. This program is distributed in the hope
+**	that it will be useful, but WITHOUT ANY WARRANTY; without even the
+**	implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+**	PURPOSE. See W3C License http://www.w3.org/Consortium/Legal/ for more
+**	details.
+**
+**	Arms, resets, and cancels a large number of timers and then lets
+**	another batch of timers expire through HTTimer_next. This is the
+**	pattern that an application with many open connections puts on the
+**	timer manager as every HTNet and HTHost has one or more timeouts.
+*/
+
+#include "WWWLib.h"
+
+#define DEFAULT_COUNT	1000000
+
+PRIVATE unsigned long seed = 1;
+PRIVATE int fired = 0;
+
+PRIVATE unsigned long random_number (void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7FFF;
+}
+
+PRIVATE int timer_handler (HTTimer * timer, void * param, HTEventType type)
+{
+    fired++;
+
+    /* Expired one-shot timers are not deleted by the timer manager */
+    HTTimer_delete(timer);
+    return HT_OK;
+}
+
+PRIVATE void report (const char * what, int count, ms_t start)
+{
+    ms_t spent = HTGetTimeInMillis() - start;
+    HTPrint("%-30s %8d timers in %6lu ms (%.0f per sec)\n", what, count, spent,
+	    spent ? count * 1000.0 / spent : 0.0);
+}
+
+int main (int argc, char ** argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+    HTTimer ** timers;
+    ms_t start;
+    ms_t next;
+    int cnt;
+
+    if (count <= 0) {
+	HTPrint("Type the number of timers to create\n");
+	HTPrint("\t%s <count>\n", argv[0]);
+	return -1;
+    }
+    if ((timers = (HTTimer **) HT_CALLOC(count, sizeof(HTTimer *))) == NULL)
+	HT_OUTOFMEM("timers");
+
+    /* Arm timers that expire between one and two hours from now */
+    start = HTGetTimeInMillis();
+    for (cnt = 0; cnt < count; cnt++)
+	timers[cnt] = HTTimer_new(NULL, timer_handler, NULL,
+				  3600000 + random_number() * 100, YES, NO);
+    report("Armed", count, start);
+
+    /* Reset them as a socket timeout is reset on activity */
+    start = HTGetTimeInMillis();
+    for (cnt = 0; cnt < count; cnt++)
+	HTTimer_new(timers[cnt], timer_handler, NULL,
+		    3600000 + random_number() * 100, YES, NO);
+    report("Reset", count, start);
+
+    /* Cancel them in random order */
+    for (cnt = count-1; cnt > 0; cnt--) {
+	int other = (random_number() << 15 | random_number()) % (cnt+1);
+	HTTimer * timer = timers[cnt];
+	timers[cnt] = timers[other];
+	timers[other] = timer;
+    }
+    start = HTGetTimeInMillis();
+    for (cnt = 0; cnt < count; cnt++)
+	HTTimer_delete(timers[cnt]);
+    report("Cancelled", count, start);
+
+    /* Now arm timers that expire within the next 100 ms and dispatch them */
+    start = HTGetTimeInMillis();
+    for (cnt = 0; cnt < count; cnt++)
+	HTTimer_new(NULL, timer_handler, NULL, random_number() % 100, YES, NO);
+    do {
+	HTTimer_next(&next);
+    } while (next);
+    report("Armed and expired", fired, start);
+
+    HTTimer_deleteAll();
+    HT_FREE(timers);
+    return 0;
+}
@@ -14,6 +14,7 @@
 #include "WWWUtil.h"
 #include "WWWCore.h"
 #include "HTNetMan.h"
+#include "HTBufPool.h"
 #include "HTANSI.h"					 /* Implemented here */
 
 #include  "HTHstMan.h"			/* @@@ FIX ME @@@ */
@@ -30,7 +31,7 @@ struct _HTInputStream {
     char *			write;			/* Last byte written */
     char *			read;			   /* Last byte read */
     int				b_read;
-    char			data [FILE_BUFFER_SIZE];
+    char *			data;		  /* Buffer borrowed from pool */
 };
 
 struct _HTOutputStream {
@@ -72,7 +73,7 @@ PRIVATE int HTANSIReader_abort (HTInputStream * me, HTList * e)
     return HT_ERROR;
 }
 
-PRIVATE int HTANSIReader_read (HTInputStream * me)
+PRIVATE int read_file (HTInputStream * me)
 {
     FILE * fp = HTChannel_file(me->ch);
     HTNet * net = HTHost_getReadNet(me->host);
@@ -129,6 +130,20 @@ PRIVATE int HTANSIReader_read (HTInputStream * me)
     return HT_ERROR;
 }
 
+/*
+**  We don't keep any data between calls so we only borrow a buffer
+**  while reading.
+*/
+PRIVATE int HTANSIReader_read (HTInputStream * me)
+{
+    int status;
+    me->data = HTBufferPool_get(FILE_BUFFER_SIZE);
+    status = read_file(me);
+    HTBufferPool_release(me->data, FILE_BUFFER_SIZE);
+    me->data = me->write = me->read = NULL;
+    return status;
+}
+
 /*
 **	The difference between the close and the free method is that we don't
 **	close the connection in the free method - we only call the free method
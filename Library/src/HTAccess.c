@@ -1378,7 +1378,7 @@ PUBLIC BOOL HTCopyAnchor (HTAnchor * src_anchor, HTRequest * main_dest)
     }
 
     /* Set the source anchor */
-    main_dest->source_anchor = HTAnchor_parent(src_anchor);
+    HTRequest_setEntityAnchor(main_dest, HTAnchor_parent(src_anchor));
 
     /* Build the POST web if not already there */
     if (!main_dest->source) {
@@ -1483,7 +1483,7 @@ PUBLIC BOOL HTUploadAnchor (HTAnchor *		source_anchor,
     request->GenMask |= HT_G_DATE;			 /* Send date header */
     request->reload = HT_CACHE_VALIDATE;
     request->method = method;
-    request->source_anchor = HTAnchor_parent(source_anchor);
+    HTRequest_setEntityAnchor(request, HTAnchor_parent(source_anchor));
     request->PostCallback = callback;
     return HTLoadAnchor(dest_anchor, request);
 }
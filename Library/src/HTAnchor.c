@@ -28,7 +28,18 @@
 #define PARENT_HASH_SIZE	HT_XL_HASH_SIZE
 #define CHILD_HASH_SIZE		HT_L_HASH_SIZE
 
-PRIVATE HTList **adult_table=0;  /* Point to table of lists of all parents */
+PRIVATE HTHashtable * adult_table = NULL;	  /* All parents by address */
+
+/*
+**	Parents which nobody refers to are kept in a list, least recently
+**	used first. If a memory budget is set then they are evicted from the
+**	head of the list while the anchors use more than the budget.
+*/
+PRIVATE HTParentAnchor * unused_head = NULL;
+PRIVATE HTParentAnchor * unused_tail = NULL;
+PRIVATE long anchor_memory = 0;		       /* Estimated bytes in parents */
+PRIVATE long anchor_max_memory = 0;		  /* Budget or 0 if no limit */
+PRIVATE long anchor_evicted = 0;			/* Parents evicted so far */
 
 /* ------------------------------------------------------------------------- */
 /*				Creation Methods			     */
@@ -64,6 +75,257 @@ PRIVATE HTChildAnchor * HTChildAnchor_new (void)
     return child;
 }
 
+/* ------------------------------------------------------------------------- */
+/*			   Memory and Reference Counting		     */
+/* ------------------------------------------------------------------------- */
+
+PRIVATE long string_size (const char * str)
+{
+    return str ? (long) strlen(str) + 1 : 0;
+}
+
+PRIVATE long assoc_size (HTAssocList * list)
+{
+    long size = 0;
+    HTAssoc * pres;
+    while ((pres = (HTAssoc *) HTAssocList_nextObject(list))) {
+	size += sizeof(HTList) + sizeof(HTAssoc);
+	size += string_size(HTAssoc_name(pres));
+	size += string_size(HTAssoc_value(pres));
+    }
+    return size;
+}
+
+PRIVATE long links_size (HTAnchor * me)
+{
+    return (long) HTList_count(me->links) * (sizeof(HTList) + sizeof(HTLink));
+}
+
+/*
+**	Estimate the memory used by a parent anchor and its children and
+**	update the total for all parents
+*/
+PRIVATE void count_memory (HTParentAnchor * me)
+{
+    long size = sizeof(HTParentAnchor);
+    size += string_size(me->address) + string_size(me->physical);
+    size += string_size(me->title) + string_size(me->content_base);
+    size += string_size(me->content_location) + string_size(me->content_md5);
+    size += string_size(me->etag) + string_size(me->derived_from);
+    size += string_size(me->version);
+    size += HTFieldList_memory(me->headers) + assoc_size(me->type_parameters);
+    size += assoc_size(me->meta_tags);
+    size += links_size((HTAnchor *) me);
+    size += (long) HTList_count(me->sources) * sizeof(HTList);
+    if (me->children) {
+	int cnt;
+	size += CHILD_HASH_SIZE * sizeof(HTList *);
+	for (cnt = 0; cnt < CHILD_HASH_SIZE; cnt++) {
+	    HTList * cur = me->children[cnt];
+	    HTChildAnchor * child;
+	    while ((child = (HTChildAnchor *) HTList_nextObject(cur))) {
+		size += sizeof(HTList) + sizeof(HTChildAnchor);
+		size += string_size(child->tag) + links_size((HTAnchor *) child);
+	    }
+	}
+    }
+    anchor_memory += size - me->memory;
+    me->memory = size;
+}
+
+PRIVATE void unused_remove (HTParentAnchor * me)
+{
+    if (me->unused) {
+	if (me->prev_unused)
+	    me->prev_unused->next_unused = me->next_unused;
+	else
+	    unused_head = me->next_unused;
+	if (me->next_unused)
+	    me->next_unused->prev_unused = me->prev_unused;
+	else
+	    unused_tail = me->prev_unused;
+	me->prev_unused = me->next_unused = NULL;
+	me->unused = NO;
+    }
+}
+
+/*
+**	Put a parent at the end of the list of unused anchors if nobody
+**	refers to it: no request, no document, and no links pointing to it.
+*/
+PRIVATE void unused_add (HTParentAnchor * me)
+{
+    if (!me->unused && me->refs <= 0 && !me->document &&
+	HTList_isEmpty(me->sources)) {
+	count_memory(me);
+	me->prev_unused = unused_tail;
+	if (unused_tail)
+	    unused_tail->next_unused = me;
+	else
+	    unused_head = me;
+	unused_tail = me;
+	me->unused = YES;
+    }
+}
+
+/*
+**	Remove the links from an anchor from the sources lists of their
+**	destinations. Destinations which aren't linked to by anything else
+**	become unused.
+*/
+PRIVATE void unlink_sources (HTAnchor * me)
+{
+    HTLink * link = &me->mainLink;
+    HTList * cur = me->links;
+    do {
+	if (link->dest) {
+	    HTParentAnchor * parent = link->dest->parent;
+	    HTList_removeObject(parent->sources, me);
+	    if (parent != me->parent) unused_add(parent);
+	}
+    } while ((link = (HTLink *) HTList_nextObject(cur)));
+}
+
+/*
+**	Maintain the list of anchors linking to a parent. Used by the
+**	link module when links are removed or moved to another anchor.
+*/
+PUBLIC BOOL HTAnchor_removeSource (HTParentAnchor * me, HTAnchor * source)
+{
+    if (me && source && HTList_removeObject(me->sources, source)) {
+	unused_add(me);
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC BOOL HTAnchor_moveSource (HTParentAnchor * me, HTAnchor * from,
+				 HTAnchor * to)
+{
+    if (me && from && to && HTList_removeObject(me->sources, from))
+	return HTList_addObject(me->sources, to);
+    return NO;
+}
+
+/*
+**	Move an unused parent to the end of the list as it has just been
+**	used. It stays a candidate for eviction.
+*/
+PRIVATE void unused_touch (HTParentAnchor * me)
+{
+    if (me->unused && me != unused_tail) {
+	unused_remove(me);
+	unused_add(me);
+    }
+}
+
+PRIVATE void * delete_family (HTAnchor * me);
+
+/*
+**	Evict unused parents, least recently used first, until we are
+**	within the memory budget. Parents which have been linked to since
+**	they became unused are just taken off the list.
+*/
+PRIVATE void evict_unused (void)
+{
+    while (anchor_max_memory > 0 && anchor_memory > anchor_max_memory &&
+	   unused_head) {
+	HTParentAnchor * me = unused_head;
+	unused_remove(me);
+	if (!HTList_isEmpty(me->sources)) continue;
+	HTTRACE(ANCH_TRACE, "Anchor...... Evicting %p with address `%s'\n" _ 
+		(void *) me _ me->address);
+
+	/* Unlink from the destinations of the parent and its children */
+	unlink_sources((HTAnchor *) me);
+	if (me->children) {
+	    int cnt;
+	    for (cnt = 0; cnt < CHILD_HASH_SIZE; cnt++) {
+		HTList * cur = me->children[cnt];
+		HTChildAnchor * child;
+		while ((child = (HTChildAnchor *) HTList_nextObject(cur)))
+		    unlink_sources((HTAnchor *) child);
+	    }
+	}
+	if (me->variants) {
+	    HTList * cur = me->variants;
+	    HTParentAnchor * variant;
+	    while ((variant = (HTParentAnchor *) HTList_nextObject(cur)))
+		if (variant->refs > 0 && --variant->refs == 0)
+		    unused_add(variant);
+	}
+
+	if (adult_table && HTHashtable_object(adult_table, me->address) == me)
+	    HTHashtable_removeObject(adult_table, me->address);
+	delete_family((HTAnchor *) me);
+	anchor_evicted++;
+    }
+}
+
+/*
+**	Requests and other objects keeping a pointer to an anchor hold a
+**	reference to its parent. When the last reference is released, the
+**	parent is put on the list of unused anchors. It isn't evicted until
+**	a new anchor is created as the caller may still be looking at it.
+*/
+PUBLIC BOOL HTAnchor_addRef (HTAnchor * me)
+{
+    if (me) {
+	HTParentAnchor * parent = me->parent;
+	unused_remove(parent);
+	parent->refs++;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC BOOL HTAnchor_release (HTAnchor * me)
+{
+    if (me && me->parent->refs > 0) {
+	HTParentAnchor * parent = me->parent;
+	if (--parent->refs == 0) unused_add(parent);
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTAnchor_references (HTAnchor * me)
+{
+    return me ? me->parent->refs : 0;
+}
+
+/*
+**	Memory budget and counters
+*/
+PUBLIC BOOL HTAnchor_setMaxMemory (long bytes)
+{
+    anchor_max_memory = bytes > 0 ? bytes : 0;
+    evict_unused();
+    return YES;
+}
+
+PUBLIC long HTAnchor_maxMemory (void)
+{
+    return anchor_max_memory;
+}
+
+PUBLIC long HTAnchor_memory (void)
+{
+    return anchor_memory;
+}
+
+PUBLIC int HTAnchor_count (void)
+{
+    return adult_table ? HTHashtable_count(adult_table) : 0;
+}
+
+PUBLIC long HTAnchor_evicted (void)
+{
+    return anchor_evicted;
+}
+
+/* ------------------------------------------------------------------------- */
+
 /*	Create new or find old child anchor
 **	-----------------------------------
 **
@@ -150,42 +412,34 @@ PUBLIC HTAnchor * HTAnchor_findAddress (const char * address)
 	HT_FREE(tag);
 	return (HTAnchor *) child;
     } else {		       	     /* Else check whether we have this node */
-	int hash;
-	const char *p;
-	HTList * adults;
-	HTList *grownups;
 	HTParentAnchor * foundAnchor;
 	char *newaddr = NULL;
 	StrAllocCopy(newaddr, address);		         /* Get our own copy */
 	HT_FREE(tag);
 	newaddr = HTSimplify(&newaddr);
 
-	/* Select list from hash table */
-	for(p=newaddr, hash=0; *p; p++)
-	    hash = (int) ((hash * 3 + (*(unsigned char*)p)) % PARENT_HASH_SIZE);
-	if (!adult_table) {
-	    if ((adult_table = (HTList* *) HT_CALLOC(PARENT_HASH_SIZE, sizeof(HTList*))) == NULL)
-	        HT_OUTOFMEM("HTAnchor_findAddress");
-	}
-	if (!adult_table[hash]) adult_table[hash] = HTList_new();
-	adults = adult_table[hash];
-
-	/* Search list for anchor */
-	grownups = adults;
-	while ((foundAnchor = (HTParentAnchor *) HTList_nextObject(grownups))){
-	    if (!strcmp(foundAnchor->address, newaddr)) {
-		HTTRACE(ANCH_TRACE, "Find Parent. %p with address `%s' already exists.\n" _ 
-			    (void*) foundAnchor _ newaddr);
-		HT_FREE(newaddr);		       /* We already have it */
-		return (HTAnchor *) foundAnchor;
-	    }
+	/* Search the table for the anchor */
+	if (!adult_table) adult_table = HTHashtable_new(PARENT_HASH_SIZE);
+	if ((foundAnchor = (HTParentAnchor *) HTHashtable_object(adult_table, newaddr))) {
+	    HTTRACE(ANCH_TRACE, "Find Parent. %p with address `%s' already exists.\n" _ 
+			(void*) foundAnchor _ newaddr);
+	    HT_FREE(newaddr);			       /* We already have it */
+
+	    /*
+	    **  If it is unused then it is now the most recently used. The
+	    **  caller must hold a reference if it keeps the anchor around
+	    */
+	    unused_touch(foundAnchor);
+	    return (HTAnchor *) foundAnchor;
 	}
 	
-	/* Node not found : create new anchor. */
+	/* Node not found : make room and create new anchor. */
+	evict_unused();
 	foundAnchor = HTParentAnchor_new();
 	foundAnchor->address = newaddr;			/* Remember our copy */
-	HTList_addObject (adults, foundAnchor);
-	HTTRACE(ANCH_TRACE, "Find Parent. %p with hash %d and address `%s' created\n" _ (void*)foundAnchor _ hash _ newaddr);
+	HTHashtable_addObject(adult_table, newaddr, foundAnchor);
+	unused_add(foundAnchor);
+	HTTRACE(ANCH_TRACE, "Find Parent. %p with address `%s' created\n" _ (void*)foundAnchor _ newaddr);
 	return (HTAnchor *) foundAnchor;
     }
 }
@@ -309,6 +563,10 @@ PRIVATE void * delete_parent (HTParentAnchor * me)
 {
     void * doc = me->document;
 
+    /* Take it off the list of unused anchors and out of the total */
+    unused_remove(me);
+    anchor_memory -= me->memory;
+
     /* Remove link and address information */
     if (me->links) {
 	HTList *cur = me->links;
@@ -389,21 +647,20 @@ PRIVATE void * delete_family (HTAnchor * me)
 */
 PUBLIC BOOL HTAnchor_deleteAll (HTList * documents)
 {
-    int cnt;
-    HTList *cur;
+    HTArray * parents;
+    HTParentAnchor ** pres;
     if (!adult_table)
 	return NO;
-    for (cnt=0; cnt<PARENT_HASH_SIZE; cnt++) {
-	if ((cur = adult_table[cnt])) { 
-	    HTParentAnchor *pres;
-	    while ((pres = (HTParentAnchor *) HTList_nextObject(cur)) != NULL){
-		void * doc = delete_family((HTAnchor *) pres);
-		if (doc && documents) HTList_addObject(documents, doc);
-	    }
-	}
-	HTList_delete(adult_table[cnt]);
+    parents = HTHashtable_values(adult_table);
+    for (pres = (HTParentAnchor **) HTArray_data(parents); pres && *pres; pres++) {
+	void * doc = delete_family((HTAnchor *) *pres);
+	if (doc && documents) HTList_addObject(documents, doc);
     }
-    HT_FREE(adult_table);
+    HTArray_delete(parents);
+    HTHashtable_delete(adult_table);
+    adult_table = NULL;
+    unused_head = unused_tail = NULL;
+    anchor_memory = 0;
     return YES;
 }
 
@@ -415,26 +672,24 @@ PUBLIC BOOL HTAnchor_deleteAll (HTList * documents)
 */
 PUBLIC BOOL HTAnchor_clearAll (HTList * documents)
 {
-    int cnt;
-    HTList * cur;
+    HTArray * parents;
+    HTParentAnchor ** cur;
     if (!adult_table) return NO;
-    for (cnt=0; cnt<PARENT_HASH_SIZE; cnt++) {
-	if ((cur = adult_table[cnt])) { 
-	    HTParentAnchor * pres;
-	    while ((pres = (HTParentAnchor *) HTList_nextObject(cur))) {
+    parents = HTHashtable_values(adult_table);
+    for (cur = (HTParentAnchor **) HTArray_data(parents); cur && *cur; cur++) {
+	HTParentAnchor * pres = *cur;
 
-		/* Then remove entity header information */
-		HTAnchor_clearHeader(pres);
+	/* Then remove entity header information */
+	HTAnchor_clearHeader(pres);
 
-		/* Delete the physical address */
-		HT_FREE(pres->physical);
+	/* Delete the physical address */
+	HT_FREE(pres->physical);
 
-		/* Register if we have a document on this anchor */
-		if (documents && pres->document)
-		    HTList_addObject(documents, pres->document);
-	    }
-	}
+	/* Register if we have a document on this anchor */
+	if (documents && pres->document)
+	    HTList_addObject(documents, pres->document);
     }
+    HTArray_delete(parents);
     return YES;
 }
 
@@ -463,8 +718,8 @@ PRIVATE void delete_links (HTAnchor * me)
 
 PUBLIC BOOL HTAnchor_delete (HTParentAnchor * me)
 {
-    /* Don't delete if document is loaded */
-    if (!me || me->document) {
+    /* Don't delete if document is loaded or somebody is using it */
+    if (!me || me->document || me->refs > 0) {
 	HTTRACE(ANCH_TRACE, "Anchor...... Not deleted\n");
 	return NO;
     }
@@ -514,32 +769,8 @@ PUBLIC BOOL HTAnchor_delete (HTParentAnchor * me)
        anchor. This caused a bug whenever requesting another anchor
        for the same URL.
     */
-    if (adult_table) {
-      int hash;
-      const char *p;
-      HTList * adults;
-      HTList * grownups;
-      HTList * last;
-      HTParentAnchor * foundAnchor;
-
-      /* Select list from hash table */
-      for(p=me->address, hash=0; *p; p++)
-	hash = (int) ((hash * 3 + (*(unsigned char*)p)) %
-		      PARENT_HASH_SIZE);
-      adults = adult_table[hash];
-
-      /* Search list for anchor */
-      grownups = adults;
-      last = grownups;
-      while ((foundAnchor = (HTParentAnchor *)
-	      HTList_nextObject(grownups))){
-	if (!strcmp(foundAnchor->address, me->address)) {
-	  HTList_quickRemoveElement (grownups, last);
-	  break;
-	}
-	last = grownups;
-      }
-    }
+    if (adult_table && HTHashtable_object(adult_table, me->address) == me)
+	HTHashtable_removeObject(adult_table, me->address);
 
     /* Now kill myself */
     delete_parent(me);
@@ -569,37 +800,16 @@ PUBLIC BOOL HTAnchor_delete (HTParentAnchor * me)
 **	This is useful for calculating statistics, sorting
 **	the parent anchors etc.
 **
-**      The caller can indicate the size of the array (total
-**      number of anchors if known - otherwise 0).
+**      The size argument is ignored as the number of anchors is
+**      known from the anchor table.
 **
 **	Return an array that must be freed by the caller or
 **      NULL if no anchors.
 */
 PUBLIC HTArray * HTAnchor_getArray (int growby)
 {
-    int cnt;
-    HTArray * array = NULL;
-    HTList * cur = NULL;
     if (!adult_table) return NULL;
-
-    /* Allocate an array for the anchors */
-    if (growby <= 0) growby = PARENT_HASH_SIZE;
-    array = HTArray_new(growby);
-
-    /* Traverse anchor structure */
-    for (cnt=0; cnt<PARENT_HASH_SIZE; cnt++) {
-	if ((cur = adult_table[cnt])) { 
-	    HTParentAnchor * pres = NULL;
-	    while ((pres = (HTParentAnchor *) HTList_nextObject(cur)) != NULL) {
-                if (HTArray_addObject(array, pres) == NO) {
-                    HTTRACE(ANCH_TRACE, "Anchor...... Can't add object %p to array %p\n" _ 
-				pres _ array);
-                    break;
-                }
-	    }
-	}
-    }
-    return array;
+    return HTHashtable_values(adult_table);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -613,7 +823,13 @@ PUBLIC HTParentAnchor * HTAnchor_parent  (HTAnchor * me)
 
 PUBLIC void HTAnchor_setDocument  (HTParentAnchor * me, void * doc)
 {
-    if (me) me->document = doc;
+    if (me) {
+	me->document = doc;
+	if (doc)
+	    unused_remove(me);
+	else
+	    unused_add(me);
+    }
 }
 
 PUBLIC void * HTAnchor_document  (HTParentAnchor * me)
@@ -755,8 +971,8 @@ PUBLIC BOOL HTAnchor_update (HTParentAnchor * me, HTResponse * response)
 	    /*
 	    **  Inherit all the unparsed headers - we may need them later!
 	    */
-	    if (me->headers) HTAssocList_delete(me->headers);
-	    me->headers = HTResponse_handOverHeader(response);
+	    if (me->headers) HTFieldList_delete(me->headers);
+	    me->headers = HTResponse_handOverFields(response);
 
 	    /*
 	    **  Notifify the response object not to delete the lists that we
@@ -768,7 +984,7 @@ PUBLIC BOOL HTAnchor_update (HTParentAnchor * me, HTResponse * response)
 	    **  Set the datestamp of when the anchor was updated if we didn't
 	    **  get any in the response
 	    */
-	    if (!HTAssocList_findObject(me->headers, "date"))
+	    if (!HTFieldList_findId(me->headers, HT_FIELD_DATE))
 		HTAnchor_setDate(me, time(NULL));
 
 	    return YES;
@@ -792,6 +1008,7 @@ PUBLIC BOOL HTAnchor_addVariant (HTParentAnchor * me,
 {
     if (me && variant) {
 	if (!me->variants) me->variants = HTList_new();
+	HTAnchor_addRef((HTAnchor *) variant);
 	return HTList_addObject(me->variants, variant);
     }
     return NO;
@@ -800,7 +1017,11 @@ PUBLIC BOOL HTAnchor_addVariant (HTParentAnchor * me,
 PUBLIC BOOL HTAnchor_deleteVariant (HTParentAnchor * me,
 				    HTParentAnchor * variant)
 {
-    return (me && variant) ? HTList_removeObject(me->variants, variant) : NO;
+    if (me && variant && HTList_removeObject(me->variants, variant)) {
+	HTAnchor_release((HTAnchor *) variant);
+	return YES;
+    }
+    return NO;
 }
 
 /*
@@ -829,7 +1050,7 @@ PUBLIC char * HTAnchor_base (HTParentAnchor * me)
     if (me) {
 	if (me->content_base) return me->content_base;
 	if (me->headers) {
-	    char * base = HTAssocList_findObject(me->headers, "content-base");
+	    char * base = HTFieldList_findId(me->headers, HT_FIELD_CONTENT_BASE);
 	    /*
 	    **  If no base is found then take the content-location if this
 	    **  is present and is absolute, else use the Request-URI.
@@ -869,7 +1090,8 @@ PUBLIC char * HTAnchor_location (HTParentAnchor * me)
 	if (me->content_location)
 	    return *me->content_location ? me->content_location : NULL;
 	if (me->headers) {
-	    char * location = HTAssocList_findObject(me->headers, "content-location");
+	    char * location =
+		HTFieldList_findId(me->headers, HT_FIELD_CONTENT_LOCATION);
 	    StrAllocCopy(me->content_location, location ? HTStrip(location) : "");
 	    return me->content_location;
 	}
@@ -1024,7 +1246,8 @@ PUBLIC HTList * HTAnchor_language (HTParentAnchor * me)
 {
     if (me) {
 	if (me->content_language == NULL && me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "content-language");
+	    char * value =
+		HTFieldList_findId(me->headers, HT_FIELD_CONTENT_LANGUAGE);
 	    char * field;
 	    if (!me->content_language) me->content_language = HTList_new();
 	    while ((field = HTNextField(&value)) != NULL) {
@@ -1100,7 +1323,7 @@ PUBLIC HTMethod HTAnchor_allow (HTParentAnchor * me)
 {
     if (me) {
 	if (me->allow == 0 && me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "allow");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_ALLOW);
 	    char * field;
 
 	    /*
@@ -1138,7 +1361,7 @@ PUBLIC const char * HTAnchor_title  (HTParentAnchor * me)
 	if (me->title)
 	    return *me->title ? me->title : NULL;
 	if (me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "title");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_TITLE);
 	    char * title;
 	    if ((title = HTNextField(&value))) StrAllocCopy(me->title, title);
 	    return me->title;
@@ -1174,7 +1397,7 @@ PUBLIC char * HTAnchor_version (HTParentAnchor * me)
 	if (me->version)
 	    return *me->version ? me->version : NULL;
 	if (me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "version");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_VERSION);
 	    char * version;
 	    if ((version = HTNextField(&value)))
 		StrAllocCopy(me->version, version);
@@ -1198,7 +1421,8 @@ PUBLIC char * HTAnchor_derived (HTParentAnchor * me)
 	if (me->derived_from)
 	    return *me->derived_from ? me->derived_from : NULL;
 	if (me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "derived-from");
+	    char * value =
+		HTFieldList_findId(me->headers, HT_FIELD_DERIVED_FROM);
 	    char * derived_from;
 	    if ((derived_from = HTNextField(&value)))
 		StrAllocCopy(me->derived_from, derived_from);
@@ -1222,7 +1446,7 @@ PUBLIC char * HTAnchor_md5 (HTParentAnchor * me)
 	if (me->content_md5)
 	    return *me->content_md5 ? me->content_md5 : NULL;
 	if (me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "content-md5");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_CONTENT_MD5);
 	    char * md5;
 	    if ((md5 = HTNextField(&value))) StrAllocCopy(me->content_md5,md5);
 	    return me->content_md5;
@@ -1247,7 +1471,7 @@ PUBLIC time_t HTAnchor_date (HTParentAnchor * me)
 {
     if (me) {
 	if (me->date == (time_t) -1 && me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "date");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_DATE);
 	    if (value) me->date = HTParseTime(value, NULL, YES);
 	}
 	return me->date;
@@ -1267,7 +1491,7 @@ PUBLIC time_t HTAnchor_expires (HTParentAnchor * me)
 {
     if (me) {
 	if (me->expires == (time_t) -1 && me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "expires");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_EXPIRES);
 	    if (value) me->expires = HTParseTime(value, NULL, YES);
 	}
 	return me->expires;
@@ -1287,7 +1511,8 @@ PUBLIC time_t HTAnchor_lastModified (HTParentAnchor * me)
 {
     if (me) {
 	if (me->last_modified == (time_t) -1 && me->headers) {
-	    char * value = HTAssocList_findObject(me->headers,"last-modified");
+	    char * value =
+		HTFieldList_findId(me->headers, HT_FIELD_LAST_MODIFIED);
 	    if (value) me->last_modified = HTParseTime(value, NULL, YES);
 	}
 	return me->last_modified;
@@ -1307,7 +1532,7 @@ PUBLIC time_t HTAnchor_age (HTParentAnchor * me)
 {
     if (me) {
 	if (me->age == (time_t) -1 && me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "age");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_AGE);
 	    if (value) me->age = atol(value);
 	}
 	return me->age;
@@ -1329,7 +1554,7 @@ PUBLIC char * HTAnchor_etag (HTParentAnchor * me)
 	if (me->etag)
 	    return *me->etag ? me->etag : NULL;
 	if (me->headers) {
-	    char * value = HTAssocList_findObject(me->headers, "etag");
+	    char * value = HTFieldList_findId(me->headers, HT_FIELD_ETAG);
 	    char * etag;
 	    if ((etag = HTNextField(&value))) StrAllocCopy(me->etag, etag);
 	    return me->etag;
@@ -1356,13 +1581,33 @@ PUBLIC BOOL HTAnchor_isEtagWeak (HTParentAnchor * me)
 */
 PUBLIC HTAssocList * HTAnchor_header (HTParentAnchor * me)
 {
-    return me ? me->headers : NULL;
+    return me ? HTFieldList_assocList(me->headers) : NULL;
 }
 
 PUBLIC BOOL HTAnchor_setHeader (HTParentAnchor * me, HTAssocList * headers)
 {
     if (me) {
-	me->headers = headers;
+	HTFieldList * fields;
+	if (me->headers && headers == HTAnchor_header(me)) return YES;
+	fields = headers ?
+	    HTFieldList_fromAssocList(headers) : NULL;
+	if (headers) HTAssocList_delete(headers);
+	return HTAnchor_setFields(me, fields);
+    }
+    return NO;
+}
+
+PUBLIC HTFieldList * HTAnchor_fields (HTParentAnchor * me)
+{
+    return me ? me->headers : NULL;
+}
+
+PUBLIC BOOL HTAnchor_setFields (HTParentAnchor * me, HTFieldList * fields)
+{
+    if (me) {
+	if (me->headers && me->headers != fields)
+	    HTFieldList_delete(me->headers);
+	me->headers = fields;
 	return YES;
     }
     return NO;
@@ -1430,6 +1675,6 @@ PUBLIC void HTAnchor_clearHeader (HTParentAnchor * me)
     HT_FREE(me->etag);
 
     /* Delete any original headers */
-    if (me->headers) HTAssocList_delete(me->headers);
+    if (me->headers) HTFieldList_delete(me->headers);
     me->headers = NULL;
 }
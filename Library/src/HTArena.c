@@ -0,0 +1,202 @@
+/*							              HTArena.c
+**	MEMORY ARENAS
+**
+**	(c) COPYRIGHT MIT 1995.
+**	Please first read the full copyright statement in the file COPYRIGH.
+**	@(#) $Id$
+**
+**	Memory is handed out from the current block by moving a pointer
+**	forward. When the block is full we get a new one and forget about
+**	the rest of the old one. Large requests get a block of their own
+**	which is linked in behind the current block so that we keep using
+**	what is left of that. The first block is part of the arena itself.
+**
+**	Objects which may outlive the owner of the arena, like the streams of
+**	a request, keep a reference to it. The memory is freed when the last
+**	reference is gone.
+*/
+
+/* Library include files */
+#include "wwwsys.h"
+#include "WWWUtil.h"
+#include "HTArena.h"					 /* Implemented here */
+
+#define ARENA_BLOCK_SIZE	2048		/* Default size of the blocks */
+
+typedef union _HTArenaAlign {			      /* Strictest alignment */
+    long	l;
+    double	d;
+    void *	p;
+} HTArenaAlign;
+
+#define ARENA_ALIGN(size) \
+	(((size) + sizeof(HTArenaAlign) - 1) & ~(sizeof(HTArenaAlign) - 1))
+
+typedef struct _HTArenaBlock HTArenaBlock;
+struct _HTArenaBlock {
+    HTArenaBlock *	next;
+    char *		end;
+};
+
+struct _HTArena {
+    HTArenaBlock *	blocks;			  /* Current block first */
+    char *		free;			/* Next free byte in block */
+    size_t		size;
+    int			references;
+};
+
+#define ARENA_HEAD	ARENA_ALIGN(sizeof(HTArena))
+#define BLOCK_HEAD	ARENA_ALIGN(sizeof(HTArenaBlock))
+#define BLOCK_DATA(b)	((char *) (b) + BLOCK_HEAD)
+
+PRIVATE unsigned long Allocations = 0;
+PRIVATE unsigned long Blocks = 0;
+
+/* ------------------------------------------------------------------------- */
+
+PUBLIC HTArena * HTArena_new (size_t size)
+{
+    HTArena * me;
+    HTArenaBlock * block;
+    if (!size) size = ARENA_BLOCK_SIZE;
+    size = ARENA_ALIGN(size);
+    if ((me = (HTArena *) HT_MALLOC(ARENA_HEAD + BLOCK_HEAD + size)) == NULL)
+	HT_OUTOFMEM("HTArena_new");
+    block = (HTArenaBlock *) ((char *) me + ARENA_HEAD);
+    block->next = NULL;
+    block->end = BLOCK_DATA(block) + size;
+    me->blocks = block;
+    me->free = BLOCK_DATA(block);
+    me->size = size;
+    me->references = 1;
+    Blocks++;
+    HTTRACE(MEM_TRACE, "Arena....... Created %p\n" _ me);
+    return me;
+}
+
+PUBLIC HTArena * HTArena_addRef (HTArena * me)
+{
+    if (me) me->references++;
+    return me;
+}
+
+PUBLIC BOOL HTArena_delete (HTArena * me)
+{
+    if (me && --me->references > 0) {
+	HTTRACE(MEM_TRACE, "Arena....... %p has %d references left\n" _
+		me _ me->references);
+	return NO;
+    } else if (me) {
+	HTArenaBlock * first = (HTArenaBlock *) ((char *) me + ARENA_HEAD);
+	HTArenaBlock * block = me->blocks;
+	while (block) {
+	    HTArenaBlock * next = block->next;
+	    if (block != first) HT_FREE(block);
+	    block = next;
+	}
+	HTTRACE(MEM_TRACE, "Arena....... Deleted %p\n" _ me);
+	HT_FREE(me);
+	return YES;
+    }
+    return NO;
+}
+
+PRIVATE HTArenaBlock * new_block (size_t size)
+{
+    HTArenaBlock * block;
+    if ((block = (HTArenaBlock *) HT_MALLOC(BLOCK_HEAD + size)) == NULL)
+	HT_OUTOFMEM("HTArena new_block");
+    block->end = BLOCK_DATA(block) + size;
+    Blocks++;
+    return block;
+}
+
+PUBLIC void * HTArena_malloc (HTArena * me, size_t size)
+{
+    char * ptr = NULL;
+    if (me) {
+	size = size ? ARENA_ALIGN(size) : sizeof(HTArenaAlign);
+	if (size > me->size / 4) {
+	    HTArenaBlock * block = new_block(size);
+	    block->next = me->blocks->next;
+	    me->blocks->next = block;
+	    ptr = BLOCK_DATA(block);
+	} else {
+	    if ((size_t) (me->blocks->end - me->free) < size) {
+		HTArenaBlock * block = new_block(me->size);
+		block->next = me->blocks;
+		me->blocks = block;
+		me->free = BLOCK_DATA(block);
+	    }
+	    ptr = me->free;
+	    me->free += size;
+	}
+	Allocations++;
+    }
+    return ptr;
+}
+
+PUBLIC void * HTArena_calloc (HTArena * me, size_t count, size_t size)
+{
+    void * ptr = HTArena_malloc(me, count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+PUBLIC char * HTArena_strdup (HTArena * me, const char * str)
+{
+    char * ptr = NULL;
+    if (str) {
+	size_t len = strlen(str) + 1;
+	if ((ptr = (char *) HTArena_malloc(me, len)) != NULL)
+	    memcpy(ptr, str, len);
+    }
+    return ptr;
+}
+
+/*
+**  Objects which are freed one by one come from the arena if there is one
+**  and hold a reference to it, otherwise from HT_CALLOC. Freeing an object
+**  in an arena only gives up the reference.
+*/
+PUBLIC void * HTArena_newObject (HTArena * me, size_t size)
+{
+    void * ptr;
+    if (me) {
+	ptr = HTArena_calloc(me, 1, size);
+	me->references++;
+    } else if ((ptr = HT_CALLOC(1, size)) == NULL)
+	HT_OUTOFMEM("HTArena_newObject");
+    return ptr;
+}
+
+PUBLIC void HTArena_deleteObject (HTArena * me, void * ptr)
+{
+    if (me)
+	HTArena_delete(me);
+    else
+	HT_FREE(ptr);
+}
+
+PUBLIC BOOL HTArena_owns (HTArena * me, const void * ptr)
+{
+    if (me && ptr) {
+	HTArenaBlock * block;
+	for (block = me->blocks; block; block = block->next) {
+	    if ((const char *) ptr >= BLOCK_DATA(block) &&
+		(const char *) ptr < block->end)
+		return YES;
+	}
+    }
+    return NO;
+}
+
+PUBLIC unsigned long HTArena_allocations (void)
+{
+    return Allocations;
+}
+
+PUBLIC unsigned long HTArena_blocks (void)
+{
+    return Blocks;
+}
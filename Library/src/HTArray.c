@@ -15,13 +15,15 @@
 
 /*	Create a array with a certain allocation unit
 **	--------------
+**	We grow by at least two entries as one is always kept for the
+**	terminating NULL.
 */
 PUBLIC HTArray * HTArray_new (int grow)
 {
     HTArray * array;
     if ((array = (HTArray  *) HT_CALLOC(1, sizeof(HTArray))) == NULL)
         HT_OUTOFMEM("HTArray_new");
-    array->growby = grow;
+    array->growby = grow > 1 ? grow : 2;
     return array;
 }
 
@@ -10,6 +10,7 @@
 **	for equality done more efficiently.
 **
 **	Atoms are kept in a hash table consisting of an array of linked lists.
+**	The array is doubled whenever there are more atoms than lists.
 **
 ** Authors:
 **	TBL	Tim Berners-Lee, WorldWideWeb project, CERN
@@ -21,10 +22,58 @@
 #include "HTUtils.h"
 #include "HTString.h"
 #include "HTList.h"
+#include "HTHash.h"
 #include "HTAtom.h"
 
-PRIVATE HTAtom * hash_table[HT_XL_HASH_SIZE];
-PRIVATE BOOL initialised = NO;
+#define ATOM_MIN_SIZE	256			  /* Smallest table, must be 2^n */
+
+PRIVATE HTAtom ** hash_table = NULL;
+PRIVATE int hash_size = 0;
+PRIVATE int atom_count = 0;
+
+/*
+**	Double the number of lists when there are more atoms than lists.
+**	The hash doesn't depend on case so that HTAtom_for() and
+**	HTAtom_caseFor() can share the same table.
+*/
+PRIVATE void grow_table (void)
+{
+    int size = hash_size ? hash_size * 2 : ATOM_MIN_SIZE;
+    HTAtom ** table;
+    int i;
+    if ((table = (HTAtom **) HT_CALLOC(size, sizeof(HTAtom *))) == NULL)
+	HT_OUTOFMEM("HTAtom grow_table");
+    for (i=0; i<hash_size; i++) {
+	HTAtom * a = hash_table[i];
+	while (a) {
+	    HTAtom * next = a->next;
+	    int hash = (int) (HTHash_caseString(a->name) & (size - 1));
+	    a->next = table[hash];
+	    table[hash] = a;
+	    a = next;
+	}
+    }
+    HT_FREE(hash_table);
+    hash_table = table;
+    hash_size = size;
+}
+
+/*
+**	Add a new atom to the head of the list
+*/
+PRIVATE HTAtom * new_atom (const char * string, int hash)
+{
+    HTAtom * a;
+    if ((a = (HTAtom  *) HT_MALLOC(sizeof(*a))) == NULL)
+        HT_OUTOFMEM("HTAtom_for");
+    if ((a->name = (char  *) HT_MALLOC(strlen(string)+1)) == NULL)
+        HT_OUTOFMEM("HTAtom_for");
+    strcpy(a->name, string);
+    a->next = hash_table[hash];
+    hash_table[hash] = a;
+    if (++atom_count > hash_size) grow_table();
+    return a;
+}
 
 /*
 **	Finds an atom representation for a string. The atom doesn't have to be
@@ -33,23 +82,11 @@ PRIVATE BOOL initialised = NO;
 PUBLIC HTAtom * HTAtom_for (const char * string)
 {
     int hash;
-    const unsigned char * p;
     HTAtom * a;
 
     if (!string) return NULL;			/* prevent core dumps */
-    
-    /*		First time around, clear hash table
-    */
-    if (!initialised) {
-        memset((void *) hash_table, '\0', sizeof(HTAtom *) * HT_XL_HASH_SIZE);
-	initialised = YES;
-    }
-    
-    /*		Generate hash function
-    */
-    for (p=string, hash=0; *p; p++) {
-        hash = (hash * 3 + TOLOWER(*p)) % HT_XL_HASH_SIZE;
-    }
+    if (!hash_table) grow_table();
+    hash = (int) (HTHash_caseString(string) & (hash_size - 1));
     
     /*		Search for the string in the list
     */
@@ -62,15 +99,8 @@ PUBLIC HTAtom * HTAtom_for (const char * string)
     
     /*		Generate a new entry
     */
-    if ((a = (HTAtom  *) HT_MALLOC(sizeof(*a))) == NULL)
-        HT_OUTOFMEM("HTAtom_for");
-    if ((a->name = (char  *) HT_MALLOC(strlen(string)+1)) == NULL)
-        HT_OUTOFMEM("HTAtom_for");
-    strcpy(a->name, string);
-    a->next = hash_table[hash];		/* Put onto the head of list */
-    hash_table[hash] = a;
-/*    HTTRACE(UTIL_TRACE, "HTAtom: New atom %p for `%s'\n" _ a _ string); */
-    return a;
+/*    HTTRACE(UTIL_TRACE, "HTAtom: New atom for `%s'\n" _ string); */
+    return new_atom(string, hash);
 }
 
 
@@ -82,23 +112,11 @@ PUBLIC HTAtom * HTAtom_for (const char * string)
 PUBLIC HTAtom * HTAtom_caseFor (const char * string)
 {
     int hash;
-    const unsigned char * p;
     HTAtom * a;
 
     if (!string) return NULL;			/* prevent core dumps */
-    
-    /*		First time around, clear hash table
-    */
-    if (!initialised) {
-        memset((void *) hash_table, '\0', sizeof(HTAtom *) * HT_XL_HASH_SIZE);
-	initialised = YES;
-    }
-    
-    /*		Generate hash function
-    */
-    for(p=string, hash=0; *p; p++) {
-        hash = (hash * 3 + TOLOWER(*p)) % HT_XL_HASH_SIZE;
-    }
+    if (!hash_table) grow_table();
+    hash = (int) (HTHash_caseString(string) & (hash_size - 1));
     
     /*		Search for the string in the list
     */
@@ -110,14 +128,7 @@ PUBLIC HTAtom * HTAtom_caseFor (const char * string)
     
     /*		Generate a new entry
     */
-    if ((a = (HTAtom  *) HT_MALLOC(sizeof(*a))) == NULL)
-        HT_OUTOFMEM("HTAtom_for");
-    if ((a->name = (char  *) HT_MALLOC(strlen(string)+1)) == NULL)
-        HT_OUTOFMEM("HTAtom_for");
-    strcpy(a->name, string);
-    a->next = hash_table[hash];		/* Put onto the head of list */
-    hash_table[hash] = a;
-    return a;
+    return new_atom(string, hash);
 }
 
 
@@ -131,7 +142,7 @@ PUBLIC void HTAtom_deleteAll (void)
     HTAtom *cur;
     HTAtom *next;
     
-    for (i=0; i<HT_XL_HASH_SIZE; i++) {
+    for (i=0; i<hash_size; i++) {
 	if (hash_table[i]) {
 	    cur = hash_table[i];
 	    while (cur) {
@@ -142,7 +153,9 @@ PUBLIC void HTAtom_deleteAll (void)
 	    }	
 	}
     }
-    initialised = NO;
+    HT_FREE(hash_table);
+    hash_size = 0;
+    atom_count = 0;
 }
 
 
@@ -175,11 +188,11 @@ PUBLIC HTList *HTAtom_templateMatches (const char * templ)
 {
     HTList *matches = HTList_new();
 
-    if (initialised && templ) {
+    if (hash_table && templ) {
 	int i;
 	HTAtom *cur;
 
-	for (i=0; i<HT_XL_HASH_SIZE; i++) {
+	for (i=0; i<hash_size; i++) {
 	    for (cur = hash_table[i];  cur;  cur=cur->next) {
 		if (mime_match(cur->name, templ))
 		    HTList_addObject(matches, (void*)cur);
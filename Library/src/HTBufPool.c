@@ -0,0 +1,181 @@
+/*							            HTBufPool.c
+**	POOL OF INPUT BUFFERS
+**
+**	(c) COPYRIGHT MIT 1995.
+**	Please first read the full copyright statement in the file COPYRIGH.
+**	@(#) $Id$
+**
+**	Input streams borrow their read buffer from here while they are
+**	reading and give it back when the channel goes idle. Idle buffers
+**	are kept on a free list for each buffer size, linked through the
+**	first bytes of the buffers themselves so that the pool never needs
+**	any memory of its own.
+*/
+
+/* Library include files */
+#include "wwwsys.h"
+#include "WWWUtil.h"
+#include "HTBufPool.h"					 /* Implemented here */
+
+#define POOL_CLASSES	4		/* Number of different buffer sizes */
+#define DEFAULT_MAX_IDLE 8	   /* Idle buffers kept for each buffer size */
+
+typedef struct _BufferPool {
+    int		size;				     /* Size of the buffers */
+    char *	free;					   /* Idle buffers */
+    int		idle;				/* Number of idle buffers */
+} BufferPool;
+
+PRIVATE BufferPool Pools[POOL_CLASSES];
+PRIVATE int MaxIdle = DEFAULT_MAX_IDLE;
+
+PRIVATE unsigned long Hits = 0;
+PRIVATE unsigned long Misses = 0;
+PRIVATE int InUse = 0;
+PRIVATE int HighWater = 0;
+
+#define NEXT_FREE(buf)	(*(char **) (buf))
+
+/* ------------------------------------------------------------------------- */
+
+PRIVATE BufferPool * find_pool (int size, BOOL create)
+{
+    int cnt;
+    for (cnt = 0; cnt < POOL_CLASSES; cnt++) {
+	if (Pools[cnt].size == size) return &Pools[cnt];
+	if (!Pools[cnt].size) {
+	    if (!create) return NULL;
+	    Pools[cnt].size = size;
+	    return &Pools[cnt];
+	}
+    }
+    return NULL;
+}
+
+/*	Get a Buffer
+**	------------
+**	Returns a buffer of the given size, either an idle one from the pool
+**	or a new one.
+*/
+PUBLIC char * HTBufferPool_get (int size)
+{
+    BufferPool * pool = size >= (int) sizeof(char *) ? find_pool(size, YES) : NULL;
+    char * buf;
+    if (pool && pool->free) {
+	buf = pool->free;
+	pool->free = NEXT_FREE(buf);
+	pool->idle--;
+	Hits++;
+    } else {
+	if ((buf = (char *) HT_MALLOC(size > 0 ? size : 1)) == NULL)
+	    HT_OUTOFMEM("HTBufferPool_get");
+	Misses++;
+    }
+    if (++InUse > HighWater) HighWater = InUse;
+    HTTRACE(MEM_TRACE, "Buffer Pool. Lending %p of %d bytes, %d in use\n" _
+	    buf _ size _ InUse);
+    return buf;
+}
+
+/*	Release a Buffer
+**	----------------
+**	Give a buffer back to the pool. The size must be the same as when
+**	the buffer was got. If we already keep enough idle buffers of this
+**	size then the buffer is freed.
+*/
+PUBLIC BOOL HTBufferPool_release (char * buf, int size)
+{
+    if (buf) {
+	BufferPool * pool = size >= (int) sizeof(char *) ? find_pool(size, NO) : NULL;
+	InUse--;
+	if (pool && pool->idle < MaxIdle) {
+	    NEXT_FREE(buf) = pool->free;
+	    pool->free = buf;
+	    pool->idle++;
+	    HTTRACE(MEM_TRACE, "Buffer Pool. Keeping %p of %d bytes, %d idle\n" _
+		    buf _ size _ pool->idle);
+	} else {
+	    HTTRACE(MEM_TRACE, "Buffer Pool. Freeing %p of %d bytes\n" _ buf _ size);
+	    HT_FREE(buf);
+	}
+	return YES;
+    }
+    return NO;
+}
+
+/*	Free all Idle Buffers
+**	---------------------
+*/
+PUBLIC BOOL HTBufferPool_deleteAll (void)
+{
+    int cnt;
+    for (cnt = 0; cnt < POOL_CLASSES; cnt++) {
+	BufferPool * pool = &Pools[cnt];
+	while (pool->free) {
+	    char * buf = pool->free;
+	    pool->free = NEXT_FREE(buf);
+	    HT_FREE(buf);
+	}
+	pool->idle = 0;
+    }
+    HTTRACE(MEM_TRACE, "Buffer Pool. Freed all idle buffers\n");
+    return YES;
+}
+
+/*	Pool Size
+**	---------
+*/
+PUBLIC BOOL HTBufferPool_setMaxIdle (int max)
+{
+    if (max >= 0) {
+	int cnt;
+	MaxIdle = max;
+	for (cnt = 0; cnt < POOL_CLASSES; cnt++) {
+	    BufferPool * pool = &Pools[cnt];
+	    while (pool->idle > MaxIdle) {
+		char * buf = pool->free;
+		pool->free = NEXT_FREE(buf);
+		pool->idle--;
+		HT_FREE(buf);
+	    }
+	}
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTBufferPool_maxIdle (void)
+{
+    return MaxIdle;
+}
+
+/*	Statistics
+**	----------
+*/
+PUBLIC unsigned long HTBufferPool_hits (void)
+{
+    return Hits;
+}
+
+PUBLIC unsigned long HTBufferPool_misses (void)
+{
+    return Misses;
+}
+
+PUBLIC int HTBufferPool_inUse (void)
+{
+    return InUse;
+}
+
+PUBLIC int HTBufferPool_highWater (void)
+{
+    return HighWater;
+}
+
+PUBLIC int HTBufferPool_idle (void)
+{
+    int idle = 0;
+    int cnt;
+    for (cnt = 0; cnt < POOL_CLASSES; cnt++) idle += Pools[cnt].idle;
+    return idle;
+}
@@ -34,6 +34,7 @@ struct _HTOutputStream {
 
     ms_t			lastFlushTime;	/* polar coordinates of the moon */
     HTTimer *			timer;
+    BOOL			gather;	     /* Target is a socket writer */
 };
 
 #define PUTBLOCK(b,l) (*me->target->isa->put_block)(me->target,(b),(l))
@@ -165,9 +166,40 @@ PRIVATE int HTBufferWriter_abort (HTOutputStream * me, HTList * e)
     return HT_ERROR;
 }
 
+/*
+**  Write what we have buffered and a block from the caller in one go
+**  instead of copying the block into the buffer first. If the socket
+**  blocks then the block is copied after all so that the socket writer
+**  can continue from where it got to when we flush the buffer.
+*/
+PRIVATE int HTBufferWriter_gather (HTOutputStream * me, const char * buf, int len)
+{
+    const char * bufs[2];
+    int lens[2];
+    int status;
+    bufs[0] = me->data;
+    lens[0] = me->read - me->data;
+    bufs[1] = buf;
+    lens[1] = len;
+    me->lastFlushTime = HTGetTimeInMillis();
+    status = HTWriter_writev(me->target, bufs, lens, 2);
+    if (status == HT_OK) {
+	me->read = me->data;
+	return HT_OK;
+    } else if (status == HT_WOULD_BLOCK) {
+	HTBufferWriter_addBuffer(me, len);
+	memcpy(me->read, buf, len);
+	me->read += len;
+	return HT_OK;
+    }
+    return HT_ERROR;
+}
+
 PRIVATE int HTBufferWriter_write (HTOutputStream * me, const char * buf, int len)
 {
     int status;
+    if (me->gather && len > me->data + me->allocated - me->read)
+	return HTBufferWriter_gather(me, buf, len);
     while (1) {
 	int available = me->data + me->allocated - me->read;
 
@@ -309,6 +341,7 @@ PUBLIC HTOutputStream * HTBufferWriter_new (HTHost *	       	host,
     HTOutputStream * me = buffer_new(host, ch, param, bufsize);
     if (me) {
 	me->target = HTWriter_new(host, ch, param, 0);
+	me->gather = YES;
 	return me;
     }
     return NULL;
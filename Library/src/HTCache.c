@@ -26,10 +26,26 @@
 #define HT_CACHE_LOC	"/tmp/"
 #define HT_CACHE_ROOT	"w3c-cache/"
 #define HT_CACHE_INDEX	".index"
+#define HT_CACHE_INDEX_TMP	".index.tmp"
+#define HT_CACHE_JOURNAL	".journal"
+#define HT_CACHE_INDEX_MAGIC	"W3C cache index 3\n"
+#define HT_CACHE_JOURNAL_MAGIC	"W3C cache journal 3\n"
+#define HT_CACHE_INDEX_MAGIC_2	"W3C cache index 2\n"
+#define HT_CACHE_JOURNAL_MAGIC_2	"W3C cache journal 2\n"
 #define HT_CACHE_LOCK	".lock"
-#define HT_CACHE_META	".meta"
+#define HT_CACHE_META	".meta"		    /* Used by old versions of the cache */
+#define HT_CACHE_BODY	".body"
+#define HT_CACHE_TMP	".tmp"
 #define HT_CACHE_EMPTY_ETAG	"@w3c@"
 
+/* Each file in the cache starts with a fixed size header */
+#define HT_CACHE_ENTRY_MAGIC	"W3Ce"
+#define HT_CACHE_BODY_MAGIC	"W3Cb"
+#define CACHE_HEADER_SIZE	32
+#define CACHE_VERSION		1
+#define CACHE_SHARED		1		   /* The body is in another file */
+#define CACHE_NAME_PROBES	16	   /* Attempts at finding a free name */
+
 /* Default heuristics cache expirations - thanks to Jeff Mogul for good comments! */
 #define NO_LM_EXPIRATION	24*3600		/* 24 hours */
 #define MAX_LM_EXPIRATION	48*3600		/* Max expiration from LM */
@@ -44,7 +60,8 @@
 
 #define WARN_HEURISTICS		24*3600		  /* When to issue a warning */
 
-#define DUMP_FREQUENCY	10			 /* Dump index every x loads */
+#define JOURNAL_MIN_RECORDS	100	 /* Journal records before new index */
+#define JOURNAL_SYNC_RECORDS	32	   /* Journal records between syncs */
 
 #define MEGA			0x100000L
 #define HT_CACHE_TOTAL_SIZE	20		/* Default cache size is 20M */
@@ -52,6 +69,7 @@
 #define HT_CACHE_GC_PCT		10        /* 10% of cache size free after GC */
 #define HT_MIN_CACHE_TOTAL_SIZE	 5			/* 5M Min cache size */
 #define HT_MAX_CACHE_ENTRY_SIZE	 3     /* 3M Max sixe of single cached entry */
+#define HT_CACHE_MEMORY_ENTRY	(64*1024)   /* Max size of entry kept in memory */
 
 /* Final states have negative value */
 typedef enum _CacheState {
@@ -61,7 +79,8 @@ typedef enum _CacheState {
     CL_BEGIN		= 0,
     CL_NEED_BODY,
     CL_NEED_OPEN_FILE,
-    CL_NEED_CONTENT
+    CL_NEED_CONTENT,
+    CL_NEED_MEMORY
 } CacheState;
 
 /* This is the context structure for the this module */
@@ -71,8 +90,28 @@ typedef struct _cache_info {
     struct stat		stat_info;	      /* Contains actual file chosen */
     HTNet *		net;
     HTTimer *		timer;
+    BOOL		returned;	   /* Returned before serving memory */
+    long		offset;		  /* Where the body starts in the file */
 } cache_info;
 
+/* An entity body which may be used by more than one entry */
+typedef struct _CacheBody {
+    unsigned long	digest[2];
+    long		size;
+    int			refs;			/* Number of entries using it */
+    HTCache *		owner;	     /* Entry holding the body if not shared */
+    char *		name;		     /* File holding the body if shared */
+} CacheBody;
+
+/* The header of a file in the cache */
+typedef struct _CacheHeader {
+    BOOL		body_file;	   /* A shared body rather than an entry */
+    int			flags;
+    long		meta_len;
+    long		body_len;
+    unsigned long	digest[2];
+} CacheHeader;
+
 struct _HTCache {
     /* Location */
     int 		hash;
@@ -91,6 +130,19 @@ struct _HTCache {
     time_t		response_time;
     time_t		corrected_initial_age;
     HTRequest *		lock;
+    BOOL		anchored;	 /* Anchor knows about this entry */
+    double		priority;		     /* GDSF priority for GC */
+    int			heap;			   /* Position in GC heap */
+
+    /* Memory tier */
+    HTChunk *		mem_body;		   /* Body kept in memory */
+    HTChunk *		mem_meta;	       /* Metainfo kept in memory */
+    HTCache *		mem_prev;		  /* Least recently used... */
+    HTCache *		mem_next;
+
+    /* Entity body */
+    unsigned long	digest[2];		 /* Hash of the entity body */
+    CacheBody *		body;			  /* Body record if any */
 };
 
 struct _HTStream {
@@ -103,6 +155,8 @@ struct _HTStream {
     HTChunk *			buffer;			/* For index reading */
     HTEOLState			EOLstate;
     BOOL			append;		   /* Creating or appending? */
+    long			meta_len;	 /* Metainformation written */
+    unsigned long		digest[2];	     /* Hash of what we write */
 };
 
 struct _HTInputStream {
@@ -130,16 +184,137 @@ PRIVATE long		HTCacheGCBuffer = (HT_CACHE_TOTAL_SIZE*MEGA)/HT_CACHE_GC_PCT;
 PRIVATE long		HTCacheContentSize = 0L;
 PRIVATE long		HTCacheMaxEntrySize = HT_MAX_CACHE_ENTRY_SIZE*MEGA;
 
-PRIVATE int		new_entries = 0;	   /* Number of new entries */
+PRIVATE int		CacheEntries = 0;	 /* Number of cache entries */
+PRIVATE int		JournalRecords = 0;   /* Records written to journal */
+PRIVATE FILE *		JournalFP = NULL;
+
+/* Entries ordered after priority for garbage collection */
+PRIVATE HTCache **	CacheHeap = NULL;
+PRIVATE int		HeapCount = 0;
+PRIVATE int		HeapAlloc = 0;
+PRIVATE double		CacheInflation = 0.0;
+
+/* Small and hot entries kept in memory, most recently used first */
+PRIVATE long		HTCacheMemorySize = 0L;	      /* Disabled by default */
+PRIVATE long		HTCacheMemoryUsed = 0L;
+PRIVATE unsigned long	HTCacheMemoryHits = 0;
+PRIVATE HTCache *	MemoryHead = NULL;
+PRIVATE HTCache *	MemoryTail = NULL;
+
+/* Entity bodies ordered after their hash so that we can share them */
+PRIVATE HTList ** 	BodyTable = NULL;
 
 PRIVATE HTNetBefore	HTCacheFilter;
 PRIVATE HTNetAfter	HTCacheUpdateFilter;
 PRIVATE HTNetAfter	HTCacheCheckFilter;
 
+PRIVATE BOOL free_object (HTCache * me);
+PRIVATE BOOL delete_object (HTList * list, HTCache * me);
+PRIVATE BOOL journal_add (char type, HTCache * cache);
+PRIVATE void body_attach (HTCache * cache, BOOL shared);
+PRIVATE void body_release (HTCache * cache);
+PRIVATE void body_clear (void);
+PRIVATE BOOL meta_write (FILE * fp, HTRequest * request, HTResponse * response);
+
 /* ------------------------------------------------------------------------- */
 /*  			     CACHE GARBAGE COLLECTOR			     */
 /* ------------------------------------------------------------------------- */
 
+/*
+**  The entries are kept in a heap ordered after their Greedy Dual Size
+**  Frequency (GDSF) priority so that the garbage collector can take the
+**  least valuable entry first without looking at the others. The priority
+**  of an entry is the inflation value at the time the entry was last used
+**  plus the number of hits divided by the size. Every time an entry is
+**  collected, the inflation value is set to its priority so that entries
+**  which haven't been used for a long time fall behind those used since.
+**  Entries which are too big to be cached get the lowest priority.
+*/
+PRIVATE double entry_priority (HTCache * me)
+{
+    if (me->size > HTCacheMaxEntrySize) return 0.0;
+    return CacheInflation + (me->hits + 1) / (double) (me->size > 0 ? me->size : 1);
+}
+
+PRIVATE void heap_set (int pos, HTCache * me)
+{
+    CacheHeap[pos] = me;
+    me->heap = pos;
+}
+
+PRIVATE void heap_up (int pos)
+{
+    HTCache * me = CacheHeap[pos];
+    while (pos > 0) {
+	int parent = (pos - 1) / 2;
+	if (CacheHeap[parent]->priority <= me->priority) break;
+	heap_set(pos, CacheHeap[parent]);
+	pos = parent;
+    }
+    heap_set(pos, me);
+}
+
+PRIVATE void heap_down (int pos)
+{
+    HTCache * me = CacheHeap[pos];
+    for (;;) {
+	int child = 2 * pos + 1;
+	if (child >= HeapCount) break;
+	if (child + 1 < HeapCount &&
+	    CacheHeap[child+1]->priority < CacheHeap[child]->priority)
+	    child++;
+	if (me->priority <= CacheHeap[child]->priority) break;
+	heap_set(pos, CacheHeap[child]);
+	pos = child;
+    }
+    heap_set(pos, me);
+}
+
+PRIVATE void heap_add (HTCache * me)
+{
+    if (HeapCount >= HeapAlloc) {
+	HeapAlloc = HeapAlloc ? HeapAlloc * 2 : 256;
+	if ((CacheHeap = (HTCache **) HT_REALLOC(CacheHeap,
+					HeapAlloc * sizeof(HTCache *))) == NULL)
+	    HT_OUTOFMEM("heap_add");
+    }
+    me->priority = entry_priority(me);
+    heap_set(HeapCount++, me);
+    heap_up(me->heap);
+}
+
+PRIVATE void heap_remove (HTCache * me)
+{
+    int pos = me->heap;
+    if (pos < 0 || pos >= HeapCount || CacheHeap[pos] != me) return;
+    me->heap = -1;
+    if (pos != --HeapCount) {
+	HTCache * last = CacheHeap[HeapCount];
+	heap_set(pos, last);
+	heap_up(pos);
+	heap_down(last->heap);
+    }
+}
+
+/*
+**  Called when an entry has been used or has changed size
+*/
+PRIVATE void heap_update (HTCache * me)
+{
+    int pos = me->heap;
+    if (pos < 0 || pos >= HeapCount || CacheHeap[pos] != me) return;
+    me->priority = entry_priority(me);
+    heap_up(pos);
+    heap_down(me->heap);
+}
+
+PRIVATE void heap_clear (void)
+{
+    HT_FREE(CacheHeap);
+    HeapCount = HeapAlloc = 0;
+    CacheInflation = 0.0;
+}
+
 PRIVATE BOOL stopGC (void)
 {
     return (HTCacheContentSize + HTCacheFolderSize < HTCacheTotalSize - HTCacheGCBuffer);
@@ -155,11 +330,6 @@ PRIVATE BOOL HTCacheGarbage (void)
     long old_size = HTCacheContentSize;
     HTTRACE(CACHE_TRACE, "Cache....... Garbage collecting\n");
     if (CacheTable) {
-	time_t cur_time = time(NULL);
-	HTList * cur;
-	int cnt;
-	int hits;
-
 	/*
 	**  Tell the user that we're gc'ing.
 	*/
@@ -169,78 +339,36 @@ PRIVATE BOOL HTCacheGarbage (void)
 	}
 
 	/*
-	**  Walk through and delete all the expired entries. If this is not
-	**  sufficient then take the fresh ones which have the lowest cache
-	**  hit count. This algorithm could be made a lot fancier by including
-	**  the size and also the pain it took to get the document in the first
-	**  case. It could also include max_stale.
+	**  Take the entries with the lowest priority until we have freed
+	**  enough space. Entries which are locked can't be removed so we put
+	**  them back in the heap when we are done. We must at least free the
+	**  min buffer size so that we don't dead lock ourselves.
 	*/
-	HTTRACE(CACHE_TRACE, "Cache....... Collecting Stale entries\n");
-	for (cnt=0; cnt<HT_XL_HASH_SIZE; cnt++) {
-	    if ((cur = CacheTable[cnt])) { 
-		HTList * old_cur = cur;
-		HTCache * pres;
-		while ((pres = (HTCache *) HTList_nextObject(cur)) != NULL) {
-		    time_t resident_time = cur_time - pres->response_time;
-		    time_t current_age = pres->corrected_initial_age +
-			resident_time;
-		    /* 2000-08-08 Jens Meggers: HTCache_remove doesn't
-		       remove a cache entry if it's locked. To avoid
-		       an endless loop, we check the return value of 
-		       HTCache_remove before skipping the entry. */
-		    if ((pres->freshness_lifetime < current_age)
-			&& HTCache_remove(pres)) {
-			cur = old_cur;
-		    } else {
-			old_cur = cur;
-		    }
-		    if (stopGC()) break;
-		}
-	    }
-	}
-
-	/*
-	**  We must at least free the min buffer size so that we don't
-	**  dead lock ourselves. We start from the bottom up by taking
-	**  all the documents with 0 hits, 1 hits, 2 hits, etc.
-	*/
-	HTTRACE(CACHE_TRACE, "Cache....... Collecting least used entries\n");
-	hits = 0;
-	while (startGC()) {
-	    BOOL removed = NO;
-	    HTTRACE(CACHE_TRACE, "Cache....... Collecting entries with %d hits\n" _ hits);
-	    for (cnt=0; cnt<HT_XL_HASH_SIZE; cnt++) {
-		if ((cur = CacheTable[cnt])) { 
-		    HTList * old_cur = cur;
-		    HTCache * pres;
-		    while ((pres = (HTCache *) HTList_nextObject(cur))) {
-			/* 2000-08-08 Jens Meggers: HTCache_remove doesn't
-			   remove a cache entry if it's locked. To avoid
-			   going into an endless loop, we check the return
-			   value of  HTCache_remove before marking the
-			   object as removed. */
-			if ((pres->size > HTCacheMaxEntrySize 
-			     || pres->hits <= hits) 
-			    && HTCache_remove(pres)) {
-			    cur = old_cur;
-			    removed = YES;
-			} else {
-			    old_cur = cur;
-			}
-			if (stopGC()) break;
-		    }
+	{
+	    HTList * locked = HTList_new();
+	    HTCache * pres;
+	    int removed = 0;
+	    while (!stopGC() && HeapCount > 0) {
+		pres = CacheHeap[0];
+		heap_remove(pres);
+		if (HTCache_hasLock(pres)) {
+		    HTList_addObject(locked, pres);
+		    continue;
 		}
+		if (pres->priority > CacheInflation)
+		    CacheInflation = pres->priority;
+		if (HTCache_remove(pres))
+		    removed++;
+		else
+		    HTList_addObject(locked, pres);
 	    }
-	    if (!removed) break;
-	    hits++;
+	    while ((pres = (HTCache *) HTList_removeLastObject(locked)))
+		heap_add(pres);
+	    HTList_delete(locked);
+	    HTTRACE(CACHE_TRACE, "Cache....... Collected %d entries\n" _ removed);
 	}
 	HTTRACE(CACHE_TRACE, "Cache....... Size reduced from %ld to %ld\n" _ 
 		    old_size _ HTCacheContentSize);
-	/*
-	**  Dump the new content to the index file
-	*/
-	HTCacheIndex_write(HTCacheRoot);
-	new_entries = 0;
 	return YES;
     }
     return NO;
@@ -250,93 +378,457 @@ PRIVATE BOOL HTCacheGarbage (void)
 /*  			      CACHE INDEX				     */
 /* ------------------------------------------------------------------------- */
 
-PRIVATE char * cache_index_name (const char * cache_root)
+PRIVATE char * cache_file_name (const char * cache_root, const char * suffix)
 {
     if (cache_root) {
 	char * location = NULL;
 	if ((location = (char *)
-	     HT_MALLOC(strlen(cache_root) + strlen(HT_CACHE_INDEX) + 1)) == NULL)
-	    HT_OUTOFMEM("cache_index_name");
+	     HT_MALLOC(strlen(cache_root) + strlen(suffix) + 1)) == NULL)
+	    HT_OUTOFMEM("cache_file_name");
 	strcpy(location, cache_root);
-	strcat(location, HT_CACHE_INDEX);
+	strcat(location, suffix);
 	return location;
     }
     return NULL;
 }
 
+PRIVATE int cache_hash (const char * url)
+{
+    int hash = 0;
+    const char * ptr;
+    for (ptr=url; *ptr; ptr++)
+	hash = (int) ((hash * 3 + (*(unsigned char *) ptr)) % HT_XL_HASH_SIZE);
+    return hash;
+}
+
+PRIVATE HTCache * find_entry (const char * url, int hash)
+{
+    if (CacheTable && hash >= 0 && hash < HT_XL_HASH_SIZE) {
+	HTList * cur = CacheTable[hash];
+	HTCache * pres;
+	while ((pres = (HTCache *) HTList_nextObject(cur))) {
+	    if (!strcmp(pres->url, url)) return pres;
+	}
+    }
+    return NULL;
+}
+
+/*
+**	Add an entry read from the index to the cache table. When reading the
+**	journal we may already have an entry for the URL, in which case the one
+**	read replaces it as it is the newer.
+*/
+PRIVATE BOOL index_entry (HTCache * cache, BOOL replace)
+{
+    HTCache * old;
+
+    /*
+    **  Check that the hash is still within bounds
+    */
+    if (cache->hash < 0 || cache->hash >= HT_XL_HASH_SIZE) {
+	free_object(cache);
+	return NO;
+    }
+
+    /*
+    **  Create the cache table if not already existent and add the new
+    **  entry.
+    */
+    if (!CacheTable) {
+	if ((CacheTable = (HTList **) HT_CALLOC(HT_XL_HASH_SIZE,
+						sizeof(HTList *))) == NULL)
+	    HT_OUTOFMEM("index_entry");
+    }
+    if (replace && (old = find_entry(cache->url, cache->hash)) != NULL)
+	delete_object(CacheTable[cache->hash], old);
+    if (!CacheTable[cache->hash]) CacheTable[cache->hash] = HTList_new();
+    HTList_addObject(CacheTable[cache->hash], (void *) cache);
+    CacheEntries++;
+    heap_add(cache);
+
+    /* Update the total cache size */
+    HTCacheContentSize += cache->size;
+    return YES;
+}
+
+/*
+**	The binary index and the journal consist of records which each
+**	start with a type and the length of the data and end with a
+**	checksum of the data. Numbers are written most significant byte
+**	first so that the files don't depend on the machine.
+*/
+PRIVATE void put_number (HTChunk * ch, long value, int bytes)
+{
+    unsigned long v = (unsigned long) value;
+    int cnt;
+    for (cnt = bytes-1; cnt >= 0; cnt--) {
+	if (cnt < (int) sizeof(long))
+	    HTChunk_putc(ch, (char) ((v >> (8*cnt)) & 0xFF));
+	else
+	    HTChunk_putc(ch, (char) (value < 0 ? 0xFF : 0));
+    }
+}
+
+PRIVATE long get_number (const unsigned char ** p, int bytes)
+{
+    unsigned long v = 0;
+    int cnt;
+    for (cnt = 0; cnt < bytes; cnt++) v = (v << 8) | *(*p)++;
+    if (bytes < (int) sizeof(long) && (v & (1UL << (8*bytes-1))))
+	v |= ~0UL << (8*bytes);
+    return (long) v;
+}
+
+PRIVATE void put_string (HTChunk * ch, const char * str)
+{
+    int len = str ? (int) strlen(str) : 0;
+    put_number(ch, len, 4);
+    if (len) HTChunk_putb(ch, str, len);
+}
+
+PRIVATE char * get_string (const unsigned char ** p, const unsigned char * end)
+{
+    char * str = NULL;
+    long len;
+    if (end - *p < 4) return NULL;
+    len = get_number(p, 4);
+    if (len < 0 || len > end - *p) return NULL;
+    if ((str = (char *) HT_MALLOC(len + 1)) == NULL)
+	HT_OUTOFMEM("get_string");
+    memcpy(str, *p, len);
+    str[len] = '\0';
+    *p += len;
+    return str;
+}
+
+PRIVATE unsigned long checksum (const unsigned char * data, int len)
+{
+    unsigned long sum = 2166136261UL;
+    while (len-- > 0) sum = ((sum ^ *data++) * 16777619UL) & 0xFFFFFFFFUL;
+    return sum;
+}
+
+#define INDEX_FIXED_SIZE	(6*8 + 2*4 + 1)
+
+PRIVATE void encode_entry (HTChunk * ch, HTCache * cache)
+{
+    put_number(ch, (long) cache->lm, 8);
+    put_number(ch, (long) cache->expires, 8);
+    put_number(ch, cache->size, 8);
+    put_number(ch, (long) cache->freshness_lifetime, 8);
+    put_number(ch, (long) cache->response_time, 8);
+    put_number(ch, (long) cache->corrected_initial_age, 8);
+    put_number(ch, cache->hash, 4);
+    put_number(ch, cache->hits, 4);
+    HTChunk_putc(ch, (char) ((cache->range ? 1 : 0) |
+			     (cache->must_revalidate ? 2 : 0) |
+			     (cache->body && cache->body->name ? 4 : 0)));
+    put_string(ch, cache->url);
+    put_string(ch, cache->cachename);
+    put_string(ch, cache->etag);
+    put_number(ch, (long) cache->digest[0], 4);
+    put_number(ch, (long) cache->digest[1], 4);
+}
+
 /*
-**  Remove the cache index file
+**	Version 2 of the index doesn't have the hash of the body. Entries of
+**	the current version are linked to their body as they are read.
+*/
+PRIVATE HTCache * decode_entry (const unsigned char * p, const unsigned char * end,
+				int version)
+{
+    HTCache * cache;
+    int flags;
+    if (end - p < INDEX_FIXED_SIZE) return NULL;
+    if ((cache = (HTCache *) HT_CALLOC(1, sizeof(HTCache))) == NULL)
+	HT_OUTOFMEM("decode_entry");
+    cache->lm = (time_t) get_number(&p, 8);
+    cache->expires = (time_t) get_number(&p, 8);
+    cache->size = get_number(&p, 8);
+    cache->freshness_lifetime = (time_t) get_number(&p, 8);
+    cache->response_time = (time_t) get_number(&p, 8);
+    cache->corrected_initial_age = (time_t) get_number(&p, 8);
+    cache->hash = (int) get_number(&p, 4);
+    cache->hits = (int) get_number(&p, 4);
+    flags = *p++;
+    cache->range = (flags & 1) ? YES : NO;
+    cache->must_revalidate = (flags & 2) ? YES : NO;
+    cache->url = get_string(&p, end);
+    cache->cachename = get_string(&p, end);
+    cache->etag = get_string(&p, end);
+    if (!cache->url || !cache->cachename) {
+	free_object(cache);
+	return NULL;
+    }
+    if (cache->etag && !*cache->etag) HT_FREE(cache->etag);
+    if (version >= 3 && end - p >= 8) {
+	cache->digest[0] = (unsigned long) get_number(&p, 4) & 0xFFFFFFFFUL;
+	cache->digest[1] = (unsigned long) get_number(&p, 4) & 0xFFFFFFFFUL;
+	body_attach(cache, (flags & 4) ? YES : NO);
+    }
+    return cache;
+}
+
+PRIVATE BOOL write_record (FILE * fp, char type, HTChunk * data)
+{
+    HTChunk * head = HTChunk_new(16);
+    int len = HTChunk_size(data);
+    BOOL status;
+    HTChunk_putc(head, type);
+    put_number(head, len, 4);
+    status = fwrite(HTChunk_data(head), 1, HTChunk_size(head), fp) ==
+	(size_t) HTChunk_size(head) &&
+	fwrite(HTChunk_data(data), 1, len, fp) == (size_t) len;
+    HTChunk_clear(head);
+    put_number(head, (long) checksum((unsigned char *) HTChunk_data(data), len), 4);
+    if (status)
+	status = fwrite(HTChunk_data(head), 1, 4, fp) == 4;
+    HTChunk_delete(head);
+    return status;
+}
+
+/*
+**	Read all the records of an index or journal file. We read the whole
+**	file in one go. A record which is cut short or has a bad checksum
+**	means that we were stopped while writing it, so we stop there.
+**	Returns NO if the file doesn't exist or is not in our format.
+*/
+PRIVATE BOOL read_records (const char * file, const char * magic,
+			   BOOL journal, int version)
+{
+    FILE * fp;
+    long length;
+    unsigned char * data;
+    const unsigned char * p;
+    const unsigned char * end;
+    int magic_len = (int) strlen(magic);
+    int records = 0;
+    if (!file || (fp = fopen(file, "rb")) == NULL) return NO;
+    fseek(fp, 0, SEEK_END);
+    length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (length < magic_len) {
+	fclose(fp);
+	return NO;
+    }
+    if ((data = (unsigned char *) HT_MALLOC(length)) == NULL)
+	HT_OUTOFMEM("read_records");
+    if (fread(data, 1, length, fp) != (size_t) length ||
+	memcmp(data, magic, magic_len)) {
+	HT_FREE(data);
+	fclose(fp);
+	return NO;
+    }
+    fclose(fp);
+
+    p = data + magic_len;
+    end = data + length;
+    while (end - p >= 5) {
+	char type = (char) *p++;
+	long len = get_number(&p, 4);
+	const unsigned char * rec = p;
+	if (len < 0 || end - p < len + 4) break;
+	p += len;
+	if (((unsigned long) get_number(&p, 4) & 0xFFFFFFFFUL) !=
+	    checksum(rec, (int) len)) break;
+	if (type == 'P') {
+	    HTCache * cache = decode_entry(rec, rec + len, version);
+	    if (cache) index_entry(cache, journal);
+	} else if (type == 'D') {
+	    char * url = get_string(&rec, rec + len);
+	    if (url) {
+		HTCache * old = find_entry(url, cache_hash(url));
+		if (old) delete_object(CacheTable[old->hash], old);
+		HT_FREE(url);
+	    }
+	}
+	records++;
+    }
+    if (p != end)
+	HTTRACE(CACHE_TRACE, "Cache Index. Ignoring broken end of `%s\'\n" _ file);
+    HTTRACE(CACHE_TRACE, "Cache Index. Read %d records from `%s\'\n" _
+	    records _ file);
+    HT_FREE(data);
+    return YES;
+}
+
+/*
+**	Make sure that what we have written to a file is on the disk and
+**	not only in the buffers of the operating system.
+*/
+PRIVATE BOOL sync_file (FILE * fp)
+{
+    if (fflush(fp) != 0) return NO;
+#ifdef HAVE_FSYNC
+    if (fsync(fileno(fp)) < 0) return NO;
+#endif
+    return YES;
+}
+
+/*
+**	A file which is created or renamed is only there after a crash when
+**	the directory holding it has been written to disk as well.
+*/
+PRIVATE BOOL sync_dir (const char * cache_root)
+{
+#if defined(HAVE_FSYNC) && !defined(WWW_MSWINDOWS)
+    int fd;
+    BOOL status;
+    if ((fd = open(cache_root, O_RDONLY)) < 0) return NO;
+    status = fsync(fd) == 0;
+    close(fd);
+    return status;
+#else
+    return YES;
+#endif
+}
+
+/*
+**	Add a record to the journal. We flush it right away so that it is
+**	not lost if we die, and sync the journal to disk every
+**	JOURNAL_SYNC_RECORDS records so that at most that many are lost if
+**	the system goes down. When the journal has grown as big as the
+**	index we write a new index and start a new journal.
+*/
+PRIVATE BOOL journal_add (char type, HTCache * cache)
+{
+    HTChunk * data;
+    BOOL status;
+    if (!HTCacheRoot || !cache) return NO;
+    if (!JournalFP) {
+	char * journal = cache_file_name(HTCacheRoot, HT_CACHE_JOURNAL);
+	if ((JournalFP = fopen(journal, "ab")) == NULL) {
+	    HTTRACE(CACHE_TRACE, "Cache Index. Can't open `%s\'\n" _ journal);
+	    HT_FREE(journal);
+	    return NO;
+	}
+	HT_FREE(journal);
+	fseek(JournalFP, 0, SEEK_END);
+	if (ftell(JournalFP) == 0) {
+	    fputs(HT_CACHE_JOURNAL_MAGIC, JournalFP);
+	    if (!sync_file(JournalFP) || !sync_dir(HTCacheRoot))
+		HTTRACE(CACHE_TRACE, "Cache Index. Can't sync new journal\n");
+	}
+    }
+    data = HTChunk_new(256);
+    if (type == 'P')
+	encode_entry(data, cache);
+    else
+	put_string(data, cache->url);
+    status = write_record(JournalFP, type, data) && fflush(JournalFP) == 0;
+    if (status && (JournalRecords+1) % JOURNAL_SYNC_RECORDS == 0)
+	status = sync_file(JournalFP);
+    HTChunk_delete(data);
+    if (!status) {
+	HTTRACE(CACHE_TRACE, "Cache Index. Error writing journal\n");
+	return NO;
+    }
+
+    /*
+    **  A deleted entry is still in the table when we get here so we only
+    **  write a new index after an update.
+    */
+    if (++JournalRecords > JOURNAL_MIN_RECORDS && JournalRecords > CacheEntries
+	&& type == 'P')
+	HTCacheIndex_write(HTCacheRoot);
+    return YES;
+}
+
+PRIVATE void journal_close (void)
+{
+    if (JournalFP) {
+	fclose(JournalFP);
+	JournalFP = NULL;
+    }
+    JournalRecords = 0;
+}
+
+/*
+**  Remove the cache index file and the journal
 */
 PUBLIC BOOL HTCacheIndex_delete (const char * cache_root)
 {
     if (cache_root) {
-	char * index = cache_index_name(cache_root);
+	char * index = cache_file_name(cache_root, HT_CACHE_INDEX);
+	char * journal = cache_file_name(cache_root, HT_CACHE_JOURNAL);
+	journal_close();
 	REMOVE(index);
+	REMOVE(journal);
 	HT_FREE(index);
+	HT_FREE(journal);
 	return YES;
     }
     return NO;
 }
 
 /*
-**	Walk through the list of cached objects and save them to disk.
-**	We override any existing version but that is normally OK as we have
-**	already read its contents.
+**	Walk through the list of cached objects and save them to disk. We
+**	write a new file and move it in place of the old index when it is
+**	complete, so there is always a valid index on disk. The journal is
+**	then no longer needed, but we only remove it when both the new index
+**	and the rename are on the disk.
 */
 PUBLIC BOOL HTCacheIndex_write (const char * cache_root)
 {
     if (cache_root && CacheTable) {
-	char * index = cache_index_name(cache_root);
+	char * index = cache_file_name(cache_root, HT_CACHE_INDEX);
+	char * tmp = cache_file_name(cache_root, HT_CACHE_INDEX_TMP);
+	char * journal = cache_file_name(cache_root, HT_CACHE_JOURNAL);
 	FILE * fp = NULL;
+	BOOL status = YES;
 	HTTRACE(CACHE_TRACE, "Cache Index. Writing index `%s\'\n" _ index);
-
-	/*
-	**  Open the file for writing. Note - we don't take a backup!
-	**  This should probably be fixed!
-	*/
-	if (!index) return NO;
-	if ((fp = fopen(index, "wb")) == NULL) {
-	    HTTRACE(CACHE_TRACE, "Cache Index. Can't open `%s\' for writing\n" _ index);
+	if ((fp = fopen(tmp, "wb")) == NULL) {
+	    HTTRACE(CACHE_TRACE, "Cache Index. Can't open `%s\' for writing\n" _ tmp);
 	    HT_FREE(index);
+	    HT_FREE(tmp);
+	    HT_FREE(journal);
 	    return NO;
 	}
 
 	/*
-	**  Walk through the list and write it out. The format is really
-	**  simple as we keep it all in ASCII.
+	**  Walk through the list and write it out
 	*/
 	{
+	    HTChunk * data = HTChunk_new(256);
 	    HTList * cur;
 	    int cnt;
-	    for (cnt=0; cnt<HT_XL_HASH_SIZE; cnt++) {
+	    if (fputs(HT_CACHE_INDEX_MAGIC, fp) < 0) status = NO;
+	    for (cnt=0; status && cnt<HT_XL_HASH_SIZE; cnt++) {
 		if ((cur = CacheTable[cnt])) { 
 		    HTCache * pres;
 		    while ((pres = (HTCache *) HTList_nextObject(cur))) {
-			if (fprintf(fp, "%s %s %s %ld %ld %ld %c %d %d %ld %ld %ld %c\r\n",
-				    pres->url,
-				    pres->cachename,
-				    pres->etag ? pres->etag : HT_CACHE_EMPTY_ETAG,
-				    (long) (pres->lm),
-				    (long) (pres->expires),
-				    pres->size,
-				    pres->range+0x30,
-				    pres->hash,
-				    pres->hits,
-				    (long) (pres->freshness_lifetime),
-				    (long) (pres->response_time),
-				    (long) (pres->corrected_initial_age),
-				    pres->must_revalidate+0x30) < 0) {
-			    HTTRACE(CACHE_TRACE, "Cache Index. Error writing cache index\n");
-			    return NO;
+			HTChunk_clear(data);
+			encode_entry(data, pres);
+			if (!write_record(fp, 'P', data)) {
+			    status = NO;
+			    break;
 			}
 		    }
 		}
 	    }
+	    HTChunk_delete(data);
 	}
 
 	/* Done writing */
-	fclose(fp);
+	if (status && !sync_file(fp)) status = NO;
+	if (fclose(fp) != 0) status = NO;
+	if (status) {
+#ifdef WWW_MSWINDOWS
+	    REMOVE(index);
+#endif
+	    if (rename(tmp, index) < 0 || !sync_dir(cache_root)) status = NO;
+	}
+	if (status) {
+	    journal_close();
+	    REMOVE(journal);
+	} else {
+	    HTTRACE(CACHE_TRACE, "Cache Index. Error writing cache index\n");
+	    REMOVE(tmp);
+	}
 	HT_FREE(index);
+	HT_FREE(tmp);
+	HT_FREE(journal);
+	return status;
     }
     return NO;
 }
@@ -387,42 +879,13 @@ PRIVATE BOOL HTCacheIndex_parseLine (char * line)
 		   &cache->corrected_initial_age,
 		   &validate) < 0) {
 	    HTTRACE(CACHE_TRACE, "Cache Index. Error reading cache index\n");
+	    free_object(cache);
 	    return NO;
 	}
 	cache->range = range-0x30;
 	cache->must_revalidate = validate-0x30;
 
-	/*
-	**  Create the new anchor and fill in the expire information we have read
-	**  in the index.
-	*/
-	if (cache) {
-	    HTAnchor * anchor = HTAnchor_findAddress(cache->url);
-	    HTParentAnchor * parent = HTAnchor_parent(anchor);
-	    HTAnchor_setExpires(parent, cache->expires);	    
-	    HTAnchor_setLastModified(parent, cache->lm);
-	    if (cache->etag) HTAnchor_setEtag(parent, cache->etag);
-	}
-
-	/*
-	**  Create the cache table if not already existent and add the new
-	**  entry. Also check that the hash is still within bounds
-	*/
-	if (!CacheTable) {
-	    if ((CacheTable = (HTList **) HT_CALLOC(HT_XL_HASH_SIZE,
-						    sizeof(HTList *))) == NULL)
-		HT_OUTOFMEM("HTCache_parseLine");
-	}
-	if (cache->hash >= 0 && cache->hash < HT_XL_HASH_SIZE) {
-	    int hash = cache->hash;
-	    if (!CacheTable[hash]) CacheTable[hash] = HTList_new();
-	    HTList_addObject(CacheTable[hash], (void *) cache);
-	}
-
-	/* Update the total cache size */
-	HTCacheContentSize += cache->size;
-
-	return YES;
+	return index_entry(cache, NO);
     }
     return NO;
 }
@@ -545,16 +1008,30 @@ PRIVATE HTStream * HTCacheIndexReader (HTRequest *	request)
 }
 
 /*
-**	Read the saved set of cached entries from disk. we only allow the index
-**	ro be read when there is no entries in memory. That way we can ensure
-**	consistancy.
+**	Is there an index in the ASCII format used by earlier versions?
 */
-PUBLIC BOOL HTCacheIndex_read (const char * cache_root)
+PRIVATE BOOL HTCacheIndex_isASCII (const char * file)
+{
+    FILE * fp;
+    BOOL status = NO;
+    if (file && (fp = fopen(file, "rb")) != NULL) {
+	char buf[9];
+	size_t len = fread(buf, 1, sizeof(buf), fp);
+	status = len > 0 && (len < sizeof(buf) || memcmp(buf, "W3C cache", len));
+	fclose(fp);
+    }
+    return status;
+}
+
+/*
+**	Read an index in the ASCII format used by earlier versions
+*/
+PRIVATE BOOL HTCacheIndex_readASCII (const char * cache_root)
 {
     BOOL status = NO;
     if (cache_root && CacheTable == NULL) {
 	BOOL wasInteractive;
-	char * file = cache_index_name(cache_root);
+	char * file = cache_file_name(cache_root, HT_CACHE_INDEX);
 	char * index = HTLocalToWWW(file, "cache:");
 	HTAnchor * anchor = HTAnchor_findAddress(index);	
 	HTRequest * request = HTRequest_new();
@@ -580,6 +1057,83 @@ PUBLIC BOOL HTCacheIndex_read (const char * cache_root)
     return status;
 }
 
+/*
+**	Earlier versions kept the body and the metainformation of an entry in
+**	two files in a directory named after the hash of the URL. We don't
+**	convert those but remove the files and start with an empty cache.
+*/
+PRIVATE void HTCacheIndex_flushOld (const char * cache_root)
+{
+    HTTRACE(CACHE_TRACE, "Cache Index. Removing %d entries of old format\n" _
+	    CacheEntries);
+    if (CacheTable) {
+	HTList * cur;
+	int cnt;
+	for (cnt=0; cnt<HT_XL_HASH_SIZE; cnt++) {
+	    if ((cur = CacheTable[cnt])) { 
+		HTCache * pres;
+		while ((pres = (HTCache *) HTList_nextObject(cur)) != NULL) {
+		    char * meta = cache_file_name(pres->cachename, HT_CACHE_META);
+		    REMOVE(meta);
+		    HT_FREE(meta);
+		}
+	    }
+	}
+    }
+    HTCacheIndex_delete(cache_root);
+    HTCache_flushAll();
+    {
+	char * dir;
+	int cnt;
+	if ((dir = (char *) HT_MALLOC(strlen(cache_root) + 10)) == NULL)
+	    HT_OUTOFMEM("HTCacheIndex_flushOld");
+	for (cnt=0; cnt<HT_XL_HASH_SIZE; cnt++) {
+	    sprintf(dir, "%s%d", cache_root, cnt);
+	    RMDIR(dir);
+	}
+	HT_FREE(dir);
+    }
+}
+
+/*
+**	Read the saved set of cached entries from disk. we only allow the index
+**	ro be read when there is no entries in memory. That way we can ensure
+**	consistancy. We first read the index and then the changes recorded in
+**	the journal since the index was written. An index in one of the
+**	formats used by earlier versions means that the entries are stored in
+**	the old way, so we throw them out.
+*/
+PUBLIC BOOL HTCacheIndex_read (const char * cache_root)
+{
+    BOOL status = NO;
+    if (cache_root && CacheTable == NULL) {
+	char * index = cache_file_name(cache_root, HT_CACHE_INDEX);
+	char * journal = cache_file_name(cache_root, HT_CACHE_JOURNAL);
+	ms_t t = HTGetTimeInMillis();
+	if (read_records(index, HT_CACHE_INDEX_MAGIC, NO, 3)) {
+	    status = YES;
+	    if (read_records(journal, HT_CACHE_JOURNAL_MAGIC, YES, 3))
+		status = YES;
+	} else {
+	    BOOL old = read_records(index, HT_CACHE_INDEX_MAGIC_2, NO, 2) ||
+		(HTCacheIndex_isASCII(index) && HTCacheIndex_readASCII(cache_root));
+	    if (read_records(journal, HT_CACHE_JOURNAL_MAGIC_2, YES, 2))
+		old = YES;
+	    else if (!old && read_records(journal, HT_CACHE_JOURNAL_MAGIC, YES, 3))
+		status = YES;
+	    if (old) {
+		HTCacheIndex_flushOld(cache_root);
+		status = YES;
+	    }
+	}
+	HTTRACE(CACHE_TRACE, "Cache Index. Read %d entries in %ld ms\n" _
+		CacheEntries _ (long) (HTGetTimeInMillis() - t));
+	HT_FREE(index);
+	HT_FREE(journal);
+    }
+    return status;
+}
+
 /* ------------------------------------------------------------------------- */
 /*  			      CACHE PARAMETERS				     */
 /* ------------------------------------------------------------------------- */
@@ -796,9 +1350,10 @@ PUBLIC BOOL HTCacheTerminate (void)
     if (HTCacheInitialized) {
 
 	/*
-	**  Write the index to file
+	**  Write the index to file and close the journal
 	*/
 	HTCacheIndex_write(HTCacheRoot);
+	journal_close();
 
 	/*
 	**  Unregister the cache before and after filters
@@ -853,103 +1408,711 @@ PUBLIC BOOL HTCacheMode_protected (void)
 }
 
 /*
-**  We can set the cache to operate in disconnected mode in which we only
-**  return (valid) responses from the cache. Disconnected mode does not
-**  automatically deliver stale documents as this must be declared 
-**  explicitly. 
+**  We can set the cache to operate in disconnected mode in which we only
+**  return (valid) responses from the cache. Disconnected mode does not
+**  automatically deliver stale documents as this must be declared 
+**  explicitly. 
+*/
+PUBLIC void HTCacheMode_setDisconnected (HTDisconnectedMode mode)
+{
+    DisconnectedMode = mode;
+}
+
+PUBLIC HTDisconnectedMode HTCacheMode_disconnected (void)
+{
+    return DisconnectedMode;
+}
+
+PUBLIC BOOL HTCacheMode_isDisconnected (HTReload mode)
+{
+    return (DisconnectedMode != HT_DISCONNECT_NONE);
+}
+
+/*
+**  Set the mode for how we handle Expires header from the local history
+**  list. The following modes are available:
+**
+**	HT_EXPIRES_IGNORE : No update in the history list
+**	HT_EXPIRES_NOTIFY : The user is notified but no reload
+**	HT_EXPIRES_AUTO   : Automatic reload
+*/
+PUBLIC void HTCacheMode_setExpires (HTExpiresMode mode)
+{
+    HTExpMode = mode;
+}
+
+PUBLIC HTExpiresMode HTCacheMode_expires (void)
+{
+    return HTExpMode;
+}
+
+/*
+**  Cache size management. We set the default cache size to 20M.
+**  We set the minimum size to 5M in order not to get into weird
+**  problems while writing the cache. The size is indicated in Mega
+**  bytes
+*/
+PUBLIC BOOL HTCacheMode_setMaxSize (int size)
+{
+    long new_size = size < HT_MIN_CACHE_TOTAL_SIZE ?
+	HT_MIN_CACHE_TOTAL_SIZE*MEGA : size*MEGA;
+    long old_size = HTCacheTotalSize;
+    HTCacheTotalSize = new_size;
+    HTCacheFolderSize = HTCacheTotalSize/HT_CACHE_FOLDER_PCT;
+    HTCacheGCBuffer = HTCacheTotalSize/HT_CACHE_GC_PCT;
+    if (new_size < old_size) HTCacheGarbage();
+    HTTRACE(CACHE_TRACE, "Cache....... Total cache size: %ld with %ld bytes for metainformation and folders and at least %ld bytes free after every gc\n" _ 
+		HTCacheTotalSize _ HTCacheFolderSize _ HTCacheGCBuffer);
+    return YES;
+}
+
+PUBLIC int HTCacheMode_maxSize (void)
+{
+    return HTCacheTotalSize / MEGA;
+}
+
+/*
+**  How big can a single cached entry be in Mbytes. The default is 3M
+**  
+*/
+PUBLIC BOOL HTCacheMode_setMaxCacheEntrySize (int size)
+{
+    long new_size = size*MEGA;
+    if (new_size > 0 && new_size < HTCacheTotalSize-HTCacheFolderSize) {
+	long old_size = HTCacheMaxEntrySize;
+	HTCacheMaxEntrySize = new_size;
+	if (new_size < old_size) HTCacheGarbage();
+	HTTRACE(CACHE_TRACE, "Cache...... Max entry cache size is %ld\n" _ HTCacheMaxEntrySize);
+	return YES;
+    }
+    HTTRACE(CACHE_TRACE, "Cache...... Max entry cache size is unchanged\n");
+    return NO;
+}
+
+PUBLIC int HTCacheMode_maxCacheEntrySize (void)
+{
+    return HTCacheMaxEntrySize / MEGA;
+}
+
+/*
+** Set the default expiration time. In seconds.
+*/
+PUBLIC void HTCacheMode_setDefaultExpiration (const int exp_time)
+{
+    DefaultExpiration = exp_time;
+}
+
+PUBLIC int HTCacheMode_DefaultExpiration (void)
+{
+    return DefaultExpiration;
+}
+
+/* ------------------------------------------------------------------------- */
+/*  			      CACHE MEMORY TIER				     */
+/* ------------------------------------------------------------------------- */
+
+/*
+**  Small cache entries which are read from the cache can be kept in memory
+**  so that the next hit doesn't have to go to the disk. Both the body and
+**  the meta information are kept. The entries in memory are linked in the
+**  order they were last used so that we can throw out the least recently
+**  used when we go over the budget. The copy in memory is dropped whenever
+**  the files on disk are changed or removed.
+*/
+PRIVATE void memory_unlink (HTCache * me)
+{
+    if (me->mem_prev)
+	me->mem_prev->mem_next = me->mem_next;
+    else if (MemoryHead == me)
+	MemoryHead = me->mem_next;
+    if (me->mem_next)
+	me->mem_next->mem_prev = me->mem_prev;
+    else if (MemoryTail == me)
+	MemoryTail = me->mem_prev;
+    me->mem_prev = me->mem_next = NULL;
+}
+
+PRIVATE void memory_link (HTCache * me)
+{
+    me->mem_prev = NULL;
+    me->mem_next = MemoryHead;
+    if (MemoryHead) MemoryHead->mem_prev = me;
+    MemoryHead = me;
+    if (!MemoryTail) MemoryTail = me;
+}
+
+PRIVATE long memory_size (HTCache * me)
+{
+    return (me->mem_body ? HTChunk_size(me->mem_body) : 0) +
+	(me->mem_meta ? HTChunk_size(me->mem_meta) : 0);
+}
+
+PRIVATE void memory_drop (HTCache * me)
+{
+    if (me && (me->mem_body || me->mem_meta)) {
+	HTCacheMemoryUsed -= memory_size(me);
+	HTChunk_delete(me->mem_body);
+	HTChunk_delete(me->mem_meta);
+	me->mem_body = me->mem_meta = NULL;
+	memory_unlink(me);
+    }
+}
+
+PRIVATE void memory_touch (HTCache * me)
+{
+    if (me && MemoryHead != me && (me->mem_body || me->mem_meta)) {
+	memory_unlink(me);
+	memory_link(me);
+    }
+}
+
+/*
+**  Is this much data small enough to be kept in memory?
+*/
+PRIVATE BOOL memory_fits (long size)
+{
+    return (HTCacheMemorySize > 0 && size >= 0 && size <= HT_CACHE_MEMORY_ENTRY &&
+	    size <= HTCacheMemorySize / 4);
+}
+
+/*
+**  Keep a chunk of data in memory, either the body or the meta information
+**  of the entry. Other entries are thrown out if we go over the budget.
+*/
+PRIVATE void memory_keep (HTCache * me, HTChunk * data, BOOL meta)
+{
+    HTChunk ** where = meta ? &me->mem_meta : &me->mem_body;
+    if (*where) {
+	HTCacheMemoryUsed -= HTChunk_size(*where);
+	HTChunk_delete(*where);
+    } else if (!me->mem_body && !me->mem_meta)
+	memory_link(me);
+    *where = data;
+    HTCacheMemoryUsed += HTChunk_size(data);
+    memory_touch(me);
+    while (HTCacheMemoryUsed > HTCacheMemorySize && MemoryTail != me)
+	memory_drop(MemoryTail);
+    HTTRACE(CACHE_TRACE, "Cache....... Keeping %d bytes of %s in memory, %ld in total\n" _
+	    HTChunk_size(data) _ me->url _ HTCacheMemoryUsed);
+}
+
+/*
+**	The memory budget is given in bytes. 0 turns the memory tier off
+*/
+PUBLIC BOOL HTCacheMode_setMemorySize (long size)
+{
+    if (size >= 0) {
+	HTCacheMemorySize = size;
+	while (HTCacheMemoryUsed > HTCacheMemorySize && MemoryTail)
+	    memory_drop(MemoryTail);
+	HTTRACE(CACHE_TRACE, "Cache...... Memory tier size is %ld\n" _ size);
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC long HTCacheMode_memorySize (void)
+{
+    return HTCacheMemorySize;
+}
+
+PUBLIC long HTCache_memoryUsed (void)
+{
+    return HTCacheMemoryUsed;
+}
+
+PUBLIC unsigned long HTCache_memoryHits (void)
+{
+    return HTCacheMemoryHits;
+}
+
+/* ------------------------------------------------------------------------- */
+/*  				 CACHE FILES				     */
+/* ------------------------------------------------------------------------- */
+
+/*
+**  Each entry is kept in a single file which starts with a fixed size header
+**  followed by the metainformation and then the entity body. The header says
+**  how long the metainformation and the body are and has a hash of the body.
+**  Entries with the same body share a single copy of it which is then kept
+**  in a file of its own named after the hash. The files are spread over two
+**  levels of directories named after the first two bytes of a hash so that
+**  no directory gets too big.
+*/
+PRIVATE void digest_init (unsigned long * digest)
+{
+    digest[0] = 2166136261UL;
+    digest[1] = 0;
+}
+
+PRIVATE void digest_update (unsigned long * digest, const unsigned char * data,
+			    int len)
+{
+    unsigned long d0 = digest[0];
+    unsigned long d1 = digest[1];
+    while (len-- > 0) {
+	d0 = ((d0 ^ *data) * 16777619UL) & 0xFFFFFFFFUL;
+	d1 = (*data++ + (d1 << 6) + (d1 << 16) - d1) & 0xFFFFFFFFUL;
+    }
+    digest[0] = d0;
+    digest[1] = d1;
+}
+
+PRIVATE BOOL cache_dir (const char * path)
+{
+    struct stat stat_info;
+    if (HT_STAT(path, &stat_info) == -1) {
+	HTTRACE(CACHE_TRACE, "Cache....... Create dir `%s\'\n" _ path);
+	if (MKDIR(path, 0777) < 0) {
+	    HTTRACE(CACHE_TRACE, "Cache....... Can't create...\n");
+	    return NO;
+	}
+    }
+    return YES;
+}
+
+/*
+**  Find the name of a file in the cache from a hash. If `create' is set
+**  then the directories are created as needed. Returns NULL if that fails.
+*/
+PRIVATE char * cache_location (unsigned long * digest, const char * suffix,
+			       BOOL create)
+{
+    char * location = NULL;
+    if (!HTCacheRoot || !digest) return NULL;
+    if ((location = (char *) HT_MALLOC(strlen(HTCacheRoot) +
+				       strlen(suffix) + 24)) == NULL)
+	HT_OUTOFMEM("cache_location");
+    sprintf(location, "%s%02lx", HTCacheRoot, (digest[0] >> 24) & 0xFF);
+    if (!create || cache_dir(location)) {
+	sprintf(location + strlen(location), "%s%02lx", DIR_SEPARATOR_STR,
+		(digest[0] >> 16) & 0xFF);
+	if (!create || cache_dir(location)) {
+	    sprintf(location + strlen(location), "%s%08lx%08lx%s",
+		    DIR_SEPARATOR_STR, digest[0], digest[1], suffix);
+	    return location;
+	}
+    }
+    HT_FREE(location);
+    return NULL;
+}
+
+/*
+**  Write the header at the beginning of a cache file. The file is left
+**  positioned right after the header.
+*/
+PRIVATE BOOL header_write (FILE * fp, const char * magic, CacheHeader * head)
+{
+    HTChunk * ch = HTChunk_new(CACHE_HEADER_SIZE);
+    BOOL status;
+    HTChunk_putb(ch, magic, 4);
+    HTChunk_putc(ch, CACHE_VERSION);
+    HTChunk_putc(ch, (char) head->flags);
+    put_number(ch, 0, 2);
+    put_number(ch, head->meta_len, 4);
+    put_number(ch, head->body_len, 8);
+    put_number(ch, (long) head->digest[0], 4);
+    put_number(ch, (long) head->digest[1], 4);
+    put_number(ch, 0, 4);
+    status = fseek(fp, 0, SEEK_SET) == 0 &&
+	fwrite(HTChunk_data(ch), 1, CACHE_HEADER_SIZE, fp) == CACHE_HEADER_SIZE;
+    HTChunk_delete(ch);
+    return status;
+}
+
+/*
+**  Read the header of a cache file. Returns NO if the file isn't in our
+**  format. Otherwise the file is left positioned right after the header.
+*/
+PRIVATE BOOL header_read (FILE * fp, CacheHeader * head)
+{
+    unsigned char data[CACHE_HEADER_SIZE];
+    const unsigned char * p = data + 8;
+    if (fread(data, 1, CACHE_HEADER_SIZE, fp) != CACHE_HEADER_SIZE ||
+	data[4] != CACHE_VERSION)
+	return NO;
+    if (!memcmp(data, HT_CACHE_ENTRY_MAGIC, 4))
+	head->body_file = NO;
+    else if (!memcmp(data, HT_CACHE_BODY_MAGIC, 4))
+	head->body_file = YES;
+    else
+	return NO;
+    head->flags = data[5];
+    head->meta_len = get_number(&p, 4);
+    head->body_len = get_number(&p, 8);
+    head->digest[0] = (unsigned long) get_number(&p, 4) & 0xFFFFFFFFUL;
+    head->digest[1] = (unsigned long) get_number(&p, 4) & 0xFFFFFFFFUL;
+    return (head->meta_len >= 0 && (!head->body_file || !head->meta_len));
+}
+
+PRIVATE long header_offset (CacheHeader * head)
+{
+    return CACHE_HEADER_SIZE + head->meta_len;
+}
+
+/*
+**  Copy `len' bytes from one file to another or all of it if `len' is
+**  negative. The hash is updated with what we copy if given. Returns the
+**  number of bytes copied or -1 on error.
+*/
+PRIVATE long copy_data (FILE * from, FILE * to, long len, unsigned long * digest)
+{
+    char buffer[4096];
+    long copied = 0;
+    while (len < 0 || copied < len) {
+	size_t want = (len < 0 || len - copied > (long) sizeof(buffer)) ?
+	    sizeof(buffer) : (size_t) (len - copied);
+	size_t got = fread(buffer, 1, want, from);
+	if (!got) break;
+	if (digest) digest_update(digest, (unsigned char *) buffer, (int) got);
+	if (fwrite(buffer, 1, got, to) != got) return -1;
+	copied += (long) got;
+    }
+    return ferror(from) ? -1 : copied;
+}
+
+/*
+**  Read either the metainformation or the body of a cache file into a
+**  chunk. A file without a header is all body.
+*/
+PRIVATE HTChunk * entry_read (const char * name, BOOL meta)
+{
+    FILE * fp;
+    HTChunk * data = NULL;
+    if (name && (fp = fopen(name, "rb")) != NULL) {
+	CacheHeader head;
+	long left = -1;
+	if (header_read(fp, &head)) {
+	    if (meta)
+		left = head.meta_len;
+	    else
+		fseek(fp, header_offset(&head), SEEK_SET);
+	} else if (meta) {
+	    fclose(fp);
+	    return NULL;
+	} else
+	    fseek(fp, 0, SEEK_SET);
+	data = HTChunk_new(1024);
+	while (left) {
+	    char buffer[1024];
+	    size_t want = (left < 0 || left > (long) sizeof(buffer)) ?
+		sizeof(buffer) : (size_t) left;
+	    size_t len = fread(buffer, 1, want, fp);
+	    if (!len) break;
+	    HTChunk_putb(data, buffer, (int) len);
+	    if (left > 0) left -= (long) len;
+	}
+	if (ferror(fp) || left > 0) {
+	    HTChunk_delete(data);
+	    data = NULL;
+	}
+	fclose(fp);
+    }
+    return data;
+}
+
+/*
+**  Find where the body starts in a file that we are about to load. If the
+**  body is shared then we switch to the file holding it. Files without a
+**  header, like the index in the old ASCII format, start with the body.
 */
-PUBLIC void HTCacheMode_setDisconnected (HTDisconnectedMode mode)
-{
-    DisconnectedMode = mode;
+PRIVATE long body_offset (char ** local)
+{
+    FILE * fp;
+    long offset = 0;
+    if (*local && (fp = fopen(*local, "rb")) != NULL) {
+	CacheHeader head;
+	if (header_read(fp, &head)) {
+	    offset = header_offset(&head);
+	    if (!head.body_file && (head.flags & CACHE_SHARED)) {
+		char * name = cache_location(head.digest, HT_CACHE_BODY, NO);
+		if (name) {
+		    HTTRACE(CACHE_TRACE, "Cache....... Body of `%s\' is in `%s\'\n" _
+			    *local _ name);
+		    HT_FREE(*local);
+		    *local = name;
+		    offset = CACHE_HEADER_SIZE;
+		}
+	    }
+	}
+	fclose(fp);
+    }
+    return offset;
 }
 
-PUBLIC HTDisconnectedMode HTCacheMode_disconnected (void)
+/*
+**  Rewrite the file of an entry with new metainformation, or with the one
+**  already there if no response is given. A body kept in the file is
+**  copied along which also gives us the hash of it. The new file is moved
+**  in place of the old one when it is complete.
+*/
+PRIVATE BOOL entry_rewrite (HTCache * cache, HTRequest * request,
+			    HTResponse * response)
 {
-    return DisconnectedMode;
+    char * tmp = cache_file_name(cache->cachename, HT_CACHE_TMP);
+    FILE * old = fopen(cache->cachename, "rb");
+    FILE * fp = NULL;
+    CacheHeader head;
+    CacheHeader old_head;
+    BOOL has_old = old && header_read(old, &old_head) && !old_head.body_file;
+    BOOL status = YES;
+    if (!tmp || (fp = fopen(tmp, "wb")) == NULL) {
+	HTTRACE(CACHE_TRACE, "Cache....... Can't open `%s\' for writing\n" _ tmp);
+	if (old) fclose(old);
+	HT_FREE(tmp);
+	return NO;
+    }
+    memset(&head, 0, sizeof(CacheHeader));
+    if (!header_write(fp, HT_CACHE_ENTRY_MAGIC, &head)) status = NO;
+    if (request && response)
+	meta_write(fp, request, response);
+    else if (has_old &&
+	     copy_data(old, fp, old_head.meta_len, NULL) != old_head.meta_len)
+	status = NO;
+    head.meta_len = ftell(fp) - CACHE_HEADER_SIZE;
+    if (cache->body && cache->body->name) {
+	head.flags = CACHE_SHARED;
+	head.body_len = cache->body->size;
+	head.digest[0] = cache->digest[0];
+	head.digest[1] = cache->digest[1];
+    } else if (has_old && cache->size > 0) {
+	digest_init(head.digest);
+	fseek(old, header_offset(&old_head), SEEK_SET);
+	if ((head.body_len = copy_data(old, fp, -1, head.digest)) < 0)
+	    status = NO;
+	cache->digest[0] = head.digest[0];
+	cache->digest[1] = head.digest[1];
+    }
+    if (status && !header_write(fp, HT_CACHE_ENTRY_MAGIC, &head)) status = NO;
+    if (fclose(fp) != 0) status = NO;
+    if (old) fclose(old);
+    if (status) {
+#ifdef WWW_MSWINDOWS
+	REMOVE(cache->cachename);
+#endif
+	if (rename(tmp, cache->cachename) < 0) status = NO;
+    }
+    if (!status) {
+	HTTRACE(CACHE_TRACE, "Cache....... Error writing `%s\'\n" _ tmp);
+	REMOVE(tmp);
+    }
+    HT_FREE(tmp);
+    return status;
 }
 
-PUBLIC BOOL HTCacheMode_isDisconnected (HTReload mode)
-{
-    return (DisconnectedMode != HT_DISCONNECT_NONE);
+/*
+**  Check that two files have the same body of `size' bytes
+*/
+PRIVATE BOOL same_body (const char * a, const char * b, long size)
+{
+    FILE * fa = fopen(a, "rb");
+    FILE * fb = fopen(b, "rb");
+    BOOL same = NO;
+    CacheHeader ha, hb;
+    if (fa && fb && header_read(fa, &ha) && header_read(fb, &hb) &&
+	ha.body_len == size && hb.body_len == size &&
+	fseek(fa, header_offset(&ha), SEEK_SET) == 0 &&
+	fseek(fb, header_offset(&hb), SEEK_SET) == 0) {
+	char ba[4096], bb[4096];
+	long left = size;
+	same = YES;
+	while (same && left > 0) {
+	    size_t want = left > (long) sizeof(ba) ? sizeof(ba) : (size_t) left;
+	    if (fread(ba, 1, want, fa) != want || fread(bb, 1, want, fb) != want ||
+		memcmp(ba, bb, want))
+		same = NO;
+	    left -= (long) want;
+	}
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
 }
 
 /*
-**  Set the mode for how we handle Expires header from the local history
-**  list. The following modes are available:
-**
-**	HT_EXPIRES_IGNORE : No update in the history list
-**	HT_EXPIRES_NOTIFY : The user is notified but no reload
-**	HT_EXPIRES_AUTO   : Automatic reload
+**  Move the body of an entry to a file of its own so that it can be shared
 */
-PUBLIC void HTCacheMode_setExpires (HTExpiresMode mode)
+PRIVATE char * body_write (HTCache * owner, CacheBody * body)
 {
-    HTExpMode = mode;
+    char * name = cache_location(body->digest, HT_CACHE_BODY, YES);
+    FILE * from;
+    FILE * to;
+    BOOL status = NO;
+    if (!name) return NULL;
+    if ((from = fopen(owner->cachename, "rb")) != NULL) {
+	CacheHeader head;
+	if (header_read(from, &head) && !head.body_file &&
+	    fseek(from, header_offset(&head), SEEK_SET) == 0 &&
+	    (to = fopen(name, "wb")) != NULL) {
+	    head.flags = 0;
+	    head.meta_len = 0;
+	    status = header_write(to, HT_CACHE_BODY_MAGIC, &head) &&
+		copy_data(from, to, body->size, NULL) == body->size;
+	    if (fclose(to) != 0) status = NO;
+	}
+	fclose(from);
+    }
+    if (!status) {
+	HTTRACE(CACHE_TRACE, "Cache....... Can't write shared body `%s\'\n" _ name);
+	REMOVE(name);
+	HT_FREE(name);
+    }
+    return name;
 }
 
-PUBLIC HTExpiresMode HTCacheMode_expires (void)
+PRIVATE int body_hash (unsigned long * digest)
 {
-    return HTExpMode;
+    return (int) (digest[0] % HT_XL_HASH_SIZE);
 }
 
-/*
-**  Cache size management. We set the default cache size to 20M.
-**  We set the minimum size to 5M in order not to get into weird
-**  problems while writing the cache. The size is indicated in Mega
-**  bytes
-*/
-PUBLIC BOOL HTCacheMode_setMaxSize (int size)
+PRIVATE CacheBody * body_find (unsigned long * digest, long size)
 {
-    long new_size = size < HT_MIN_CACHE_TOTAL_SIZE ?
-	HT_MIN_CACHE_TOTAL_SIZE*MEGA : size*MEGA;
-    long old_size = HTCacheTotalSize;
-    HTCacheTotalSize = new_size;
-    HTCacheFolderSize = HTCacheTotalSize/HT_CACHE_FOLDER_PCT;
-    HTCacheGCBuffer = HTCacheTotalSize/HT_CACHE_GC_PCT;
-    if (new_size < old_size) HTCacheGarbage();
-    HTTRACE(CACHE_TRACE, "Cache....... Total cache size: %ld with %ld bytes for metainformation and folders and at least %ld bytes free after every gc\n" _ 
-		HTCacheTotalSize _ HTCacheFolderSize _ HTCacheGCBuffer);
-    return YES;
+    if (BodyTable) {
+	HTList * cur = BodyTable[body_hash(digest)];
+	CacheBody * pres;
+	while ((pres = (CacheBody *) HTList_nextObject(cur))) {
+	    if (pres->digest[0] == digest[0] && pres->digest[1] == digest[1] &&
+		pres->size == size)
+		return pres;
+	}
+    }
+    return NULL;
 }
 
-PUBLIC int HTCacheMode_maxSize (void)
+PRIVATE CacheBody * body_new (unsigned long * digest, long size)
 {
-    return HTCacheTotalSize / MEGA;
+    CacheBody * body;
+    int hash = body_hash(digest);
+    if (!BodyTable) {
+	if ((BodyTable = (HTList **) HT_CALLOC(HT_XL_HASH_SIZE,
+					       sizeof(HTList *))) == NULL)
+	    HT_OUTOFMEM("body_new");
+    }
+    if (!BodyTable[hash]) BodyTable[hash] = HTList_new();
+    if ((body = (CacheBody *) HT_CALLOC(1, sizeof(CacheBody))) == NULL)
+	HT_OUTOFMEM("body_new");
+    body->digest[0] = digest[0];
+    body->digest[1] = digest[1];
+    body->size = size;
+    HTList_addObject(BodyTable[hash], (void *) body);
+    return body;
 }
 
 /*
-**  How big can a single cached entry be in Mbytes. The default is 3M
-**  
+**  Link an entry read from the index to its body. If the body is not shared
+**  then the entry becomes the owner unless we already know another entry
+**  with the same body.
 */
-PUBLIC BOOL HTCacheMode_setMaxCacheEntrySize (int size)
-{
-    long new_size = size*MEGA;
-    if (new_size > 0 && new_size < HTCacheTotalSize-HTCacheFolderSize) {
-	long old_size = HTCacheMaxEntrySize;
-	HTCacheMaxEntrySize = new_size;
-	if (new_size < old_size) HTCacheGarbage();
-	HTTRACE(CACHE_TRACE, "Cache...... Max entry cache size is %ld\n" _ HTCacheMaxEntrySize);
-	return YES;
+PRIVATE void body_attach (HTCache * cache, BOOL shared)
+{
+    CacheBody * body;
+    if (!cache || cache->range || cache->size <= 0 ||
+	(!cache->digest[0] && !cache->digest[1]))
+	return;
+    body = body_find(cache->digest, cache->size);
+    if (shared) {
+	if (!body) body = body_new(cache->digest, cache->size);
+	if (!body->name) {
+	    body->name = cache_location(body->digest, HT_CACHE_BODY, NO);
+	    body->owner = NULL;
+	}
+    } else if (!body) {
+	body = body_new(cache->digest, cache->size);
+	body->owner = cache;
+    } else
+	return;
+    body->refs++;
+    cache->body = body;
+}
+
+/*
+**  The entry doesn't use its body anymore. A shared body is removed from
+**  disk when the last entry using it goes away.
+*/
+PRIVATE void body_release (HTCache * cache)
+{
+    CacheBody * body = cache ? cache->body : NULL;
+    if (body) {
+	cache->body = NULL;
+	if (body->owner == cache) body->owner = NULL;
+	if (--body->refs <= 0) {
+	    if (body->name) {
+		HTTRACE(CACHE_TRACE, "Cache....... Removing shared body `%s\'\n" _
+			body->name);
+		REMOVE(body->name);
+	    }
+	    HTList_removeObject(BodyTable[body_hash(body->digest)], body);
+	    HT_FREE(body->name);
+	    HT_FREE(body);
+	}
     }
-    HTTRACE(CACHE_TRACE, "Cache...... Max entry cache size is unchanged\n");
-    return NO;
 }
 
-PUBLIC int HTCacheMode_maxCacheEntrySize (void)
+/*
+**  Forget about all bodies without touching the disk
+*/
+PRIVATE void body_clear (void)
 {
-    return HTCacheMaxEntrySize / MEGA;
+    if (BodyTable) {
+	int cnt;
+	for (cnt=0; cnt<HT_XL_HASH_SIZE; cnt++) {
+	    HTList * cur = BodyTable[cnt];
+	    CacheBody * pres;
+	    while ((pres = (CacheBody *) HTList_nextObject(cur))) {
+		HT_FREE(pres->name);
+		HT_FREE(pres);
+	    }
+	    HTList_delete(BodyTable[cnt]);
+	}
+	HT_FREE(BodyTable);
+    }
 }
 
 /*
-** Set the default expiration time. In seconds.
+**  We have written the full body of an entry. If another entry has the
+**  same body then we move it to a file of its own that both entries use
+**  and take it out of the entry files. We check that the bodies really are
+**  the same before doing so.
 */
-PUBLIC void HTCacheMode_setDefaultExpiration (const int exp_time)
-{
-    DefaultExpiration = exp_time;
+PRIVATE BOOL body_share (HTCache * cache, long size)
+{
+    CacheBody * body;
+    if (!cache || size <= 0) return NO;
+    if ((body = body_find(cache->digest, size)) == NULL) {
+	body = body_new(cache->digest, size);
+	body->owner = cache;
+	body->refs = 1;
+	cache->body = body;
+	return NO;
+    }
+    if (body->owner) {
+	HTCache * owner = body->owner;
+	if (owner == cache || HTCache_hasLock(owner) || owner->range ||
+	    !same_body(owner->cachename, cache->cachename, size) ||
+	    (body->name = body_write(owner, body)) == NULL)
+	    return NO;
+	HTTRACE(CACHE_TRACE, "Cache....... Sharing body of `%s\' in `%s\'\n" _
+		owner->url _ body->name);
+	body->owner = NULL;
+	entry_rewrite(owner, NULL, NULL);
+	journal_add('P', owner);
+    } else if (!same_body(body->name, cache->cachename, size))
+	return NO;
+    HTTRACE(CACHE_TRACE, "Cache....... `%s\' shares body `%s\'\n" _
+	    cache->url _ body->name);
+    body->refs++;
+    cache->body = body;
+    entry_rewrite(cache, NULL, NULL);
+    return YES;
 }
 
-PUBLIC int HTCacheMode_DefaultExpiration (void)
+/*
+**  The file holding the body of an entry
+*/
+PRIVATE char * body_file (HTCache * cache)
 {
-    return DefaultExpiration;
+    return (cache->body && cache->body->name) ? cache->body->name :
+	cache->cachename;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -958,6 +2121,8 @@ PUBLIC int HTCacheMode_DefaultExpiration (void)
 
 PRIVATE BOOL free_object (HTCache * me)
 {
+    memory_drop(me);
+    body_release(me);
     HT_FREE(me->url);
     HT_FREE(me->cachename);
     HT_FREE(me->etag);
@@ -969,13 +2134,18 @@ PRIVATE BOOL delete_object (HTList * list, HTCache * me)
 {
     HTTRACE(CACHE_TRACE, "Cache....... delete %p from list %p\n" _ me _ list);
     HTList_removeObject(list, (void *) me);
+    heap_remove(me);
     HTCacheContentSize -= me->size;
+    CacheEntries--;
     free_object(me);
     return YES;
 }
 
 /*
-**	Create directory path for cache file
+**	Find a file name for a new cache entry. The name is made from a hash
+**	of the URL and the file goes in a directory named after the first
+**	bytes of the hash. In the unlikely case that the name is taken, we
+**	add a number to it.
 **
 ** On exit:
 **	return YES
@@ -985,55 +2155,28 @@ PRIVATE BOOL delete_object (HTList * list, HTCache * me)
 */
 PRIVATE BOOL HTCache_createLocation (HTCache * me)
 {
-    if (me && HTCacheRoot) {
-	BOOL status = YES;
-	char * path = NULL;
+    if (me && me->url && HTCacheRoot) {
+	unsigned long digest[2];
 	struct stat stat_info;
-	if ((path = (char *) HT_MALLOC(strlen(HTCacheRoot) + 10)) == NULL)
-	    HT_OUTOFMEM("HTCache_createLocation");
-
-	/*
-	** Find the path and check whether the directory already exists or not
-	*/
-	sprintf(path, "%s%d", HTCacheRoot, me->hash);
-	if (HT_STAT(path, &stat_info) == -1) {
-	    HTTRACE(CACHE_TRACE, "Cache....... Create dir `%s\'\n" _ path);
-	    if (MKDIR(path, 0777) < 0) {
-		HTTRACE(CACHE_TRACE, "Cache....... Can't create...\n");
-		status = NO;
-	    }
-	} else {
-	    HTTRACE(CACHE_TRACE, "Cache....... Directory `%s\' already exists\n" _ path);
+	char suffix[16];
+	int cnt;
+	digest_init(digest);
+	digest_update(digest, (unsigned char *) me->url, (int) strlen(me->url));
+	*suffix = '\0';
+	for (cnt = 1; ; cnt++) {
+	    HT_FREE(me->cachename);
+	    if ((me->cachename = cache_location(digest, suffix, YES)) == NULL)
+		return NO;
+	    if (HT_STAT(me->cachename, &stat_info) == -1 ||
+		cnt >= CACHE_NAME_PROBES)
+		break;
+	    sprintf(suffix, "-%d", cnt);
 	}
-
-	/*
-	** Find a non-existent filename within the path that we just created
-	*/
-	me->cachename = HTGetTmpFileName(path);
-	HT_FREE(path);
-	return status;
-    }
-    return NO;
-}
-
-/*
-**	Find a cache filename for this cache object.
-*/
-#if 0
-PRIVATE BOOL HTCache_findName (HTCache * me)
-{
-    if (me) {
-	/*
-	** Create path for this cache entry. We base the cache location on the
-	** hash calculated as a function of the URL. That way, we ensure a 
-	** resonably uniform distribution.
-	*/
-	me->cachename = HTGetTmpFileName(NULL);
-	return HTCache_createLocation(me);
+	HTTRACE(CACHE_TRACE, "Cache....... New entry `%s\'\n" _ me->cachename);
+	return YES;
     }
     return NO;
 }
-#endif
 
 /*
 **  Calculate the corrected_initial_age of the object. We use the time
@@ -1133,9 +2276,11 @@ PRIVATE HTCache * HTCache_new (HTRequest * request, HTResponse * response,
 	pres->hash = hash;
 	pres->url = url;
 	pres->range = NO;
+	pres->anchored = YES;
 	HTCache_createLocation(pres);
 	HTList_addObject(list, (void *) pres);
-	new_entries++;
+	CacheEntries++;
+	heap_add(pres);
     } else
 	HT_FREE(url);
 
@@ -1183,6 +2328,7 @@ PUBLIC HTCache * HTCache_touch (HTRequest * request, HTResponse * response,
     if (cache) {
 	cache->size = 0;
 	cache->range = YES;
+	journal_add('P', cache);
     }
 
     return cache;
@@ -1401,13 +2547,14 @@ PRIVATE int HTCacheCheckFilter (HTRequest * request, HTResponse * response,
 		*/
 		if (status == 204) {
 		    HTCache_updateMeta(cache, request, response);
+		    memory_drop(cache);
+		    body_release(cache);
 		    cache->size = 0;
 		    cache->range = YES;
-		    /* @@ JK: update the cache meta data on disk */
-		    HTCache_writeMeta (cache, request, response);
-		    /* @@ JK: and we remove the file name as it's obsolete 
-		       now */
+		    /* @@ JK: remove the file as the body is obsolete now */
 		    REMOVE(cache->cachename);
+		    /* @@ JK: and write the cache meta data on disk again */
+		    HTCache_writeMeta (cache, request, response);
 		} else
 		    HTCache_remove(cache);
 	    } 
@@ -1435,6 +2582,13 @@ PRIVATE BOOL HTCache_setSize (HTCache * cache, long written, BOOL append)
 	if (cache->size > 0 && !append) HTCacheContentSize -= cache->size;
 	cache->size = written;
 	HTCacheContentSize += written;
+	heap_update(cache);
+
+	/*
+	**  Record the updated entry in the journal so that we don't loose it
+	**  before the index is written the next time.
+	*/
+	journal_add('P', cache);
 
 	/*
 	**  Now add the new size to the total cache size. If the new size is
@@ -1491,6 +2645,20 @@ PUBLIC HTCache * HTCache_find (HTParentAnchor * anchor, char * default_name)
 		}
 	    }
 	}
+
+	/*
+	**  Entries read from the index don't create anchors when they are
+	**  read as that makes the startup slow. The first time we find the
+	**  entry we fill in the expire information we have in the anchor.
+	*/
+	if (pres && !pres->anchored) {
+	    HTParentAnchor * parent = default_name ?
+		HTAnchor_parent(HTAnchor_findAddress(pres->url)) : anchor;
+	    HTAnchor_setExpires(parent, pres->expires);	    
+	    HTAnchor_setLastModified(parent, pres->lm);
+	    if (pres->etag) HTAnchor_setEtag(parent, pres->etag);
+	    pres->anchored = YES;
+	}
 	HT_FREE(url);
     }
     return pres;
@@ -1504,7 +2672,9 @@ PRIVATE BOOL HTCache_delete (HTCache * cache)
 {
     if (cache && CacheTable) {
 	HTList * cur = CacheTable[cache->hash];
-	return cur && delete_object(cur, cache);
+	if (!cur) return NO;
+	journal_add('D', cache);
+	return delete_object(cur, cache);
     }
     return NO;
 }
@@ -1524,37 +2694,23 @@ PUBLIC BOOL HTCache_deleteAll (void)
 	for (cnt=0; cnt<HT_XL_HASH_SIZE; cnt++) {
 	    if ((cur = CacheTable[cnt])) { 
 		HTCache * pres;
-		while ((pres = (HTCache *) HTList_nextObject(cur)) != NULL)
+		while ((pres = (HTCache *) HTList_nextObject(cur)) != NULL) {
+		    pres->body = NULL;
 		    free_object(pres);
+		}
 	    }
 	    HTList_delete(CacheTable[cnt]);
 	}
 	HT_FREE(CacheTable);
 	HTCacheContentSize = 0L;
+	CacheEntries = 0;
+	heap_clear();
+	body_clear();
 	return YES;
     }
     return NO;
 }
 
-/*
-**  Is we have a valid entry in the cache then we also need a location
-**  where we can get it. Hopefully, we may be able to access it
-**  thourgh one of our protocol modules, for example the local file
-**  module. The name returned is in URL syntax and must be freed by
-**  the caller
-*/
-PRIVATE char * HTCache_metaLocation (HTCache * cache)
-{
-    char * local = NULL;
-    if (cache && cache->cachename && *cache->cachename) {
-	if ((local = (char *) HT_MALLOC(strlen(cache->cachename) +
-					strlen(HT_CACHE_META) + 5)) == NULL)
-	    HT_OUTOFMEM("HTCache_metaLocation");
-	sprintf(local, "%s%s", cache->cachename, HT_CACHE_META);
-    }
-    return local;
-}
-
 /*
 **  Walk through the set of headers and write those out that we are allowed
 **  to store in the cache. We look into the connection header to see what the 
@@ -1564,7 +2720,7 @@ PRIVATE char * HTCache_metaLocation (HTCache * cache)
 PRIVATE BOOL meta_write (FILE * fp, HTRequest * request, HTResponse * response)
 {
     if (fp && request && response) {
-	HTAssocList * headers = HTAnchor_header(HTRequest_anchor(request));
+	HTFieldList * headers = HTAnchor_fields(HTRequest_anchor(request));
 	HTAssocList * connection = HTResponse_connection(response);
 	char * nocache = HTResponse_noCache(response);
 
@@ -1589,7 +2745,7 @@ PRIVATE BOOL meta_write (FILE * fp, HTRequest * request, HTResponse * response)
 		StrAllocCopy(line, nocache);		 /* Get our own copy */
 		ptr = line;
 		while ((field = HTNextField(&ptr)) != NULL)
-		    HTAssocList_removeObject(headers, field);
+		    HTFieldList_remove(headers, field);
 		HT_FREE(line);
 	    }
 
@@ -1600,7 +2756,7 @@ PRIVATE BOOL meta_write (FILE * fp, HTRequest * request, HTResponse * response)
 		HTAssoc * pres;
 		while ((pres=(HTAssoc *) HTAssocList_nextObject(connection))) {
 		    char * field = HTAssoc_name(pres);
-		    HTAssocList_removeObject(headers, field);
+		    HTFieldList_remove(headers, field);
 		}
 	    }
 	}
@@ -1610,10 +2766,10 @@ PRIVATE BOOL meta_write (FILE * fp, HTRequest * request, HTResponse * response)
 	**  in the index file.
 	*/
 	{
-	    HTAssocList * cur = headers;
-	    HTAssoc * pres;
-	    while ((pres = (HTAssoc *) HTAssocList_nextObject(cur))) {
-		char * name = HTAssoc_name(pres);
+	    int cnt;
+	    for (cnt = 0; cnt < HTFieldList_count(headers); cnt++) {
+		char * name = HTFieldList_name(headers, cnt);
+		char * value = HTFieldList_value(headers, cnt);
 
 		/* Don't write the headers that are already hop-by-hop */
 		if (strcasecomp(name, "connection") &&
@@ -1622,7 +2778,7 @@ PRIVATE BOOL meta_write (FILE * fp, HTRequest * request, HTResponse * response)
 		    strcasecomp(name, "proxy-authorization") &&
 		    strcasecomp(name, "transfer-encoding") &&
 		    strcasecomp(name, "upgrade")) {
-		    if (fprintf(fp, "%s: %s\n", name, HTAssoc_value(pres)) < 0) {
+		    if (fprintf(fp, "%s: %s\n", name, value ? value : "") < 0) {
 			HTTRACE(CACHE_TRACE, "Cache....... Error writing metainfo\n");
 			return NO;
 		    }
@@ -1643,58 +2799,47 @@ PRIVATE BOOL meta_write (FILE * fp, HTRequest * request, HTResponse * response)
 }
 
 /*
-**  Save the metainformation for the data object. If no headers
-**  are available then the meta file is empty
+**  Save the metainformation for the data object in the cache file, keeping
+**  the body that is already there. If no headers are available then the
+**  metainformation is empty
 */
 PUBLIC BOOL HTCache_writeMeta (HTCache * cache, HTRequest * request,
 			       HTResponse * response)
 {
     if (cache && request && response) {
-	BOOL status;
-	FILE * fp;
-	char * name = HTCache_metaLocation(cache);
-	if (!name) {
+	if (!cache->cachename) {
 	    HTTRACE(CACHE_TRACE, "Cache....... Invalid cache entry\n");
 	    HTCache_remove(cache);
 	    return NO;
 	}
-	if ((fp = fopen(name, "wb")) == NULL) {
-	    HTTRACE(CACHE_TRACE, "Cache....... Can't open `%s\' for writing\n" _ name);
+	if (!entry_rewrite(cache, request, response)) {
 	    HTCache_remove(cache);
-	    HT_FREE(name);	    
 	    return NO;
 	}
-	status = meta_write(fp, request, response);
-	fclose(fp);
-	HT_FREE(name);
-	return status;
+	if (cache->mem_meta) {
+	    HTCacheMemoryUsed -= HTChunk_size(cache->mem_meta);
+	    HTChunk_delete(cache->mem_meta);
+	    cache->mem_meta = NULL;
+	    if (!cache->mem_body) memory_unlink(cache);
+	}
+	return YES;
     }
     return NO;
 }
 
-PRIVATE BOOL meta_read (FILE * fp, HTRequest * request, HTStream * target)
+PRIVATE BOOL meta_read (HTChunk * meta, HTRequest * request, HTStream * target)
 {
-    if (fp && request && target) {
-	int status;
-	char buffer[512];
-	while (1) {
-	    if ((status = fread(buffer, 1, 512, fp)) <= 0) {
-		HTTRACE(PROT_TRACE, "Cache....... Meta information loaded\n");
-		return YES;
-	    }
-	
-	    /* Send the data down the pipe */
-	    status = (*target->isa->put_block)(target, buffer, status);
-
-	    if (status == HT_LOADED) {
-		(*target->isa->flush)(target);
-		return YES;
-	    }
-	    if (status < 0) {
-		HTTRACE(PROT_TRACE, "Cache....... Target ERROR %d\n" _ status);
-		break;
-	    }
+    if (meta && request && target) {
+	int status = HTChunk_size(meta) > 0 ?
+	    (*target->isa->put_block)(target, HTChunk_data(meta), HTChunk_size(meta)) :
+	    HT_OK;
+	if (status == HT_LOADED) (*target->isa->flush)(target);
+	if (status < 0) {
+	    HTTRACE(PROT_TRACE, "Cache....... Target ERROR %d\n" _ status);
+	    return NO;
 	}
+	HTTRACE(PROT_TRACE, "Cache....... Meta information loaded\n");
+	return YES;
     }
     return NO;
 }
@@ -1708,34 +2853,45 @@ PRIVATE BOOL HTCache_readMeta (HTCache * cache, HTRequest * request)
     HTParentAnchor * anchor = HTRequest_anchor(request);
     if (cache && request && anchor) {
 	BOOL status;
-	FILE * fp;
-	char * name = HTCache_metaLocation(cache);
-	if (!name) {
-	    HTTRACE(CACHE_TRACE, "Cache....... Invalid meta name\n" _ name);
-	    HTCache_remove(cache);
-	    return NO;
-	}
-	HTTRACE(CACHE_TRACE, "Cache....... Looking for `%s\'\n" _ name);
-	if ((fp = fopen(name, "rb")) == NULL) {
-	    HTTRACE(CACHE_TRACE, "Cache....... Can't open `%s\' for reading\n" _ name);
-	    HTCache_remove(cache);
-	    HT_FREE(name);	    
+	HTChunk * meta = cache->mem_meta;
+	BOOL in_memory = meta != NULL;
+	if (in_memory) {
+	    HTTRACE(CACHE_TRACE, "Cache....... Metainfo for `%s\' is in memory\n" _ cache->url);
+	    memory_touch(cache);
 	} else {
+	    HTTRACE(CACHE_TRACE, "Cache....... Looking for `%s\'\n" _ cache->cachename);
+	    meta = entry_read(cache->cachename, YES);
+	    if (!meta) {
+		HTTRACE(CACHE_TRACE, "Cache....... Can't read metainfo from `%s\'\n" _
+			cache->cachename);
+		HTCache_remove(cache);
+		return NO;
+	    }
+	}
+	{
 	    HTStream * target = HTStreamStack(WWW_MIME_HEAD, WWW_DEBUG,
 					      HTBlackHole(), request, NO);
 	    /*
 	    **  Make sure that we save the reponse information in the anchor
 	    */
 	    HTResponse_setCachable(HTRequest_response(request), HT_CACHE_ALL);
-	    status = meta_read(fp, request, target);
+	    status = meta_read(meta, request, target);
 	    (*target->isa->_free)(target);
 	    /* JK: Moved the delete outside of meta_read, because it was being
 	       deleted multiple times. 
 	       Delete the response headers. In principle, they are
 	       already available in the anchor */ 
 	    HTRequest_setResponse(request, NULL);
-	    fclose(fp);
-	    HT_FREE(name);
+
+	    /*
+	    **  Keep the metainformation in memory if the memory tier is on
+	    */
+	    if (!in_memory) {
+		if (status && memory_fits(HTChunk_size(meta)))
+		    memory_keep(cache, meta, YES);
+		else
+		    HTChunk_delete(meta);
+	    }
 	    return status;
 	}
     }
@@ -1753,6 +2909,7 @@ PUBLIC BOOL HTCache_updateMeta (HTCache * cache, HTRequest * request,
     if (cache && request && response) {
 	HTParentAnchor * anchor = HTRequest_anchor(request);
 	cache->hits++;
+	heap_update(cache);
 
 	/* Calculate the various times */
 	calculate_time(cache, request, response);
@@ -1767,6 +2924,7 @@ PUBLIC BOOL HTCache_updateMeta (HTCache * cache, HTRequest * request,
 	/* Must we revalidate this every time? */
 	cache->must_revalidate = HTResponse_mustRevalidate(response);
 
+	journal_add('P', cache);
 	return YES;
     }
     return NO;
@@ -1778,13 +2936,17 @@ PUBLIC BOOL HTCache_resetMeta (HTCache * cache, HTRequest * request,
   /* what a problem... we update the cache with the wrong data
      from the response... after the redirection */
   HTCache_updateMeta (cache, request, response);
+  memory_drop(cache);
+  body_release(cache);
+  HTCacheContentSize -= cache->size;
   cache->size = 0;
   cache->range = YES;
-  /* @@ JK: update the cache meta data on disk */
-  HTCache_writeMeta (cache, request, response);
-  /* @@ JK: and we remove the file name as it's obsolete 
-     now */
+  heap_update(cache);
+  journal_add('P', cache);
+  /* @@ JK: remove the file as the body is obsolete now */
   REMOVE(cache->cachename);
+  /* @@ JK: and write the cache meta data on disk again */
+  HTCache_writeMeta (cache, request, response);
 
   return YES;
 }
@@ -1796,9 +2958,7 @@ PUBLIC BOOL HTCache_resetMeta (HTCache * cache, HTRequest * request,
 PRIVATE BOOL flush_object (HTCache * cache)
 {
     if (cache && !HTCache_hasLock(cache)) {
-	char * head = HTCache_metaLocation(cache);
-	REMOVE(head);
-	HT_FREE(head);
+	memory_drop(cache);
 	REMOVE(cache->cachename);
 	return YES;
     }
@@ -1831,8 +2991,11 @@ PUBLIC BOOL HTCache_flushAll (void)
 	}
 
 	/* Write the new empty index to disk */
-	HTCacheIndex_write(HTCacheRoot);
 	HTCacheContentSize = 0L;
+	CacheEntries = 0;
+	heap_clear();
+	body_clear();
+	HTCacheIndex_write(HTCacheRoot);
 	return YES;
     }
     return NO;
@@ -1985,7 +3148,7 @@ PUBLIC BOOL HTCache_breakLock (HTCache * cache, HTRequest * request)
 PUBLIC char * HTCache_name (HTCache * cache)
 {
     if (cache) {
-	char * local = cache->cachename;
+	char * local = body_file(cache);
 	char * url = HTLocalToWWW(local, "cache:");
 	return url;
     }
@@ -2005,6 +3168,7 @@ PUBLIC BOOL HTCache_addHit (HTCache * cache)
 {
     if (cache) {
 	cache->hits++;
+	heap_update(cache);
 	HTTRACE(CACHE_TRACE, "Cache....... Hits for %p is %d\n" _ 
 				 cache _ cache->hits);
 	return YES;
@@ -2022,20 +3186,37 @@ PRIVATE BOOL free_stream (HTStream * me, BOOL abort)
 	HTCache * cache = me->cache;
 
 	/*
-	**  We close the file object. This does not mean that we have the
-	**  complete object. In case of an "abort" then we only have a part,
-	**  however, next time we do a load we can use byte ranges to complete
-	**  the request.
+	**  We fill in the header and close the file object. This does not mean
+	**  that we have the complete object. In case of an "abort" then we only
+	**  have a part, however, next time we do a load we can use byte ranges
+	**  to complete the request.
 	*/
-	if (me->fp) fclose(me->fp);
+	if (me->fp) {
+	    if (!me->append) {
+		CacheHeader head;
+		memset(&head, 0, sizeof(CacheHeader));
+		head.meta_len = me->meta_len;
+		head.body_len = me->bytes_written;
+		head.digest[0] = me->digest[0];
+		head.digest[1] = me->digest[1];
+		header_write(me->fp, HT_CACHE_ENTRY_MAGIC, &head);
+	    }
+	    fclose(me->fp);
+	}
 
 	/*
 	**  We are done storing the object body and can update the cache entry.
-	**  Also update the meta information entry on disk as well. When we
-	**  are done we don't need the lock anymore.
+	**  When appending, we also update the meta information on disk as the
+	**  file got it before we had the new response. When we are done we
+	**  don't need the lock anymore.
 	*/
 	if (cache) {
-	    HTCache_writeMeta(cache, me->request, me->response);
+	    if (me->append)
+		HTCache_writeMeta(cache, me->request, me->response);
+	    else {
+		cache->digest[0] = me->digest[0];
+		cache->digest[1] = me->digest[1];
+	    }
 	    HTCache_releaseLock(cache);
 
 	    /*
@@ -2044,6 +3225,12 @@ PRIVATE BOOL free_stream (HTStream * me, BOOL abort)
 	    */
 	    cache->range = abort;
 
+	    /*
+	    **  If we have the full body then see if another entry has the
+	    **  same so that they can share it
+	    */
+	    if (!abort && !me->append) body_share(cache, me->bytes_written);
+
 	    /*
 	    **  Set the size and maybe do gc. If it is an abort then set the
 	    **  byte range so that we can start from this point next time. We
@@ -2052,15 +3239,6 @@ PRIVATE BOOL free_stream (HTStream * me, BOOL abort)
 	    */
 	    HTCache_setSize(cache, me->bytes_written, me->append);
 	}
-
-	/*
-	**  In order not to loose information, we dump the current cache index
-	**  every time we have created DUMP_FREQUENCY new entries
-	*/
-	if (new_entries > DUMP_FREQUENCY) {
-	    HTCacheIndex_write(HTCacheRoot);
-	    new_entries = 0;
-	}
 	HT_FREE(me);
 	return YES;
     }
@@ -2088,8 +3266,9 @@ PRIVATE int HTCache_flush (HTStream * me)
 PRIVATE int HTCache_putBlock (HTStream * me, const char * s, int  l)
 {
     int status = (fwrite(s, 1, l, me->fp) != l) ? HT_ERROR : HT_OK;
-    if (l > 1 && status == HT_OK) {
-	HTCache_flush(me);
+    if (status == HT_OK) {
+	if (l > 1) HTCache_flush(me);
+	if (!me->append) digest_update(me->digest, (unsigned char *) s, l);
 	me->bytes_written += l;
     }
     return status;
@@ -2158,18 +3337,31 @@ PRIVATE HTStream * HTCacheStream (HTRequest * request, BOOL append)
 	}
     }
     HTCache_getLock(cache, request);
+    memory_drop(cache);
+    body_release(cache);
 
     /*
     ** Test that we can actually write to the cache file. If the entry already
-    ** existed then it will be overridden with the new data.
+    ** existed then it will be overridden with the new data. We can only
+    ** append to a file which has the header already.
     */
-    if ((fp = fopen(cache->cachename, append ? "ab" : "wb")) == NULL) {
+    if (!cache->cachename ||
+	(fp = fopen(cache->cachename, append ? "r+b" : "wb")) == NULL) {
 	HTTRACE(CACHE_TRACE, "Cache....... Can't open `%s\' for writing\n" _ cache->cachename);
 	HTCache_delete(cache);
 	return NULL;
+    } else if (append) {
+	CacheHeader head;
+	if (!header_read(fp, &head) || head.body_file ||
+	    fseek(fp, 0, SEEK_END) != 0) {
+	    HTTRACE(CACHE_TRACE, "Cache....... Can't append to `%s\'\n" _ cache->cachename);
+	    fclose(fp);
+	    HTCache_delete(cache);
+	    return NULL;
+	}
+	HTTRACE(CACHE_TRACE, "Cache....... Append to file `%s\'\n" _ cache->cachename);
     } else {
-	HTTRACE(CACHE_TRACE, "Cache....... %s file `%s\'\n" _ 
-		    append ? "Append to" : "Creating" _ cache->cachename);
+	HTTRACE(CACHE_TRACE, "Cache....... Creating file `%s\'\n" _ cache->cachename);
     }
 
     /* Set up the stream */
@@ -2183,6 +3375,19 @@ PRIVATE HTStream * HTCacheStream (HTRequest * request, BOOL append)
 	me->cache = cache;
 	me->fp = fp;
 	me->append = append;
+
+	/*
+	**  A new file starts with a header which we fill in when we are done
+	**  and the metainformation that we have got so far
+	*/
+	if (!append) {
+	    CacheHeader head;
+	    memset(&head, 0, sizeof(CacheHeader));
+	    header_write(fp, HT_CACHE_ENTRY_MAGIC, &head);
+	    meta_write(fp, request, response);
+	    me->meta_len = ftell(fp) - CACHE_HEADER_SIZE;
+	    digest_init(me->digest);
+	}
 	return me;
     }
     return NULL;
@@ -2288,6 +3493,21 @@ PRIVATE int CacheCleanup (HTRequest * req, int status)
 */
 PRIVATE int CacheEvent (SOCKET soc, void * pVoid, HTEventType type);
 
+/*
+**  Find the cache entry for the file we are about to load so that we can
+**  see if it is in the memory tier.
+*/
+PRIVATE HTCache * memory_entry (HTRequest * request, const char * local)
+{
+    if (local && (HTCacheMemorySize > 0 || MemoryHead)) {
+	HTCache * entry = HTCache_find(HTRequest_anchor(request),
+				       HTRequest_defaultPutName(request));
+	if (entry && entry->cachename && !strcmp(body_file(entry), local))
+	    return entry;
+    }
+    return NULL;
+}
+
 PUBLIC int HTLoadCache (SOCKET soc, HTRequest * request)
 {
     cache_info * cache;			      /* Specific access information */
@@ -2322,6 +3542,7 @@ PRIVATE int ReturnEvent (HTTimer * timer, void * param, HTEventType type)
     /*
     **  Delete the timer
     */
+    HTTimer_delete(timer);
     cache->timer = NULL;
 
     /*
@@ -2337,6 +3558,7 @@ PRIVATE int CacheEvent (SOCKET soc, void * pVoid, HTEventType type)
     HTNet * net = cache->net;
     HTRequest * request = HTNet_request(net);
     HTParentAnchor * anchor = HTRequest_anchor(request);
+    HTCache * entry = NULL;
 
     if (type == HTEvent_BEGIN) {
 	cache->state = CL_BEGIN;
@@ -2364,6 +3586,7 @@ PRIVATE int CacheEvent (SOCKET soc, void * pVoid, HTEventType type)
 		cache->state = CL_ERROR;
 		break;
 	    }
+	    HT_FREE(cache->local);
 	    cache->local = HTWWWToLocal(HTAnchor_physical(anchor), "",
 					HTRequest_userProfile(request));
 	    if (!cache->local) {
@@ -2371,6 +3594,15 @@ PRIVATE int CacheEvent (SOCKET soc, void * pVoid, HTEventType type)
 		break;
 	    }
 
+	    /*
+	    **  If the entry is in memory then we need neither a file nor a host
+	    */
+	    entry = memory_entry(request, cache->local);
+	    if (entry && entry->mem_body) {
+		cache->state = CL_NEED_MEMORY;
+		break;
+	    }
+
 	    /*
 	    **  Create a new host object and link it to the net object
 	    */
@@ -2387,6 +3619,11 @@ PRIVATE int CacheEvent (SOCKET soc, void * pVoid, HTEventType type)
 	    break;
 
 	case CL_NEED_BODY:
+	    /*
+	    **  Find where the body starts in the file. This may lead us to
+	    **  another file if the body is shared.
+	    */
+	    cache->offset = body_offset(&cache->local);
 	    if (HT_STAT(cache->local, &cache->stat_info) == -1) {
 		HTTRACE(PROT_TRACE, "Load Cache.. Not found `%s\'\n" _ cache->local);
 		HTRequest_addError(request, ERR_FATAL, NO, HTERR_NOT_FOUND,
@@ -2398,17 +3635,92 @@ PRIVATE int CacheEvent (SOCKET soc, void * pVoid, HTEventType type)
 	    /*
 	    **  The cache entry may be empty in which case we just return
 	    */
-	    if (!cache->stat_info.st_size) {
+	    if (cache->stat_info.st_size <= cache->offset) {
 		HTRequest_addError(request, ERR_FATAL, NO,HTERR_NO_CONTENT,
 				   NULL, 0, "HTLoadCache");
 		cache->state = CL_NO_DATA;
-	    } else
-		cache->state = CL_NEED_OPEN_FILE;
+		break;
+	    }
+
+	    /*
+	    **  If the entry is small then keep a copy in memory for the next
+	    **  time. This time we read it from the file as usual.
+	    */
+	    entry = memory_entry(request, cache->local);
+	    if (entry && !entry->range && !HTCache_hasLock(entry) &&
+		entry->size == cache->stat_info.st_size - cache->offset &&
+		memory_fits(entry->size)) {
+		HTChunk * body = entry_read(cache->local, NO);
+		if (body && HTChunk_size(body) == entry->size)
+		    memory_keep(entry, body, NO);
+		else
+		    HTChunk_delete(body);
+	    }
+	    cache->state = CL_NEED_OPEN_FILE;
+	    break;
+
+	case CL_NEED_MEMORY:
+	    /*
+	    **  Like when reading the file, we return once if we are not
+	    **  preemptive so that the cache acts like any other protocol
+	    */
+	    if (!cache->returned && HTEvent_isCallbacksRegistered() &&
+		!HTRequest_preemptive(request)) {
+		cache->returned = YES;
+		if (!cache->timer) {
+		    HTTRACE(PROT_TRACE, "HTLoadCache. Returning\n");
+		    cache->timer = HTTimer_new(NULL, ReturnEvent, cache, 1, YES, NO);
+		}
+		return HT_OK;
+	    }
+	    entry = memory_entry(request, cache->local);
+	    if (!entry || !entry->mem_body) {
+		HTTRACE(PROT_TRACE, "Load Cache.. `%s\' is no longer in memory\n" _ cache->local);
+		cache->state = CL_BEGIN;
+		break;
+	    }
+	    {
+		HTStream * rstream = HTStreamStack(HTAnchor_format(anchor),
+						   HTRequest_outputFormat(request),
+						   HTRequest_outputStream(request),
+						   request, YES);
+		HTRequest_setOutputConnected(request, YES);
+		HTRequest_addError(request, ERR_INFO, NO, HTERR_OK,
+				   NULL, 0, "HTLoadCache");
+		HTTRACE(PROT_TRACE, "Load Cache.. Serving %d bytes of `%s\' from memory\n" _
+			HTChunk_size(entry->mem_body) _ cache->local);
+		HTCacheMemoryHits++;
+		memory_touch(entry);
+		status = (*rstream->isa->put_block)(rstream,
+						    HTChunk_data(entry->mem_body),
+						    HTChunk_size(entry->mem_body));
+		if (status < 0 && status != HT_WOULD_BLOCK) {
+		    (*rstream->isa->abort)(rstream, NULL);
+		    HTRequest_addError(request, ERR_INFO, NO, HTERR_FORBIDDEN,
+				       NULL, 0, "HTLoadCache");
+		    cache->state = CL_ERROR;
+		} else {
+		    (*rstream->isa->_free)(rstream);
+		    cache->state = CL_GOT_DATA;
+		}
+	    }
 	    break;
 
 	case CL_NEED_OPEN_FILE:
 	    status = HTFileOpen(net, cache->local, HT_FB_RDONLY);
 	    if (status == HT_OK) {
+		/*
+		**  Skip the header and the metainformation
+		*/
+		if (cache->offset > 0) {
+		    HTChannel * ch = HTHost_channel(HTNet_host(net));
+#ifdef NO_UNIX_IO
+		    fseek(HTChannel_file(ch), cache->offset, SEEK_SET);
+#else
+		    lseek(HTChannel_socket(ch), cache->offset, SEEK_SET);
+#endif
+		}
+
 		/*
 		** Create the stream pipe FROM the channel to the application.
 		** The target for the input stream pipe is set up using the
@@ -22,6 +22,7 @@ struct _HTChunk {
     int		growby;		/* Allocation unit in bytes	*/
     int		allocated;	/* Current size of *data	*/
     char *	data;		/* Pointer to malloced area or 0 */
+    HTArena *	arena;		/* If the chunk lives in an arena */
 };	
 
 /* --------------------------------------------------------------------------*/
@@ -38,17 +39,71 @@ PUBLIC HTChunk * HTChunk_new (int grow)
     return ch;
 }
 
+PUBLIC HTChunk * HTChunk_newArena (HTArena * arena, int grow)
+{
+    HTChunk * ch;
+    if (!arena) return HTChunk_new(grow);
+    ch = (HTChunk *) HTArena_newObject(arena, sizeof(HTChunk));
+    ch->growby = grow;
+    ch->arena = arena;
+    return ch;
+}
+
+/*
+**	The data of a chunk in an arena can't be handed over to the caller
+*/
+PRIVATE char * copy_data (HTChunk * ch)
+{
+    char * data = NULL;
+    if (ch->data) {
+	if ((data = (char *) HT_MALLOC(ch->size+1)) == NULL)
+	    HT_OUTOFMEM("HTChunk copy_data");
+	memcpy(data, ch->data, ch->size+1);
+    }
+    return data;
+}
+
+
+/*
+**	Make room for at least needed bytes plus the terminating '\0'. The
+**	chunk grows by half its size, at least by growby bytes, so that
+**	adding n bytes costs O(n) in copying. We don't double it as that
+**	leaves big chunks with a lot of unused memory, which made realloc()
+**	move them to fresh memory more often. The new memory is not cleared;
+**	instead we always put a '\0' after the last byte in the chunk.
+*/
+PRIVATE void grow (HTChunk * ch, int needed)
+{
+    int size = ch->allocated + (ch->allocated/2 > ch->growby ?
+				ch->allocated/2 : ch->growby);
+    if (size <= needed) size = needed - needed%ch->growby + ch->growby;
+    if (ch->arena) {
+	char * data = (char *) HTArena_malloc(ch->arena, size);
+	if (ch->data)
+	    memcpy(data, ch->data, ch->allocated);
+	else
+	    *data = '\0';
+	ch->data = data;
+    } else if (ch->data) {
+	if ((ch->data = (char *) HT_REALLOC(ch->data, size)) == NULL)
+	    HT_OUTOFMEM("HTChunk grow");
+    } else {
+	if ((ch->data = (char *) HT_MALLOC(size)) == NULL)
+	    HT_OUTOFMEM("HTChunk grow");
+	*ch->data = '\0';
+    }
+    ch->allocated = size;
+}
 
 /*	Clear a chunk of all data
 **	--------------------------
-**	Zero the space but do NOT HT_FREE it. We zero because we promise to have
-**	a NUL terminated string at all times.
+**	Keep the space but do NOT HT_FREE it.
 */
 PUBLIC void HTChunk_clear (HTChunk * ch)
 {
     if (ch) {
 	ch->size = 0;
-	if (ch->data) memset((void *) ch->data, '\0', ch->allocated);
+	if (ch->data) *ch->data = '\0';
     }
 }
 
@@ -59,8 +114,12 @@ PUBLIC void HTChunk_clear (HTChunk * ch)
 PUBLIC void HTChunk_delete (HTChunk * ch)
 {
     if (ch) {
-	HT_FREE(ch->data);
-    	HT_FREE(ch);
+	if (ch->arena)
+	    HTArena_deleteObject(ch->arena, ch);
+	else {
+	    HT_FREE(ch->data);
+	    HT_FREE(ch);
+	}
     }
 }
 
@@ -77,7 +136,7 @@ PUBLIC int HTChunk_size (HTChunk * ch)
 PUBLIC BOOL HTChunk_truncate (HTChunk * ch, int length)
 {
     if (ch && length >= 0 && length < ch->size) {
-	memset(ch->data+length, '\0', ch->size-length);
+	*(ch->data+length) = '\0';
 	ch->size = length;
 	return YES;
     }
@@ -87,16 +146,16 @@ PUBLIC BOOL HTChunk_truncate (HTChunk * ch, int length)
 /*      Set the "size" of the Chunk's data
 **      -----------------------------------
 ** The actual allocated length must  be at least 1 byte longer to hold the
-** mandatory null terminator. 
+** mandatory null terminator. If the chunk is extended then the new bytes
+** are whatever the caller has put there, for example after
+** HTChunk_reserve().
 */
 PUBLIC BOOL HTChunk_setSize (HTChunk * ch, int length)
 {
     if (ch && length >= 0) {
-	if (length < ch->size)
-	    memset(ch->data+length, '\0', ch->size-length);
-	else if (length >= ch->allocated)
-	    HTChunk_ensure(ch, length - ch->size);
+	if (length >= ch->allocated) grow(ch, length);
 	ch->size = length;
+	*(ch->data+length) = '\0';
 	return YES;
     }
     return NO;
@@ -140,8 +199,30 @@ PUBLIC char * HTChunk_toCString (HTChunk * ch)
 {
     char * ret = 0;
     if (ch) {
-	ret = ch->data;
-    	HT_FREE(ch);
+	if (ch->arena) {
+	    ret = copy_data(ch);
+	    HTArena_deleteObject(ch->arena, ch);
+	} else {
+	    ret = ch->data;
+	    HT_FREE(ch);
+	}
+    }
+    return ret;
+}
+
+/*	Free the data but keep the chunk
+**	--------------------------------
+**	The caller gets the data, which must be freed using HT_FREE, and the
+**	chunk starts all over again.
+*/
+PUBLIC char * HTChunk_steal (HTChunk * ch)
+{
+    char * ret = NULL;
+    if (ch) {
+	ret = ch->arena ? copy_data(ch) : ch->data;
+	ch->data = NULL;
+	ch->size = 0;
+	ch->allocated = 0;
     }
     return ret;
 }
@@ -152,18 +233,11 @@ PUBLIC char * HTChunk_toCString (HTChunk * ch)
 PUBLIC void HTChunk_putc (HTChunk * ch, char c)
 {
     if (ch) {	
-	if (!ch->data || ch->size >= ch->allocated-1) { /* [SIC] bobr */
-	    if (ch->data) {
-		if ((ch->data = (char  *) HT_REALLOC(ch->data,ch->allocated+ch->growby)) == NULL)
-		    HT_OUTOFMEM("HTChunk_putc");
-		memset((void *) (ch->data + ch->allocated), '\0', ch->growby);
-	    } else {
-		if ((ch->data = (char  *) HT_CALLOC(1, ch->allocated+ch->growby)) == NULL)
-		    HT_OUTOFMEM("HTChunk_putc");
-	    }
-	    ch->allocated += ch->growby;
-	}
-	*(ch->data+ch->size++) = c;
+	char * ptr;
+	if (ch->size >= ch->allocated-1) grow(ch, ch->size+1);
+	ptr = ch->data + ch->size++;
+	*ptr++ = c;
+	*ptr = '\0';
     }
 }
 
@@ -183,19 +257,10 @@ PUBLIC void HTChunk_putb (HTChunk * ch, const char * block, int len)
 {
     if (ch && block && len) {
 	int needed = ch->size+len;
-	if (needed >= ch->allocated) {
-	    ch->allocated = needed - needed%ch->growby + ch->growby;
-	    if (ch->data) {
-		if ((ch->data = (char *) HT_REALLOC(ch->data, ch->allocated)) == NULL)
-		    HT_OUTOFMEM("HTChunk_putb");
-	        memset((void *) (ch->data + needed), '\0', ch->allocated-needed);
-	    } else {
-		if ((ch->data = (char *) HT_CALLOC(1, ch->allocated)) == NULL)
-		    HT_OUTOFMEM("HTChunk_putb");
-	    }
-	}
+	if (needed >= ch->allocated) grow(ch, needed);
 	memcpy((void *) (ch->data+ch->size), block, len);
 	ch->size = needed;
+	*(ch->data+needed) = '\0';
     }
 }
 
@@ -211,24 +276,21 @@ PUBLIC void HTChunk_ensure (HTChunk * ch, int len)
 {
     if (ch && len > 0) {
 	int needed = ch->size+len;
-	if (needed >= ch->allocated) {
-	    ch->allocated = needed - needed%ch->growby + ch->growby;
-	    if (ch->data) {
-		if ((ch->data = (char  *) HT_REALLOC(ch->data, ch->allocated)) == NULL)
-		    HT_OUTOFMEM("HTChunk_ensure");
-	        memset((void *) (ch->data + ch->size), '\0', ch->allocated-ch->size);
-	    } else {
-		if ((ch->data = (char  *) HT_CALLOC(1, ch->allocated)) == NULL)
-		    HT_OUTOFMEM("HTChunk_ensure");
-	    }
-	}
+	if (needed >= ch->allocated) grow(ch, needed);
+    }
+}
+
+/*	Reserve space at the end of the chunk
+**	-------------------------------------
+**	Returns a pointer to at least len free bytes after the data in the
+**	chunk. Set the new size with HTChunk_setSize() when they are filled.
+*/
+PUBLIC char * HTChunk_reserve (HTChunk * ch, int len)
+{
+    if (ch && len >= 0) {
+	int needed = ch->size+len;
+	if (needed >= ch->allocated) grow(ch, needed);
+	return ch->data+ch->size;
     }
-#if 0
-    if (needed <= ch->allocated) return;
-    ch->allocated = needed-1 - ((needed-1) % ch->growby)
-    			     + ch->growby; /* Round up */
-    ch->data = ch->data ? (char *)realloc(ch->data, ch->allocated)
-			: (char *)HT_MALLOC(ch->allocated);
-    if (ch->data == NULL) HT_OUTOFMEM(__FILE__, "HTChunk_ensure");
-#endif
+    return NULL;
 }
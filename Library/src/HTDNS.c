@@ -21,6 +21,7 @@
 #include "HTAlert.h"
 #include "HTError.h"
 #include "HTTrans.h"
+#include "HTNetMan.h"
 #include "HTHstMan.h"
 #include "HTDNS.h"					 /* Implemented here */
 
@@ -29,6 +30,12 @@
 #endif
 
 #define DNS_TIMEOUT		1800L	     /* Default DNS timeout is 30 mn */
+#define DNS_THREADS		4	   /* Default number of resolver threads */
+
+#if defined(HAVE_LIBPTHREAD) && defined(HAVE_PTHREAD_H) && \
+    defined(HAVE_GETADDRINFO) && !defined(_WINSOCKAPI_)
+#define HT_ASYNC_DNS
+#endif
 
 /* Type definitions and global variables etc. local to this module */
 struct _HTdns {
@@ -37,11 +44,17 @@ struct _HTdns {
     int			addrlength;	       /* Length of address in bytes */
     int			homes;	       /* Number of IP addresses on the host */
     char **		addrlist;      /* List of addresses from name server */
+    int *		family;		   /* Address family of each address */
     double *		weight;			   /* Weight on each address */
 };
 
-PRIVATE HTList	**CacheTable = NULL;
+PRIVATE HTHashtable * CacheTable = NULL;	 /* Lists of entries by host */
 PRIVATE time_t	DNSTimeout = DNS_TIMEOUT;	   /* Timeout on DNS entries */
+PRIVATE int	DNSThreads = DNS_THREADS;	/* Max concurrent lookups */
+#ifdef HT_ASYNC_DNS
+PRIVATE BOOL	DNSAsync = YES;			   /* Use resolver threads */
+PRIVATE void	Resolver_terminate (void);
+#endif
 
 /* ------------------------------------------------------------------------- */
 
@@ -52,19 +65,50 @@ PRIVATE void free_object (HTdns * me)
 	if (*me->addrlist)
 	    HT_FREE(*me->addrlist);
 	HT_FREE(me->addrlist);
+	HT_FREE(me->family);
 	HT_FREE(me->weight);
 	HT_FREE(me);
     }
 }
 
+/*
+**  Delete a cache entry. The list is removed from the cache table and
+**  freed when the last entry goes so that we don't keep a list for
+**  every host name we have ever seen.
+*/
 PRIVATE BOOL delete_object (HTList * list, HTdns * me)
 {
     HTTRACE(PROT_TRACE, "DNS Delete.. object %p from list %p\n" _ me _ list);
     HTList_removeObject(list, (void *) me);
+    if (HTList_isEmpty(list)) {
+	HTHashtable_removeObject(CacheTable, me->hostname);
+	HTList_delete(list);
+    }
     free_object(me);
     return YES;
 }
 
+/*
+**  Find the cache list for a host name. The name must not contain a port.
+**  The list is created when we have something to add to it.
+*/
+PRIVATE HTList * cache_find (const char * hostname)
+{
+    return CacheTable ? (HTList *) HTHashtable_object(CacheTable, hostname) :
+	NULL;
+}
+
+PRIVATE HTList * cache_list (const char * hostname)
+{
+    HTList * list;
+    if (!CacheTable) CacheTable = HTHashtable_new(HT_M_HASH_SIZE);
+    if ((list = (HTList *) HTHashtable_object(CacheTable, hostname)) == NULL) {
+	list = HTList_new();
+	HTHashtable_addObject(CacheTable, hostname, list);
+    }
+    return list;
+}
+
 /*	HTDNS_setTimeout
 **	----------------
 **	Set the cache timeout for DNS entries. Default is DNS_TIMEOUT
@@ -114,8 +158,10 @@ PUBLIC HTdns * HTDNS_add (HTList * list, struct hostent * element,
     }
     me->homes = cnt;
     *homes = cnt;
-    if ((me->weight = (double *) HT_CALLOC(me->homes, sizeof(double))) == NULL)
+    if ((me->weight = (double *) HT_CALLOC(me->homes, sizeof(double))) == NULL ||
+	(me->family = (int *) HT_CALLOC(me->homes, sizeof(int))) == NULL)
         HT_OUTOFMEM("HTDNS_add");
+    while (cnt > 0) me->family[--cnt] = element->h_addrtype;
     me->addrlength = element->h_length;
     HTTRACE(PROT_TRACE, "DNS Add..... `%s\' with %d home(s) to %p\n" _ 
 		host _ *homes _ list);
@@ -123,6 +169,170 @@ PUBLIC HTdns * HTDNS_add (HTList * list, struct hostent * element,
     return me;
 }
 
+#ifdef HAVE_GETADDRINFO
+/*
+**  The hints we give getaddrinfo(). We only ask for IPv6 addresses if the
+**  host has an IPv6 address configured itself.
+*/
+PRIVATE void addrinfo_hints (struct addrinfo * hints)
+{
+    memset(hints, 0, sizeof(struct addrinfo));
+#ifdef HT_IPV6
+    hints->ai_family = AF_UNSPEC;
+#else
+    hints->ai_family = AF_INET;
+#endif
+    hints->ai_socktype = SOCK_STREAM;
+#ifdef AI_ADDRCONFIG
+    hints->ai_flags = AI_ADDRCONFIG;
+#endif
+}
+
+/*
+**  Add the result of getaddrinfo() to the cache. The addresses are kept
+**  in the order given by the resolver but alternating between the
+**  address families so that if one family doesn't work then the next
+**  home tried is from the other family. Returns NULL if there are no
+**  addresses we can use.
+*/
+PRIVATE HTdns * add_addrinfo (struct addrinfo * result, char * host,
+			      int * homes)
+{
+    HTList * list;
+    HTdns * me;
+    struct addrinfo * ai;
+    struct addrinfo ** v4;
+    struct addrinfo ** v6;
+    int n4 = 0, n6 = 0, i4 = 0, i6 = 0;
+    int slot = sizeof(struct in_addr);
+    char * addr = NULL;
+    int cnt = 0;
+    for (ai = result; ai; ai = ai->ai_next) {
+	if (ai->ai_family == AF_INET) n4++;
+#ifdef HT_IPV6
+	if (ai->ai_family == AF_INET6) n6++;
+#endif
+    }
+    if (!n4 && !n6) return NULL;
+    list = cache_list(host);
+#ifdef HT_IPV6
+    if (n6) slot = sizeof(struct in6_addr);
+#endif
+    if ((v4 = (struct addrinfo **) HT_CALLOC(n4+n6, sizeof(struct addrinfo *))) == NULL)
+	HT_OUTOFMEM("HTDNS_add");
+    v6 = v4 + n4;
+    for (ai = result; ai; ai = ai->ai_next) {
+	if (ai->ai_family == AF_INET) v4[i4++] = ai;
+#ifdef HT_IPV6
+	if (ai->ai_family == AF_INET6) v6[i6++] = ai;
+#endif
+    }
+    if ((me = (HTdns *) HT_CALLOC(1, sizeof(HTdns))) == NULL ||
+	(me->addrlist = (char **) HT_CALLOC(n4+n6+1, sizeof(char *))) == NULL ||
+	(addr = (char *) HT_CALLOC(n4+n6, slot)) == NULL ||
+	(me->family = (int *) HT_CALLOC(n4+n6, sizeof(int))) == NULL ||
+	(me->weight = (double *) HT_CALLOC(n4+n6, sizeof(double))) == NULL)
+	HT_OUTOFMEM("HTDNS_add");
+    StrAllocCopy(me->hostname, host);
+    me->ntime = time(NULL);
+    me->addrlength = slot;
+
+    /* Start with the family the resolver prefers and then alternate */
+    i4 = i6 = 0;
+    while (i4 < n4 || i6 < n6) {
+	*(me->addrlist+cnt) = addr + cnt*slot;
+#ifdef HT_IPV6
+	if (i6 < n6 && (i4 >= n4 ||
+			(cnt % 2 == 0) == (result->ai_family == AF_INET6))) {
+	    memcpy(*(me->addrlist+cnt),
+		   &((struct sockaddr_in6 *) v6[i6++]->ai_addr)->sin6_addr,
+		   sizeof(struct in6_addr));
+	    me->family[cnt++] = AF_INET6;
+	    continue;
+	}
+#endif
+	memcpy(*(me->addrlist+cnt),
+	       &((struct sockaddr_in *) v4[i4++]->ai_addr)->sin_addr,
+	       sizeof(struct in_addr));
+	me->family[cnt++] = AF_INET;
+    }
+    HT_FREE(v4);
+    me->homes = cnt;
+    *homes = cnt;
+    HTTRACE(PROT_TRACE, "DNS Add..... `%s' with %d IPv4 and %d IPv6 home(s) to %p\n" _ 
+		host _ n4 _ n6 _ list);
+    HTList_addObject(list, (void *) me);
+    return me;
+}
+
+/*
+**  Tell the request why a getaddrinfo() lookup failed. Only EAI_SYSTEM
+**  leaves the reason in errno, the other codes have their own messages.
+**  A status of 0 means that we got no addresses we can use.
+*/
+PRIVATE void addrinfo_error (HTRequest * request, int status, int error)
+{
+    const char * msg;
+#ifdef EAI_SYSTEM
+    if (status == EAI_SYSTEM) {
+	HTRequest_addSystemError(request, ERR_FATAL, error, NO, "getaddrinfo");
+	return;
+    }
+#endif
+    msg = status ? gai_strerror(status) : "no addresses";
+    HTRequest_addError(request, ERR_FATAL, NO, HTERR_NO_REMOTE_HOST,
+		       (void *) msg, (int) strlen(msg), "getaddrinfo");
+}
+#endif /* HAVE_GETADDRINFO */
+
+/*	HTDNS_sockAddr
+**	--------------
+**	Put the address of a home into a socket address. The port number
+**	already in the socket address is kept.
+*/
+PUBLIC BOOL HTDNS_sockAddr (HTdns * dns, int home, SockAddr * addr)
+{
+    if (dns && addr && home >= 0 && home < dns->homes) {
+	u_short port = addr->in.sin_port;
+#ifdef HT_IPV6
+	if (dns->family[home] == AF_INET6) {
+	    memset((void *) &addr->in6, '\0', sizeof(addr->in6));
+	    addr->in6.sin6_family = AF_INET6;
+	    addr->in6.sin6_port = port;
+	    memcpy((void *) &addr->in6.sin6_addr, *(dns->addrlist+home),
+		   sizeof(struct in6_addr));
+	    return YES;
+	}
+#endif
+	memset((void *) &addr->in, '\0', sizeof(addr->in));
+	addr->in.sin_family = AF_INET;
+	addr->in.sin_port = port;
+	memcpy((void *) &addr->in.sin_addr, *(dns->addrlist+home),
+	       sizeof(struct in_addr));
+	return YES;
+    }
+    return NO;
+}
+
+/*	HTDNS_raceHome
+**	--------------
+**	Find the best home with another address family than the one given.
+**	Returns -1 if all homes have the same address family
+*/
+PUBLIC int HTDNS_raceHome (HTdns * dns, int home)
+{
+    int best = -1;
+    if (dns && home >= 0 && home < dns->homes) {
+	int cnt;
+	for (cnt=0; cnt<dns->homes; cnt++) {
+	    if (dns->family[cnt] != dns->family[home] &&
+		(best < 0 || *(dns->weight+cnt) < *(dns->weight+best)))
+		best = cnt;
+	}
+    }
+    return best;
+}
+
 
 /*	HTDNS_updateWeights
 **	-------------------
@@ -172,16 +382,13 @@ PUBLIC BOOL HTDNS_updateWeigths(HTdns *dns, int current, ms_t deltatime)
 PUBLIC BOOL HTDNS_delete (const char * host)
 {
     HTList *list;
-    int hash = 0;
-    const char *ptr;
     if (!host || !CacheTable) return NO;
-    for(ptr=host; *ptr; ptr++)
-	hash = (int) ((hash * 3 + (*(unsigned char *) ptr)) % HT_M_HASH_SIZE);
-    if ((list = CacheTable[hash])) {	 /* We have the list, find the entry */
+    if ((list = (HTList *) HTHashtable_object(CacheTable, host))) {
+	HTList *cur = list;		 /* We have the list, find the entry */
 	HTdns *pres;
-	while ((pres = (HTdns *) HTList_nextObject(list))) {
+	while ((pres = (HTdns *) HTList_nextObject(cur))) {
 	    if (!strcmp(pres->hostname, host)) {
-		delete_object(CacheTable[hash], pres);
+		delete_object(list, pres);
 		break;
 	    }
 	}
@@ -195,19 +402,23 @@ PUBLIC BOOL HTDNS_delete (const char * host)
 */
 PUBLIC BOOL HTDNS_deleteAll (void)
 {
-    int cnt;
-    HTList *cur;
+    HTArray * lists;
+    HTList ** list;
+#ifdef HT_ASYNC_DNS
+    Resolver_terminate();
+#endif
     if (!CacheTable) return NO;
-    for (cnt=0; cnt<HT_M_HASH_SIZE; cnt++) {
-	if ((cur = CacheTable[cnt])) { 
-	    HTdns *pres;
-	    while ((pres = (HTdns *) HTList_nextObject(cur)) != NULL)
-		free_object(pres);
-	}
-	HTList_delete(CacheTable[cnt]);
-	CacheTable[cnt] = NULL;
+    lists = HTHashtable_values(CacheTable);
+    for (list = (HTList **) HTArray_data(lists); list && *list; list++) {
+	HTList *cur = *list;
+	HTdns *pres;
+	while ((pres = (HTdns *) HTList_nextObject(cur)) != NULL)
+	    free_object(pres);
+	HTList_delete(*list);
     }
-    HT_FREE(CacheTable);
+    HTArray_delete(lists);
+    HTHashtable_delete(CacheTable);
+    CacheTable = NULL;
     return YES;
 }
 
@@ -279,6 +490,347 @@ PUBLIC int HTACEfromUTF8 (char *hostUTF8, char *punycode, size_t punyLength)
 }
 #endif
 
+/* ------------------------------------------------------------------------- */
+/*			   ASYNCHRONOUS NAME RESOLUTION			     */
+/* ------------------------------------------------------------------------- */
+
+#ifdef HT_ASYNC_DNS
+/*
+**  Lookups are handed to a small pool of resolver threads which call the
+**  reentrant getaddrinfo(). When a lookup completes, the thread links it
+**  into the done list and writes a byte to a pipe which is registered
+**  with the event manager, so the result is always handled by the thread
+**  running the eventloop. The resolver threads never touch any other
+**  libwww data structures. Host objects waiting for a name are kept in
+**  the lookup and are restarted when the answer (or an error) arrives.
+*/
+typedef struct _HTLookup HTLookup;
+struct _HTLookup {
+    char *		hostname;		 /* ACE encoded name to look up */
+    HTList *		waiting;	  /* Host objects parked on the name */
+    struct addrinfo *	result;			      /* From getaddrinfo() */
+    int			status;		       /* getaddrinfo() return code */
+    int			error;			 /* errno for EAI_SYSTEM */
+    BOOL		running;	     /* Owned by a resolver thread */
+    BOOL		done;
+    HTLookup *		next;		      /* Resolver queue or done list */
+};
+
+PRIVATE HTList *	Lookups = NULL;		  /* Lookups not yet dispatched */
+PRIVATE HTEvent *	WakeEvent = NULL;
+PRIVATE BOOL		WakeRegistered = NO;
+
+/* Shared with the resolver threads and protected by DNSMutex */
+PRIVATE pthread_mutex_t	DNSMutex = PTHREAD_MUTEX_INITIALIZER;
+PRIVATE pthread_cond_t	DNSCond = PTHREAD_COND_INITIALIZER;
+PRIVATE pthread_cond_t	DoneCond = PTHREAD_COND_INITIALIZER;
+PRIVATE HTLookup *	QueueHead = NULL;
+PRIVATE HTLookup *	QueueTail = NULL;
+PRIVATE HTLookup *	DoneList = NULL;
+PRIVATE int		WakeFd[2] = { -1, -1 };
+PRIVATE int		Threads = 0;
+PRIVATE int		IdleThreads = 0;
+PRIVATE int		Running = 0;	      /* Lookups in getaddrinfo() */
+PRIVATE BOOL		DNSStop = NO;
+
+PRIVATE void Lookup_delete (HTLookup * me)
+{
+    if (me) {
+	if (me->result) freeaddrinfo(me->result);
+	HTList_delete(me->waiting);
+	HT_FREE(me->hostname);
+	HT_FREE(me);
+    }
+}
+
+PRIVATE void * Resolver_thread (void * arg)
+{
+    pthread_mutex_lock(&DNSMutex);
+    while (!DNSStop) {
+	HTLookup * lookup = QueueHead;
+	struct addrinfo hints;
+	if (!lookup) {
+	    IdleThreads++;
+	    pthread_cond_wait(&DNSCond, &DNSMutex);
+	    IdleThreads--;
+	    continue;
+	}
+	if ((QueueHead = lookup->next) == NULL) QueueTail = NULL;
+	lookup->next = NULL;
+	lookup->running = YES;
+	Running++;
+	pthread_mutex_unlock(&DNSMutex);
+
+	addrinfo_hints(&hints);
+	lookup->status = getaddrinfo(lookup->hostname, NULL, &hints,
+				     &lookup->result);
+	lookup->error = errno;
+
+	pthread_mutex_lock(&DNSMutex);
+	lookup->running = NO;
+	Running--;
+	lookup->next = DoneList;
+	DoneList = lookup;
+	if (WakeFd[1] >= 0) write(WakeFd[1], "", 1);
+	pthread_cond_signal(&DoneCond);
+    }
+    Threads--;
+    pthread_mutex_unlock(&DNSMutex);
+    return NULL;
+}
+
+/*
+**  Add the addresses found by the resolver to the DNS cache unless a
+**  blocking lookup got there first.
+*/
+PRIVATE void Lookup_cache (HTLookup * lookup)
+{
+    HTList * cur = cache_find(lookup->hostname);
+    HTdns * pres;
+    int homes = 0;
+    while ((pres = (HTdns *) HTList_nextObject(cur)))
+	if (!strcmp(pres->hostname, lookup->hostname)) return;
+    if (!add_addrinfo(lookup->result, lookup->hostname, &homes))
+	lookup->status = EAI_NONAME;
+}
+
+/*
+**  Restart the host objects parked on a lookup. Each host re-enters
+**  HTDoConnect through the Net object holding its lock and then finds
+**  the answer in the cache (or the failed lookup). A callback may delete
+**  other hosts, which takes them off the waiting list through
+**  HTDNS_cancelLookup, so we pop them off one at a time.
+*/
+PRIVATE void Lookup_dispatch (HTLookup * lookup)
+{
+    HTHost * host;
+    if (lookup->status == 0) Lookup_cache(lookup);
+    lookup->done = YES;
+    HTTRACE(PROT_TRACE, "DNS Lookup.. `%s\' %s\n" _ lookup->hostname _ 
+	    lookup->status ? gai_strerror(lookup->status) : "resolved");
+    while ((host = (HTHost *) HTList_removeLastObject(lookup->waiting))) {
+	HTNet * net = host->lock;
+	if (host->tcpstate == TCP_DNS && net && net->event.cbf)
+	    (*net->event.cbf)(INVSOC, net->event.param, HTEvent_CONNECT);
+    }
+    HTList_removeObject(Lookups, lookup);
+    Lookup_delete(lookup);
+}
+
+PRIVATE int Resolver_event (SOCKET soc, void * param, HTEventType type)
+{
+    HTLookup * done;
+    char buf[64];
+    while (read(WakeFd[0], buf, sizeof(buf)) > 0);
+    pthread_mutex_lock(&DNSMutex);
+    done = DoneList;
+    DoneList = NULL;
+    pthread_mutex_unlock(&DNSMutex);
+    while (done) {
+	HTLookup * lookup = done;
+	done = lookup->next;
+	if (HTList_indexOf(Lookups, lookup) >= 0)
+	    Lookup_dispatch(lookup);
+	else
+	    Lookup_delete(lookup);	      /* Abandoned by HTDNS_deleteAll */
+    }
+    if (HTList_isEmpty(Lookups) && WakeRegistered) {
+	HTEvent_unregister(WakeFd[0], HTEvent_READ);
+	WakeRegistered = NO;
+    }
+    return HT_OK;
+}
+
+/*
+**  Make sure that we have a wakeup pipe registered with the event manager
+**  and that there is a resolver thread to pick up the lookup.
+*/
+PRIVATE BOOL Resolver_start (void)
+{
+    BOOL ok = YES;
+    if (WakeFd[0] < 0) {
+	int fds[2];
+	if (pipe(fds) < 0) {
+	    HTTRACE(PROT_TRACE, "DNS Lookup.. Can't create pipe\n");
+	    return NO;
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+	pthread_mutex_lock(&DNSMutex);
+	WakeFd[0] = fds[0];
+	WakeFd[1] = fds[1];
+	pthread_mutex_unlock(&DNSMutex);
+    }
+    if (!WakeEvent)
+	WakeEvent = HTEvent_new(Resolver_event, NULL, HT_PRIORITY_MAX, -1);
+    if (!WakeRegistered) {
+	if (HTEvent_register(WakeFd[0], HTEvent_READ, WakeEvent) != HT_OK)
+	    return NO;
+	WakeRegistered = YES;
+    }
+    pthread_mutex_lock(&DNSMutex);
+    DNSStop = NO;
+    if (!IdleThreads && Threads < DNSThreads) {
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, Resolver_thread, NULL) == 0) {
+	    Threads++;
+	    HTTRACE(PROT_TRACE, "DNS Lookup.. Started resolver thread %d\n" _ Threads);
+	} else if (!Threads)
+	    ok = NO;
+	pthread_attr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&DNSMutex);
+    return ok;
+}
+
+/*
+**  Park the host on a lookup of the name, starting a new lookup if there
+**  is none in progress already.
+**  Returns:
+**		HT_WOULD_BLOCK	Host is waiting for the answer
+**		HT_ERROR	The lookup has completed but failed
+**		HT_OK		Can't resolve asynchronously
+*/
+PRIVATE int Lookup_wait (HTHost * host, char * hostace, HTRequest * request)
+{
+    HTList * cur = Lookups;
+    HTLookup * lookup;
+    while ((lookup = (HTLookup *) HTList_nextObject(cur)))
+	if (!strcmp(lookup->hostname, hostace)) break;
+    if (lookup && lookup->done) {
+	addrinfo_error(request, lookup->status, lookup->error);
+	return HT_ERROR;
+    }
+    if (!lookup) {
+	HTAlertCallback *cbf = HTAlert_find(HT_PROG_DNS);
+	if (!Resolver_start()) return HT_OK;
+	if ((lookup = (HTLookup *) HT_CALLOC(1, sizeof(HTLookup))) == NULL)
+	    HT_OUTOFMEM("Lookup_wait");
+	StrAllocCopy(lookup->hostname, hostace);
+	lookup->waiting = HTList_new();
+	if (!Lookups) Lookups = HTList_new();
+	HTList_addObject(Lookups, lookup);
+	if (cbf) (*cbf)(request, HT_PROG_DNS, HT_MSG_NULL,NULL,hostace,NULL);
+	pthread_mutex_lock(&DNSMutex);
+	if (QueueTail)
+	    QueueTail->next = lookup;
+	else
+	    QueueHead = lookup;
+	QueueTail = lookup;
+	pthread_cond_signal(&DNSCond);
+	pthread_mutex_unlock(&DNSMutex);
+	HTTRACE(PROT_TRACE, "DNS Lookup.. Queued `%s\'\n" _ hostace);
+    }
+    if (HTList_indexOf(lookup->waiting, host) < 0)
+	HTList_addObject(lookup->waiting, host);
+    return HT_WOULD_BLOCK;
+}
+
+/*
+**  Stop the resolver threads and delete all lookups. Lookups which are
+**  still in getaddrinfo() can't be interrupted, so we wait for them to
+**  come back before deleting them.
+*/
+PRIVATE void Resolver_terminate (void)
+{
+    HTLookup * done;
+    HTLookup * lookup;
+    HTList * cur;
+    if (WakeRegistered) {
+	HTEvent_unregister(WakeFd[0], HTEvent_READ);
+	WakeRegistered = NO;
+    }
+    pthread_mutex_lock(&DNSMutex);
+    DNSStop = YES;
+    pthread_cond_broadcast(&DNSCond);
+    QueueHead = QueueTail = NULL;
+    while (Running > 0)
+	pthread_cond_wait(&DoneCond, &DNSMutex);
+    done = DoneList;
+    DoneList = NULL;
+    if (WakeFd[0] >= 0) {
+	close(WakeFd[0]);
+	close(WakeFd[1]);
+	WakeFd[0] = WakeFd[1] = -1;
+    }
+    while (done) {
+	lookup = done;
+	done = lookup->next;
+	if (HTList_indexOf(Lookups, lookup) < 0) Lookup_delete(lookup);
+    }
+    pthread_mutex_unlock(&DNSMutex);
+    cur = Lookups;
+    while ((lookup = (HTLookup *) HTList_nextObject(cur)))
+	Lookup_delete(lookup);
+    HTList_delete(Lookups);
+    Lookups = NULL;
+    HTEvent_delete(WakeEvent);
+    WakeEvent = NULL;
+}
+#endif /* HT_ASYNC_DNS */
+
+/*	HTDNS_setAsync
+**	--------------
+**	Turn non-blocking name resolution on or off. Returns NO if it isn't
+**	supported on this platform.
+*/
+PUBLIC BOOL HTDNS_setAsync (BOOL mode)
+{
+#ifdef HT_ASYNC_DNS
+    DNSAsync = mode;
+    return YES;
+#else
+    return mode ? NO : YES;
+#endif
+}
+
+PUBLIC BOOL HTDNS_async (void)
+{
+#ifdef HT_ASYNC_DNS
+    return DNSAsync;
+#else
+    return NO;
+#endif
+}
+
+/*	HTDNS_setResolverThreads
+**	------------------------
+**	Set the max number of concurrent lookups. Default is DNS_THREADS.
+*/
+PUBLIC BOOL HTDNS_setResolverThreads (int threads)
+{
+    if (threads > 0) {
+	DNSThreads = threads;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTDNS_resolverThreads (void)
+{
+    return DNSThreads;
+}
+
+/*	HTDNS_cancelLookup
+**	------------------
+**	Take a host off any lookup it is waiting for. This is called when
+**	the host object is deleted.
+*/
+PUBLIC BOOL HTDNS_cancelLookup (HTHost * host)
+{
+#ifdef HT_ASYNC_DNS
+    HTList * cur = Lookups;
+    HTLookup * lookup;
+    while ((lookup = (HTLookup *) HTList_nextObject(cur)))
+	if (lookup->waiting && HTList_removeObjectAll(lookup->waiting, host))
+	    return YES;
+#endif
+    return NO;
+}
+
 /*	HTGetHostByName
 **	---------------
 **	Resolve the host name using internal DNS cache. As we want to refer   
@@ -287,10 +839,11 @@ PUBLIC int HTACEfromUTF8 (char *hostUTF8, char *punycode, size_t punyLength)
 **      Returns:
 **	       	>0	Number of homes
 **		-1	Error
+**		HT_WOULD_BLOCK	The host is waiting for a resolver thread
 */
 PUBLIC int HTGetHostByName (HTHost * host, char *hostname, HTRequest* request)
 {
-    SockA *sin = HTHost_getSockAddr(host);
+    SockAddr *sin = host ? &host->sock_addr : NULL;
     int homes = -1;
     HTList *list;				    /* Current list in cache */
     HTdns *pres = NULL;
@@ -307,22 +860,8 @@ PUBLIC int HTGetHostByName (HTHost * host, char *hostname, HTRequest* request)
     }
     HTHost_setHome(host, 0); 
 
-    /* Find a hash for this host */
-    {
-	int hash = 0;
-	char *ptr;
-	for(ptr=hostace; *ptr; ptr++)
-	    hash = (int) ((hash * 3 + (*(unsigned char *) ptr)) % HT_M_HASH_SIZE);
-	if (!CacheTable) {
-	    if ((CacheTable = (HTList* *) HT_CALLOC(HT_M_HASH_SIZE, sizeof(HTList *))) == NULL)
-	        HT_OUTOFMEM("HTDNS_init");
-	}
-	if (!CacheTable[hash]) CacheTable[hash] = HTList_new();
-	list = CacheTable[hash];
-    }
-
     /* Search the cache */
-    {
+    if ((list = cache_find(hostace)) != NULL) {
 	HTList *cur = list;
 	while ((pres = (HTdns *) HTList_nextObject(cur))) {
 	    if (!strcmp(pres->hostname, hostace)) {
@@ -353,9 +892,41 @@ PUBLIC int HTGetHostByName (HTHost * host, char *hostname, HTRequest* request)
 	    }
 	}
 	host->dns = pres;
-	memcpy((void *) &sin->sin_addr, *(pres->addrlist+HTHost_home(host)),
-	       pres->addrlength);
-    } else {
+	HTDNS_sockAddr(pres, HTHost_home(host), sin);
+    }
+#ifdef HT_ASYNC_DNS
+    /*
+    ** Unless the request is preemptive, let a resolver thread do the
+    ** lookup and park the host until the answer comes back through the
+    ** event manager
+    */
+    else if (DNSAsync && !HTRequest_preemptive(request) &&
+	     (homes = Lookup_wait(host, hostace, request)) != HT_OK) {
+	return homes;
+    }
+#endif /* HT_ASYNC_DNS */
+#ifdef HAVE_GETADDRINFO
+    else {
+	struct addrinfo hints;
+	struct addrinfo * result = NULL;
+	HTAlertCallback *cbf = HTAlert_find(HT_PROG_DNS);
+	int status;
+
+	if (cbf) (*cbf)(request, HT_PROG_DNS, HT_MSG_NULL,NULL,hostace,NULL);
+	addrinfo_hints(&hints);
+	if ((status = getaddrinfo(hostace, NULL, &hints, &result)) != 0 ||
+	    (host->dns = add_addrinfo(result, hostace, &homes)) == NULL) {
+	    HTTRACE(PROT_TRACE, "HostByName.. `%s': %s\n" _ hostace _ 
+		    status ? gai_strerror(status) : "no addresses");
+	    addrinfo_error(request, status, errno);
+	    if (result) freeaddrinfo(result);
+	    return -1;
+	}
+	freeaddrinfo(result);
+	HTDNS_sockAddr(host->dns, 0, sin);
+    }
+#else /* HAVE_GETADDRINFO */
+    else {
 	struct hostent *hostelement;			      /* see netdb.h */
 	HTAlertCallback *cbf = HTAlert_find(HT_PROG_DNS);
 #ifdef HT_REENTRANT
@@ -391,10 +962,11 @@ PUBLIC int HTGetHostByName (HTHost * host, char *hostname, HTRequest* request)
    			             "gethostbyname");
 	    return -1;
 	}	
-	host->dns = HTDNS_add(list, hostelement, hostace, &homes);
-	memcpy((void *) &sin->sin_addr, *hostelement->h_addr_list,
-	       hostelement->h_length);
+	host->dns = HTDNS_add(cache_list(hostace), hostelement, hostace,
+			      &homes);
+	HTDNS_sockAddr(host->dns, 0, sin);
     }
+#endif /* !HAVE_GETADDRINFO */
     return homes;
 }
 
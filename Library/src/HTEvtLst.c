@@ -43,10 +43,25 @@
 
 #define HT_FS_BYTES(a)		((((a)/16)+1) * 4)
 
+#define POLL_ALLOCATION		64     /* Initial size of poll/epoll arrays */
+
+#ifndef WWW_WIN_ASYNC
+#if defined(HAVE_POLL) && (defined(HAVE_POLL_H) || defined(HAVE_SYS_POLL_H))
+#define HT_POLL
+#endif
+#if defined(HAVE_EPOLL_CREATE) && defined(HAVE_SYS_EPOLL_H)
+#define HT_EPOLL
+#endif
+#endif /* !WWW_WIN_ASYNC */
+
 typedef struct {
     SOCKET 	s ;	 		/* our socket */
     HTEvent * 	events[HTEvent_TYPES];	/* event parameters for read, write, oob */
     HTTimer *	timeouts[HTEvent_TYPES];
+#ifndef WWW_WIN_ASYNC
+    int		index;			      /* Our slot in the poll() array */
+    int		armed;				  /* Event mask known by epoll */
+#endif
 } SockEvents;
 
 typedef struct {
@@ -73,8 +88,30 @@ PRIVATE ATOM HTclass;
 PRIVATE HINSTANCE HTinstance;
 PRIVATE unsigned long HTwinMsg;
 #else /* WWW_WIN_ASYNC */
+/*
+**  The eventloop waits for socket activity using one of the backends
+**  below. A backend keeps the system's view of what we are waiting for in
+**  sync with the SockEvents registry and hands the sockets that are ready
+**  to EventOrder_add.
+*/
+typedef struct _EventBackend {
+    HTEventBackend	type;
+    char *		name;
+    BOOL		(*init)		(void);
+    void		(*terminate)	(void);
+    BOOL		(*update)	(SockEvents * sockp);
+    int			(*wait)		(ms_t * timeout);
+    int			(*collect)	(ms_t now);
+    void		(*rearm)	(SOCKET s);
+} EventBackend;
+
+PRIVATE EventBackend * Backend = NULL;			/* The one in use */
+PRIVATE HTEventBackend WantedBackend = HT_EVENT_DEFAULT;
+
 PRIVATE fd_set FdArray[HTEvent_TYPES];
+PRIVATE fd_set ReadySet[HTEvent_TYPES];		/* Result of last select */
 PRIVATE SOCKET MaxSock = 0;			  /* max socket value in use */
+PRIVATE SOCKET ReadyMax = 0;
 #endif /* !WWW_WIN_ASYNC */
 
 /* ------------------------------------------------------------------------- */
@@ -266,6 +303,9 @@ PRIVATE SockEvents * SockEvents_get (SOCKET s, SockEvents_action action)
         if ((pres = (SockEvents *) HT_CALLOC(1, sizeof(SockEvents))) == NULL)
 	    HT_OUTOFMEM("HTEventList_register");
 	pres->s = s;
+#ifndef WWW_WIN_ASYNC
+	pres->index = -1;
+#endif
 	HTList_addObject(HashTable[v], (void *)pres);
 	return pres;
     }
@@ -290,22 +330,38 @@ PRIVATE int EventOrder_add (SOCKET s, HTEventType type, ms_t now)
     if (sockp->timeouts[HTEvent_INDEX(type)])
 	HTTimer_refresh(sockp->timeouts[HTEvent_INDEX(type)], now);
 
-    /* Look to see if it's already here from before */
-    while ((pres = (EventOrder *) HTList_nextObject(cur))) {
-	if (pres->s == s && pres->event == event && pres->type == type) {
-	    pres->skipped++;
-	    return HT_OK;
-	}
-	if (pres->event->priority+pres->skipped > event->priority)
-	    insertAfter = cur;
+    /*
+    **  Look to see if it's already here from before. If so then it has
+    **  been skipped and we move it up the queue so that low priority
+    **  events don't starve.
+    */
+    while ((pres = (EventOrder *) HTList_nextObject(cur)))
+	if (pres->s == s && pres->event == event && pres->type == type) break;
+    if (pres) {
+	pres->skipped++;
+	HTList_removeObject(EventOrderList, (void *) pres);
+    } else {
+	if ((pres = (EventOrder *) HT_CALLOC(1, sizeof(EventOrder))) == NULL)
+	    HT_OUTOFMEM("EventOrder_add");
+	pres->event = event;
+	pres->s = s;
+	pres->type = type;
     }
 
-    /* Create a new element */
-    if ((pres = (EventOrder *) HT_CALLOC(1, sizeof(EventOrder))) == NULL)
-	HT_OUTOFMEM("EventOrder_add");
-    pres->event = event;
-    pres->s = s;
-    pres->type = type;
+    /*
+    **  The list is kept in order of priority with the highest first.
+    **  Events with the same priority are executed in the order they
+    **  arrived.
+    */
+    {
+	int priority = pres->event->priority + pres->skipped;
+	EventOrder * next;
+	cur = EventOrderList;
+	while ((next = (EventOrder *) HTList_nextObject(cur))) {
+	    if (next->event->priority + next->skipped < priority) break;
+	    insertAfter = cur;
+	}
+    }
     HTList_addObject(insertAfter, (void *)pres);
     return HT_OK;
 }
@@ -317,14 +373,18 @@ PUBLIC int EventOrder_executeAndDelete (void)
     int i = 0;
     HTTRACE(THD_TRACE, "EventOrder.. execute ordered events\n");
     if (cur == NULL) return NO;
-    while ((pres=(EventOrder *) HTList_removeLastObject(cur)) && i<EVENTS_TO_EXECUTE) {
+    while (i<EVENTS_TO_EXECUTE && (pres=(EventOrder *) HTList_removeLastObject(cur))) {
 	HTEvent * event = pres->event;
+	SOCKET s = pres->s;
 	int ret;
 	HTTRACE(THD_TRACE, "EventList... calling socket %d, request %p handler %p type %s\n" _ 
 		    pres->s _ (void *) event->request _ 
 		    (void *) event->cbf _ HTEvent_type2str(pres->type));
 	ret = (*pres->event->cbf)(pres->s, pres->event->param, pres->type);
 	HT_FREE(pres);
+#ifndef WWW_WIN_ASYNC
+	if (Backend && Backend->rearm) (*Backend->rearm)(s);
+#endif /* !WWW_WIN_ASYNC */
 	if (ret != HT_OK) return ret;
 	i++;
     }
@@ -355,20 +415,58 @@ PUBLIC BOOL EventOrder_deleteAll (void)
     return YES;
 }
 
+PRIVATE int EventList_remaining (SockEvents * pres)
+{
+    int ret = 0;
+    int i;
+    for (i = 0; i < HTEvent_TYPES; i++)
+	if (pres->events[i] != NULL)
+	    ret |= 1<<i;
+    return ret;
+}
+
 /* ------------------------------------------------------------------------- */
-/*				EVENT REGISTRATION			     */
+/*				EVENT BACKENDS				     */
 /* ------------------------------------------------------------------------- */
 
+#ifndef WWW_WIN_ASYNC
+
 /*
-** ResetMaxSock - reset the value of the maximum socket in use 
+**  Queue the events that a poll() style backend found on a socket. Errors
+**  and hangups are passed on to whoever is waiting on the socket in the
+**  same way as select() flags such a socket as readable or writable.
+*/
+PRIVATE int EventList_ready (SockEvents * sockp, BOOL oob, BOOL wr, BOOL rd,
+			     BOOL err, ms_t now)
+{
+    SOCKET s = sockp->s;
+    int want = EventList_remaining(sockp);
+    int status = HT_OK;
+    if (oob && (want & (1<<HTEvent_INDEX(HTEvent_OOB))))
+	if ((status = EventOrder_add(s, HTEvent_OOB, now)) != HT_OK)
+	    return status;
+    if ((wr || err) && (want & (1<<HTEvent_INDEX(HTEvent_WRITE))))
+	if ((status = EventOrder_add(s, HTEvent_WRITE, now)) != HT_OK)
+	    return status;
+    if ((rd || err) && (want & (1<<HTEvent_INDEX(HTEvent_READ))))
+	status = EventOrder_add(s, HTEvent_READ, now);
+    return status;
+}
+
+/*
+**  select() backend. This is always available but it can't handle sockets
+**  with values larger than FD_SETSIZE
+*/
+
+/*
+** ResetMaxSock - reset the value of the maximum socket in use
 */
-#ifndef WWW_WIN_ASYNC
 PRIVATE void __ResetMaxSock (void)
 {
     SOCKET cnt;
     SOCKET t_max = 0;
     SOCKET old_max = MaxSock;
-    for (cnt = 0 ; cnt <= MaxSock; cnt++) { 
+    for (cnt = 0 ; cnt <= MaxSock; cnt++) {
 	if (FD_ISSET(cnt, (FdArray + HTEvent_INDEX(HTEvent_READ))) ||
 	    FD_ISSET(cnt, (FdArray + HTEvent_INDEX(HTEvent_WRITE))) ||
 	    FD_ISSET(cnt, (FdArray + HTEvent_INDEX(HTEvent_OOB))))
@@ -377,28 +475,501 @@ PRIVATE void __ResetMaxSock (void)
     MaxSock = t_max+1;
     HTTRACE(THD_TRACE, "Event....... Reset MaxSock from %u to %u\n" _ old_max _ MaxSock);
     return;
-}  
-#endif /* !WWW_WIN_ASYNC */
+}
 
-PRIVATE int EventList_remaining (SockEvents * pres)
+PRIVATE BOOL Select_init (void)
 {
-    int ret = 0;
+    FD_ZERO(FdArray+HTEvent_INDEX(HTEvent_READ));
+    FD_ZERO(FdArray+HTEvent_INDEX(HTEvent_WRITE));
+    FD_ZERO(FdArray+HTEvent_INDEX(HTEvent_OOB));
+    MaxSock = 0;
+    return YES;
+}
+
+PRIVATE void Select_terminate (void)
+{
+    Select_init();
+}
+
+PRIVATE BOOL Select_update (SockEvents * sockp)
+{
+    SOCKET s = sockp->s;
     int i;
-    for (i = 0; i < HTEvent_TYPES; i++)
-	if (pres->events[i] != NULL)
-	    ret |= 1<<i;
-    return ret;
+#ifndef _WINSOCKAPI_
+    if (s >= FD_SETSIZE) {
+	HTTRACE(THD_TRACE, "Event....... Socket %d is beyond FD_SETSIZE - use poll or epoll\n" _ s);
+	return NO;
+    }
+#endif /* !_WINSOCKAPI_ */
+    for (i = 0; i < HTEvent_TYPES; i++) {
+	if (sockp->events[i])
+	    FD_SET(s, FdArray+i);
+	else
+	    FD_CLR(s, FdArray+i);
+    }
+    if (EventList_remaining(sockp)) {
+	if (s > MaxSock) {
+	    MaxSock = s ;
+	    HTTRACE(THD_TRACE, "Event....... New value for MaxSock is %d\n" _ MaxSock);
+	}
+    } else if (s >= MaxSock)
+	__ResetMaxSock();
+    return YES;
 }
 
+PRIVATE int Select_wait (ms_t * timeout)
+{
+    struct timeval waittime, * wt = NULL;
+    fd_set * treadset = ReadySet+HTEvent_INDEX(HTEvent_READ);
+    fd_set * twriteset = ReadySet+HTEvent_INDEX(HTEvent_WRITE);
+    fd_set * texceptset = ReadySet+HTEvent_INDEX(HTEvent_OOB);
+    int active_sockets;
+
+    /*
+    **  Timeval struct copy needed for linux, as it set the value to the
+    **  remaining timeout while exiting the select. (and perhaps for
+    **  other OS). Code borrowed from X server.
+    */
+    if (timeout) {
+	waittime.tv_sec = *timeout / MILLI_PER_SECOND;
+	waittime.tv_usec = (*timeout % MILLI_PER_SECOND) *
+	    (1000000 / MILLI_PER_SECOND);
+	wt = &waittime;
+    }
+
+    /*
+    **  Now we copy the current active file descriptors to pass them to select.
+    */
+    *treadset = FdArray[HTEvent_INDEX(HTEvent_READ)];
+    *twriteset = FdArray[HTEvent_INDEX(HTEvent_WRITE)];
+    *texceptset = FdArray[HTEvent_INDEX(HTEvent_OOB)];
+
+    /* And also get the max socket value */
+    ReadyMax = MaxSock;
+
+    HTTRACE(THD_TRACE, "Event Loop.. calling select: maxfds is %d\n" _ ReadyMax);
+#ifdef HTDEBUG
+    fd_dump(ReadyMax, treadset, twriteset, texceptset, wt);
+#endif
+
+#ifdef __hpux
+    active_sockets = select(ReadyMax+1, (int *)treadset, (int *)twriteset,
+			    (int *)texceptset, wt);
+#elif defined(_WINSOCKAPI_)
+    /*
+     * yovavm@contact.com
+     *
+     * On some WINSOCK versions select() with 3 empty sets and NULL timeout
+     * returns 0 and in some it returns -1.
+     * If 0 is returned in such situation, we will go into an infinite loop
+     * (cause the sets will stay empty forever ...),
+     * so make sure to set the active_sockets = -1 which will take us out
+     * of the loop.
+     */
+    if ((treadset->fd_count || twriteset->fd_count || texceptset->fd_count)
+	&& wt)
+	 active_sockets = select(ReadyMax+1, treadset, twriteset,
+				 texceptset, wt);
+    else
+	 active_sockets = -1;
+#else
+    active_sockets = select(ReadyMax+1, treadset, twriteset, texceptset, wt);
+#endif
+
+    HTTRACE(THD_TRACE, "Event Loop.. select returns %d\n" _ active_sockets);
+#ifdef HTDEBUG
+    fd_dump(ReadyMax, treadset, twriteset, texceptset, wt);
+#endif
+    return active_sockets;
+}
+
+PRIVATE int Select_collect (ms_t now)
+{
+    SOCKET s;
+    int status;
+
+    /* There were active sockets. Determine which fd sets they were in */
+    for (s = 0 ; s <= ReadyMax ; s++) {
+	if (FD_ISSET(s, ReadySet+HTEvent_INDEX(HTEvent_OOB)))
+	    if ((status = EventOrder_add(s, HTEvent_OOB, now)) != HT_OK)
+		return status;
+	if (FD_ISSET(s, ReadySet+HTEvent_INDEX(HTEvent_WRITE)))
+	    if ((status = EventOrder_add(s, HTEvent_WRITE, now)) != HT_OK)
+		return status;
+	if (FD_ISSET(s, ReadySet+HTEvent_INDEX(HTEvent_READ)))
+	    if ((status = EventOrder_add(s, HTEvent_READ, now)) != HT_OK)
+		return status;
+    }
+    return HT_OK;
+}
+
+#ifdef HT_POLL
+/*
+**  poll() backend. Each registered socket has a slot in PollArray and
+**  remembers its index so that it can be updated without searching. When a
+**  socket goes away, the last slot is moved into its place.
+*/
+PRIVATE struct pollfd * PollArray = NULL;
+PRIVATE SockEvents ** PollSocks = NULL;
+PRIVATE int PollCount = 0;
+PRIVATE int PollSize = 0;
+
+PRIVATE BOOL Poll_init (void)
+{
+    PollCount = 0;
+    return YES;
+}
+
+PRIVATE void Poll_terminate (void)
+{
+    HT_FREE(PollArray);
+    HT_FREE(PollSocks);
+    PollCount = PollSize = 0;
+}
+
+PRIVATE BOOL Poll_update (SockEvents * sockp)
+{
+    short mask = 0;
+    if (sockp->events[HTEvent_INDEX(HTEvent_READ)]) mask |= POLLIN;
+    if (sockp->events[HTEvent_INDEX(HTEvent_WRITE)]) mask |= POLLOUT;
+    if (sockp->events[HTEvent_INDEX(HTEvent_OOB)]) mask |= POLLPRI;
+    if (mask) {
+	if (sockp->index < 0) {
+	    if (PollCount >= PollSize) {
+		PollSize = PollSize ? PollSize*2 : POLL_ALLOCATION;
+		if ((PollArray = (struct pollfd *) HT_REALLOC(PollArray, PollSize*sizeof(struct pollfd))) == NULL)
+		    HT_OUTOFMEM("Poll_update");
+		if ((PollSocks = (SockEvents **) HT_REALLOC(PollSocks, PollSize*sizeof(SockEvents *))) == NULL)
+		    HT_OUTOFMEM("Poll_update");
+	    }
+	    sockp->index = PollCount++;
+	    PollArray[sockp->index].fd = sockp->s;
+	    PollArray[sockp->index].revents = 0;
+	    PollSocks[sockp->index] = sockp;
+	}
+	PollArray[sockp->index].events = mask;
+    } else if (sockp->index >= 0) {
+	int last = --PollCount;
+	if (sockp->index != last) {
+	    PollArray[sockp->index] = PollArray[last];
+	    PollSocks[sockp->index] = PollSocks[last];
+	    PollSocks[sockp->index]->index = sockp->index;
+	}
+	sockp->index = -1;
+    }
+    return YES;
+}
+
+PRIVATE int Poll_wait (ms_t * timeout)
+{
+    int active_sockets;
+    HTTRACE(THD_TRACE, "Event Loop.. calling poll: %d sockets\n" _ PollCount);
+    active_sockets = poll(PollArray, PollCount, timeout ? (int) *timeout : -1);
+    HTTRACE(THD_TRACE, "Event Loop.. poll returns %d\n" _ active_sockets);
+    return active_sockets;
+}
+
+PRIVATE int Poll_collect (ms_t now)
+{
+    int cnt;
+    int status;
+    for (cnt = 0; cnt < PollCount; cnt++) {
+	short revents = PollArray[cnt].revents;
+	if (!revents) continue;
+	PollArray[cnt].revents = 0;
+	if (revents & POLLNVAL) {
+	    HTTRACE(THD_TRACE, "Event Loop.. Socket %d is not open\n" _ PollArray[cnt].fd);
+	    continue;
+	}
+	if ((status = EventList_ready(PollSocks[cnt],
+				      (revents & POLLPRI) != 0,
+				      (revents & POLLOUT) != 0,
+				      (revents & POLLIN) != 0,
+				      (revents & (POLLERR | POLLHUP)) != 0,
+				      now)) != HT_OK)
+	    return status;
+    }
+    return HT_OK;
+}
+#endif /* HT_POLL */
+
+#ifdef HT_EPOLL
+/*
+**  epoll backend. The kernel keeps the set of sockets that we are
+**  interested in so we only tell it about changes, and epoll_wait only
+**  returns the sockets that are ready. The protocol modules don't
+**  necessarily drain a socket when called so in edge triggered mode we
+**  rearm a socket after each time its handler has been called. If data is
+**  still pending then the kernel reports it again. epoll refuses regular
+**  files, which the cache and file modules register, so we keep those in
+**  a list of our own and treat them as always ready like select does.
+*/
+PRIVATE int EpollFd = -1;
+PRIVATE unsigned int EpollFlags = 0;
+PRIVATE struct epoll_event * EpollEvents = NULL;
+PRIVATE int EpollSize = 0;
+PRIVATE int EpollCount = 0;			  /* Sockets known by epoll */
+PRIVATE int EpollReady = 0;
+PRIVATE SockEvents ** EpollFiles = NULL;	/* Files epoll can't watch */
+PRIVATE int EpollFileCount = 0;
+PRIVATE int EpollFileSize = 0;
+
+PRIVATE BOOL Epoll_init (void)
+{
+    if ((EpollFd = epoll_create(POLL_ALLOCATION)) < 0) {
+	HTTRACE(THD_TRACE, "Event....... Can't create epoll descriptor\n");
+	return NO;
+    }
+    EpollFlags = 0;
+    EpollCount = EpollReady = EpollFileCount = 0;
+    return YES;
+}
+
+PRIVATE BOOL Epoll_initEdge (void)
+{
+    if (!Epoll_init()) return NO;
+    EpollFlags = EPOLLET;
+    return YES;
+}
+
+PRIVATE void Epoll_terminate (void)
+{
+    if (EpollFd >= 0) close(EpollFd);
+    EpollFd = -1;
+    HT_FREE(EpollEvents);
+    HT_FREE(EpollFiles);
+    EpollSize = EpollCount = EpollReady = 0;
+    EpollFileSize = EpollFileCount = 0;
+}
+
+/*
+**  A file has a slot in EpollFiles and remembers its index like in the
+**  poll backend
+*/
+PRIVATE void Epoll_addFile (SockEvents * sockp)
+{
+    if (EpollFileCount >= EpollFileSize) {
+	EpollFileSize = EpollFileSize ? EpollFileSize*2 : 8;
+	if ((EpollFiles = (SockEvents **) HT_REALLOC(EpollFiles, EpollFileSize*sizeof(SockEvents *))) == NULL)
+	    HT_OUTOFMEM("Epoll_addFile");
+    }
+    sockp->index = EpollFileCount++;
+    EpollFiles[sockp->index] = sockp;
+    HTTRACE(THD_TRACE, "Event....... Socket %d is a file which is always ready\n" _ sockp->s);
+}
+
+PRIVATE void Epoll_deleteFile (SockEvents * sockp)
+{
+    int last = --EpollFileCount;
+    if (sockp->index != last) {
+	EpollFiles[sockp->index] = EpollFiles[last];
+	EpollFiles[sockp->index]->index = sockp->index;
+    }
+    sockp->index = -1;
+}
+
+PRIVATE BOOL Epoll_update (SockEvents * sockp)
+{
+    struct epoll_event ev;
+    int mask = 0;
+    if (sockp->events[HTEvent_INDEX(HTEvent_READ)]) mask |= EPOLLIN;
+    if (sockp->events[HTEvent_INDEX(HTEvent_WRITE)]) mask |= EPOLLOUT;
+    if (sockp->events[HTEvent_INDEX(HTEvent_OOB)]) mask |= EPOLLPRI;
+    if (mask == sockp->armed) return YES;
+    if (sockp->index >= 0) {
+	if (!mask) Epoll_deleteFile(sockp);
+	sockp->armed = mask;
+	return YES;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = mask | EpollFlags;
+    ev.data.fd = sockp->s;
+    if (!mask) {
+	/* If the socket has been closed already then the kernel dropped it */
+	epoll_ctl(EpollFd, EPOLL_CTL_DEL, sockp->s, &ev);
+	EpollCount--;
+    } else if (sockp->armed) {
+	if (epoll_ctl(EpollFd, EPOLL_CTL_MOD, sockp->s, &ev) < 0 &&
+	    (errno != ENOENT ||
+	     epoll_ctl(EpollFd, EPOLL_CTL_ADD, sockp->s, &ev) < 0)) {
+	    HTTRACE(THD_TRACE, "Event....... epoll can't modify socket %d\n" _ sockp->s);
+	    return NO;
+	}
+    } else {
+	if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, sockp->s, &ev) < 0) {
+	    if (errno == EPERM) {
+		Epoll_addFile(sockp);
+		sockp->armed = mask;
+		return YES;
+	    }
+	    if (errno != EEXIST ||
+		epoll_ctl(EpollFd, EPOLL_CTL_MOD, sockp->s, &ev) < 0) {
+		HTTRACE(THD_TRACE, "Event....... epoll can't add socket %d\n" _ sockp->s);
+		return NO;
+	    }
+	}
+	EpollCount++;
+    }
+    sockp->armed = mask;
+    return YES;
+}
+
+PRIVATE int Epoll_wait (ms_t * timeout)
+{
+    int wait = timeout ? (int) *timeout : -1;
+    if (!EpollEvents || EpollSize < EpollCount) {
+	EpollSize = EpollCount > POLL_ALLOCATION ? EpollCount : POLL_ALLOCATION;
+	HT_FREE(EpollEvents);
+	if ((EpollEvents = (struct epoll_event *) HT_MALLOC(EpollSize * sizeof(struct epoll_event))) == NULL)
+	    HT_OUTOFMEM("Epoll_wait");
+    }
+    HTTRACE(THD_TRACE, "Event Loop.. calling epoll_wait: %d sockets\n" _ EpollCount);
+    if (EpollFileCount) wait = 0;
+    EpollReady = epoll_wait(EpollFd, EpollEvents, EpollSize, wait);
+    HTTRACE(THD_TRACE, "Event Loop.. epoll_wait returns %d\n" _ EpollReady);
+    return EpollReady < 0 ? EpollReady : EpollReady + EpollFileCount;
+}
+
+PRIVATE int Epoll_collect (ms_t now)
+{
+    int cnt;
+    int status;
+    for (cnt = 0; cnt < EpollReady; cnt++) {
+	unsigned int revents = EpollEvents[cnt].events;
+	SockEvents * sockp = SockEvents_get(EpollEvents[cnt].data.fd, SockEvents_find);
+	if (!sockp) continue;
+	if ((status = EventList_ready(sockp,
+				      (revents & EPOLLPRI) != 0,
+				      (revents & EPOLLOUT) != 0,
+				      (revents & EPOLLIN) != 0,
+				      (revents & (EPOLLERR | EPOLLHUP)) != 0,
+				      now)) != HT_OK)
+	    return status;
+    }
+    EpollReady = 0;
+    for (cnt = 0; cnt < EpollFileCount; cnt++) {
+	SockEvents * sockp = EpollFiles[cnt];
+	if ((status = EventList_ready(sockp, NO,
+				      (sockp->armed & EPOLLOUT) != 0,
+				      (sockp->armed & EPOLLIN) != 0,
+				      NO, now)) != HT_OK)
+	    return status;
+    }
+    return HT_OK;
+}
+
+PRIVATE void Epoll_rearm (SOCKET s)
+{
+    SockEvents * sockp;
+    if ((EpollFlags & EPOLLET) && (sockp = SockEvents_get(s, SockEvents_find))
+	&& sockp->armed) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = sockp->armed | EpollFlags;
+	ev.data.fd = s;
+	epoll_ctl(EpollFd, EPOLL_CTL_MOD, s, &ev);
+    }
+}
+#endif /* HT_EPOLL */
+
+PRIVATE EventBackend Backends[] = {
+#ifdef HT_EPOLL
+    {HT_EVENT_EPOLL, "epoll", Epoll_init, Epoll_terminate,
+     Epoll_update, Epoll_wait, Epoll_collect, NULL},
+    {HT_EVENT_EPOLL_ET, "edge triggered epoll", Epoll_initEdge, Epoll_terminate,
+     Epoll_update, Epoll_wait, Epoll_collect, Epoll_rearm},
+#endif /* HT_EPOLL */
+#ifdef HT_POLL
+    {HT_EVENT_POLL, "poll", Poll_init, Poll_terminate,
+     Poll_update, Poll_wait, Poll_collect, NULL},
+#endif /* HT_POLL */
+    {HT_EVENT_SELECT, "select", Select_init, Select_terminate,
+     Select_update, Select_wait, Select_collect, NULL},
+    {HT_EVENT_DEFAULT, NULL, NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+/*
+**  Find a backend. The default is the best one that we have which isn't
+**  edge triggered.
+*/
+PRIVATE EventBackend * Backend_find (HTEventBackend type)
+{
+    EventBackend * pres;
+    for (pres = Backends; pres->name; pres++) {
+	if (pres->type == type) return pres;
+	if (type == HT_EVENT_DEFAULT && pres->type != HT_EVENT_EPOLL_ET)
+	    return pres;
+    }
+    return NULL;
+}
+
+/*
+**  Start the wanted backend and tell it about any sockets that are
+**  already registered. If it can't be started then we fall back on select.
+*/
+PRIVATE BOOL Backend_start (void)
+{
+    EventBackend * wanted = Backend_find(WantedBackend);
+    int v;
+    if (Backend && Backend == wanted) return YES;
+    if (Backend) (*Backend->terminate)();
+    if (!wanted || !(*wanted->init)()) {
+	HTTRACE(THD_TRACE, "Event....... Can't start event backend - using select\n");
+	wanted = Backend_find(HT_EVENT_SELECT);
+	(*wanted->init)();
+    }
+    Backend = wanted;
+    HTTRACE(THD_TRACE, "Event....... Using %s to wait for sockets\n" _ Backend->name);
+    for (v = 0; v < HT_M_HASH_SIZE; v++) {
+	HTList * cur = HashTable[v];
+	SockEvents * pres;
+	while ((pres = (SockEvents *) HTList_nextObject(cur))) {
+	    pres->index = -1;
+	    pres->armed = 0;
+	    (*Backend->update)(pres);
+	}
+    }
+    return YES;
+}
+
+#endif /* !WWW_WIN_ASYNC */
+
+PUBLIC BOOL HTEventList_setBackend (HTEventBackend backend)
+{
+#ifdef WWW_WIN_ASYNC
+    return (backend == HT_EVENT_DEFAULT);
+#else
+    if (Backend_find(backend) == NULL) {
+	HTTRACE(THD_TRACE, "Event....... Event backend %d is not available\n" _ backend);
+	return NO;
+    }
+    WantedBackend = backend;
+    return YES;
+#endif /* !WWW_WIN_ASYNC */
+}
+
+PUBLIC HTEventBackend HTEventList_backend (void)
+{
+#ifdef WWW_WIN_ASYNC
+    return HT_EVENT_DEFAULT;
+#else
+    return Backend ? Backend->type : WantedBackend;
+#endif /* !WWW_WIN_ASYNC */
+}
+
+/* ------------------------------------------------------------------------- */
+/*				EVENT REGISTRATION			     */
+/* ------------------------------------------------------------------------- */
+
 /*
 **  For a given socket, reqister a request structure, a set of operations, 
 **  a HTEventCallback function, and a priority. For this implementation, 
 **  we allow only a single HTEventCallback function for all operations.
-**  and the priority field is ignored.
+**  The priority of the event decides the order in which events on sockets
+**  that are ready at the same time are dispatched.
 */
 PUBLIC int HTEventList_register (SOCKET s, HTEventType type, HTEvent * event)
 {
-    int newset = 0;
     SockEvents * sockp;
     HTTRACE(THD_TRACE, "Event....... Register socket %d, request %p handler %p type %s at priority %d\n" _ 
 		s _ (void *) event->request _ 
@@ -415,20 +986,19 @@ PUBLIC int HTEventList_register (SOCKET s, HTEventType type, HTEvent * event)
     sockp = SockEvents_get(s, SockEvents_mayCreate);
     sockp->s = s;
     sockp->events[HTEvent_INDEX(type)] = event;
-    newset = EventList_remaining(sockp);
 #ifdef WWW_WIN_ASYNC
-    if (WSAAsyncSelect(s, HTSocketWin, HTwinMsg, HTEvent_BITS(newset)) < 0) {
-        HTTRACE(THD_TRACE, "Event....... WSAAsyncSelect returned `%s'!" _ HTErrnoString(socerrno));
-	return HT_ERROR;
+    {
+	int newset = EventList_remaining(sockp);
+	if (WSAAsyncSelect(s, HTSocketWin, HTwinMsg, HTEvent_BITS(newset)) < 0) {
+	    HTTRACE(THD_TRACE, "Event....... WSAAsyncSelect returned `%s'!" _ HTErrnoString(socerrno));
+	    return HT_ERROR;
+	}
     }
 #else /* WWW_WIN_ASYNC */
-    FD_SET(s, FdArray+HTEvent_INDEX(type));
-
-    HTTRACEDATA((char *) FdArray+HTEvent_INDEX(type), 8, "HTEventList_register: (s:%d)" _ s);
-
-    if (s > MaxSock) {
-	MaxSock = s ;
-	HTTRACE(THD_TRACE, "Event....... New value for MaxSock is %d\n" _ MaxSock);
+    if (!Backend) Backend_start();
+    if (!(*Backend->update)(sockp)) {
+	sockp->events[HTEvent_INDEX(type)] = NULL;
+	return HT_ERROR;
     }
 #endif /* !WWW_WIN_ASYNC */
 
@@ -512,10 +1082,7 @@ PUBLIC int HTEventList_unregister (SOCKET s, HTEventType type)
 	    if (WSAAsyncSelect(s, HTSocketWin, HTwinMsg, remaining) < 0)
 		ret = HT_ERROR;
 #else /* WWW_WIN_ASYNC */
-	    FD_CLR(s, FdArray+HTEvent_INDEX(type));
-
-	    HTTRACEDATA((char*)FdArray+HTEvent_INDEX(type), 8, "HTEventList_unregister: (s:%d)" _ s);
-
+	    if (Backend) (*Backend->update)(pres);
 #endif /* !WWW_WIN_ASYNC */
 
 	    /*
@@ -525,12 +1092,6 @@ PUBLIC int HTEventList_unregister (SOCKET s, HTEventType type)
 	    if (remaining == 0) {
 		HTList * doomed = cur;
 		HTTRACE(THD_TRACE, "Event....... No more events registered for socket %d\n" _ s);
-
-#ifndef WWW_WIN_ASYNC
-		/* Check to see if we have to update MaxSock */
-		if (pres->s >= MaxSock) __ResetMaxSock();
-#endif /* !WWW_WIN_ASYNC */
-
 		HT_FREE(pres);
 		pres = (SockEvents *) HTList_nextObject(cur);
 		HTList_quickRemoveElement(doomed, last);
@@ -568,21 +1129,18 @@ PUBLIC int HTEventList_unregisterAll (void)
 	while ((pres = (SockEvents *) HTList_nextObject(cur))) {
 #ifdef WWW_WIN_ASYNC
 	    WSAAsyncSelect(pres->s, HTSocketWin, HTwinMsg, 0);
-#endif /* WWW_WIN_ASYNC */
+#else /* WWW_WIN_ASYNC */
+	    if (Backend) {
+		memset(pres->events, 0, sizeof(pres->events));
+		(*Backend->update)(pres);
+	    }
+#endif /* !WWW_WIN_ASYNC */
 	    HT_FREE(pres);
 	}
 	HTList_delete(HashTable[i]);
 	HashTable[i] = NULL;
     }
 
-#ifndef WWW_WIN_ASYNC
-    MaxSock = 0 ;
-    HTTRACE(THD_TRACE, "Event....... New value for MaxSock is %d\n" _ MaxSock);
-    FD_ZERO(FdArray+HTEvent_INDEX(HTEvent_READ));
-    FD_ZERO(FdArray+HTEvent_INDEX(HTEvent_WRITE));
-    FD_ZERO(FdArray+HTEvent_INDEX(HTEvent_OOB));
-#endif /* !WWW_WIN_ASYNC */
-
     EventOrder_deleteAll();
     return 0;
 }
@@ -668,13 +1226,10 @@ PUBLIC int HTEventList_loop (HTRequest * theRequest)
 
 #else /* WWW_WIN_ASYNC */
 
-    fd_set treadset, twriteset, texceptset;
-    struct timeval waittime, * wt;
     int active_sockets;
-    int maxfds;
     ms_t timeout;
+    ms_t * wt;
     ms_t now;
-    SOCKET s;
     int status = HT_OK;
 
     /* Check that we don't have multiple loops started at once */
@@ -683,6 +1238,7 @@ PUBLIC int HTEventList_loop (HTRequest * theRequest)
 	return HT_ERROR;
     }
     HTInLoop = YES;
+    if (!Backend) Backend_start();
 
     /* Set up list of events - is kept around until EventOrder_deleteAll */
     if (!EventOrderList)
@@ -693,20 +1249,12 @@ PUBLIC int HTEventList_loop (HTRequest * theRequest)
     /* Don't leave this loop until we leave the application */
     while (!HTEndLoop) {
 
-        /*
-	**  Timeval struct copy needed for linux, as it set the value to the
-	**  remaining timeout while exiting the select. (and perhaps for
-	**  other OS). Code borrowed from X server.
+	/*
+	**  Dispatch the timers that have expired and find out how long we
+	**  can wait for the next one. A timeout of 0 means no timers.
 	*/
-	wt = NULL;
 	if ((status = HTTimer_next(&timeout)))
 	    break;
-	if (timeout != 0) {
-	    waittime.tv_sec = timeout / MILLI_PER_SECOND;
-	    waittime.tv_usec = (timeout % MILLI_PER_SECOND) *
-		(1000000 / MILLI_PER_SECOND);
-	    wt = &waittime;
-	}
 
 	/*
 	** Check whether we still have to continue the event loop. It could
@@ -715,51 +1263,18 @@ PUBLIC int HTEventList_loop (HTRequest * theRequest)
 	if (HTEndLoop) break;
 
 	/*
-	**  Now we copy the current active file descriptors to pass them to select.
+	**  If we have events left over from last time then we only check
+	**  for new activity before calling them.
 	*/
-        treadset = FdArray[HTEvent_INDEX(HTEvent_READ)];
-        twriteset = FdArray[HTEvent_INDEX(HTEvent_WRITE)];
-        texceptset = FdArray[HTEvent_INDEX(HTEvent_OOB)];
-
-	/* And also get the max socket value */
-        maxfds = MaxSock; 
-
-	HTTRACE(THD_TRACE, "Event Loop.. calling select: maxfds is %d\n" _ maxfds);
-#ifdef HTDEBUG
-	fd_dump(maxfds, &treadset, &twriteset, &texceptset, wt);
-#endif
-
-#ifdef __hpux 
-        active_sockets = select(maxfds+1, (int *)&treadset, (int *)&twriteset,
-				(int *)&texceptset, wt);
-#elif defined(_WINSOCKAPI_)
-	/*
-	 * yovavm@contact.com
-	 *
-	 * On some WINSOCK versions select() with 3 empty sets and NULL timeout
-	 * returns 0 and in some it returns -1.
-	 * If 0 is returned in such situation, we will go into an infinite loop
-	 * (cause the sets will stay empty forever ...),
-	 * so make sure to set the active_sockets = -1 which will take us out 
-	 * of the loop.
-	 */
-	if ((treadset.fd_count || twriteset.fd_count || texceptset.fd_count) 
-	    && wt)
-	     active_sockets = select(maxfds+1, &treadset, &twriteset,
-				     &texceptset, wt);
-	else
-	     active_sockets = -1;	
-#else
-        active_sockets = select(maxfds+1, &treadset, &twriteset, &texceptset, wt);
-#endif
+	if (!HTList_isEmpty(EventOrderList)) {
+	    timeout = 0;
+	    wt = &timeout;
+	} else
+	    wt = timeout ? &timeout : NULL;
+	active_sockets = (*Backend->wait)(wt);
 
 	now = HTGetTimeInMillis();
 
-	HTTRACE(THD_TRACE, "Event Loop.. select returns %d\n" _ active_sockets);
-#ifdef HTDEBUG
-	fd_dump(maxfds, &treadset, &twriteset, &texceptset, wt);
-#endif
-
         if (active_sockets == -1) {
 #ifdef EINTR
 	    if (socerrno == EINTR) {
@@ -772,7 +1287,7 @@ PUBLIC int HTEventList_loop (HTRequest * theRequest)
 		**           signal,  it  is  implementation-dependent  whether
 		**	     select() restarts or returns with EINTR.
 		*/
-		HTTRACE(THD_TRACE, "Event Loop.. select was interruted - try again\n");
+		HTTRACE(THD_TRACE, "Event Loop.. %s was interruted - try again\n" _ Backend->name);
 		continue;
 	    }
 #endif /* EINTR */
@@ -787,7 +1302,7 @@ PUBLIC int HTEventList_loop (HTRequest * theRequest)
 		continue;
 	    }
 #endif
-	    HTTRACE(THD_TRACE, "Event Loop.. select returned error %d\n" _ socerrno);
+	    HTTRACE(THD_TRACE, "Event Loop.. %s returned error %d\n" _ Backend->name _ socerrno);
 
 #ifdef HTDEBUG
 	    EventList_dump();
@@ -798,29 +1313,15 @@ PUBLIC int HTEventList_loop (HTRequest * theRequest)
         }
 
 	/*
-	**  We had a timeout so now we check and see if we have a timeout
-	**  handler to call. Let HTTimer_next get it.
-	*/ 
-	if (active_sockets == 0)
-	    continue;
-
-	/* There were active sockets. Determine which fd sets they were in */
-	for (s = 0 ; s <= maxfds ; s++) { 
-	    if (FD_ISSET(s, &texceptset))
-		if ((status = EventOrder_add(s, HTEvent_OOB, now)) != HT_OK)
-		    goto stop_loop;
-	    if (FD_ISSET(s, &twriteset))
-		if ((status = EventOrder_add(s, HTEvent_WRITE, now)) != HT_OK)
-		    goto stop_loop;
-	    if (FD_ISSET(s, &treadset))
-		if ((status = EventOrder_add(s, HTEvent_READ, now)) != HT_OK)
-		    goto stop_loop;
-	}
+	**  If there were active sockets then order them by priority. If we
+	**  had a timeout then HTTimer_next will find the timeout handler.
+	*/
+	if (active_sockets > 0 && (status = (*Backend->collect)(now)) != HT_OK)
+	    break;
 	if ((status = EventOrder_executeAndDelete()) != HT_OK) break;
     };
 
     /* Reset HTEndLoop in case we want to start again */
- stop_loop:
     HTEndLoop = 0;
     HTInLoop = NO;
     return status;
@@ -967,6 +1468,10 @@ PUBLIC BOOL HTEventInit (void)
     }
 #endif /* _WINSOCKAPI_ */
 
+#ifndef WWW_WIN_ASYNC
+    Backend_start();
+#endif /* !WWW_WIN_ASYNC */
+
     HTEvent_setRegisterCallback(HTEventList_register);
     HTEvent_setUnregisterCallback(HTEventList_unregister);
     return YES;
@@ -981,6 +1486,11 @@ PUBLIC BOOL HTEventTerminate (void)
 #ifdef WWW_WIN_ASYNC
     DestroyWindow(HTSocketWin);
     UnregisterClass((LPCTSTR)HTclass, HTinstance);
+#else /* WWW_WIN_ASYNC */
+    if (Backend) {
+	(*Backend->terminate)();
+	Backend = NULL;
+    }
 #endif /* WWW_WIN_ASYNC */
 
     return YES;
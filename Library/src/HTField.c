@@ -0,0 +1,326 @@
+/*							              HTField.c
+**	LIST OF ORIGINAL HEADER FIELDS
+**
+**	(c) COPYRIGHT MIT 1995.
+**	Please first read the full copyright statement in the file COPYRIGH.
+**	@(#) $Id$
+**
+**	The fields are kept in an array in the order they arrived, with the
+**	name as an atom. Names and values are copied into blocks which are
+**	never moved or reallocated so that we can hand out pointers to them.
+**	For each well-known field id we remember the last field with that id
+**	so that the fields libwww looks for are found without a search.
+*/
+
+/* Library include files */
+#include "wwwsys.h"
+#include "WWWUtil.h"
+#include "HTField.h"					 /* Implemented here */
+
+#define FIELD_BLOCK_SIZE	1024	     /* Size of the first string block */
+#define FIELD_BLOCK_MAX		8192		/* Largest size we grow to */
+#define FIELD_ARRAY_SIZE	16		   /* Initial number of fields */
+
+typedef struct _HTFieldBlock HTFieldBlock;
+struct _HTFieldBlock {
+    HTFieldBlock *	next;
+    int			size;
+    int			used;		     /* Data follows the structure */
+};
+
+typedef struct _HTField {
+    HTAtom *		atom;
+    char *		name;			     /* As it was added */
+    char *		value;
+    HTFieldId		id;
+} HTField;
+
+struct _HTFieldList {
+    HTField *		fields;
+    int			count;
+    int			size;
+    int			last[HT_FIELD_COUNT];	 /* Index + 1, 0 if none */
+    HTFieldBlock *	blocks;			  /* Current block first */
+    HTAssocList *	view;
+};
+
+PRIVATE const char * FieldNames[HT_FIELD_COUNT] = {
+    NULL,
+    "age",
+    "allow",
+    "cache-control",
+    "connection",
+    "content-base",
+    "content-encoding",
+    "content-language",
+    "content-length",
+    "content-location",
+    "content-md5",
+    "content-type",
+    "date",
+    "derived-from",
+    "etag",
+    "expires",
+    "last-modified",
+    "location",
+    "pragma",
+    "server",
+    "set-cookie",
+    "title",
+    "transfer-encoding",
+    "vary",
+    "version"
+};
+
+/* ------------------------------------------------------------------------- */
+
+PUBLIC HTFieldId HTField_id (const char * name)
+{
+    if (name) {
+	int cnt;
+	for (cnt = 1; cnt < HT_FIELD_COUNT; cnt++) {
+	    if (TOLOWER(*name) == *FieldNames[cnt] &&
+		!strcasecomp(name, FieldNames[cnt]))
+		return (HTFieldId) cnt;
+	}
+    }
+    return HT_FIELD_OTHER;
+}
+
+/*
+**	Copy a string into the current block, or into a new block if there
+**	isn't room for it.
+*/
+PRIVATE char * store_string (HTFieldList * me, const char * str)
+{
+    int len = strlen(str) + 1;
+    HTFieldBlock * block = me->blocks;
+    char * ptr;
+    if (!block || block->size - block->used < len) {
+	int size = block ? block->size * 2 : FIELD_BLOCK_SIZE;
+	if (size > FIELD_BLOCK_MAX) size = FIELD_BLOCK_MAX;
+	if (size < len) size = len;
+	if ((block = (HTFieldBlock *)
+	     HT_MALLOC(sizeof(HTFieldBlock) + size)) == NULL)
+	    HT_OUTOFMEM("HTFieldList store_string");
+	block->next = me->blocks;
+	block->size = size;
+	block->used = 0;
+	me->blocks = block;
+    }
+    ptr = (char *) (block + 1) + block->used;
+    memcpy(ptr, str, len);
+    block->used += len;
+    return ptr;
+}
+
+PRIVATE void update_index (HTFieldList * me)
+{
+    int cnt;
+    memset(me->last, 0, sizeof(me->last));
+    for (cnt = 0; cnt < me->count; cnt++)
+	me->last[me->fields[cnt].id] = cnt + 1;
+}
+
+PRIVATE void view_add (HTFieldList * me, HTField * field)
+{
+    HTAssoc * assoc;
+    if ((assoc = (HTAssoc *) HT_MALLOC(sizeof(HTAssoc))) == NULL)
+	HT_OUTOFMEM("HTFieldList view_add");
+    assoc->name = field->name;
+    assoc->value = field->value;
+    HTList_addObject(me->view, assoc);
+}
+
+PRIVATE void view_remove (HTFieldList * me, HTField * field)
+{
+    HTList * cur = me->view;
+    HTAssoc * assoc;
+    while ((assoc = (HTAssoc *) HTList_nextObject(cur))) {
+	if (assoc->name == field->name) {
+	    HTList_removeObject(me->view, assoc);
+	    HT_FREE(assoc);
+	    return;
+	}
+    }
+}
+
+/*	Create and Delete
+**	-----------------
+*/
+PUBLIC HTFieldList * HTFieldList_new (void)
+{
+    HTFieldList * me;
+    if ((me = (HTFieldList *) HT_CALLOC(1, sizeof(HTFieldList))) == NULL)
+	HT_OUTOFMEM("HTFieldList_new");
+    return me;
+}
+
+PUBLIC BOOL HTFieldList_delete (HTFieldList * me)
+{
+    if (me) {
+	HTFieldBlock * block = me->blocks;
+	while (block) {
+	    HTFieldBlock * next = block->next;
+	    HT_FREE(block);
+	    block = next;
+	}
+	if (me->view) {
+	    HTList * cur = me->view;
+	    HTAssoc * assoc;
+	    while ((assoc = (HTAssoc *) HTList_nextObject(cur)))
+		HT_FREE(assoc);
+	    HTList_delete(me->view);
+	}
+	HT_FREE(me->fields);
+	HT_FREE(me);
+	return YES;
+    }
+    return NO;
+}
+
+/*	Add and Remove
+**	--------------
+*/
+PUBLIC BOOL HTFieldList_add (HTFieldList * me,
+			     const char * name, const char * value)
+{
+    if (me && name) {
+	HTField * field;
+	if (me->count >= me->size) {
+	    int size = me->size ? me->size * 2 : FIELD_ARRAY_SIZE;
+	    if ((me->fields = (HTField *)
+		 HT_REALLOC(me->fields, size * sizeof(HTField))) == NULL)
+		HT_OUTOFMEM("HTFieldList_add");
+	    me->size = size;
+	}
+	field = &me->fields[me->count++];
+	field->atom = HTAtom_caseFor(name);
+	field->id = HTField_id(name);
+	field->name = store_string(me, name);
+	field->value = value ? store_string(me, value) : NULL;
+	me->last[field->id] = me->count;
+	if (me->view) view_add(me, field);
+	return YES;
+    }
+    HTTRACE(UTIL_TRACE, "HTFieldList. Can't add field to %p\n" _ me);
+    return NO;
+}
+
+PUBLIC BOOL HTFieldList_remove (HTFieldList * me, const char * name)
+{
+    BOOL found = NO;
+    if (me && name && me->count) {
+	HTFieldId id = HTField_id(name);
+	HTAtom * atom = id == HT_FIELD_OTHER ? HTAtom_caseFor(name) : NULL;
+	int from, to;
+	for (from = 0, to = 0; from < me->count; from++) {
+	    HTField * field = &me->fields[from];
+	    if (id != HT_FIELD_OTHER ? field->id == id : field->atom == atom) {
+		if (me->view) view_remove(me, field);
+		found = YES;
+	    } else
+		me->fields[to++] = *field;
+	}
+	if (found) {
+	    me->count = to;
+	    update_index(me);
+	}
+    }
+    return found;
+}
+
+/*	Find
+**	----
+*/
+PUBLIC char * HTFieldList_findId (HTFieldList * me, HTFieldId id)
+{
+    if (me && id > HT_FIELD_OTHER && id < HT_FIELD_COUNT && me->last[id])
+	return me->fields[me->last[id] - 1].value;
+    return NULL;
+}
+
+PUBLIC char * HTFieldList_find (HTFieldList * me, const char * name)
+{
+    if (me && name && me->count) {
+	HTFieldId id = HTField_id(name);
+	if (id == HT_FIELD_OTHER) {
+	    HTAtom * atom = HTAtom_caseFor(name);
+	    int cnt;
+	    for (cnt = me->count - 1; cnt >= 0; cnt--) {
+		if (me->fields[cnt].atom == atom)
+		    return me->fields[cnt].value;
+	    }
+	    return NULL;
+	}
+	return HTFieldList_findId(me, id);
+    }
+    return NULL;
+}
+
+/*	Traverse
+**	--------
+*/
+PUBLIC int HTFieldList_count (HTFieldList * me)
+{
+    return me ? me->count : 0;
+}
+
+PUBLIC char * HTFieldList_name (HTFieldList * me, int n)
+{
+    return (me && n >= 0 && n < me->count) ? me->fields[n].name : NULL;
+}
+
+PUBLIC char * HTFieldList_value (HTFieldList * me, int n)
+{
+    return (me && n >= 0 && n < me->count) ? me->fields[n].value : NULL;
+}
+
+/*	Association Lists
+**	-----------------
+*/
+PUBLIC HTAssocList * HTFieldList_assocList (HTFieldList * me)
+{
+    if (me && !me->view) {
+	int cnt;
+	me->view = HTAssocList_new();
+	for (cnt = 0; cnt < me->count; cnt++)
+	    view_add(me, &me->fields[cnt]);
+    }
+    return me ? me->view : NULL;
+}
+
+PUBLIC HTFieldList * HTFieldList_fromAssocList (HTAssocList * list)
+{
+    HTFieldList * me = HTFieldList_new();
+    int count = HTList_count(list);
+    if (count > 0) {
+	HTAssoc ** all;
+	HTAssocList * cur = list;
+	HTAssoc * assoc;
+	int cnt = count;
+	if ((all = (HTAssoc **) HT_MALLOC(count * sizeof(HTAssoc *))) == NULL)
+	    HT_OUTOFMEM("HTFieldList_fromAssocList");
+	while ((assoc = (HTAssoc *) HTAssocList_nextObject(cur)) && cnt > 0)
+	    all[--cnt] = assoc;
+	for (; cnt < count; cnt++)
+	    HTFieldList_add(me, HTAssoc_name(all[cnt]), HTAssoc_value(all[cnt]));
+	HT_FREE(all);
+    }
+    return me;
+}
+
+PUBLIC long HTFieldList_memory (HTFieldList * me)
+{
+    long size = 0;
+    if (me) {
+	HTFieldBlock * block;
+	size = sizeof(HTFieldList) + (long) me->size * sizeof(HTField);
+	for (block = me->blocks; block; block = block->next)
+	    size += sizeof(HTFieldBlock) + block->size;
+	if (me->view)
+	    size += (long) (me->count + 1) * sizeof(HTList) +
+		(long) me->count * sizeof(HTAssoc);
+    }
+    return size;
+}
@@ -4,6 +4,13 @@
 **	This HashTable class implements a simple hash table to keep
 **	objects associated with key words.
 **
+**	The table uses open addressing with linear probing in an array
+**	whose size is a power of two so that a slot is found by masking
+**	the hash value instead of a modulo. The table doubles in size when
+**	it gets 3/4 full. Removed elements leave a marker in their slot
+**	until the next time the table is rebuilt, so that walking the
+**	table while removing elements is safe.
+**
 ** Author:
 **	JP	John Punin
 **
@@ -12,8 +19,49 @@
 #include "wwwsys.h"
 #include "HTUtils.h"
 #include "HTString.h"
+#include "HTAtom.h"
 #include "HTHash.h"
 
+#define HASH_MIN_SIZE	16		  /* Smallest table, must be 2^n */
+
+PRIVATE char HashDeleted;		/* Key of a slot that has been freed */
+#define HASH_DELETED	(&HashDeleted)
+
+/*
+(
+  Hash Function
+)
+
+32 bit FNV-1a. It is cheap, has no modulo, and the low bits, which we use
+for the index, are well mixed.
+*/
+PUBLIC unsigned int HTHash_string (const char * key)
+{
+    unsigned int hash = 2166136261U;
+    if (key) {
+	const unsigned char * ptr = (const unsigned char *) key;
+	while (*ptr) {
+	    hash ^= *ptr++;
+	    hash *= 16777619U;
+	}
+    }
+    return hash & 0xFFFFFFFFU;
+}
+
+PUBLIC unsigned int HTHash_caseString (const char * key)
+{
+    unsigned int hash = 2166136261U;
+    if (key) {
+	const unsigned char * ptr = (const unsigned char *) key;
+	while (*ptr) {
+	    hash ^= TOLOWER(*ptr);
+	    ptr++;
+	    hash *= 16777619U;
+	}
+    }
+    return hash & 0xFFFFFFFFU;
+}
+
 /*
 (
   Creation and Deletion Methods
@@ -22,35 +70,42 @@
 These methods create and deletes a Hash Table
 */
 
-PUBLIC HTHashtable * HTHashtable_new (int size)
+PRIVATE HTHashtable * hashtable_new (int size, BOOL interned)
 {
     HTHashtable *newHashtable;
-    int c = size > 0 ? size : HT_L_HASH_SIZE;
+    int c = HASH_MIN_SIZE;
+    while (size > 0 && c < size + size/3) c <<= 1;
     if ((newHashtable = (HTHashtable  *) HT_CALLOC(1, sizeof (HTHashtable))) == NULL)
         HT_OUTOFMEM("HTHashtable_new");
 
-    if((newHashtable->table = (void **) HT_CALLOC(c, sizeof (void *))) == NULL)
+    if((newHashtable->table = (keynode *) HT_CALLOC(c, sizeof (keynode))) == NULL)
 	HT_OUTOFMEM("HTHashtable_new");
 
     newHashtable->count = 0;
+    newHashtable->used = 0;
     newHashtable->size = c;
+    newHashtable->interned = interned;
     return newHashtable;
 }
 
+PUBLIC HTHashtable * HTHashtable_new (int size)
+{
+    return hashtable_new(size, NO);
+}
+
+PUBLIC HTHashtable * HTHashtable_newInterned (int size)
+{
+    return hashtable_new(size, YES);
+}
+
 PUBLIC BOOL HTHashtable_delete (HTHashtable *me)
 {
     if (me) {
-	int i;
-	for(i = 0; i< me->size; i++) {
-	    HTList * l = (HTList *)me->table[i];
-	    if (l) {
-		HTList *cur = l;
-		keynode *kn;
-		while ((kn = (keynode *) HTList_nextObject(cur))) {
-		    HT_FREE(kn->key);
-		    HT_FREE(kn);
-		}
-		HTList_delete(l);
+	if (!me->interned) {
+	    int i;
+	    for(i = 0; i< me->size; i++) {
+		keynode * kn = me->table + i;
+		if (kn->key && kn->key != HASH_DELETED) HT_FREE(kn->key);
 	    }
 	}
         HT_FREE(me->table);
@@ -60,16 +115,51 @@ PUBLIC BOOL HTHashtable_delete (HTHashtable *me)
     return NO;
 }
 
-PRIVATE int hash_number (const char *key, int size)
+/*
+**  Find the slot of a key. If it isn't there then return the slot where
+**  it should be added which is the first freed slot in the probe sequence
+**  if any, otherwise the empty slot ending it.
+*/
+PRIVATE keynode * find_slot (HTHashtable * me, const char * key,
+			     unsigned int hash)
 {
-    int hash = 0;
+    int mask = me->size - 1;
+    int i = (int) (hash & mask);
+    keynode * freed = NULL;
+    for (;;) {
+	keynode * kn = me->table + i;
+	if (!kn->key)
+	    return freed ? freed : kn;
+	if (kn->key == HASH_DELETED) {
+	    if (!freed) freed = kn;
+	} else if (kn->hash == hash &&
+		   (kn->key == key || !strcmp(kn->key, key)))
+	    return kn;
+	i = (i + 1) & mask;
+    }
+}
 
-    if (key) {
-	const char * ptr = key;
-	for(; *ptr; ptr++)
-	    hash = (int) ((hash*3 + (*(unsigned char*)ptr)) % size);
+/*
+**  Move all elements to a new table of the given size. This also gets
+**  rid of the freed slots.
+*/
+PRIVATE void rehash (HTHashtable * me, int size)
+{
+    keynode * old = me->table;
+    int oldsize = me->size;
+    int i;
+    if ((me->table = (keynode *) HT_CALLOC(size, sizeof(keynode))) == NULL)
+	HT_OUTOFMEM("HTHashtable rehash");
+    me->size = size;
+    for (i = 0; i < oldsize; i++) {
+	if (old[i].key && old[i].key != HASH_DELETED) {
+	    int j = (int) (old[i].hash & (size - 1));
+	    while (me->table[j].key) j = (j + 1) & (size - 1);
+	    me->table[j] = old[i];
+	}
     }
-    return hash;
+    me->used = me->count;
+    HT_FREE(old);
 }
 
 /*
@@ -81,18 +171,28 @@ PRIVATE int hash_number (const char *key, int size)
 PUBLIC BOOL HTHashtable_addObject (HTHashtable *me, const char *key,
 				   void *newObject)
 {
-    if(me) {
-	int size = me->size;
-	int i = hash_number(key,size);
-	HTList *l = (HTList *)me->table[i];
-	keynode *kn;
-	if(!l)
-	    l = me->table[i] = HTList_new();
-	if ((kn = (keynode  *) HT_CALLOC(1, sizeof (keynode))) == NULL)
-	    HT_OUTOFMEM("HTHashtable_addObject");
-	StrAllocCopy(kn->key,key);
+    if(me && key) {
+	unsigned int hash = HTHash_string(key);
+	keynode * kn = find_slot(me, key, hash);
+	if (kn->key && kn->key != HASH_DELETED) {
+	    kn->object = newObject;
+	    return YES;
+	}
+
+	/* Make room if the table is getting full */
+	if (!kn->key && (me->used + 1) * 4 > me->size * 3) {
+	    rehash(me, (me->count + 1) * 2 > me->size ? me->size * 2 : me->size);
+	    kn = find_slot(me, key, hash);
+	}
+	if (!kn->key) me->used++;
+	if (me->interned)
+	    kn->key = HTAtom_name(HTAtom_for(key));
+	else {
+	    kn->key = NULL;
+	    StrAllocCopy(kn->key,key);
+	}
+	kn->hash = hash;
 	kn->object = newObject;
-	HTList_addObject(l,kn);
 	me->count++;
 	return YES;
     }
@@ -105,22 +205,21 @@ PUBLIC BOOL HTHashtable_addObject (HTHashtable *me, const char *key,
 )
 */
 
+PRIVATE void remove_slot (HTHashtable * me, keynode * kn)
+{
+    if (!me->interned) HT_FREE(kn->key);
+    kn->key = HASH_DELETED;
+    kn->object = NULL;
+    me->count--;
+}
+
 PUBLIC BOOL HTHashtable_removeObject (HTHashtable *me, const char *key)
 {
-    if(me) {
-	int size = me->size;
-	int i = hash_number(key,size);
-	HTList *l = (HTList *)me->table[i];
-	if(l) {
-	    HTList *cur = l;
-	    keynode *kn;
-	    while ((kn = (keynode *) HTList_nextObject(cur))) {
-		if(!strcmp(key,kn->key)) {
-		    HTList_removeObject(l,kn);
-		    me->count--;
-		    return YES;
-		}
-	    }
+    if(me && key) {
+	keynode * kn = find_slot(me, key, HTHash_string(key));
+	if (kn->key && kn->key != HASH_DELETED) {
+	    remove_slot(me, kn);
+	    return YES;
 	}
     }
     return NO;
@@ -134,18 +233,10 @@ PUBLIC BOOL HTHashtable_removeObject (HTHashtable *me, const char *key)
 
 PUBLIC void *HTHashtable_object (HTHashtable * me, const char *key)
 {
-    if(me) {
-	int size = me->size;
-	int i = hash_number(key,size);
-	HTList * l = (HTList *)me->table[i];
-	if (l) {
-	    HTList *cur = l;
-	    keynode *kn;
-	    while ((kn = (keynode *) HTList_nextObject(cur))) {
-		if(!strcmp(key,kn->key))
-		    return kn->object;
-	    }
-	}
+    if(me && key) {
+	keynode * kn = find_slot(me, key, HTHash_string(key));
+	if (kn->key && kn->key != HASH_DELETED)
+	    return kn->object;
     }
     return NULL;
 }
@@ -175,20 +266,13 @@ PUBLIC BOOL HTHashtable_walk (HTHashtable *me,
     if(me) {
 	int i, j;
 	for(i = 0; i< me->size; i++) {
-	    HTList *l = (HTList *)me->table[i];
-	    if(l) {
-		HTList *cur = l;
-		keynode *kn, *nextkn;
-		for(kn = (keynode *)HTList_nextObject(cur); kn; kn = nextkn) {
-		    j = walkFunc(me, kn->key, kn->object);
-		    if(j == 0)
-			return YES;
-		    nextkn = (keynode *)HTList_nextObject(cur);
-		    if (j < 0) {
-			HTList_removeObject(l, kn);
-			me->count--;
-		    }
-		}
+	    keynode * kn = me->table + i;
+	    if (kn->key && kn->key != HASH_DELETED) {
+		j = walkFunc(me, kn->key, kn->object);
+		if(j == 0)
+		    return YES;
+		if (j < 0 && kn->key != HASH_DELETED)
+		    remove_slot(me, kn);
 	    }
 	}
 	return YES;
@@ -207,17 +291,13 @@ PUBLIC HTArray * HTHashtable_keys (HTHashtable *me)
     if(me) {
 	HTArray *keys = HTArray_new(me->count);
 	int i;
-    
+
 	for(i = 0; i< me->size; i++) {
-	    HTList * l = (HTList *)me->table[i];
-	    if (l) {
-		HTList *cur = l;
-		keynode *kn;
-		while ((kn = (keynode *) HTList_nextObject(cur))) {
-		    char * nkey = NULL;
-		    StrAllocCopy(nkey,kn->key);
-		    HTArray_addObject(keys,nkey);
-		}
+	    keynode * kn = me->table + i;
+	    if (kn->key && kn->key != HASH_DELETED) {
+		char * nkey = NULL;
+		StrAllocCopy(nkey,kn->key);
+		HTArray_addObject(keys,nkey);
 	    }
 	}
 	return keys;
@@ -225,6 +305,28 @@ PUBLIC HTArray * HTHashtable_keys (HTHashtable *me)
     return NULL;
 }
 
+/*
+(
+   Extract in a dynamic array all objects of the Hash Table
+)
+*/
+
+PUBLIC HTArray * HTHashtable_values (HTHashtable *me)
+{
+    if(me) {
+	HTArray *values = HTArray_new(me->count > 0 ? me->count : 1);
+	int i;
+
+	for(i = 0; i< me->size; i++) {
+	    keynode * kn = me->table + i;
+	    if (kn->key && kn->key != HASH_DELETED)
+		HTArray_addObject(values, kn->object);
+	}
+	return values;
+    }
+    return NULL;
+}
+
 /*
 (
    Print the keys of the Hash Table
@@ -244,4 +346,3 @@ PUBLIC void HTHashtable_print (HTHashtable *me)
     }
     HTArray_delete(keys);
 }
-
@@ -47,6 +47,9 @@ PUBLIC HTHistory *HTHistory_new (void)
 PUBLIC BOOL HTHistory_delete (HTHistory * hist)
 {
     if (hist) {
+	HTAnchor * cur;
+	while ((cur = (HTAnchor *) HTList_removeLastObject(hist->alist)))
+	    HTAnchor_release(cur);
 	HTList_delete(hist->alist);
 	HT_FREE(hist);
 	return YES;
@@ -57,12 +60,14 @@ PUBLIC BOOL HTHistory_delete (HTHistory * hist)
 /*	Record an entry in a list
 **	-------------------------
 **      Registers the object in the linear list. The first entry is the
-**	home page. No check is done for duplicates.
+**	home page. No check is done for duplicates. The history holds a
+**	reference to the anchor for as long as it is in the list.
 **	Returns YES if ok, else NO
 */
 PUBLIC BOOL HTHistory_record (HTHistory * hist, HTAnchor * cur)
 {
-    return (hist && cur && HTList_addObject(hist->alist, cur) && hist->pos++);
+    return (hist && cur && HTList_addObject(hist->alist, cur) &&
+	    HTAnchor_addRef(cur) && hist->pos++);
 }
 
 /*	Replace list with new element
@@ -89,7 +94,9 @@ PUBLIC BOOL HTHistory_replace (HTHistory * hist, HTAnchor * cur)
 */
 PUBLIC BOOL HTHistory_removeLast (HTHistory * hist)
 {
-    return (hist && HTList_removeLastObject(hist->alist) && hist->pos--);
+    HTAnchor * cur;
+    return (hist && (cur = (HTAnchor *) HTList_removeLastObject(hist->alist)) &&
+	    HTAnchor_release(cur) && hist->pos--);
 }
 
 /*	Remove the History list from position
@@ -102,7 +109,10 @@ PUBLIC BOOL HTHistory_removeFrom  (HTHistory * hist, int pos)
 {
     if (hist && pos>=0) {
 	int cnt = HTList_count(hist->alist) - pos;
-	while (cnt-->0 && HTList_removeLastObject(hist->alist));
+	HTAnchor * cur;
+	while (cnt-->0 &&
+	       (cur = (HTAnchor *) HTList_removeLastObject(hist->alist)))
+	    HTAnchor_release(cur);
 	if (hist->pos > pos)
 	    hist->pos = pos;
 	return YES;
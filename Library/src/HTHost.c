@@ -22,6 +22,8 @@
 #include "HTTrans.h"
 #include "HTTPUtil.h"
 #include "HTTCP.h"
+#include "HTDNS.h"
+#include "HTInet.h"
 #include "HTHost.h"					 /* Implemented here */
 #include "HTHstMan.h"
 
@@ -39,13 +41,19 @@ struct _HTInputStream {
 };
 
 PRIVATE int HostEvent(SOCKET soc, void * pVoid, HTEventType type);
+PRIVATE BOOL _roomInPipe (HTHost * host);
+PRIVATE HTNet * best_pending (HTHost * host);
+PRIVATE BOOL add_pending_host (HTHost * host);
+PRIVATE BOOL request_allowed (HTHost * host);
+PRIVATE BOOL request_started (HTHost * host);
+PRIVATE BOOL delay_request (HTHost * host);
 
 /* Type definitions and global variables etc. local to this module */
 PRIVATE time_t	HostTimeout = HOST_OBJECT_TTL;	 /* Timeout for host objects */
 PRIVATE time_t	HTPassiveTimeout = TCP_IDLE_PASSIVE; /* Passive timeout in s */
 PRIVATE ms_t	HTActiveTimeout = TCP_IDLE_ACTIVE;   /* Active timeout in ms */
 
-PRIVATE HTList	** HostTable = NULL;
+PRIVATE HTHashtable * HostTable = NULL;	/* Lists of hosts by host name */
 PRIVATE HTList * PendHost = NULL;	    /* List of pending host elements */
 
 /* JK: New functions for interruption the automatic pending request 
@@ -60,6 +68,12 @@ PRIVATE int EventTimeout = -1;		        /* Global Host event timeout */
 PRIVATE ms_t WriteDelay = DEFAULT_DELAY;		      /* Delay in ms */
 
 PRIVATE int MaxPipelinedRequests = MAX_PIPES;
+PRIVATE int MaxConnections = 1;		      /* Connections per host by default */
+
+#define HOST_SHARE	1024	       /* Virtual time used by a weight 1 host */
+PRIVATE unsigned long VirtualTime = 0;	  /* Fair sharing of pending hosts */
+
+PRIVATE ms_t RequestDelay = 0;		  /* Time between requests to a host */
 
 /* ------------------------------------------------------------------------- */
 
@@ -73,6 +87,10 @@ PRIVATE void free_object (HTHost * me)
 	HT_FREE(me->user_agent);
 	HT_FREE(me->range_units);
 
+	/* Stop connecting to a second address (if any) */
+	HTDoCancelRace(me);
+	HTEvent_delete(me->race_event);
+
 	/* Delete the channel (if any) */
 	if (me->channel) {
 	    HTChannel_delete(me->channel, HT_OK);
@@ -83,8 +101,18 @@ PRIVATE void free_object (HTHost * me)
 	for (i = 0; i < HTEvent_TYPES; i++)
 	    HTEvent_delete(me->events[i]);
 
-	/* Delete the timer (if any) */
+	/* Delete the timers (if any) */
 	if (me->timer) HTTimer_delete(me->timer);
+	if (me->request_timer) HTTimer_delete(me->request_timer);
+
+	/* We are no longer waiting for a socket */
+	if (PendHost) HTList_removeObjectAll(PendHost, me);
+
+	/*
+	** Stop waiting for a DNS lookup (if any). The host may still be
+	** on a waiting list after it has left TCP_DNS
+	*/
+	HTDNS_cancelLookup(me);
 
 	/* Delete the queues */
 	HTList_delete(me->pipeline);
@@ -93,10 +121,18 @@ PRIVATE void free_object (HTHost * me)
     }
 }
 
+/*
+**	The list of hosts with a name is removed from the host table when
+**	the last host on it is deleted
+*/
 PRIVATE BOOL delete_object (HTList * list, HTHost * me)
 {
     HTTRACE(CORE_TRACE, "Host info... object %p from list %p\n" _ me _ list);
     HTList_removeObject(list, (void *) me);
+    if (HTList_isEmpty(list)) {
+	HTHashtable_removeObject(HostTable, me->hostname);
+	HTList_delete(list);
+    }
     free_object(me);
     return YES;
 }
@@ -166,6 +202,22 @@ PRIVATE int IdleTimeoutEvent (HTTimer * timer, void * param, HTEventType type)
     return HostEvent (sockfd, host, HTEvent_CLOSE);
 }
 
+/*
+**  The host is allowed to start another request so launch the next
+**  pending one
+*/
+PRIVATE int RequestDelayEvent (HTTimer * timer, void * param, HTEventType type)
+{
+    HTHost * host = (HTHost *) param;
+
+    HTTimer_delete(timer);
+    host->request_timer = NULL;
+
+    HTTRACE(CORE_TRACE, "Host Event.. Host %p may start another request\n" _ host);
+    HTHost_launchPending(host);
+    return HT_OK;
+}
+
 /*
 **	HostEvent - host event manager - recieves events from the event 
 **	manager and dispatches them to the client net objects by calling the 
@@ -267,6 +319,51 @@ PRIVATE int HostEvent (SOCKET soc, void * pVoid, HTEventType type)
     return HT_OK;
 }
 
+/*
+**	If we have a TTL for the persistent TCP connection of a host object
+**	then check that we haven't passed it. If we have then the channel is
+**	closed, otherwise it gets a new lease.
+*/
+PRIVATE void check_channel (HTHost * pres)
+{
+    if (pres->expires > 0) {
+	time_t t = time(NULL);
+	if (HTHost_isIdle(pres) && pres->expires < t) {
+	    HTTRACE(CORE_TRACE, "Host info... Persistent channel %p gotten cold\n" _ 
+		    pres->channel);
+	    HTHost_clearChannel(pres, HT_OK);
+	} else {
+	    pres->expires = t + HTPassiveTimeout;
+	    HTTRACE(CORE_TRACE, "Host info... REUSING CHANNEL %p\n" _ pres->channel);
+	}
+    }
+}
+
+PRIVATE HTHost * new_object (HTList * list, char * host, u_short u_port, int hash)
+{
+    HTHost * pres;
+    if ((pres = (HTHost *) HT_CALLOC(1, sizeof(HTHost))) == NULL)
+	HT_OUTOFMEM("HTHost_add");
+    pres->hash = hash;
+    StrAllocCopy(pres->hostname, host);
+    pres->u_port = u_port;
+    pres->ntime = time(NULL);
+    pres->mode = HT_TP_SINGLE;
+    pres->delay = WriteDelay;
+    pres->inFlush = NO;
+    pres->race_sock = INVSOC;
+    pres->race_home = -1;
+    {
+	int i;
+	for (i = 0; i < HTEvent_TYPES; i++)
+	    pres->events[i]= HTEvent_new(HostEvent, pres, HT_PRIORITY_MAX, EventTimeout);
+    }
+    HTTRACE(CORE_TRACE, "Host info... added `%s\' with host %p to list %p\n" _ 
+		host _ pres _ list);
+    HTList_appendObject(list, (void *) pres);
+    return pres;
+}
+
 /*
 **	Search the host info cache for a host object or create a new one
 **	and add it. Examples of host names are
@@ -288,22 +385,11 @@ PUBLIC HTHost * HTHost_new (char * host, u_short u_port)
 	return NULL;
     }
     
-    /* Find a hash for this host */
-    {
-	char *ptr;
-	for (ptr=host; *ptr; ptr++)
-	    hash = (int) ((hash * 3 + (*(unsigned char *) ptr)) % HOST_HASH_SIZE);
-	if (!HostTable) {
-	    if ((HostTable = (HTList **) HT_CALLOC(HOST_HASH_SIZE,
-						   sizeof(HTList *))) == NULL)
-	        HT_OUTOFMEM("HTHost_find");
-	}
-	if (!HostTable[hash]) HostTable[hash] = HTList_new();
-	list = HostTable[hash];
-    }
+    hash = (int) (HTHash_string(host) % HOST_HASH_SIZE);
+    if (!HostTable) HostTable = HTHashtable_new(HOST_HASH_SIZE);
 
-    /* Search the cache */
-    {
+    /* Search the list of hosts with this name */
+    if ((list = (HTList *) HTHashtable_object(HostTable, host)) != NULL) {
 	HTList * cur = list;
 	while ((pres = (HTHost *) HTList_nextObject(cur))) {
 	    if (!strcmp(pres->hostname, host) && u_port == pres->u_port) {
@@ -319,48 +405,95 @@ PUBLIC HTHost * HTHost_new (char * host, u_short u_port)
 
     /* If not found then create new Host object, else use existing one */
     if (pres) {
-	if (pres->channel) {
-
-            /*
-            **  If we have a TTL for this TCP connection then
-            **  check that we haven't passed it.
-            */
-            if (pres->expires > 0) {
-                time_t t = time(NULL);
-                if (HTHost_isIdle(pres) && pres->expires < t) {
-                    HTTRACE(CORE_TRACE, "Host info... Persistent channel %p gotten cold\n" _ 
-                        pres->channel);
-		    HTHost_clearChannel(pres, HT_OK);
-                } else {
-                    pres->expires = t + HTPassiveTimeout;
-                    HTTRACE(CORE_TRACE, "Host info... REUSING CHANNEL %p\n" _ pres->channel);
-                }
-            }
-	} else {
+	if (pres->channel)
+	    check_channel(pres);
+	else {
 	    HTTRACE(CORE_TRACE, "Host info... Found Host %p with no active channel\n" _ pres);
 	}
     } else {
-	if ((pres = (HTHost *) HT_CALLOC(1, sizeof(HTHost))) == NULL)
-	    HT_OUTOFMEM("HTHost_add");
-	pres->hash = hash;
-	StrAllocCopy(pres->hostname, host);
-	pres->u_port = u_port;
-	pres->ntime = time(NULL);
-	pres->mode = HT_TP_SINGLE;
-	pres->delay = WriteDelay;
-	pres->inFlush = NO;
-	{
-	    int i;
-	    for (i = 0; i < HTEvent_TYPES; i++)
-		pres->events[i]= HTEvent_new(HostEvent, pres, HT_PRIORITY_MAX, EventTimeout);
+	if ((list = (HTList *) HTHashtable_object(HostTable, host)) == NULL) {
+	    list = HTList_new();
+	    HTHashtable_addObject(HostTable, host, list);
 	}
-	HTTRACE(CORE_TRACE, "Host info... added `%s\' with host %p to list %p\n" _ 
-		    host _ pres _ list);
-	HTList_addObject(list, (void *) pres);
+	pres = new_object(list, host, u_port, hash);
     }
     return pres;
 }
 
+/*
+**	Pick one of the connections to a host. Several host objects can
+**	exist for the same host and port, each with its own channel, up to
+**	the number of connections allowed for the host. An idle persistent
+**	connection is reused first. Otherwise we open a new connection if
+**	we have a socket for it, and if not then we queue the request on
+**	the connection which has the fewest requests.
+*/
+PRIVATE HTHost * find_connection (char * host, u_short u_port)
+{
+    HTHost * first = HTHost_new(host, u_port);
+    HTList * cur;
+    HTHost * pres;
+    HTHost * idle = NULL;
+    HTHost * unused = NULL;
+    HTHost * least = NULL;
+    HTHost * least_connected = NULL;
+    int least_load = 0;
+    int least_connected_load = 0;
+    int count = 0;
+    int max;
+    if (!first) return NULL;
+    max = first->max_connections > 0 ? first->max_connections : MaxConnections;
+    if (max <= 1) return first;
+
+    cur = (HTList *) HTHashtable_object(HostTable, host);
+    while ((pres = (HTHost *) HTList_nextObject(cur))) {
+	int load;
+	if (pres->u_port != u_port || pres->listening) continue;
+	count++;
+	load = HTList_count(pres->pipeline) + HTList_count(pres->pending);
+	if (!load && !pres->lock) {
+	    if (pres->channel) check_channel(pres);
+	    if (pres->channel) {
+		if (!idle && _roomInPipe(pres)) idle = pres;
+	    } else if (!unused)
+		unused = pres;
+	}
+	if (!least || load < least_load) {
+	    least = pres;
+	    least_load = load;
+	}
+	if (pres->channel && (!least_connected || load < least_connected_load)) {
+	    least_connected = pres;
+	    least_connected_load = load;
+	}
+    }
+
+    if (idle) {
+	HTTRACE(CORE_TRACE, "Host info... Using idle connection %p to `%s\'\n" _ idle _ host);
+	return idle;
+    }
+    if (HTNet_availableSockets() > 0) {
+	if (unused) {
+	    HTTRACE(CORE_TRACE, "Host info... Using unconnected %p to `%s\'\n" _ unused _ host);
+	    return unused;
+	}
+	if (count < max) {
+	    HTList * list = (HTList *) HTHashtable_object(HostTable, host);
+	    pres = new_object(list, host, u_port, first->hash);
+	    pres->version = first->version;
+	    pres->methods = first->methods;
+	    pres->max_connections = first->max_connections;
+	    pres->delay = first->delay;
+	    HTTRACE(CORE_TRACE, "Host info... Opening connection %d of %d to `%s\'\n" _ 
+		    count+1 _ max _ host);
+	    return pres;
+	}
+    }
+    pres = least_connected ? least_connected : least ? least : first;
+    HTTRACE(CORE_TRACE, "Host info... Queuing on connection %p to `%s\'\n" _ pres _ host);
+    return pres;
+}
+
 PUBLIC HTHost * HTHost_newWParse (HTRequest * request, char * url, u_short u_port)
 {
     char * port;
@@ -395,13 +528,13 @@ PUBLIC HTHost * HTHost_newWParse (HTRequest * request, char * url, u_short u_por
     HTTRACE(PROT_TRACE, "HTHost parse Looking up `%s\' on port %u\n" _ parsedHost _ u_port);
 
     /* Find information about this host */
-    if ((me = HTHost_new(parsedHost, u_port)) == NULL) {
+    if ((me = find_connection(parsedHost, u_port)) == NULL) {
 	HTTRACE(PROT_TRACE, "HTHost parse Can't get host info\n");
 	me->tcpstate = TCP_ERROR;
 	return NULL;
     }
-    sin = &me->sock_addr;
-    memset((void *) sin, '\0', sizeof(SockA));
+    sin = &me->sock_addr.in;
+    memset((void *) &me->sock_addr, '\0', sizeof(SockAddr));
 #ifdef DECNET
     sin->sdn_family = AF_DECnet;
     net->sock_addr.sdn_objnum = port ? (unsigned char)(strtol(port, (char **) 0, 10)) : DNP_OBJ;
@@ -428,14 +561,10 @@ PUBLIC HTHost * HTHost_find (char * host)
     HTHost * pres = NULL;
     HTTRACE(CORE_TRACE, "Host info... Looking for `%s\'\n" _ host ? host : "<null>");
 
-    /* Find a hash for this host */
+    /* Find the list of hosts with this name */
     if (host && HostTable) {
-	int hash = 0;
-	char *ptr;
-	for (ptr=host; *ptr; ptr++)
-	    hash = (int) ((hash * 3 + (*(unsigned char *) ptr)) % HOST_HASH_SIZE);
-	if (!HostTable[hash]) return NULL;
-	list = HostTable[hash];
+	if ((list = (HTList *) HTHashtable_object(HostTable, host)) == NULL)
+	    return NULL;
 
 	/* Search the cache */
 	{
@@ -462,24 +591,23 @@ PUBLIC HTHost * HTHost_find (char * host)
 */
 PUBLIC void HTHost_deleteAll (void)
 {
-    HTList * list;
+    HTArray * lists;
+    HTList ** list;
     HTHost * host;
-    int i;
 
     if (!HostTable)
 	return;
 
-    for (i=0; i < HOST_HASH_SIZE; i++) {
-	list = HostTable[i];
-	if (!list) continue;
-
-	while ((host = (HTHost *) HTList_removeFirstObject(list)) != NULL)
+    lists = HTHashtable_values(HostTable);
+    for (list = (HTList **) HTArray_data(lists); list && *list; list++) {
+	while ((host = (HTHost *) HTList_removeFirstObject(*list)) != NULL)
 	    free_object(host);
 
-	HTList_delete(list);
+	HTList_delete(*list);
     }
+    HTArray_delete(lists);
 
-    HT_FREE(HostTable);
+    HTHashtable_delete(HostTable);
     HostTable = NULL;
 }
 
@@ -775,6 +903,7 @@ PUBLIC BOOL HTHost_closeNotification (HTHost * host)
 PUBLIC BOOL HTHost_clearChannel (HTHost * host, int status)
 {
     if (host && host->channel) {
+	HTDoCancelRace(host);
 	HTChannel_setHost(host->channel, NULL);
 	
 	HTEvent_unregister(HTChannel_socket(host->channel), HTEvent_READ);
@@ -983,17 +1112,31 @@ PUBLIC int HTHost_addNet (HTHost * host, HTNet * net)
 	int status = HT_OK;
 	BOOL doit = (host->doit==net);
 
+	/*
+	**  If we have made as many requests to this host as we are allowed
+	**  for now then the Net object must wait until the timer launches it.
+	**  Net objects launched from the pending queue have already been
+	**  checked.
+	*/
+	if (!doit && !request_allowed(host)) {
+	    if (!host->pending) host->pending = HTList_new();
+	    if (host->lock == net)
+		HTList_appendObject(host->pending, net);
+	    else
+		HTList_addObject(host->pending, net);
+ 	    HTTRACE(CORE_TRACE, "Host info... Added Net %p (request %p) as pending on delayed Host %p, %d pending\n" _ 
+			net _ net->request _ host _ HTList_count(host->pending));
+	    return HT_PENDING;
+	}
+
 	/*
 	**  If we don't have a socket already then check to see if we can get
 	**  one. Otherwise we put the host object into our pending queue.
 	*/
 	if (!host->channel && HTNet_availableSockets() <= 0) {
 
-	    /* Create list for pending Host objects */
-	    if (!PendHost) PendHost = HTList_new();
-
-	    /* Add the host object ad pending if not already */
-	    if (HTList_indexOf(PendHost, host) < 0) HTList_addObject(PendHost, host);
+	    /* Add the host object as pending if not already */
+	    add_pending_host(host);
 
 	    /* 
 	    ** Add the Net object to the Host object. If it is the current Net
@@ -1050,6 +1193,7 @@ PUBLIC int HTHost_addNet (HTHost * host, HTNet * net)
 	    if (!host->pipeline) host->pipeline = HTList_new();
 	    HTList_addObject(host->pipeline, net);
 	    host->reqsMade++;
+	    request_started(host);
             HTTRACE(CORE_TRACE, "Host info... Added Net %p (request %p) to pipe on Host %p, %d requests made, %d requests in pipe, %d pending\n" _ 
 			net _ net->request _ host _ host->reqsMade _ 
 			HTList_count(host->pipeline) _ HTList_count(host->pending));
@@ -1162,7 +1306,7 @@ PUBLIC BOOL HTHost_deleteNet (HTHost * host, HTNet * net, int status)
 	}
 
 	HTList_removeObjectAll(host->pending, net); /* just to make sure */
-	host->lock = HTList_firstObject(host->pending);
+	host->lock = best_pending(host);
 	return YES;
     }
     return NO;
@@ -1178,18 +1322,92 @@ PUBLIC BOOL HTHost_deleteNet (HTHost * host, HTNet * net, int status)
 **	requests as resources get available
 */
 
+/*
+**	The pending Net objects on a host are served in order of priority.
+**	Net objects with the same priority are served in the order they
+**	were added. Returns NULL if none.
+*/
+PRIVATE HTNet * best_pending (HTHost * host)
+{
+    HTList * cur = host ? host->pending : NULL;
+    HTNet * best = NULL;
+    HTNet * net;
+    while ((net = (HTNet *) HTList_nextObject(cur)))
+	if (!best || HTNet_priority(net) >= HTNet_priority(best)) best = net;
+    return best;
+}
+
+PRIVATE int pending_priority (HTHost * host)
+{
+    HTNet * net = best_pending(host);
+    return net ? HTNet_priority(net) : HT_PRIORITY_INV;
+}
+
+/*
+**	The priority of the pending work which this host can start right
+**	now. A host which has to wait before making another request has
+**	nothing to do for the moment.
+*/
+PRIVATE int ready_priority (HTHost * host)
+{
+    return request_allowed(host) ? pending_priority(host) : HT_PRIORITY_INV;
+}
+
+/*
+**	Find the pending host with the most urgent request, not counting
+**	the one given. Hosts with requests of the same priority get their
+**	turn in proportion to their weight.
+*/
+PRIVATE HTHost * best_pending_host (HTHost * exclude)
+{
+    HTList * cur = PendHost;
+    HTHost * best = NULL;
+    HTHost * pres;
+    int best_priority = HT_PRIORITY_INV;
+    while ((pres = (HTHost *) HTList_nextObject(cur))) {
+	int priority;
+	if (pres == exclude) continue;
+	if ((priority = ready_priority(pres)) == HT_PRIORITY_INV) continue;
+	if (!best || priority > best_priority ||
+	    (priority == best_priority && pres->vtime <= best->vtime)) {
+	    best = pres;
+	    best_priority = priority;
+	}
+    }
+    return best;
+}
+
+/*
+**	Add a host to the pending host queue if not already there. A host
+**	which has been waiting for a while doesn't get any credit for that
+**	compared to the hosts that have been served in the meantime.
+*/
+PRIVATE BOOL add_pending_host (HTHost * host)
+{
+    if (!PendHost) PendHost = HTList_new();
+    if (HTList_indexOf(PendHost, host) < 0) {
+	if (host->vtime < VirtualTime) host->vtime = VirtualTime;
+	HTList_addObject(PendHost, host);
+	return YES;
+    }
+    return NO;
+}
+
 /*
 **	Check this host object for any pending requests and return the next
-**	registered Net object.
+**	registered Net object. The Net object holding the lock goes first,
+**	otherwise the one with the highest priority.
 */
 PUBLIC HTNet * HTHost_nextPendingNet (HTHost * host)
 {
     HTNet * net = NULL;
     if (host && host->pending) {
-	/*JK 23/Sep/96 Bug correction. Associated the following lines to the
-	**above if. There was a missing pair of brackets. 
-	*/
-	if ((net = (HTNet *) HTList_removeFirstObject(host->pending)) != NULL) {
+	if (host->lock && HTList_indexOf(host->pending, host->lock) >= 0)
+	    net = host->lock;
+	else
+	    net = best_pending(host);
+	if (net) {
+	    HTList_removeObject(host->pending, net);
 	    HTTRACE(CORE_TRACE, "Host info... Popping %p from pending net queue on host %p\n" _ 
 			net _ host);
 #if 0
@@ -1206,15 +1424,31 @@ PUBLIC HTNet * HTHost_nextPendingNet (HTHost * host)
 }
 
 /*
-**	Return the current list of pending host objects waiting for a socket
+**	Return the next pending host object waiting for a socket. This is
+**	the one with the most urgent request and among hosts with equally
+**	urgent requests the one which has had the smallest share so far.
 */
 PUBLIC HTHost * HTHost_nextPendingHost (void)
 {
     HTHost * host = NULL;
     if (PendHost) {
-	if ((host = (HTHost *) HTList_removeFirstObject(PendHost)) != NULL)
+	HTList * cur = PendHost;
+	HTHost * pres;
+	if ((host = best_pending_host(NULL)) != NULL) {
+	    HTList_removeObject(PendHost, host);
+	    VirtualTime = host->vtime;
+	    host->vtime += HOST_SHARE / (host->weight > 0 ? host->weight : 1);
 	    HTTRACE(PROT_TRACE, "Host info... Popping %p from pending host queue\n" _ 
 			host);
+	}
+
+	/* Forget about hosts which have got nothing left to do */
+	while ((pres = (HTHost *) HTList_nextObject(cur))) {
+	    if (HTList_isEmpty(pres->pending)) {
+		HTList_removeObject(PendHost, pres);
+		cur = PendHost;
+	    }
+	}
     }
     return host;
 }
@@ -1244,9 +1478,43 @@ PUBLIC BOOL HTHost_launchPending (HTHost * host)
     }
 
     /*
-    **  Check the current Host object for pending Net objects
+    **  If another host is waiting for a socket with more urgent requests
+    **  than ours then let it go first. If we don't have a connection then
+    **  we queue up behind it and if we have an idle connection then we
+    **  give it up as we are out of sockets.
+    */
+    if (DoPendingReqLaunch && !HTList_isEmpty(PendHost)) {
+	HTHost * waiting = best_pending_host(host);
+	if (waiting &&
+	    ready_priority(waiting) > ready_priority(host)) {
+	    if (!host->channel) {
+		if (!HTList_isEmpty(host->pending)) add_pending_host(host);
+		goto launch_pending_host;
+	    } else if (HTList_isEmpty(host->pipeline) &&
+		       HTNet_availableSockets() <= 0) {
+		HTTRACE(CORE_TRACE, "Host info... Host %p yields its connection to %p\n" _ 
+			    host _ waiting);
+		if (!HTList_isEmpty(host->pending)) add_pending_host(host);
+		if (host->timer) {
+		    HTTimer_delete(host->timer);
+		    host->timer = NULL;
+		}
+		HTChannel_setSemaphore(host->channel, 0);
+		HTHost_clearChannel(host, HT_OK);
+		goto launch_pending_host;
+	    }
+	}
+    }
+
+    /*
+    **  Check the current Host object for pending Net objects. If we have
+    **  to wait before making another request to this host then set a
+    **  timer and see if any other host can use the socket meanwhile.
     */
-    if (_roomInPipe(host) && DoPendingReqLaunch &&
+    if (DoPendingReqLaunch && !HTList_isEmpty(host->pending) &&
+	!request_allowed(host)) {
+	delay_request(host);
+    } else if (_roomInPipe(host) && DoPendingReqLaunch &&
 	   (net = HTHost_nextPendingNet(host))) {
 	HTHost_ActivateRequest(net);
 	HTTRACE(CORE_TRACE, "Launch pending net object %p with %d reqs in pipe (%d reqs made)\n" _ 
@@ -1255,14 +1523,25 @@ PUBLIC BOOL HTHost_launchPending (HTHost * host)
     }
 
     /*
-    **  Check for other pending Host objects
+    **  Check for other pending Host objects. If we are losing our
+    **  connection while deleting a Net object and we have more urgent
+    **  requests pending than the other hosts then we keep the socket.
+    **  We are called again when the Net object is gone.
     */
+ launch_pending_host:
     if (DoPendingReqLaunch && HTNet_availableSockets() > 0) {
-	HTHost * pending = HTHost_nextPendingHost();
+	HTHost * pending;
+	if (!host->channel && !HTList_isEmpty(host->pipeline) &&
+	    !HTList_isEmpty(host->pending)) {
+	    HTHost * waiting = best_pending_host(host);
+	    if (waiting && ready_priority(host) > ready_priority(waiting))
+		return YES;
+	}
+	pending = HTHost_nextPendingHost();
 	if (pending && (net = HTHost_nextPendingNet(pending))) {
 	    if (!pending->pipeline) pending->pipeline = HTList_new();
 	    HTList_addObject(pending->pipeline, net);
-	    host->reqsMade++;
+	    pending->reqsMade++;
 	    HTTRACE(CORE_TRACE, "Launch pending host object %p, net %p with %d reqs in pipe (%d reqs made)\n" _ 
 			pending _ net _ HTList_count(pending->pipeline) _ pending->reqsMade);
 	    HTHost_ActivateRequest(net);
@@ -1310,7 +1589,7 @@ PUBLIC int HTHost_connect (HTHost * host, HTNet * net, char * url)
 	if (!host->lock && !host->channel) {
 	    HTNet * next_pending = NULL;
 	    host->forceWriteFlush = YES;
-	    host->lock = (next_pending = HTList_firstObject(host->pending)) ?
+	    host->lock = (next_pending = best_pending(host)) ?
 		next_pending : net;
 	    HTTRACE(CORE_TRACE, "Host connect Grabbing lock on Host %p with %p\n" _ host _ host->lock);
 	}
@@ -1331,7 +1610,7 @@ PUBLIC int HTHost_connect (HTHost * host, HTNet * net, char * url)
 	    **  take over the current lock
 	    */
 	    HTNet * next_pending = NULL;
-	    if ((next_pending = HTList_firstObject(host->pending))) {
+	    if ((next_pending = best_pending(host))) {
 		HTTRACE(CORE_TRACE, "Host connect Changing lock on Host %p to %p\n" _ 
 			host _ next_pending);
 		host->lock = next_pending;	    
@@ -1410,7 +1689,7 @@ PUBLIC int HTHost_accept (HTHost * host, HTNet * net, char * url)
 	    **  take over the current lock
 	    */
 	    HTNet * next_pending = NULL;
-	    if ((next_pending = HTList_firstObject(host->pending))) {
+	    if ((next_pending = best_pending(host))) {
 		HTTRACE(CORE_TRACE, "Host connect Changing lock on Host %p to %p\n" _ 
 			host _ next_pending);
 		host->lock = next_pending;	    
@@ -1456,9 +1735,17 @@ PUBLIC int HTHost_register (HTHost * host, HTNet * net, HTEventType type)
 		return NO;
 	    net->registeredFor ^= HTEvent_BITS(type);
 
-	    /* host object may already be registered */
-	    if (host->registeredFor & HTEvent_BITS(type))
+	    /*
+	    **  Host object may already be registered. The host event has
+	    **  the priority of the most urgent Net object waiting for it so
+	    **  that the event loop dispatches it before less urgent ones.
+	    */
+	    event = *(host->events+HTEvent_INDEX(type));
+	    if (host->registeredFor & HTEvent_BITS(type)) {
+		if (HTNet_priority(net) > event->priority)
+		    HTEvent_setPriority(event, HTNet_priority(net));
 		return YES;
+	    }
 	    host->registeredFor ^= HTEvent_BITS(type);
 
 #ifdef WWW_WIN_ASYNC
@@ -1470,6 +1757,7 @@ PUBLIC int HTHost_register (HTHost * host, HTNet * net, HTEventType type)
             /* JK:  register a request in the event structure */
 	    event =  *(host->events+HTEvent_INDEX(type));
 	    event->request = HTNet_request (net);
+	    HTEvent_setPriority(event, HTNet_priority(net));
 	    return HTEvent_register(HTChannel_socket(host->channel),
 				    type, event);
 	}
@@ -1527,7 +1815,7 @@ PUBLIC size_t HTHost_remainingRead (HTHost * host)
 PUBLIC SockA * HTHost_getSockAddr (HTHost * host)
 {
     if (!host) return NULL;
-    return &host->sock_addr;
+    return &host->sock_addr.in;
 }
 
 PUBLIC BOOL HTHost_setHome (HTHost * host, int home)
@@ -1771,6 +2059,175 @@ PUBLIC int HTHost_maxPipelinedRequests (void)
     return MaxPipelinedRequests;
 }
 
+PUBLIC BOOL HTHost_setMaxConnections (int max)
+{
+    if (max > 0) {
+	MaxConnections = max;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTHost_maxConnections (void)
+{
+    return MaxConnections;
+}
+
+PUBLIC BOOL HTHost_setMaxHostConnections (HTHost * host, int max)
+{
+    if (host && max >= 0) {
+	host->max_connections = max;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTHost_maxHostConnections (HTHost * host)
+{
+    if (!host) return -1;
+    return host->max_connections > 0 ? host->max_connections : MaxConnections;
+}
+
+/*
+**	Request rate. All connections to the same host and port share the
+**	limit which is kept in the first host object. We allow a request
+**	when the time has come for it, give or take the burst. This is the
+**	same as a token bucket holding as many tokens as the burst and
+**	getting a new token for every delay.
+*/
+PRIVATE HTHost * first_connection (HTHost * host)
+{
+    HTList * cur = HostTable ?
+	(HTList *) HTHashtable_object(HostTable, host->hostname) : NULL;
+    HTHost * pres;
+    while ((pres = (HTHost *) HTList_nextObject(cur)))
+	if (pres->u_port == host->u_port && !pres->listening) return pres;
+    return host;
+}
+
+PRIVATE ms_t request_delay (HTHost * first)
+{
+    return first->request_delay > 0 ? first->request_delay : RequestDelay;
+}
+
+PRIVATE ms_t next_request (HTHost * host)
+{
+    HTHost * first = first_connection(host);
+    ms_t delay = request_delay(first);
+    ms_t slack;
+    if (!delay) return 0;
+    slack = (first->request_burst > 1 ? first->request_burst - 1 : 0) * delay;
+    return first->request_next > slack ? first->request_next - slack : 0;
+}
+
+PRIVATE BOOL request_allowed (HTHost * host)
+{
+    ms_t next = host ? next_request(host) : 0;
+    return !next || HTGetTimeInMillis() >= next;
+}
+
+PRIVATE BOOL request_started (HTHost * host)
+{
+    if (host) {
+	HTHost * first = first_connection(host);
+	ms_t delay = request_delay(first);
+	if (delay) {
+	    ms_t now = HTGetTimeInMillis();
+	    if (first->request_next < now) first->request_next = now;
+	    first->request_next += delay;
+	}
+	return YES;
+    }
+    return NO;
+}
+
+PRIVATE BOOL delay_request (HTHost * host)
+{
+    if (host && !host->request_timer) {
+	ms_t next = next_request(host);
+	ms_t now = HTGetTimeInMillis();
+	if (next > now) {
+	    HTTRACE(CORE_TRACE, "Host info... Host %p waits %lu ms before the next request\n" _ 
+		    host _ next - now);
+	    host->request_timer = HTTimer_new(NULL, RequestDelayEvent, host,
+					      next - now, YES, NO);
+	    return YES;
+	}
+    }
+    return NO;
+}
+
+PUBLIC BOOL HTHost_setDefaultRequestDelay (ms_t delay)
+{
+    RequestDelay = delay;
+    HTTRACE(CORE_TRACE, "Host........ Default request delay is %lu ms\n" _ delay);
+    return YES;
+}
+
+PUBLIC ms_t HTHost_defaultRequestDelay (void)
+{
+    return RequestDelay;
+}
+
+PUBLIC BOOL HTHost_setRequestDelay (HTHost * host, ms_t delay)
+{
+    if (host) {
+	first_connection(host)->request_delay = delay;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC ms_t HTHost_requestDelay (HTHost * host)
+{
+    return host ? request_delay(first_connection(host)) : 0;
+}
+
+PUBLIC BOOL HTHost_setRequestBurst (HTHost * host, int burst)
+{
+    if (host && burst >= 0) {
+	first_connection(host)->request_burst = burst;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTHost_requestBurst (HTHost * host)
+{
+    if (!host) return -1;
+    {
+	HTHost * first = first_connection(host);
+	return first->request_burst > 0 ? first->request_burst : 1;
+    }
+}
+
+PUBLIC BOOL HTHost_setWeight (HTHost * host, int weight)
+{
+    if (host && weight > 0) {
+	host->weight = weight;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTHost_weight (HTHost * host)
+{
+    if (!host) return -1;
+    return host->weight > 0 ? host->weight : 1;
+}
+
+PUBLIC int HTHost_numberOfConnections (HTHost * host)
+{
+    int count = 0;
+    if (host && HostTable) {
+	HTList * cur = (HTList *) HTHashtable_object(HostTable, host->hostname);
+	HTHost * pres;
+	while ((pres = (HTHost *) HTList_nextObject(cur)))
+	    if (pres->u_port == host->u_port && pres->channel) count++;
+    }
+    return count;
+}
+
 PUBLIC void HTHost_setActivateRequestCallback (HTHost_ActivateRequestCallback * cbf)
 {
     HTTRACE(CORE_TRACE, "HTHost...... Registering %p\n" _ cbf);
@@ -184,7 +184,15 @@ PUBLIC const char * HTInetString (SockA * sin)
        other address spaces. */
     return inet_ntoa(sin->sin_addr);
 #endif
-    static char string[16];
+    static char string[64];
+#ifdef HT_IPV6
+    if (sin->sin_family == AF_INET6) {
+	if (!inet_ntop(AF_INET6, &((struct sockaddr_in6 *) sin)->sin6_addr,
+		       string, sizeof(string)))
+	    *string = '\0';
+	return string;
+    }
+#endif
     sprintf(string, "%d.%d.%d.%d",
 	    (int)*((unsigned char *)(&sin->sin_addr)+0),
 	    (int)*((unsigned char *)(&sin->sin_addr)+1),
@@ -209,7 +217,7 @@ PUBLIC const char * HTInetString (SockA * sin)
 PUBLIC int HTParseInet (HTHost * host, char * hostname, HTRequest * request)
 {
     int status = 1;
-    SockA *sin = &host->sock_addr;
+    SockA *sin = &host->sock_addr.in;
 
 #ifdef DECNET
     /* read Decnet node name. @@ Should know about DECnet addresses, but it's
@@ -233,6 +241,7 @@ PUBLIC int HTParseInet (HTHost * host, char * hostname, HTRequest * request)
 	    strptr++;
 	}
 	if (!*strptr) {
+	    sin->sin_family = AF_INET;
 #ifdef GUSI
 	    sin->sin_addr = inet_addr(hostname); 		 /* See netinet/in.h */
 #else
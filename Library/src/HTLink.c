@@ -87,6 +87,7 @@ PUBLIC BOOL HTLink_remove (HTAnchor * source, HTAnchor * destination)
 
     /* Remove if dest is the main link */
     if (source->mainLink.dest == destination) {
+	HTAnchor_removeSource(destination->parent, source);
 	source->mainLink.dest = NULL;
 	source->mainLink.type = NULL;
 	source->mainLink.method = METHOD_INVALID;
@@ -100,6 +101,7 @@ PUBLIC BOOL HTLink_remove (HTAnchor * source, HTAnchor * destination)
 	HTLink *pres;
 	while ((pres = (HTLink *) HTList_nextObject(cur))) {
 	    if (pres->dest == destination) {
+		HTAnchor_removeSource(destination->parent, source);
 		HTList_removeObject(source->links, pres);
 		HT_FREE(pres);
 		return YES;
@@ -119,6 +121,8 @@ PUBLIC BOOL HTLink_removeAll (HTAnchor * me)
     HTTRACE(ANCH_TRACE, "Link delete. from anchor %p\n" _ (void *) me);
 
     /* Remove if dest is the main link */
+    if (me->mainLink.dest)
+	HTAnchor_removeSource(me->mainLink.dest->parent, me);
     me->mainLink.dest = NULL;
     me->mainLink.type = NULL;
     me->mainLink.method = METHOD_INVALID;
@@ -128,8 +132,10 @@ PUBLIC BOOL HTLink_removeAll (HTAnchor * me)
     if (me->links) {
 	HTList *cur = me->links;
 	HTLink *pres;
-	while ((pres = (HTLink *) HTList_nextObject(cur)))
+	while ((pres = (HTLink *) HTList_nextObject(cur))) {
+	    if (pres->dest) HTAnchor_removeSource(pres->dest->parent, me);
 	    HT_FREE(pres);
+	}
 	HTList_delete(me->links);
 	me->links = NULL;
     }
@@ -147,6 +153,18 @@ PUBLIC BOOL HTLink_moveAll (HTAnchor * src, HTAnchor * dest)
     HTTRACE(ANCH_TRACE, "Link move... all from anchor %p to anchor %p\n" _ 
 		(void *) src _ (void *) dest);
 
+    /* The destinations are now linked to from dest instead of src */
+    if (dest->mainLink.dest)
+	HTAnchor_removeSource(dest->mainLink.dest->parent, dest);
+    if (src->mainLink.dest)
+	HTAnchor_moveSource(src->mainLink.dest->parent, src, dest);
+    if (src->links) {
+	HTList *cur = src->links;
+	HTLink *pres;
+	while ((pres = (HTLink *) HTList_nextObject(cur)))
+	    if (pres->dest) HTAnchor_moveSource(pres->dest->parent, src, dest);
+    }
+
     /* Move main link information */
     dest->mainLink.dest = src->mainLink.dest;
     dest->mainLink.type = src->mainLink.type;
@@ -162,8 +180,10 @@ PUBLIC BOOL HTLink_moveAll (HTAnchor * src, HTAnchor * dest)
     if (dest->links) {
 	HTList *cur = dest->links;
 	HTLink *pres;
-	while ((pres = (HTLink *) HTList_nextObject(cur)))
+	while ((pres = (HTLink *) HTList_nextObject(cur))) {
+	    if (pres->dest) HTAnchor_removeSource(pres->dest->parent, dest);
 	    HT_FREE(pres);
+	}
 	HTList_delete(dest->links);
     }
     dest->links = src->links;
@@ -27,6 +27,12 @@
 #include "HTHeader.h"
 #include "HTWWWStr.h"
 
+/* SSE2 is used for scanning header lines if the compiler has it */
+#if defined(HAVE_EMMINTRIN_H) && defined(__SSE2__)
+#include <emmintrin.h>
+#define HT_SSE2
+#endif
+
 #ifndef NO_CACHE
 #include "HTTee.h"
 #include "HTConLen.h"
@@ -54,7 +60,7 @@ struct _HTStream {
     HTFormat			target_format;
     HTChunk *			token;
     HTChunk *			value;
-    int				hash;
+    HTArena *			arena;
     HTEOLState			EOLstate;
     HTMIMEMode			mode;
     BOOL			transparent;
@@ -238,19 +244,21 @@ PRIVATE int _dispatchParsers (HTRequest * req, char * token, char * value)
     BOOL found = NO;
     BOOL local = NO;
     HTMIMEParseSet * parseSet;
+    unsigned int hash;
 
     /* In case we get an empty header consisting of a CRLF, we fall thru */
     HTTRACE(STREAM_TRACE, "MIME header. %s: %s\n" _ 
 			      token ? token : "<null>" _ 
 			      value ? value : "<null>");
     if (!token) return HT_OK;			    /* Ignore noop token */
+    hash = HTHash_caseString(token);
 
     /*
     ** Search the local set of MIME parsers
     */
     if ((parseSet = HTRequest_MIMEParseSet(req, &local)) != NULL) {
-        status = HTMIMEParseSet_dispatch(parseSet, req, 
-					 token, value, &found);
+        status = HTMIMEParseSet_dispatchHash(parseSet, req, 
+					     token, hash, value, &found);
 	if (found) return status;
     }
 
@@ -258,8 +266,8 @@ PRIVATE int _dispatchParsers (HTRequest * req, char * token, char * value)
     ** Search the global set of MIME parsers
     */
     if (local==NO && (parseSet = HTHeader_MIMEParseSet()) != NULL) {
-	status = HTMIMEParseSet_dispatch(parseSet, req, 
-					 token, value, &found);
+	status = HTMIMEParseSet_dispatchHash(parseSet, req, 
+					     token, hash, value, &found);
 	if (found) return status;
     }
 
@@ -290,6 +298,96 @@ PRIVATE int _stream2dispatchParsers (HTStream * me)
     return (_dispatchParsers (me->request, token, value));
 }
 
+/*
+**	Find the first CR or LF in the buffer, or the end of it. With SSE2
+**	we look at 16 bytes at a time which pays off for long values like
+**	cookies.
+*/
+PRIVATE const char * find_eol (const char * ptr, const char * end)
+{
+#ifdef HT_SSE2
+    const __m128i cr = _mm_set1_epi8(CR);
+    const __m128i lf = _mm_set1_epi8(LF);
+    while (end - ptr >= 16) {
+	__m128i data = _mm_loadu_si128((const __m128i *) ptr);
+	int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, cr),
+						  _mm_cmpeq_epi8(data, lf)));
+	if (mask) {
+	    while (!(mask & 1)) mask >>= 1, ptr++;
+	    return ptr;
+	}
+	ptr += 16;
+    }
+#endif
+    while (ptr < end && *ptr != CR && *ptr != LF) ptr++;
+    return ptr;
+}
+
+/*
+**	Dispatch a header line found in one piece. The chunks are only used
+**	to get the token and the value terminated, like the state machine
+**	does it so that an empty value is an empty string.
+*/
+PRIVATE int dispatch_line (HTStream * me, const char * token, int tokenlen,
+			   const char * value, int valuelen)
+{
+    int status;
+    HTChunk_putb(me->token, token, tokenlen);
+    HTChunk_putc(me->token, '\0');
+    HTChunk_putb(me->value, value, valuelen);
+    HTChunk_putc(me->value, '\0');
+    status = _stream2dispatchParsers(me);
+    HTChunk_truncate(me->token, 0);
+    HTChunk_truncate(me->value, 0);
+    return status;
+}
+
+/*
+**	Fast path for header lines that are all in the buffer. Starting at
+**	the beginning of a line, we dispatch each line that ends with CR, LF
+**	or CRLF and is followed by the start of a new header line. We stop
+**	at a line which is folded, ends the header, has no token, or isn't
+**	all there, and leave that to the state machine in HTMIME_put_block.
+**	Returns the number of bytes used, and the status of the last
+**	dispatch in *status.
+*/
+PRIVATE int parse_lines (HTStream * me, const char * b, int l, int * status)
+{
+    const char * line = b;
+    const char * end = b + l;
+    *status = HT_OK;
+    while (line < end) {
+	const char * ptr = line;
+	const char * token_end;
+	const char * value;
+	const char * eol;
+
+	/* The token ends with a colon or white space */
+	while (ptr < end && *ptr != ':' && !isspace((int) *ptr)) ptr++;
+	if (ptr == line || ptr == end || *ptr == CR || *ptr == LF) break;
+	token_end = ptr;
+
+	/* The value starts after any colons and white space */
+	while (ptr < end && *ptr != CR && *ptr != LF &&
+	       (*ptr == ':' || isspace((int) *ptr)))
+	    ptr++;
+	value = ptr;
+	eol = find_eol(ptr, end);
+
+	/* Only if a new line starts after the end of line */
+	ptr = eol;
+	if (ptr < end && *ptr == CR) ptr++;
+	if (ptr < end && *ptr == LF) ptr++;
+	if (ptr >= end || isspace((int) *ptr)) break;
+
+	*status = dispatch_line(me, line, token_end-line, value, eol-value);
+	HTNet_addBytesRead(me->net, ptr-line);
+	line = ptr;
+	if (*status != HT_OK && *status != HT_LOADED) break;
+    }
+    return line - b;
+}
+
 /*
 **	Header is terminated by CRCR, LFLF, CRLFLF, CRLFCRLF
 **	Folding is either of CF LWS, LF LWS, CRLF LWS
@@ -301,8 +399,19 @@ PRIVATE int HTMIME_put_block (HTStream * me, const char * b, int l)
     const char * value = HTChunk_size(me->value) > 0 ? b : NULL;
     int length = l;
     int status;
+    BOOL fast = (me->EOLstate == EOL_BEGIN && !me->haveToken &&
+		 !HTChunk_size(me->token) && !HTChunk_size(me->value));
 
     while (!me->transparent) {
+	if (fast) {
+	    int used = parse_lines(me, b, l, &status);
+	    fast = NO;
+	    if (used) {
+		b += used, l -= used;
+		start = b, end = b;
+		if (status != HT_OK && status != HT_LOADED) return status;
+	    }
+	}
 	if (me->EOLstate == EOL_FCR) {
 	    if (*b == CR)				    /* End of header */
 	        me->EOLstate = EOL_END;
@@ -338,10 +447,6 @@ PRIVATE int HTMIME_put_block (HTStream * me, const char * b, int l)
 		    HTChunk_putb(me->token, start, end-start);
 		    HTChunk_putc(me->token, '\0');
 		    me->haveToken = YES;
-		} else {
-		    unsigned char ch = *(unsigned char *) b;
-		    ch = TOLOWER(ch);
-		    me->hash = (me->hash * 3 + ch) % MIME_HASH_SIZE;
 		}
 	    } else if (value == NULL && *b != ':' && !isspace((int) *b))
 	        value = b;
@@ -373,8 +478,8 @@ PRIVATE int HTMIME_put_block (HTStream * me, const char * b, int l)
 		    HTChunk_truncate(me->token,0);
 		    HTChunk_truncate(me->value,0);
 		    me->haveToken = NO;
-		    me->hash = 0;
 		    value = NULL;
+		    fast = YES;
 		}
 		me->EOLstate = EOL_BEGIN;
 		if (ret != HT_OK && ret != HT_LOADED) return ret;
@@ -497,7 +602,7 @@ PRIVATE int HTMIME_free (HTStream * me)
     HTTRACE(PROT_TRACE, "MIME........ FREEING....\n");
     HTChunk_delete(me->token);
     HTChunk_delete(me->value);
-    HT_FREE(me);
+    HTArena_deleteObject(me->arena, me);
     return status;
 }
 
@@ -510,7 +615,7 @@ PRIVATE int HTMIME_abort (HTStream * me, HTList * e)
     HTTRACE(PROT_TRACE, "MIME........ ABORTING...\n");
     HTChunk_delete(me->token);
     HTChunk_delete(me->value);
-    HT_FREE(me);
+    HTArena_deleteObject(me->arena, me);
     return status;
 }
 
@@ -543,19 +648,18 @@ PUBLIC HTStream* HTMIMEConvert (HTRequest *	request,
 				HTFormat	output_format,
 				HTStream *	output_stream)
 {
-    HTStream * me;
-    if ((me = (HTStream *) HT_CALLOC(1, sizeof(* me))) == NULL)
-        HT_OUTOFMEM("HTMIMEConvert");
+    HTArena * arena = HTRequest_arena(request);
+    HTStream * me = (HTStream *) HTArena_newObject(arena, sizeof(* me));
     me->isa = &HTMIME;       
+    me->arena = arena;
     me->request = request;
     me->response = HTRequest_response(request);
     me->net = HTRequest_net(request);
     me->target = output_stream;
     me->target_format = output_format;
     me->save_stream = LocalSaveStream ? LocalSaveStream : HTBlackHoleConverter;
-    me->token = HTChunk_new(256);
-    me->value = HTChunk_new(256);
-    me->hash = 0;
+    me->token = HTChunk_newArena(arena, 256);
+    me->value = HTChunk_newArena(arena, 256);
     me->EOLstate = EOL_BEGIN;
     me->haveToken = NO;
     return me;
@@ -767,27 +871,22 @@ PUBLIC HTConverter * HTMIME_saveStream (void)
  */
 PRIVATE void HTMIME_anchor2response (HTRequest * req)
 {
-  char * token;
-  char * value;
-  HTAssocList * header;
-  HTAssoc * pres;
+  HTFieldList * header;
   HTResponse * res;
   HTParentAnchor * anchor;
+  int cnt;
 
   if (!req)
     return;
   
   anchor = HTRequest_anchor (req);
-  header = HTAnchor_header (anchor);
+  header = HTAnchor_fields (anchor);
   if (!anchor || !header)
     return;
 
-  while ((pres = (HTAssoc *) HTAssocList_nextObject (header)))
-    {
-      token = HTAssoc_name (pres);
-      value = HTAssoc_value (pres);
-      _dispatchParsers (req, token, value);
-    }
+  for (cnt = 0; cnt < HTFieldList_count (header); cnt++)
+    _dispatchParsers (req, HTFieldList_name (header, cnt),
+		      HTFieldList_value (header, cnt));
   
   /*
   **  Notify the response object not to delete the lists that we
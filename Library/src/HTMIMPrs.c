@@ -16,6 +16,7 @@
 #include "wwwsys.h"
 #include "HTUtils.h"
 #include "HTString.h"
+#include "HTHash.h"
 #include "HTMIMPrs.h"
 
 struct _HTMIMEParseEl{
@@ -54,16 +55,7 @@ PRIVATE int HTMIMEParseEl_delete(HTMIMEParseEl * me, HTMIMEParseEl ** pBefore)
 
 PRIVATE int HTMIMEParseSet_hash(HTMIMEParseSet * me, const char * token)
 {
-    int ret;
-    const char * p;
-
-    for (p=token, ret=0; *p; p++) {
-        char ch;
-        ch = *(unsigned char *) p;
-	ch = TOLOWER(ch);
-        ret = (ret * 3 +(ch)) % me->size;
-    }
-    return ret;
+    return (int) (HTHash_caseString(token) % me->size);
 }
 
 PUBLIC HTMIMEParseSet * HTMIMEParseSet_new(int hashSize)
@@ -156,6 +148,15 @@ PUBLIC int HTMIMEParseSet_delete (HTMIMEParseSet * me, const char * token)
 */
 PUBLIC int HTMIMEParseSet_dispatch (HTMIMEParseSet * me, HTRequest * request, 
 				    char * token, char * value, BOOL * pFound)
+{
+    return HTMIMEParseSet_dispatchHash(me, request, token,
+				       HTHash_caseString(token), value, pFound);
+}
+
+PUBLIC int HTMIMEParseSet_dispatchHash (HTMIMEParseSet * me,
+					HTRequest * request, char * token,
+					unsigned int tokenHash, char * value,
+					BOOL * pFound)
 {
     int hash;
     HTResponse * response = HTRequest_response(request);
@@ -167,12 +168,12 @@ PUBLIC int HTMIMEParseSet_dispatch (HTMIMEParseSet * me, HTRequest * request,
     **  Get a hash value for this token. This has is a function of the hash
     **  size given when the MIME header parse set was created.
     */
-    hash = HTMIMEParseSet_hash(me, token);
+    hash = me->size > 0 ? (int) (tokenHash % me->size) : 0;
 
     /*
     **  Search for an exact match
     */
-    for (pEl = me->parsers[hash]; pEl; pEl = pEl->next) {
+    for (pEl = me->parsers ? me->parsers[hash] : NULL; pEl; pEl = pEl->next) {
         if ((pEl->caseSensitive && !strcmp(pEl->token, token)) || 
 	    (!pEl->caseSensitive && !strcasecomp(pEl->token, token))) {
 	    if (pFound) *pFound = YES;
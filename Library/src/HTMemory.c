@@ -7,6 +7,13 @@
 **
 ** History:
 **	 8 Feb 95	Written by Eric and Henrik
+**
+**	Small blocks come from slab caches, one for each multiple of
+**	SLAB_GRAIN bytes up to SLAB_MAX. A cache gets memory from malloc()
+**	SLAB_CHUNK bytes at a time and keeps the blocks that are freed on a
+**	free list linked through the blocks themselves. The chunks are never
+**	given back. We keep the chunks sorted by address so that
+**	HTMemory_free() can tell which blocks are ours.
 */
 
 /* Library include files */
@@ -19,6 +26,143 @@ PRIVATE HTList * HTMemCall = NULL;		    /* List of memory freers */
 PRIVATE HTMemory_exitCallback * PExit = NULL;	  /* panic and exit function */
 PRIVATE size_t LastAllocSize = 0;		  /* size of last allocation */ 
 
+PRIVATE unsigned long Allocations = 0;		 /* Successful allocations */
+PRIVATE unsigned long Reallocations = 0;
+PRIVATE unsigned long Frees = 0;
+
+#define SLAB_GRAIN	16		 /* Sizes are rounded up to this */
+#define SLAB_MAX	256		 /* Larger blocks come from malloc() */
+#define SLAB_CLASSES	(SLAB_MAX / SLAB_GRAIN)
+#define SLAB_CHUNK	16384		       /* Memory we get at a time */
+
+#define SLAB_CLASS(size)	(((size) - 1) / SLAB_GRAIN)
+#define SLAB_SIZE(cls)		(((cls) + 1) * SLAB_GRAIN)
+#define NEXT_FREE(block)	(*(void **) (block))
+
+typedef struct _HTSlab {
+    void *		free;				   /* Freed blocks */
+    char *		next;		     /* Unused part of the last chunk */
+    char *		end;
+    HTSlabStatistics	stats;
+} HTSlab;
+
+typedef struct _HTSlabChunk {
+    char *		base;
+    int			cls;
+} HTSlabChunk;
+
+PRIVATE BOOL SlabCache = YES;
+PRIVATE HTSlab Slabs[SLAB_CLASSES];
+PRIVATE HTSlabChunk * Chunks = NULL;		      /* Sorted by address */
+PRIVATE int ChunkCount = 0;
+PRIVATE int ChunkSize = 0;
+
+/* ------------------------------------------------------------------------- */
+/*				Slab Caches				     */
+/* ------------------------------------------------------------------------- */
+
+/*
+**	Returns the class of the chunk that the block is in, or -1 if the
+**	block didn't come from a slab cache.
+*/
+PRIVATE int slab_class (void * ptr)
+{
+    int low = 0;
+    int high = ChunkCount - 1;
+    while (low <= high) {
+	int mid = (low + high) / 2;
+	char * base = Chunks[mid].base;
+	if ((char *) ptr < base)
+	    high = mid - 1;
+	else if ((char *) ptr >= base + SLAB_CHUNK)
+	    low = mid + 1;
+	else
+	    return Chunks[mid].cls;
+    }
+    return -1;
+}
+
+/*
+**	Get a new chunk for a class. The chunk table is managed with plain
+**	malloc() so that we don't call ourselves.
+*/
+PRIVATE BOOL slab_grow (int cls)
+{
+    char * base;
+    int pos;
+    if (ChunkCount >= ChunkSize) {
+	int size = ChunkSize ? ChunkSize * 2 : 64;
+	HTSlabChunk * chunks;
+	if ((chunks = (HTSlabChunk *)
+	     realloc(Chunks, size * sizeof(HTSlabChunk))) == NULL)
+	    return NO;
+	Chunks = chunks;
+	ChunkSize = size;
+    }
+    if ((base = (char *) malloc(SLAB_CHUNK)) == NULL) return NO;
+    for (pos = ChunkCount; pos > 0 && Chunks[pos-1].base > base; pos--)
+	Chunks[pos] = Chunks[pos-1];
+    Chunks[pos].base = base;
+    Chunks[pos].cls = cls;
+    ChunkCount++;
+    Slabs[cls].next = base;
+    Slabs[cls].end = base + SLAB_CHUNK;
+    Slabs[cls].stats.chunks++;
+    return YES;
+}
+
+PRIVATE void * slab_alloc (size_t size)
+{
+    int cls = SLAB_CLASS(size);
+    HTSlab * slab = &Slabs[cls];
+    void * ptr;
+    if (slab->free) {
+	ptr = slab->free;
+	slab->free = NEXT_FREE(ptr);
+    } else {
+	size_t block = SLAB_SIZE(cls);
+	if (slab->end - slab->next < (long) block && !slab_grow(cls))
+	    return NULL;
+	ptr = slab->next;
+	slab->next += block;
+    }
+    slab->stats.allocations++;
+    if (++slab->stats.in_use > slab->stats.high_water)
+	slab->stats.high_water = slab->stats.in_use;
+    return ptr;
+}
+
+PRIVATE void slab_free (void * ptr, int cls)
+{
+    HTSlab * slab = &Slabs[cls];
+    NEXT_FREE(ptr) = slab->free;
+    slab->free = ptr;
+    slab->stats.frees++;
+    slab->stats.in_use--;
+}
+
+PUBLIC BOOL HTMemory_setSlabCache (BOOL mode)
+{
+    SlabCache = mode;
+    return YES;
+}
+
+PUBLIC BOOL HTMemory_slabCache (void)
+{
+    return SlabCache;
+}
+
+PUBLIC BOOL HTMemory_slabStatistics (size_t size, HTSlabStatistics * stats)
+{
+    if (size > 0 && size <= SLAB_MAX && stats) {
+	int cls = SLAB_CLASS(size);
+	*stats = Slabs[cls].stats;
+	stats->size = SLAB_SIZE(cls);
+	return YES;
+    }
+    return NO;
+}
+
 /* ------------------------------------------------------------------------- */
 
 /*	HTMemoryCall_add
@@ -65,14 +209,25 @@ PUBLIC BOOL HTMemoryCall_deleteAll (void)
 PUBLIC void * HTMemory_malloc (size_t size)
 {
     void * ptr;
+    if (SlabCache && size > 0 && size <= SLAB_MAX &&
+	(ptr = slab_alloc(size)) != NULL) {
+	Allocations++;
+	return ptr;
+    }
     ptr = malloc(LastAllocSize = size);
-    if (ptr != NULL) return ptr;
+    if (ptr != NULL) {
+	Allocations++;
+	return ptr;
+    }
     if (HTMemCall) {
 	HTMemoryCallback * pres;
 	while ((pres = (HTMemoryCallback *) HTList_nextObject(HTMemCall))) {
 	    HTTRACE(MEM_TRACE, "Mem Calling. %p (size %d)\n" _ (void*)pres _ size);
 	    (*pres)(size);
-	    if ((ptr = malloc(size)) != NULL) return ptr;
+	    if ((ptr = malloc(size)) != NULL) {
+		Allocations++;
+		return ptr;
+	    }
 	}
     }
     HTTRACE(MEM_TRACE, "Memory.... Couldn't allocate %d bytes\n" _ size);
@@ -85,8 +240,17 @@ PUBLIC void * HTMemory_malloc (size_t size)
 PUBLIC void * HTMemory_calloc (size_t nobj, size_t size)
 {
     void * ptr;
+    if (SlabCache && size > 0 && nobj > 0 && nobj <= SLAB_MAX / size &&
+	(ptr = slab_alloc(nobj * size)) != NULL) {
+	memset(ptr, 0, nobj * size);
+	Allocations++;
+	return ptr;
+    }
     ptr = calloc(nobj, LastAllocSize = size);
-    if (ptr != NULL) return ptr;
+    if (ptr != NULL) {
+	Allocations++;
+	return ptr;
+    }
     if (HTMemCall) {
 	HTMemoryCallback * pres;
 	size_t total = size * nobj;
@@ -94,7 +258,10 @@ PUBLIC void * HTMemory_calloc (size_t nobj, size_t size)
 	    HTTRACE(MEM_TRACE, "Mem Calling. %p (size %d)\n" _ 
 				   (void *) pres _ total);
 	    (*pres)(total);
-	    if ((ptr = calloc(nobj, size)) != NULL) return ptr;
+	    if ((ptr = calloc(nobj, size)) != NULL) {
+		Allocations++;
+		return ptr;
+	    }
 	}
     }
     HTTRACE(MEM_TRACE, "Memory...... Couldn't allocate %d objects of size %d\n" _ 
@@ -108,14 +275,40 @@ PUBLIC void * HTMemory_calloc (size_t nobj, size_t size)
 PUBLIC void * HTMemory_realloc (void * p, size_t size)
 {
     void * ptr;
+    int cls;
+
+    /*
+    **  A block from a slab cache is kept if the new size fits in it, else
+    **  it is moved to a new block
+    */
+    if (p && (cls = slab_class(p)) >= 0) {
+	size_t old = SLAB_SIZE(cls);
+	if (size > 0 && size <= old) {
+	    Reallocations++;
+	    return p;
+	}
+	if ((ptr = HTMemory_malloc(size ? size : 1)) != NULL) {
+	    memcpy(ptr, p, size < old ? size : old);
+	    slab_free(p, cls);
+	    Allocations--;
+	    Reallocations++;
+	}
+	return ptr;
+    }
     ptr = realloc(p, LastAllocSize = size);
-    if (ptr != NULL) return ptr;
+    if (ptr != NULL) {
+	if (p) Reallocations++; else Allocations++;
+	return ptr;
+    }
     if (HTMemCall) {
 	HTMemoryCallback * pres;
 	while ((pres = (HTMemoryCallback *) HTList_nextObject(HTMemCall))) {
 	    HTTRACE(MEM_TRACE, "Mem Calling. %p (size %d)\n" _ (void*)pres _ size);
 	    (*pres)(size);
-	    if ((ptr = realloc(p, size)) != NULL) return ptr;
+	    if ((ptr = realloc(p, size)) != NULL) {
+		if (p) Reallocations++; else Allocations++;
+		return ptr;
+	    }
 	}
     }
     HTTRACE(MEM_TRACE, "Memory...... Couldn't reallocate %d bytes\n" _ size);
@@ -128,11 +321,34 @@ PUBLIC void * HTMemory_realloc (void * p, size_t size)
 PUBLIC void HTMemory_free (void * ptr)
 {
     if (ptr) {
+	int cls = ChunkCount ? slab_class(ptr) : -1;
 	HTTRACE(MEM_TRACE, "Memory Free. %p\n" _ ptr);
-	free(ptr);
+	if (cls >= 0)
+	    slab_free(ptr, cls);
+	else
+	    free(ptr);
+	Frees++;
     }
 }
 
+/*	Allocation Counters
+**	-------------------
+*/
+PUBLIC unsigned long HTMemory_allocations (void)
+{
+    return Allocations;
+}
+
+PUBLIC unsigned long HTMemory_reallocations (void)
+{
+    return Reallocations;
+}
+
+PUBLIC unsigned long HTMemory_frees (void)
+{
+    return Frees;
+}
+
 /*	HTMemory_setExit
 **	----------------
 **	Register the memory exit function. This function notifies the user that
@@ -304,6 +304,9 @@ PUBLIC int HTNetCall_executeAfter (HTList * list, HTRequest * request,
 	HTResponse * response = HTRequest_response(request);
 	if (list && request && addr) {
 	    AfterFilter * pres;
+
+	    /* The filters may delete the request but we still need the anchor */
+	    HTAnchor_addRef((HTAnchor *) anchor);
 	    while ((pres = (AfterFilter *) HTList_nextObject(list))) {
 		if ((pres->status == status || pres->status == HT_ALL) &&
 		    (!pres->tmplate ||
@@ -321,6 +324,7 @@ PUBLIC int HTNetCall_executeAfter (HTList * list, HTRequest * request,
 		    if ((url = HTAnchor_physical(anchor))) addr = url;
 		}
 	    }
+	    HTAnchor_release((HTAnchor *) anchor);
 	}
 	if (!url) HT_FREE(addr);
     }
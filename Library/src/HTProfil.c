@@ -15,6 +15,7 @@
 #include "WWWCache.h"
 #include "WWWStream.h"
 #include "HTInit.h"
+#include "HTBufPool.h"
 #include "HTProfil.h"				         /* Implemented here */
 
 PRIVATE HTList * converters = NULL;
@@ -45,6 +46,9 @@ PUBLIC void HTProfile_delete (void)
 
 	/* Terminate libwww */
 	HTLibTerminate();
+
+	/* Free the idle input buffers */
+	HTBufferPool_deleteAll();
     }
 }
 
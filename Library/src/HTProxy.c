@@ -33,6 +33,7 @@
 typedef struct _HTProxy {
     char *	access;
     char *	url;			          /* URL of Gateway or Proxy */
+    int		order;			       /* Position in compiled list */
 #ifdef HT_POSIX_REGEX
     regex_t *	regex;				  /* Compiled regex */
 #endif
@@ -56,6 +57,27 @@ PRIVATE int      noproxy_is_onlyproxy = 0; /* Interpret the noproxy list as an o
 PRIVATE HTList * onlyproxy = NULL;  /* Proxy only on these hosts and domains */
 #endif
 
+/*
+**	The lists are compiled into hash tables the first time they are
+**	searched after a change. Plain noproxy entries are indexed by host or
+**	domain name so that a lookup costs one probe per label of the host
+**	name, and plain proxies are indexed by access method. Only regex
+**	entries are still tried one by one. As long as there are no regex
+**	entries, the result is also remembered per access, host and port.
+*/
+#define PROXY_HASH_SIZE		64
+#define PROXY_RESULTS_MAX	1024
+
+PRIVATE BOOL	      proxy_compiled = NO;
+PRIVATE HTHashtable * noproxy_hosts = NULL;	    /* Domain -> entry list */
+PRIVATE HTHashtable * proxy_access = NULL;	     /* Access -> HTProxy */
+PRIVATE HTHashtable * proxy_results = NULL;	  /* Results per host:port */
+PRIVATE char	      proxy_none[] = "";	    /* Result for "no proxy" */
+#ifdef HT_POSIX_REGEX
+PRIVATE HTList *      noproxy_regex = NULL;	/* Noproxy regex entries */
+PRIVATE HTList *      proxy_regex = NULL;	  /* Proxy regex entries */
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef HT_POSIX_REGEX
@@ -87,6 +109,188 @@ PRIVATE regex_t * get_regex_t (const char * regex_str, int cflags)
 }
 #endif
 
+/*
+**	Compiled lists
+**	--------------
+*/
+PRIVATE int free_domain (HTHashtable * table, char * key, void * object)
+{
+    HTList_delete((HTList *) object);
+    return 1;
+}
+
+PRIVATE int free_result (HTHashtable * table, char * key, void * object)
+{
+    if (object != proxy_none) HT_FREE(object);
+    return 1;
+}
+
+PRIVATE void proxy_uncompile (void)
+{
+    if (noproxy_hosts) {
+	HTHashtable_walk(noproxy_hosts, free_domain);
+	HTHashtable_delete(noproxy_hosts);
+	noproxy_hosts = NULL;
+    }
+    if (proxy_access) {
+	HTHashtable_delete(proxy_access);
+	proxy_access = NULL;
+    }
+    if (proxy_results) {
+	HTHashtable_walk(proxy_results, free_result);
+	HTHashtable_delete(proxy_results);
+	proxy_results = NULL;
+    }
+#ifdef HT_POSIX_REGEX
+    HTList_delete(noproxy_regex);
+    noproxy_regex = NULL;
+    HTList_delete(proxy_regex);
+    proxy_regex = NULL;
+#endif
+    proxy_compiled = NO;
+}
+
+PRIVATE void proxy_compile (void)
+{
+    HTList * cur;
+    proxy_uncompile();
+
+    /*
+    **  Noproxy entries are indexed by the name without any leading dots
+    **  so that both "w3.org" and ".w3.org" cover w3.org and its subdomains
+    */
+    if ((cur = noproxy) != NULL) {
+	HTHostList * pres;
+	noproxy_hosts = HTHashtable_new(PROXY_HASH_SIZE);
+	while ((pres = (HTHostList *) HTList_nextObject(cur)) != NULL) {
+	    const char * domain = pres->host;
+	    HTList * same;
+#ifdef HT_POSIX_REGEX
+	    if (pres->regex) {
+		if (!noproxy_regex) noproxy_regex = HTList_new();
+		HTList_addObject(noproxy_regex, (void *) pres);
+		continue;
+	    }
+#endif
+	    while (*domain == '.') domain++;
+	    if ((same = (HTList *) HTHashtable_object(noproxy_hosts, domain)) == NULL) {
+		same = HTList_new();
+		HTHashtable_addObject(noproxy_hosts, domain, (void *) same);
+	    }
+	    HTList_addObject(same, (void *) pres);
+	}
+    }
+
+    /*
+    **  The proxy list is searched from the head so the first entry for an
+    **  access method wins. Regex entries remember their position so that
+    **  they only win over a plain entry found further up the list.
+    */
+    if ((cur = proxies) != NULL) {
+	HTProxy * pres;
+	int order = 0;
+#ifdef HT_POSIX_REGEX
+	HTList * last = NULL;
+#endif
+	proxy_access = HTHashtable_new(PROXY_HASH_SIZE);
+	while ((pres = (HTProxy *) HTList_nextObject(cur)) != NULL) {
+	    pres->order = order++;
+#ifdef HT_POSIX_REGEX
+	    if (pres->regex) {
+		if (!proxy_regex) last = proxy_regex = HTList_new();
+		HTList_addObject(last, (void *) pres);
+		last = last->next;
+		continue;
+	    }
+#endif
+	    if (!HTHashtable_object(proxy_access, pres->access))
+		HTHashtable_addObject(proxy_access, pres->access, (void *) pres);
+	}
+    }
+
+#ifdef HT_POSIX_REGEX
+    if (!noproxy_regex && !proxy_regex)
+#endif
+	proxy_results = HTHashtable_new(PROXY_HASH_SIZE);
+    proxy_compiled = YES;
+    HTTRACE(PROT_TRACE, "HTProxy..... Compiled %d noproxy domains and %d proxies\n" _
+	    HTHashtable_count(noproxy_hosts) _ HTHashtable_count(proxy_access));
+}
+
+/*
+**	Split a URL into the access method, the host name and the port in
+**	the same way as HTParse does for PARSE_ACCESS and PARSE_HOST but
+**	without making a copy for each. The host name is lower cased. The
+**	returned copy holds the strings and must be freed by the caller.
+*/
+PRIVATE char * split_url (const char * url, char ** access, char ** host,
+			  unsigned * port)
+{
+    char * copy = NULL;
+    char * after;
+    char * ptr;
+    StrAllocCopy(copy, url);
+    *access = *host = copy + strlen(copy);
+    *port = 0;
+    if ((ptr = strchr(copy, '#')) != NULL) *ptr = '\0';
+    for (ptr = after = copy; *ptr && *ptr!='/' && *ptr!='?'; ptr++) {
+	if (*ptr == ':') {
+	    *ptr = '\0';
+	    *access = copy;
+	    after = ptr + 1;
+	    break;
+	}
+    }
+    if (*after == '/' && *(after+1) == '/') {
+	*host = after + 2;
+	if ((ptr = strchr(*host, '/')) != NULL) *ptr = '\0';
+	if ((ptr = strchr(*host, ':')) != NULL) {
+	    *ptr++ = '\0';				    /* Chop off port */
+	    if (*ptr) *port = (unsigned) atoi(ptr);
+	}
+	for (ptr = *host; (*ptr = TOLOWER(*ptr)); ptr++);
+    }
+    return copy;
+}
+
+/*
+**	Is the host registered in the noproxy list? A host matches an entry
+**	if it is the same name or ends in a dot followed by the entry, so
+**	we look up the host and each of the domains it is part of.
+*/
+PRIVATE BOOL noproxy_match (const char * url, const char * access,
+			    const char * host, unsigned port)
+{
+    if (*host) {
+	const char * domain = host;
+	while (domain) {
+	    HTList * cur = (HTList *) HTHashtable_object(noproxy_hosts, domain);
+	    HTHostList * pres;
+	    while ((pres = (HTHostList *) HTList_nextObject(cur)) != NULL) {
+		if ((!pres->access || !strcmp(pres->access, access)) &&
+		    (!pres->port || pres->port == port)) {
+		    HTTRACE(PROT_TRACE, "GetProxy.... No proxy directive found: `%s\'\n" _ pres->host);
+		    return YES;
+		}
+	    }
+	    if ((domain = strchr(domain, '.')) != NULL) domain++;
+	}
+#ifdef HT_POSIX_REGEX
+	{
+	    HTList * cur = noproxy_regex;
+	    HTHostList * pres;
+	    while ((pres = (HTHostList *) HTList_nextObject(cur)) != NULL) {
+		if (!regexec(pres->regex, url, 0, NULL, 0)) {
+		    HTTRACE(PROT_TRACE, "GetProxy.... No proxy directive found: `%s\'\n" _ pres->host);
+		    return YES;
+		}
+	    }
+	}
+#endif
+    }
+    return NO;
+}
+
 /*
 **	Existing entries are replaced with new ones
 */
@@ -96,6 +300,7 @@ PRIVATE BOOL add_object (HTList * list, const char * access, const char * url,
     HTProxy *me;
     if (!list || !access || !url || !*url)
 	return NO;
+    proxy_uncompile();
     if ((me = (HTProxy *) HT_CALLOC(1, sizeof(HTProxy))) == NULL)
 	HT_OUTOFMEM("add_object");
     StrAllocCopy(me->access, access);		     	    /* Access method */
@@ -177,6 +382,7 @@ PRIVATE BOOL add_hostname (HTList * list, const char * host,
     HTHostList *me;
     if (!list || !host || !*host)
 	return NO;
+    proxy_uncompile();
     if ((me = (HTHostList *) HT_CALLOC(1, sizeof(HTHostList))) == NULL)
         HT_OUTOFMEM("add_hostname");
 #ifdef HT_POSIX_REGEX
@@ -286,6 +492,7 @@ PUBLIC BOOL HTProxy_addRegex (const char * regex,
 */
 PUBLIC BOOL HTProxy_deleteAll (void)
 {
+    proxy_uncompile();
     if (remove_allObjects(proxies)) {
 	HTList_delete(proxies);
 
@@ -373,6 +580,7 @@ PUBLIC BOOL HTNoProxy_addRegex (const char * regex, int regex_flags)
 */
 PUBLIC BOOL HTNoProxy_deleteAll (void)
 {
+    proxy_uncompile();
     if (remove_AllHostnames(noproxy)) {
 	HTList_delete(noproxy);
 	noproxy = NULL;
@@ -397,6 +605,7 @@ PUBLIC int HTProxy_NoProxyIsOnlyProxy (void)
 PUBLIC void HTProxy_setNoProxyIsOnlyProxy (int value)
 {
   noproxy_is_onlyproxy = value;
+  proxy_uncompile();
 }
 
 /*	HTProxy_find
@@ -411,84 +620,77 @@ PUBLIC void HTProxy_setNoProxyIsOnlyProxy (int value)
 */
 PUBLIC char * HTProxy_find (const char * url)
 {
+    char * copy;
     char * access;
+    char * host;
+    char * key = NULL;
     char * proxy = NULL;
-    int no_proxy_found = 0;
+    unsigned port;
+    BOOL no_proxy_found;
 
     if (!url || !proxies)
 	return NULL;
-    access = HTParse(url, "", PARSE_ACCESS);
-
-    /* First check if the host (if any) is registered in the noproxy list */
-    if (noproxy) {
-	char *host = HTParse(url, "", PARSE_HOST);
-	char *ptr;
-	unsigned port=0;
-	if ((ptr = strchr(host, ':')) != NULL) {
-	    *ptr++ = '\0';				    /* Chop off port */
-	    if (*ptr) port = (unsigned) atoi(ptr);
+    if (!proxy_compiled) proxy_compile();
+    copy = split_url(url, &access, &host, &port);
+
+    /* Reuse the result from last time for this access, host and port */
+    if (proxy_results) {
+	char buf[16];
+	char * found;
+	sprintf(buf, ":%u", port);
+	StrAllocMCopy(&key, access, "://", host, buf, NULL);
+	if ((found = (char *) HTHashtable_object(proxy_results, key)) != NULL) {
+	    if (found != proxy_none) StrAllocCopy(proxy, found);
+	    HTTRACE(PROT_TRACE, "GetProxy.... Remembered: `%s\'\n" _ found);
+	    HT_FREE(key);
+	    HT_FREE(copy);
+	    return proxy;
 	}
-	if (*host) {				   /* If we have a host name */
-	    HTList *cur = noproxy;
-	    HTHostList *pres;
-	    while ((pres = (HTHostList *) HTList_nextObject(cur)) != NULL) {
-#ifdef HT_POSIX_REGEX
-		if (pres->regex) {
-		    BOOL match = regexec(pres->regex, url, 0, NULL, 0) ? NO : YES;
-		    if (match) {
-			HTTRACE(PROT_TRACE, "GetProxy.... No proxy directive found: `%s\'\n" _ pres->host);
-			no_proxy_found = 1;
-			break;
-		    }
-		} else
-#endif
-		if (!pres->access ||
-		    (pres->access && !strcmp(pres->access, access))) {
-		    if ((pres->port == 0) || (pres->port == port)) {
-			char *np = pres->host+strlen(pres->host);
-			char *hp = host+strlen(host);
-			while (np>=pres->host && hp>=host && (*np--==*hp--));
-			if (np==pres->host-1 && (hp==host-1 || *hp=='.')) {
-			    HTTRACE(PROT_TRACE, "GetProxy.... No proxy directive found: `%s\'\n" _ pres->host);
-			    no_proxy_found = 1;
-			    break;
-			}
-		    }
-		}
-	    }
-	}
-	HT_FREE(host);
     }
 
-    if ((no_proxy_found && !noproxy_is_onlyproxy)
-        || (!no_proxy_found && noproxy_is_onlyproxy)) {
-      HT_FREE(access);
-      return NULL;
-    }
+    /* First check if the host (if any) is registered in the noproxy list */
+    no_proxy_found = noproxy ? noproxy_match(url, access, host, port) : NO;
 
     /* Now check if we have a proxy registered for this access method */
-    {
-	HTList *cur = proxies;
-	HTProxy *pres;
-	while ((pres = (HTProxy *) HTList_nextObject(cur)) != NULL) {
+    if ((no_proxy_found && !noproxy_is_onlyproxy)
+	|| (!no_proxy_found && noproxy_is_onlyproxy)) {
+	HTTRACE(PROT_TRACE, "GetProxy.... Going direct for `%s\'\n" _ url);
+    } else {
+	HTProxy * pres = (HTProxy *) HTHashtable_object(proxy_access, access);
 #ifdef HT_POSIX_REGEX
-	    if (pres->regex) {
-		BOOL match = regexec(pres->regex, url, 0, NULL, 0) ? NO : YES;
-		if (match) {
-		    StrAllocCopy(proxy, pres->url);
-		    HTTRACE(PROT_TRACE, "GetProxy.... Found: `%s\'\n" _ pres->url);
+	{
+	    HTList * cur = proxy_regex;
+	    HTProxy * rx;
+	    while ((rx = (HTProxy *) HTList_nextObject(cur)) != NULL) {
+		if (pres && rx->order > pres->order) break;
+		if (!regexec(rx->regex, url, 0, NULL, 0)) {
+		    pres = rx;
 		    break;
 		}
-	    } else
-#endif
-	    if (!strcmp(pres->access, access)) {
-		StrAllocCopy(proxy, pres->url);
-		HTTRACE(PROT_TRACE, "GetProxy.... Found: `%s\'\n" _ pres->url);
-		break;
 	    }
 	}
+#endif
+	if (pres) {
+	    StrAllocCopy(proxy, pres->url);
+	    HTTRACE(PROT_TRACE, "GetProxy.... Found: `%s\'\n" _ pres->url);
+	}
     }
-    HT_FREE(access);
+
+    if (key) {
+	if (HTHashtable_count(proxy_results) >= PROXY_RESULTS_MAX) {
+	    HTHashtable_walk(proxy_results, free_result);
+	    HTHashtable_delete(proxy_results);
+	    proxy_results = HTHashtable_new(PROXY_HASH_SIZE);
+	}
+	if (proxy) {
+	    char * result = NULL;
+	    StrAllocCopy(result, proxy);
+	    HTHashtable_addObject(proxy_results, key, result);
+	} else
+	    HTHashtable_addObject(proxy_results, key, proxy_none);
+	HT_FREE(key);
+    }
+    HT_FREE(copy);
     return proxy;
 }
 
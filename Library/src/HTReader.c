@@ -14,6 +14,7 @@
 #include "WWWUtil.h"
 #include "WWWCore.h"
 #include "HTNetMan.h"
+#include "HTBufPool.h"
 #include "HTReader.h"					 /* Implemented here */
 
 struct _HTStream {
@@ -28,11 +29,23 @@ struct _HTInputStream {
     char *			write;			/* Last byte written */
     char *			read;			   /* Last byte read */
     int				b_read;
-    char			data [INPUT_BUFFER_SIZE];	   /* buffer */
+    char *			data;		  /* Buffer borrowed from pool */
 };
 
 /* ------------------------------------------------------------------------- */
 
+/*
+**  Give the buffer back to the pool if we have passed on everything we
+**  have read so that idle connections don't hold on to a buffer.
+*/
+PRIVATE void release_buffer (HTInputStream * me)
+{
+    if (me->data && me->write >= me->read) {
+	HTBufferPool_release(me->data, INPUT_BUFFER_SIZE);
+	me->data = me->write = me->read = NULL;
+    }
+}
+
 PRIVATE int HTReader_flush (HTInputStream * me)
 {
     HTNet * net = HTHost_getReadNet(me->host);
@@ -113,6 +126,7 @@ PRIVATE int HTReader_read (HTInputStream * me)
     do {
 	/* don't read if we have to push unwritten data from last call */
 	if (me->write >= me->read) {
+	    if (!me->data) me->data = HTBufferPool_get(INPUT_BUFFER_SIZE);
 	    if ((me->b_read = NETREAD(soc, me->data, INPUT_BUFFER_SIZE)) < 0) {
 #ifdef EAGAIN
 		if (socerrno==EAGAIN || socerrno==EWOULDBLOCK)      /* POSIX */
@@ -121,6 +135,7 @@ PRIVATE int HTReader_read (HTInputStream * me)
 #endif	
 		{
 		    HTTRACE(STREAM_TRACE, "Read Socket. WOULD BLOCK fd %d\n" _ soc);
+		    release_buffer(me);
 		    HTHost_register(host, net, HTEvent_READ);
 		    return HT_WOULD_BLOCK;
 #ifdef __svr4__
@@ -168,12 +183,14 @@ PRIVATE int HTReader_read (HTInputStream * me)
 		    if (request)
 			HTRequest_addSystemError(request, ERR_FATAL, socerrno,
 						 NO, "NETREAD");
+		    release_buffer(me);
 		    return HT_ERROR;
 		}
 	    } else if (!me->b_read) {
 
 	    socketClosed:
 		HTTRACE(STREAM_TRACE, "Read Socket. FIN received on socket %d\n" _ soc);
+		release_buffer(me);
 		HTHost_unregister(host, net, HTEvent_READ);
 		HTHost_register(host, net, HTEvent_CLOSE);
 		return HT_CLOSED;
@@ -235,6 +252,7 @@ PRIVATE int HTReader_read (HTInputStream * me)
 		} else
 		    HTTRACE(STREAM_TRACE, "Read Socket. Target returns %d\n" _ status);
 /*		me->write = me->read; */
+		release_buffer(me);
 		return status;
 	    } else {				     /* We have a real error */
 		HTTRACE(STREAM_TRACE, "Read Socket. Target ERROR %d\n" _ status);
@@ -251,6 +269,7 @@ PRIVATE int HTReader_read (HTInputStream * me)
 	    }
 	}
     } while (net->preemptive);
+    release_buffer(me);
     HTHost_register(host, net, HTEvent_READ);
     return HT_WOULD_BLOCK;
 }
@@ -271,13 +290,14 @@ PRIVATE int HTReader_close (HTInputStream * me)
 	net->readStream = NULL;
     }
     HTTRACE(STREAM_TRACE, "Socket read. FREEING....\n");
+    if (me->data) HTBufferPool_release(me->data, INPUT_BUFFER_SIZE);
     HT_FREE(me);
     return status;
 }
 
 PUBLIC int HTReader_consumed (HTInputStream * me, size_t bytes)
 {
-    me->write += bytes;
+    if (me->data) me->write += bytes;
     me->b_read -= bytes;
     HTHost_setRemainingRead(me->host, me->b_read);
     return HT_OK;
@@ -50,6 +50,7 @@
 #endif
 
 PRIVATE int HTMaxRetry = HT_MAX_RELOADS;
+PRIVATE size_t HTArenaSize = 0;			 /* No arenas by default */
 
 struct _HTStream {
 	HTStreamClass * isa;
@@ -152,6 +153,10 @@ PUBLIC HTRequest * HTRequest_dup (HTRequest * src)
     if ((me = (HTRequest  *) HT_MALLOC(sizeof(HTRequest))) == NULL)
         HT_OUTOFMEM("HTRequest_dup");
     memcpy(me, src, sizeof(HTRequest));
+    me->arena = NULL;
+    HTAnchor_addRef((HTAnchor *) me->anchor);
+    HTAnchor_addRef((HTAnchor *) me->parentAnchor);
+    HTAnchor_addRef((HTAnchor *) me->source_anchor);
     HTTRACE(CORE_TRACE, "Request..... Duplicated %p to %p\n" _ src _ me);
     return me;
 }
@@ -171,7 +176,11 @@ PUBLIC HTRequest * HTRequest_dupInternal (HTRequest * src)
     if ((me = (HTRequest  *) HT_MALLOC(sizeof(HTRequest))) == NULL)
         HT_OUTOFMEM("HTRequest_dup");
     memcpy(me, src, sizeof(HTRequest));
+    me->arena = NULL;
     HTRequest_clear(me);
+    HTAnchor_addRef((HTAnchor *) me->anchor);
+    HTAnchor_addRef((HTAnchor *) me->parentAnchor);
+    HTAnchor_addRef((HTAnchor *) me->source_anchor);
     return me;
 }
 
@@ -254,6 +263,14 @@ PUBLIC void HTRequest_delete (HTRequest * me)
         me->messageBodyFormat = NULL;
         me->messageBodyLength = -1;     
 #endif
+
+	/* Let go of the anchors so that they can be evicted */
+	HTAnchor_release((HTAnchor *) me->anchor);
+	HTAnchor_release((HTAnchor *) me->parentAnchor);
+	HTAnchor_release((HTAnchor *) me->source_anchor);
+
+	/* Give up our reference to the arena */
+	if (me->arena) HTArena_delete(me->arena);
         
 	HT_FREE(me);
     }
@@ -396,7 +413,7 @@ PUBLIC HTResponse * HTRequest_response (HTRequest * me)
 {
     if (me) {
 	if (!me->response)
-	    me->response = HTResponse_new();
+	    me->response = HTResponse_newArena(HTRequest_arena(me));
 	return me->response;
     }
     return NULL;
@@ -482,6 +499,28 @@ PUBLIC int HTRequest_maxRetry (void)
     return HTMaxRetry;
 }
 
+/*
+**  Arena for memory which lives as long as the request. Only created if
+**  arenas are enabled
+*/
+PUBLIC BOOL HTRequest_setArenaSize (size_t size)
+{
+    HTArenaSize = size;
+    return YES;
+}
+
+PUBLIC size_t HTRequest_arenaSize (void)
+{
+    return HTArenaSize;
+}
+
+PUBLIC HTArena * HTRequest_arena (HTRequest * me)
+{
+    if (me && !me->arena && HTArenaSize > 0)
+	me->arena = HTArena_new(HTArenaSize);
+    return me ? me->arena : NULL;
+}
+
 PUBLIC int HTRequest_retrys (HTRequest * me)
 {
     return me ? me->retrys : 0;
@@ -1101,6 +1140,8 @@ PUBLIC BOOL HTRequest_deleteMandatoryAll (HTRequest * me)
 PUBLIC void HTRequest_setAnchor (HTRequest * me, HTAnchor *anchor)
 {
     if (me) {
+	HTAnchor_addRef(anchor);
+	HTAnchor_release((HTAnchor *) me->anchor);
 	me->anchor = HTAnchor_parent(anchor);
 	me->childAnchor = ((HTAnchor *) me->anchor != anchor) ?
 	    (HTChildAnchor *) anchor : NULL;
@@ -1122,7 +1163,11 @@ PUBLIC HTChildAnchor * HTRequest_childAnchor (HTRequest * me)
 */
 PUBLIC void HTRequest_setParent (HTRequest * me, HTParentAnchor *parent)
 {
-    if (me) me->parentAnchor = parent;
+    if (me) {
+	HTAnchor_addRef((HTAnchor *) parent);
+	HTAnchor_release((HTAnchor *) me->parentAnchor);
+	me->parentAnchor = parent;
+    }
 }
 
 PUBLIC HTParentAnchor * HTRequest_parent (HTRequest * me)
@@ -1434,6 +1479,8 @@ PUBLIC BOOL HTRequest_setEntityAnchor (HTRequest * me,
 				       HTParentAnchor * anchor)
 {
     if (me) {
+	HTAnchor_addRef((HTAnchor *) anchor);
+	HTAnchor_release((HTAnchor *) me->source_anchor);
 	me->source_anchor = anchor;
 	return YES;
     }
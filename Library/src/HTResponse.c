@@ -17,15 +17,30 @@
 #include "HTWWWStr.h"
 #include "HTResMan.h"					 /* Implemented here */
 
+/*
+**  Strings in a response which lives in an arena are copied into the arena
+*/
+PRIVATE void copy_string (HTResponse * me, char ** dest, const char * src)
+{
+    if (me->arena)
+	*dest = HTArena_strdup(me->arena, src);
+    else
+	StrAllocCopy(*dest, src);
+}
+
 /* --------------------------------------------------------------------------*/
 /*			Create and delete the HTResponse Object		     */
 /* --------------------------------------------------------------------------*/
 
 PUBLIC HTResponse * HTResponse_new (void)
 {
-    HTResponse * me;
-    if ((me = (HTResponse *) HT_CALLOC(1, sizeof(HTResponse))) == NULL)
-	HT_OUTOFMEM("HTResponse_new()");
+    return HTResponse_newArena(NULL);
+}
+
+PUBLIC HTResponse * HTResponse_newArena (HTArena * arena)
+{
+    HTResponse * me = (HTResponse *) HTArena_newObject(arena, sizeof(HTResponse));
+    me->arena = arena;
     
     /* Default content-* values */
     me->content_type = WWW_UNKNOWN;
@@ -47,8 +62,10 @@ PUBLIC BOOL HTResponse_delete (HTResponse * me)
 	HTTRACE(CORE_TRACE, "Response.... Delete %p\n" _ me);
 
 	/* Access Authentication */
-	HT_FREE(me->realm);
-	HT_FREE(me->scheme);
+	if (!me->arena) {
+	    HT_FREE(me->realm);
+	    HT_FREE(me->scheme);
+	}
 	if (me->challenge) HTAssocList_delete(me->challenge);
 
 	/* Connection headers */
@@ -74,6 +91,9 @@ PUBLIC BOOL HTResponse_delete (HTResponse * me)
 	/* Variants */
 	if (me->variants) HTAssocList_delete(me->variants);
 
+	/* Redirection */
+	HTAnchor_release(me->redirectionAnchor);
+
 	/*
 	** Only delete Content Type parameters and original headers if the
 	** information is not used elsewhere, for example by the anchor
@@ -88,13 +108,13 @@ PUBLIC BOOL HTResponse_delete (HTResponse * me)
 	    if (me->content_encoding) HTList_delete(me->content_encoding);
 
 	    /* List of all headers */
-	    if (me->headers) HTAssocList_delete(me->headers);
+	    if (me->headers) HTFieldList_delete(me->headers);
 	}
 
 	/* HTTP reason string */
-	if (me->reason)  HT_FREE (me->reason);
+	if (me->reason && !me->arena) HT_FREE (me->reason);
 
- 	HT_FREE(me);
+ 	HTArena_deleteObject(me->arena, me);
 	return YES;
     }
     return NO;
@@ -115,7 +135,10 @@ PUBLIC HTAnchor * HTResponse_redirection (HTResponse * me)
 PUBLIC BOOL HTResponse_setRedirection (HTResponse * me, HTAnchor * anchor)
 {
     if (me && anchor) {
-	me->redirectionAnchor = (HTAnchor *) HTAnchor_parent(anchor);
+	HTAnchor * redirection = (HTAnchor *) HTAnchor_parent(anchor);
+	HTAnchor_addRef(redirection);
+	HTAnchor_release(me->redirectionAnchor);
+	me->redirectionAnchor = redirection;
 	return YES;
     }
     return NO;
@@ -173,7 +196,7 @@ PUBLIC HTAssocList * HTResponse_challenge (HTResponse * me)
 PUBLIC BOOL HTResponse_setRealm (HTResponse * me, char * realm)
 {
     if (me && realm) {
-	StrAllocCopy(me->realm, realm);
+	copy_string(me, &me->realm, realm);
 	return YES;
     }
     return NO;
@@ -190,7 +213,7 @@ PUBLIC const char * HTResponse_realm (HTResponse * me)
 PUBLIC BOOL HTResponse_setScheme (HTResponse * me, char * scheme)
 {
     if (me && scheme) {
-	StrAllocCopy(me->scheme, scheme);
+	copy_string(me, &me->scheme, scheme);
 	return YES;
     }
     return NO;
@@ -422,7 +445,7 @@ PUBLIC char * HTResponse_noCache (HTResponse * me)
 PUBLIC char * HTResponse_etag (HTResponse * me)
 {
     if (me && me->headers) {
-	char * value = HTAssocList_findObject(me->headers, "etag");
+	char * value = HTFieldList_findId(me->headers, HT_FIELD_ETAG);
 	char * etag = HTNextField(&value);
 	return etag;
     }
@@ -635,8 +658,8 @@ PUBLIC BOOL HTResponse_addHeader (HTResponse * me,
 				  char * token, char * value)
 {
     if (me) {
-	if (!me->headers) me->headers = HTAssocList_new();
-	return HTAssocList_addObject(me->headers, token, value);
+	if (!me->headers) me->headers = HTFieldList_new();
+	return HTFieldList_add(me->headers, token, value);
     }
     return NO;
 }
@@ -644,7 +667,7 @@ PUBLIC BOOL HTResponse_addHeader (HTResponse * me,
 PUBLIC BOOL HTResponse_deleteHeaderAll (HTResponse * me)
 {
     if (me && me->headers) {
-	HTAssocList_delete(me->headers);
+	HTFieldList_delete(me->headers);
 	me->headers = NULL;
 	return YES;
     }
@@ -652,13 +675,18 @@ PUBLIC BOOL HTResponse_deleteHeaderAll (HTResponse * me)
 }
 
 PUBLIC HTAssocList * HTResponse_header (HTResponse * me)
+{
+    return (me ? HTFieldList_assocList(me->headers) : NULL);
+}
+
+PUBLIC HTFieldList * HTResponse_fields (HTResponse * me)
 {
     return (me ? me->headers : NULL);
 }
 
-PUBLIC HTAssocList * HTResponse_handOverHeader (HTResponse * me)
+PUBLIC HTFieldList * HTResponse_handOverFields (HTResponse * me)
 {
-    HTAssocList * headers = NULL;
+    HTFieldList * headers = NULL;
     if (me) {
 	headers = me->headers;
 	me->headers = NULL;
@@ -667,6 +695,25 @@ PUBLIC HTAssocList * HTResponse_handOverHeader (HTResponse * me)
     return headers;
 }
 
+/*
+**  For applications which want the headers as an association list of
+**  their own, newest first as it used to be
+*/
+PUBLIC HTAssocList * HTResponse_handOverHeader (HTResponse * me)
+{
+    HTFieldList * fields = HTResponse_handOverFields(me);
+    HTAssocList * headers = NULL;
+    if (fields) {
+	int cnt;
+	headers = HTAssocList_new();
+	for (cnt = 0; cnt < HTFieldList_count(fields); cnt++)
+	    HTAssocList_addObject(headers, HTFieldList_name(fields, cnt),
+				  HTFieldList_value(fields, cnt));
+	HTFieldList_delete(fields);
+    }
+    return headers;
+}
+
 /*
 **  HTTP reason string
 */
@@ -681,7 +728,7 @@ PUBLIC char * HTResponse_reason (HTResponse * me)
 PUBLIC BOOL HTResponse_setReason (HTResponse * me, char * reason)
 {
   if (me && reason && *reason) {
-      StrAllocCopy(me->reason, reason);
+      copy_string(me, &me->reason, reason);
       return YES;
     }
   return NO;
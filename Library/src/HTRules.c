@@ -46,9 +46,43 @@ struct _HTRule {
     char *	pattern;
     char *	replace;
     int   	insert;		       /* Index into any wildcard in replace */
+    int		prefix;			    /* Length of pattern up to '*' */
+    BOOL	wild;				 /* Does pattern contain '*'? */
 };
 
+/*
+**	A rule list is compiled into a trie of the pattern prefixes up to the
+**	wildcard the first time it is used after a change. Each node keeps the
+**	rules whose prefix ends there so translating a token is a single walk
+**	down the trie, however many rules there are. Rules are numbered by
+**	their position in the list so that the result is the same as when
+**	trying them in order.
+*/
+typedef struct _RuleSet {
+    int		first;		     /* First Pass or Fail rule or -1 if none */
+    int		maps;				    /* Number of Map rules */
+    int *	map;				  /* Map rules in list order */
+} RuleSet;
+
+typedef struct _RuleNode {
+    struct _RuleNode *	child;
+    struct _RuleNode *	next;				   /* Next sibling */
+    unsigned char	c;
+    RuleSet *		wild;		 /* Rules with a wildcard from here */
+    RuleSet *		exact;		      /* Rules matching exactly here */
+} RuleNode;
+
+typedef struct _RuleIndex {
+    HTList *	list;
+    int		changes;			 /* rule_changes when built */
+    int		count;
+    HTRule **	rule;				    /* Rules in list order */
+    RuleNode *	trie[2];		  /* Case sensitive and insensitive */
+} RuleIndex;
+
 PRIVATE HTList * rules = NULL;
+PRIVATE HTList * rule_indexes = NULL;		  /* Compiled rule lists */
+PRIVATE int rule_changes = 0;
 
 /* ------------------------------------------------------------------------- */
 
@@ -77,6 +111,194 @@ PUBLIC BOOL HTRule_addGlobal(HTRuleOp op,
     return HTRule_add(rules, op, pattern, replace);
 }
 
+/*	Compiled rule lists
+**	-------------------
+*/
+PRIVATE void ruleset_add (RuleSet ** set, HTRule * rule, int n)
+{
+    RuleSet * me = *set;
+    if (!me) {
+	if ((me = *set = (RuleSet *) HT_CALLOC(1, sizeof(RuleSet))) == NULL)
+	    HT_OUTOFMEM("ruleset_add");
+	me->first = -1;
+    }
+    if (rule->op == HT_Map) {
+	if ((me->map = (int *) HT_REALLOC(me->map, (me->maps+1)*sizeof(int))) == NULL)
+	    HT_OUTOFMEM("ruleset_add");
+	me->map[me->maps++] = n;
+    } else if (me->first < 0)
+	me->first = n;
+}
+
+PRIVATE void ruleset_delete (RuleSet * me)
+{
+    if (me) {
+	HT_FREE(me->map);
+	HT_FREE(me);
+    }
+}
+
+PRIVATE void rulenode_delete (RuleNode * node)
+{
+    while (node) {
+	RuleNode * next = node->next;
+	rulenode_delete(node->child);
+	ruleset_delete(node->wild);
+	ruleset_delete(node->exact);
+	HT_FREE(node);
+	node = next;
+    }
+}
+
+PRIVATE RuleNode * rulenode_new (void)
+{
+    RuleNode * me;
+    if ((me = (RuleNode *) HT_CALLOC(1, sizeof(RuleNode))) == NULL)
+	HT_OUTOFMEM("rulenode_new");
+    return me;
+}
+
+PRIVATE RuleNode * rule_trie (RuleIndex * index, BOOL ignore_case)
+{
+    RuleNode * root = rulenode_new();
+    int n;
+    for (n = 0; n < index->count; n++) {
+	HTRule * rule = index->rule[n];
+	RuleNode * node = root;
+	int i;
+	for (i = 0; i < rule->prefix; i++) {
+	    unsigned char c = ignore_case ?
+		TOUPPER(rule->pattern[i]) : rule->pattern[i];
+	    RuleNode * child;
+	    for (child = node->child; child && child->c != c; child = child->next);
+	    if (!child) {
+		child = rulenode_new();
+		child->c = c;
+		child->next = node->child;
+		node->child = child;
+	    }
+	    node = child;
+	}
+	ruleset_add(rule->wild ? &node->wild : &node->exact, rule, n);
+    }
+    HTTRACE(APP_TRACE, "Rule Index.. Compiled %d rules\n" _ index->count);
+    return root;
+}
+
+PRIVATE void ruleindex_delete (RuleIndex * me)
+{
+    if (me) {
+	rulenode_delete(me->trie[0]);
+	rulenode_delete(me->trie[1]);
+	HT_FREE(me->rule);
+	HT_FREE(me);
+    }
+}
+
+PRIVATE RuleIndex * rule_index (HTList * list, BOOL ignore_case)
+{
+    HTList * cur = rule_indexes;
+    RuleIndex * me;
+    while ((me = (RuleIndex *) HTList_nextObject(cur)) != NULL) {
+	if (me->list == list) break;
+    }
+    if (me && me->changes != rule_changes) {
+	HTList_removeObject(rule_indexes, (void *) me);
+	ruleindex_delete(me);
+	me = NULL;
+    }
+    if (!me) {
+	HTRule * pres;
+	int n = 0;
+	if ((me = (RuleIndex *) HT_CALLOC(1, sizeof(RuleIndex))) == NULL)
+	    HT_OUTOFMEM("rule_index");
+	me->list = list;
+	me->changes = rule_changes;
+	me->count = HTList_count(list);
+	if ((me->rule = (HTRule **) HT_CALLOC(me->count+1, sizeof(HTRule *))) == NULL)
+	    HT_OUTOFMEM("rule_index");
+	cur = list;
+	while ((pres = (HTRule *) HTList_nextObject(cur)) != NULL)
+	    me->rule[n++] = pres;
+	if (!rule_indexes) rule_indexes = HTList_new();
+	HTList_addObject(rule_indexes, (void *) me);
+    }
+    if (!me->trie[ignore_case ? 1 : 0])
+	me->trie[ignore_case ? 1 : 0] = rule_trie(me, ignore_case);
+    return me;
+}
+
+/*
+**	Find the rule deciding the translation of a token: the first Pass or
+**	Fail rule matching, or if there is none the last Map rule matching.
+**	`rest' is set to the part of the token matched by the wildcard.
+*/
+PRIVATE HTRule * rule_find (HTList * list, const char * token,
+			    BOOL ignore_case, const char ** rest)
+{
+    RuleIndex * index = rule_index(list, ignore_case);
+    RuleNode * node = index->trie[ignore_case ? 1 : 0];
+    const char * ptr = token;
+    int first = -1, map = -1;
+    const char * first_rest = NULL;
+    const char * map_rest = NULL;
+    for (;;) {
+	RuleSet * set = node->wild;
+	int pass;
+	for (pass = 0; pass < 2; pass++) {
+	    if (set && set->first >= 0 && (first < 0 || set->first < first)) {
+		first = set->first;
+		first_rest = ptr;
+	    }
+	    if (set && set->maps && set->map[set->maps-1] > map) {
+		map = set->map[set->maps-1];
+		map_rest = ptr;
+	    }
+	    if (*ptr) break;
+	    set = node->exact;
+	}
+	if (!*ptr) break;
+	{
+	    unsigned char c = ignore_case ? TOUPPER(*ptr) : *ptr;
+	    for (node = node->child; node && node->c != c; node = node->next);
+	}
+	if (!node) break;
+	ptr++;
+    }
+    if (first >= 0) {
+	*rest = first_rest;
+	return index->rule[first];
+    } else if (map >= 0) {
+	*rest = map_rest;
+	return index->rule[map];
+    }
+    return NULL;
+}
+
+/*
+**	Same as rule_find but trying one rule at a time. This is needed when
+**	the token itself contains a '*' as the matcher then carries on
+**	comparing the pattern after the wildcard.
+*/
+PRIVATE HTRule * rule_scan (HTList * list, const char * token,
+			    BOOL ignore_case, const char ** rest)
+{
+    HTRule * pres;
+    HTRule * map = NULL;
+    while ((pres = (HTRule *) HTList_nextObject(list))) {
+	char * match = ignore_case ? HTStrCaseMatch(pres->pattern, token) :
+	    HTStrMatch(pres->pattern, token);
+	if (!match) continue;
+	if (pres->op != HT_Map) {
+	    *rest = match;
+	    return pres;
+	}
+	map = pres;
+	*rest = match;
+    }
+    return map;
+}
+
 /*	Add rule to the list
 **	--------------------
 **	This function adds a rule to the list of rules. The
@@ -99,6 +321,12 @@ PUBLIC BOOL HTRule_add (HTList * list, HTRuleOp op,
 	    HT_OUTOFMEM("HTRule_add");
 	me->op = op;
 	StrAllocCopy(me->pattern, pattern);
+	{
+	    char * star = strchr(pattern, '*');
+	    me->prefix = star ? star-pattern : (int) strlen(pattern);
+	    me->wild = star ? YES : NO;
+	}
+	rule_changes++;
 	if (replace) {
 	    char *ptr = strchr(replace, '*');
 	    StrAllocCopy(me->replace, replace);
@@ -120,8 +348,17 @@ PUBLIC BOOL HTRule_add (HTList * list, HTRuleOp op,
 PUBLIC BOOL HTRule_deleteAll (HTList * list)
 {
     if (list) {
-	HTList *cur = list;
+	HTList *cur = rule_indexes;
 	HTRule *pres;
+	RuleIndex *index;
+	while ((index = (RuleIndex *) HTList_nextObject(cur))) {
+	    if (index->list == list) {
+		HTList_removeObject(rule_indexes, (void *) index);
+		ruleindex_delete(index);
+		break;
+	    }
+	}
+	cur = list;
 	while ((pres = (HTRule *) HTList_nextObject(cur))) {
 	    HT_FREE(pres->pattern);
 	    HT_FREE(pres->replace);
@@ -135,57 +372,53 @@ PUBLIC BOOL HTRule_deleteAll (HTList * list)
 /*	Translate by rules
 **	------------------
 **	The most recently defined rules are applied last.
-**	This function walks through the list of rules and translates the
-**	reference when matches are found. The list is traversed in order
-**	starting from the head of the list. It returns the address of the
-**	equivalent string allocated from the heap which the CALLER MUST
-**	FREE.
+**	This function finds the rules matching the reference in the order
+**	they appear in the list and translates the reference by them. The
+**	first Pass or Fail rule matching ends the translation. It returns the
+**	address of the equivalent string allocated from the heap which the
+**	CALLER MUST FREE.
 */
 PUBLIC char * HTRule_translate (HTList * list, const char * token,
 				BOOL ignore_case)
 {
     HTRule * pres;
+    const char * rest = NULL;
     char * replace = NULL;
     if (!token || !list) return NULL;
     HTTRACE(APP_TRACE, "Check rules. for `%s\'\n" _ token);
-    while ((pres = (HTRule *) HTList_nextObject(list))) {
-	char * rest = ignore_case ? HTStrCaseMatch(pres->pattern, token) :
-	    HTStrMatch(pres->pattern, token);
-	if (!rest) continue;				  /* No match at all */
-    
-	/* We found a match for this entry, now do operation */
-	switch (pres->op) {
-
-          case HT_Pass:
-	  case HT_Map:
-	    if (!pres->replace) {			       /* No replace */
-		StrAllocCopy(replace, token);
-
-	    } else if (*rest && pres->insert >= 0) {
-		if ((replace = (char  *) HT_MALLOC(strlen(pres->replace)+strlen(rest))) == NULL)
-		    HT_OUTOFMEM("HTRule_translate");
-		strcpy(replace, pres->replace);
-		strcpy(replace+pres->insert, rest);
-
-	    } else {		       /* Perfect match or no insetion point */
-		StrAllocCopy(replace, pres->replace);
-	    }
+    pres = strchr(token, '*') ? rule_scan(list, token, ignore_case, &rest) :
+	rule_find(list, token, ignore_case, &rest);
+    if (!pres) {
+	StrAllocCopy(replace, token);
+	return replace;
+    }
 
-	    if (pres->op == HT_Pass) {
-		HTTRACE(APP_TRACE, "............ map into `%s'\n" _ replace);
-		return replace;
-	    }
-	    break;
-	    
-	  case HT_Fail:
+    /* We found the rule deciding the translation, now do operation */
+    switch (pres->op) {
 
-	  default:
-	    HTTRACE(APP_TRACE, "............ FAIL `%s'\n" _ token);
-	    return NULL;
+      case HT_Pass:
+      case HT_Map:
+	if (!pres->replace) {				       /* No replace */
+	    StrAllocCopy(replace, token);
+
+	} else if (*rest && pres->insert >= 0) {
+	    if ((replace = (char  *) HT_MALLOC(strlen(pres->replace)+strlen(rest))) == NULL)
+		HT_OUTOFMEM("HTRule_translate");
+	    strcpy(replace, pres->replace);
+	    strcpy(replace+pres->insert, rest);
+
+	} else {		       /* Perfect match or no insetion point */
+	    StrAllocCopy(replace, pres->replace);
 	}
+	HTTRACE(APP_TRACE, "............ map into `%s'\n" _ replace);
+	return replace;
+
+      case HT_Fail:
+
+      default:
+	HTTRACE(APP_TRACE, "............ FAIL `%s'\n" _ token);
+	return NULL;
     }
-    if (!replace) StrAllocCopy(replace, token);
-    return replace;
 }
 
 /*	Load one line of configuration
@@ -27,6 +27,7 @@ struct _HTStream {
     BOOL		give_up;
     BOOL		ignore;
     BOOL		ensure;
+    HTArena *		arena;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -42,7 +43,7 @@ PRIVATE int HTSC_flush (HTStream * me)
 PRIVATE int HTSC_free (HTStream * me)
 {
     HTTRACE(STREAM_TRACE, "Chunkstream. FREEING...\n");
-    HT_FREE(me);
+    HTArena_deleteObject(me->arena, me);
     return HT_OK;
 }
 
@@ -52,7 +53,7 @@ PRIVATE int HTSC_free (HTStream * me)
 PRIVATE int HTSC_abort (HTStream * me, HTList * errorlist)
 {
     HTTRACE(STREAM_TRACE, "Chunkstream. ABORTING...\n");
-    HT_FREE(me);
+    HTArena_deleteObject(me->arena, me);
     return HT_ERROR;
 }
 
@@ -116,11 +117,11 @@ PUBLIC HTStream * HTStreamToChunk (HTRequest * 	request,
 				   int 		max_size)
 {
     if (request) {
-	HTStream * me;
+	HTArena * arena = HTRequest_arena(request);
+	HTStream * me = (HTStream *) HTArena_newObject(arena, sizeof(HTStream));
 	*chunk = NULL;
-	if ((me = (HTStream  *) HT_CALLOC(1, sizeof(HTStream))) == NULL)
-	    HT_OUTOFMEM("HTStreamToChunk");
 	me->isa = &HTStreamToChunkClass;
+	me->arena = arena;
 	me->request = request;
 	me->max_size = (!max_size) ? max_size : HT_MAXSIZE;
 	me->chunk = *chunk = HTChunk_new(me->max_size > 0 ?
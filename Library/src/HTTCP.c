@@ -42,6 +42,9 @@
 /* x ms penalty on a multi-homed host if IP-address is down for unknown reason */
 #define TCP_PENALTY		60000
 
+/* x ms before trying the other address family in parallel (RFC 8305) */
+#define TCP_RACE_DELAY		250
+
 /* empirical study in socket call error codes
    yovavm@contact.com : added handling for WSAEINVAL error code (Windows)
    "When calling connect() in the second time, after the first call to 
@@ -93,14 +96,15 @@
 /* _makeSocket - create a socket, if !preemptive, set FIONBIO
 ** returns sockfd or INVSOC if error
 */
-PRIVATE int _makeSocket (HTHost * host, HTRequest * request, int preemptive)
+PRIVATE int _makeSocket (HTHost * host, HTRequest * request, int preemptive,
+			 int family)
 {
     int status = 1;
     SOCKET sockfd = INVSOC;
 #ifdef DECNET
     if ((sockfd=socket(AF_DECnet, SOCK_STREAM, 0))==INVSOC)
 #else
-    if ((sockfd=socket(AF_INET, SOCK_STREAM,IPPROTO_TCP))==INVSOC)
+    if ((sockfd=socket(family, SOCK_STREAM,IPPROTO_TCP))==INVSOC)
 #endif
     {
 	HTRequest_addSystemError(request, ERR_FATAL, socerrno, NO, "socket");
@@ -188,6 +192,152 @@ PRIVATE BOOL createChannelAndTransportStreams (HTHost * host, SOCKET sockfd, HTT
     return NO;
 }
 
+/* ------------------------------------------------------------------------- */
+/*		   RACING THE OTHER ADDRESS FAMILY (HAPPY EYEBALLS)	     */
+/* ------------------------------------------------------------------------- */
+
+/*
+**  When a host has both IPv4 and IPv6 addresses and the connect to the
+**  preferred home hasn't finished after TCP_RACE_DELAY ms, we start a
+**  second connect to the best home of the other family on race_sock. The
+**  first one to connect wins. If it is race_sock then it is moved onto
+**  the socket number of the channel using dup2() so that the channel and
+**  the transport streams are kept. The winner's connect time is recorded
+**  by HTDNS_updateWeigths, so the next connect goes straight to it.
+*/
+
+/*	HTDoCancelRace
+**	--------------
+**	Stop a second connection attempt (if any) and close its socket.
+**	The system error number is preserved.
+*/
+PUBLIC BOOL HTDoCancelRace (HTHost * host)
+{
+    if (host && (host->race_timer || host->race_sock != INVSOC)) {
+	int err = errno;
+	if (host->race_timer) {
+	    HTTimer_delete(host->race_timer);
+	    host->race_timer = NULL;
+	}
+	if (host->race_sock != INVSOC) {
+	    HTTRACE(PROT_TRACE, "HTDoConnect. Cancelling connect on socket %d\n" _ host->race_sock);
+	    HTEvent_unregister(host->race_sock, HTEvent_CONNECT);
+	    NETCLOSE(host->race_sock);
+	    HTNet_decreaseSocket();
+	    host->race_sock = INVSOC;
+	}
+	host->race_lost = NO;
+	errno = err;
+	return YES;
+    }
+    return NO;
+}
+
+#ifdef HT_IPV6
+/*
+**  Let the Net object holding the lock on the host continue
+*/
+PRIVATE int RaceDispatch (HTHost * host)
+{
+    HTNet * net = host->lock;
+    if (net && net->event.cbf)
+	return (*net->event.cbf)(HTChannel_socket(host->channel),
+				 net->event.param, HTEvent_CONNECT);
+    return HT_OK;
+}
+
+PRIVATE int RaceEvent (SOCKET soc, void * param, HTEventType type)
+{
+    HTHost * host = (HTHost *) param;
+    SOCKET sockfd = HTChannel_socket(host->channel);
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (soc != host->race_sock) return HT_OK;
+    if (getsockopt(soc, SOL_SOCKET, SO_ERROR, (char *) &error, &len) < 0)
+	error = socerrno;
+
+    /* The host may have connected or given up in the meantime */
+    if (host->tcpstate != TCP_NEED_CONNECT || sockfd == INVSOC) {
+	HTDoCancelRace(host);
+	return HT_OK;
+    }
+
+    /* If the first connect has failed as well then we are done */
+    if (error) {
+	BOOL lost = host->race_lost;
+	HTTRACE(PROT_TRACE, "HTDoConnect. Home %d failed on socket %d\n" _ 
+		host->race_home _ soc);
+	HTDNS_updateWeigths(host->dns, host->race_home,
+			    HTGetTimeInMillis() - host->race_start +
+			    (HT_HOSTUNREACHABLE(error) ? TCP_DELAY : TCP_PENALTY));
+	HTHost_decreaseRetry(host);
+	HTDoCancelRace(host);
+	if (lost) {
+	    errno = error;
+	    host->tcpstate = TCP_ERROR;
+	    HTTRACE(PROT_TRACE, "HTHost %p going to state TCP_ERROR.\n" _ host);
+	    return RaceDispatch(host);
+	}
+	return HT_OK;
+    }
+
+    /* We won - the first connect has been too slow */
+    HTTRACE(PROT_TRACE, "HTDoConnect. Home %d connected first on socket %d\n" _ 
+	    host->race_home _ soc);
+    HTEvent_unregister(soc, HTEvent_CONNECT);
+    if (host->lock) HTHost_unregister(host, host->lock, HTEvent_CONNECT);
+    HTEvent_unregister(sockfd, HTEvent_CONNECT);
+    if (dup2(soc, sockfd) < 0) {
+	HTTRACE(PROT_TRACE, "HTDoConnect. Can't move socket %d to %d\n" _ soc _ sockfd);
+	HTDoCancelRace(host);
+	return HT_OK;
+    }
+    if (!host->race_lost)
+	HTDNS_updateWeigths(host->dns, HTHost_home(host),
+			    HTGetTimeInMillis() - host->connecttime);
+    HTHost_setHome(host, host->race_home);
+    HTDNS_sockAddr(host->dns, host->race_home, &host->sock_addr);
+    host->connecttime = host->race_start;
+    HTDoCancelRace(host);
+    host->tcpstate = TCP_CONNECTED;
+    HTTRACE(PROT_TRACE, "HTHost %p going to state TCP_CONNECTED.\n" _ host);
+    return RaceDispatch(host);
+}
+
+/*
+**  The first connect is slow so start the second one
+*/
+PRIVATE int RaceTimeout (HTTimer * timer, void * param, HTEventType type)
+{
+    HTHost * host = (HTHost *) param;
+    SockAddr addr;
+    SOCKET sockfd;
+    HTTimer_delete(timer);
+    host->race_timer = NULL;
+    if (host->tcpstate != TCP_NEED_CONNECT || host->race_sock != INVSOC)
+	return HT_OK;
+    memcpy((void *) &addr, (void *) &host->sock_addr, sizeof(SockAddr));
+    if (!HTDNS_sockAddr(host->dns, host->race_home, &addr) ||
+	(sockfd = _makeSocket(host, NULL, NO, addr.sa.sa_family)) == INVSOC)
+	return HT_OK;
+    HTTRACE(PROT_TRACE, "HTDoConnect. Trying home %d (%s) on socket %d\n" _ 
+	    host->race_home _ HTInetString(&addr.in) _ sockfd);
+    if (NETCALL_ERROR(connect(sockfd, &addr.sa, SockAddr_length(&addr))) &&
+	!NETCALL_WOULDBLOCK(socerrno)) {
+	HTTRACE(PROT_TRACE, "HTDoConnect. Home %d failed right away\n" _ host->race_home);
+	NETCLOSE(sockfd);
+	HTNet_decreaseSocket();
+	return HT_OK;
+    }
+    host->race_sock = sockfd;
+    host->race_start = HTGetTimeInMillis();
+    if (!host->race_event)
+	host->race_event = HTEvent_new(RaceEvent, host, HT_PRIORITY_MAX, -1);
+    HTEvent_register(sockfd, HTEvent_CONNECT, host->race_event);
+    return HT_OK;
+}
+#endif /* HT_IPV6 */
+
 /*								HTDoConnect()
 **
 **	Note: Any port indication in URL, e.g., as `host:port' overwrites
@@ -255,7 +405,16 @@ PUBLIC int HTDoConnect (HTNet * net)
 	    break;
 
 	case TCP_DNS:
-	    if ((status = HTParseInet(host, hostname, request)) < 0) {
+	    /*
+	    **  If the name is being looked up by a resolver thread then we
+	    **  stay in this state. The Net object holding the lock on the
+	    **  host is called back when the answer is in the DNS cache.
+	    */
+	    if ((status = HTParseInet(host, hostname, request)) == HT_WOULD_BLOCK) {
+		HTTRACE(PROT_TRACE, "HTDoConnect. Waiting for DNS lookup of `%s'\n" _ hostname);
+		return HT_WOULD_BLOCK;
+	    }
+	    if (status < 0) {
 		HTTRACE(PROT_TRACE, "HTDoConnect. Can't locate `%s\'\n" _ hostname);
 		HTRequest_addError(request, ERR_FATAL, NO,
 				   HTERR_NO_REMOTE_HOST,
@@ -276,7 +435,8 @@ PUBLIC int HTDoConnect (HTNet * net)
 	    SOCKET sockfd;
 
 	    /* Create a new socket */
-	    if ((sockfd = _makeSocket(host, request, preemptive)) == INVSOC) {
+	    if ((sockfd = _makeSocket(host, request, preemptive,
+				      host->sock_addr.sa.sa_family)) == INVSOC) {
 		host->tcpstate = TCP_ERROR;
 		break;
 	    }
@@ -286,6 +446,7 @@ PUBLIC int HTDoConnect (HTNet * net)
 
 	    /* If multi-homed host then start timer on connection */
 	    if (HTHost_retry(host)) host->connecttime = HTGetTimeInMillis();
+	    host->race_home = -1;
 
 	    /* Progress notification */
 	    {
@@ -317,8 +478,8 @@ PUBLIC int HTDoConnect (HTNet * net)
             */
 	    HTHost_register(host, net, HTEvent_CONNECT);
 #endif /* _WINSOCKAPI_ */
-	    status = connect(HTChannel_socket(host->channel), (struct sockaddr *) &host->sock_addr,
-			     sizeof(host->sock_addr));
+	    status = connect(HTChannel_socket(host->channel), &host->sock_addr.sa,
+			     SockAddr_length(&host->sock_addr));
 	    /*
 	     * According to the Sun man page for connect:
 	     *     EINPROGRESS         The socket is non-blocking and the  con-
@@ -346,6 +507,19 @@ PUBLIC int HTDoConnect (HTNet * net)
 
 		    HTHost_register(host, net, HTEvent_CONNECT);
 #endif /* _WINSOCKAPI_ */
+#ifdef HT_IPV6
+		    /*
+		    **  If the host also has addresses of the other family that
+		    **  we haven't tried yet then start connecting to one of
+		    **  those as well unless this connect is done by the time
+		    **  the timer goes off
+		    */
+		    if (!preemptive && HTHost_retry(host) > 1 &&
+			host->race_home < 0 && !host->race_timer &&
+			(host->race_home = HTDNS_raceHome(host->dns, HTHost_home(host))) >= 0)
+			host->race_timer = HTTimer_new(NULL, RaceTimeout, host,
+						       TCP_RACE_DELAY, YES, NO);
+#endif /* HT_IPV6 */
 		    return HT_WOULD_BLOCK;
 		}
 #ifdef _WINSOCKAPI_
@@ -378,6 +552,20 @@ PUBLIC int HTDoConnect (HTNet * net)
 		    HTTRACE(PROT_TRACE, "HTHost %p going to state TCP_NEED_SOCKET.\n" _ host);
 		    break;
 		}
+		/*
+		**  If a connect to the other address family is still in
+		**  progress then wait for that one
+		*/
+		if (host->race_sock != INVSOC) {
+		    HTTRACE(PROT_TRACE, "HTDoConnect. Home %d failed, waiting for home %d\n" _ 
+			    HTHost_home(host) _ host->race_home);
+		    HTHost_unregister(host, net, HTEvent_CONNECT);
+		    HTDNS_updateWeigths(host->dns, HTHost_home(host),
+					HTGetTimeInMillis() - host->connecttime +
+					(HT_HOSTUNREACHABLE(socerrno) ? TCP_DELAY : TCP_PENALTY));
+		    host->race_lost = YES;
+		    return HT_WOULD_BLOCK;
+		}
 		if (HTHost_retry(host)) {
 		    host->connecttime = HTGetTimeInMillis() - host->connecttime;
 		    /* Added EINVAL `invalid argument' as this is what I 
@@ -398,6 +586,7 @@ PUBLIC int HTDoConnect (HTNet * net)
 	    break;
 
 	  case TCP_CONNECTED:
+	    HTDoCancelRace(host);
 	    HTHost_unregister(host, net, HTEvent_CONNECT);
 	    if (HTHost_retry(host)) {
 		host->connecttime = HTGetTimeInMillis() - host->connecttime;
@@ -429,6 +618,8 @@ PUBLIC int HTDoConnect (HTNet * net)
 	  case TCP_NEED_BIND:
 	  case TCP_NEED_LISTEN:
 	  case TCP_ERROR:
+	    HTDoCancelRace(host);
+	    HTHost_unregister(host, net, HTEvent_CONNECT);
 	    if (HTChannel_socket(host->channel) != INVSOC) {
 		NETCLOSE(HTChannel_socket(host->channel));
 		if (HTHost_isPersistent(host)) {	 /* Inherited socket */
@@ -478,7 +669,7 @@ PUBLIC int HTDoAccept (HTNet * listening, HTNet * accepting)
 	return HT_ERROR;
     }
 
-    status = accept(HTNet_socket(listening), (struct sockaddr *) &host->sock_addr, &size);
+    status = accept(HTNet_socket(listening), &host->sock_addr.sa, &size);
     if (NETCALL_ERROR(status))
     {
 	if (NETCALL_WOULDBLOCK(socerrno))
@@ -567,7 +758,7 @@ PUBLIC int HTDoListen (HTNet * listening, HTNet * accepting, int backlog)
 	    SOCKET sockfd;
 
 	    /* Create a new socket */
-	    if ((sockfd = _makeSocket(host, request, preemptive)) == INVSOC) {
+	    if ((sockfd = _makeSocket(host, request, preemptive, AF_INET)) == INVSOC) {
 		host->tcpstate = TCP_ERROR;
 		break;
 	    }
@@ -588,8 +779,8 @@ PUBLIC int HTDoListen (HTNet * listening, HTNet * accepting, int backlog)
 
 	case TCP_NEED_BIND:
 	    HTTRACE(PROT_TRACE, "Socket...... Binding socket %d\n" _ HTNet_socket(listening));
-	    status = bind(HTNet_socket(listening), (struct sockaddr *) &host->sock_addr,
-			  sizeof(host->sock_addr));
+	    status = bind(HTNet_socket(listening), &host->sock_addr.sa,
+			  SockAddr_length(&host->sock_addr));
 	    if (NETCALL_ERROR(status)) {
 		HTTRACE(PROT_TRACE, "Socket...... Bind failed %d\n" _ socerrno);
 		host->tcpstate = TCP_ERROR;		
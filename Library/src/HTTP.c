@@ -93,6 +93,7 @@ struct _HTStream {
     char 			buffer[MAX_STATUS_LEN+1];
     int				buflen;
     int				startLen;/* buflen when put_block was called */
+    HTArena *			arena;
 };
 
 struct _HTInputStream {
@@ -947,7 +948,7 @@ PRIVATE int HTTPStatus_free (HTStream * me)
 	if ((status = (*me->target->isa->_free)(me->target))==HT_WOULD_BLOCK)
 	    return HT_WOULD_BLOCK;
     }
-    HT_FREE(me);
+    HTArena_deleteObject(me->arena, me);
     return status;
 }
 
@@ -955,7 +956,7 @@ PRIVATE int HTTPStatus_abort (HTStream * me, HTList * e)
 {
     if (me->target)
 	ABORT_TARGET;
-    HT_FREE(me);
+    HTArena_deleteObject(me->arena, me);
     HTTRACE(PROT_TRACE, "HTTPStatus.. ABORTING...\n");
     return HT_ERROR;
 }
@@ -980,10 +981,10 @@ PUBLIC HTStream * HTTPStatus_new (HTRequest *	request,
 				  HTFormat	output_format,
 				  HTStream *	output_stream)
 {
-    HTStream * me;
-    if ((me = (HTStream  *) HT_CALLOC(1, sizeof(HTStream))) == NULL)
-        HT_OUTOFMEM("HTTPStatus_new");
+    HTArena * arena = HTRequest_arena(request);
+    HTStream * me = (HTStream *) HTArena_newObject(arena, sizeof(HTStream));
     me->isa = &HTTPStatusClass;
+    me->arena = arena;
     if (request) {
 	HTNet * net = HTRequest_net(request);
         /* Get existing copy */
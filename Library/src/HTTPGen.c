@@ -39,6 +39,7 @@ struct _HTStream {
     int				version;
     BOOL			endHeader;
     BOOL			transparent;
+    HTArena *			arena;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -274,7 +275,7 @@ PRIVATE int HTTPGen_free (HTStream * me)
     if (status != HT_WOULD_BLOCK) {
 	if ((status = (*me->target->isa->_free)(me->target)) == HT_WOULD_BLOCK)
 	    return HT_WOULD_BLOCK;
-	HT_FREE(me);
+	HTArena_deleteObject(me->arena, me);
     }
     return status;
 }
@@ -284,7 +285,7 @@ PRIVATE int HTTPGen_abort (HTStream * me, HTList * e)
     HTTRACE(PROT_TRACE, "HTTPGen..... ABORTING...\n");
     if (me) {
 	if (me->target) (*me->target->isa->abort)(me->target, e);
-	HT_FREE(me);
+	HTArena_deleteObject(me->arena, me);
     }
     return HT_ERROR;
 }
@@ -306,10 +307,10 @@ PRIVATE const HTStreamClass HTTPGenClass =
 PUBLIC HTStream * HTTPGen_new (HTRequest * request, HTStream * target,
 			       BOOL endHeader, int version)
 {
-    HTStream * me;
-    if ((me = (HTStream  *) HT_CALLOC(1, sizeof(HTStream))) == NULL)
-        HT_OUTOFMEM("HTTPGen_new");
+    HTArena * arena = HTRequest_arena(request);
+    HTStream * me = (HTStream *) HTArena_newObject(arena, sizeof(HTStream));
     me->isa = &HTTPGenClass;
+    me->arena = arena;
     me->target = target;
     me->request = request;
     me->endHeader = endHeader;
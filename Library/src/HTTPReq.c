@@ -35,6 +35,7 @@ struct _HTStream {
     int 			state;    
     char *			url;
     BOOL			transparent;
+    HTArena *			arena;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -597,7 +598,7 @@ PRIVATE int HTTPRequest_free (HTStream * me)
 	if ((status = (*me->target->isa->_free)(me->target)) == HT_WOULD_BLOCK)
 	    return HT_WOULD_BLOCK;
 	HT_FREE(me->url);
-	HT_FREE(me);
+	HTArena_deleteObject(me->arena, me);
     }
     return status;
 }
@@ -611,7 +612,7 @@ PRIVATE int HTTPRequest_abort (HTStream * me, HTList * e)
 	  (*me->target->isa->abort)(me->target, e);
 	if (me->url)
 	  HT_FREE(me->url);
-	HT_FREE(me);
+	HTArena_deleteObject(me->arena, me);
     }
     return HT_ERROR;
 }
@@ -633,10 +634,10 @@ PRIVATE const HTStreamClass HTTPRequestClass =
 PUBLIC HTStream * HTTPRequest_new (HTRequest * request, HTStream * target,
 				   BOOL endHeader, int version)
 {
-    HTStream * me;
-    if ((me = (HTStream  *) HT_CALLOC(1, sizeof(HTStream))) == NULL)
-        HT_OUTOFMEM("HTTPRequest_new");
+    HTArena * arena = HTRequest_arena(request);
+    HTStream * me = (HTStream *) HTArena_newObject(arena, sizeof(HTStream));
     me->isa = &HTTPRequestClass;
+    me->arena = arena;
     me->target = target;
     me->request = request;
     me->version = version;
@@ -5,7 +5,10 @@
 **	Please first read the full copyright statement in the file COPYRIGH.
 **	@(#) $Id$
 **
-**	Timers based on the X server timers
+**	Timers based on the X server timers. The pending timers are kept in
+**	a binary heap ordered by expiration time. Each timer knows its
+**	position in the heap so that it can be found, moved and removed in
+**	O(log n) time without searching.
 **
 ** Authors:
 **	EGP	Eric Prud'hommeaux (eric@w3.org)
@@ -21,6 +24,8 @@
 #include "HTReqMan.h"
 #include "HTTimer.h"					 /* Implemented here */
 
+#define TIMER_ALLOCATION	64	      /* Initial size of the timer heap */
+
 struct _HTTimer {
     ms_t	millis;		/* Relative value in millis */
     ms_t	expires;	/* Absolute value in millis */
@@ -28,9 +33,14 @@ struct _HTTimer {
     BOOL	repetitive;
     void *	param;		/* Client supplied context */
     HTTimerCallback * cbf;
+    int		index;		/* Position in heap, -1 if not pending */
+    unsigned long order;	/* Keeps timers with same expiration FIFO */
 };
 
-PRIVATE HTList * Timers = NULL;			   /* List of timers */
+PRIVATE HTTimer ** Timers = NULL;		 /* Heap of pending timers */
+PRIVATE int TimerCount = 0;
+PRIVATE int TimerSize = 0;
+PRIVATE unsigned long TimerOrder = 0;
 
 PRIVATE HTTimerSetCallback * SetPlatformTimer = NULL;
 PRIVATE HTTimerSetCallback * DeletePlatformTimer = NULL;
@@ -50,32 +60,104 @@ PRIVATE HTTimer * InTimer = NULL;
 
 #endif /* !WATCH_RECURSION */
 
+/* ------------------------------------------------------------------------- */
+/*				TIMER HEAP				     */
+/* ------------------------------------------------------------------------- */
+
+#define TIMER_BEFORE(a, b) ((a)->expires < (b)->expires || \
+			    ((a)->expires == (b)->expires && (a)->order < (b)->order))
+
+PRIVATE void Heap_set (int index, HTTimer * timer)
+{
+    Timers[index] = timer;
+    timer->index = index;
+}
+
+PRIVATE void Heap_up (int index)
+{
+    HTTimer * timer = Timers[index];
+    while (index > 0) {
+	int parent = (index-1) / 2;
+	if (!TIMER_BEFORE(timer, Timers[parent])) break;
+	Heap_set(index, Timers[parent]);
+	index = parent;
+    }
+    Heap_set(index, timer);
+}
+
+PRIVATE void Heap_down (int index)
+{
+    HTTimer * timer = Timers[index];
+    for (;;) {
+	int child = 2*index + 1;
+	if (child >= TimerCount) break;
+	if (child+1 < TimerCount && TIMER_BEFORE(Timers[child+1], Timers[child]))
+	    child++;
+	if (!TIMER_BEFORE(Timers[child], timer)) break;
+	Heap_set(index, Timers[child]);
+	index = child;
+    }
+    Heap_set(index, timer);
+}
+
+PRIVATE void Heap_add (HTTimer * timer)
+{
+    if (TimerCount >= TimerSize) {
+	TimerSize = TimerSize ? TimerSize*2 : TIMER_ALLOCATION;
+	if ((Timers = (HTTimer **) HT_REALLOC(Timers, TimerSize*sizeof(HTTimer *))) == NULL)
+	    HT_OUTOFMEM("Heap_add");
+    }
+    Heap_set(TimerCount++, timer);
+    Heap_up(timer->index);
+}
+
+/*
+**  Restore the heap order after the timer at this index has changed
+*/
+PRIVATE void Heap_fix (int index)
+{
+    if (index > 0 && TIMER_BEFORE(Timers[index], Timers[(index-1)/2]))
+	Heap_up(index);
+    else
+	Heap_down(index);
+}
+
+PRIVATE BOOL Heap_remove (HTTimer * timer)
+{
+    int index = timer->index;
+    if (index < 0 || index >= TimerCount || Timers[index] != timer)
+	return NO;
+    timer->index = -1;
+    if (index != --TimerCount) {
+	Heap_set(index, Timers[TimerCount]);
+	Heap_fix(index);
+    }
+    return YES;
+}
+
 /* JK: used by Amaya */
 PUBLIC BOOL HTTimer_expireAll (void)
 {
-  HTList * cur;
   HTTimer * timer;
-  if (Timers) {
+  int cnt;
+  if (TimerCount) {
     /*
     **  first delete all plattform specific timers to
     **  avoid having a concurrent callback
     */
-    cur = Timers;
-    while ((timer = (HTTimer *) HTList_nextObject(cur))) {
-      if (DeletePlatformTimer) DeletePlatformTimer(timer);
+    for (cnt = 0; cnt < TimerCount; cnt++) {
+      if (DeletePlatformTimer) DeletePlatformTimer(Timers[cnt]);
     }
  
     /*
     ** simulate a timer timeout thru timer_dispatch
     ** to kill its context
     */
-    cur = Timers;
-    while ((timer = (HTTimer *) HTList_nextObject(cur))) {
+    while (TimerCount) {
+      timer = Timers[0];
           /* avoid having it being refreshed */
       timer->repetitive = NO;
       HTTimer_dispatch (timer);
-      /* as the timer is erased, we start again from the top of the list */
-      cur = Timers;
     }
     return YES;
   }
@@ -89,13 +171,11 @@ PUBLIC BOOL HTTimer_expireAll (void)
 **  timer with the next expiration time if repetitive. Otherwise we just leave
 **  it
 */
-PRIVATE int Timer_dispatch (HTList * cur, HTList * last)
+PRIVATE int Timer_dispatch (HTTimer * timer)
 {
-    HTTimer * timer;
     int ret = HT_ERROR;
 
-    timer = (HTTimer *)HTList_objectOf(cur);
-    if (timer == NULL) {
+    if (timer == NULL || timer->index < 0) {
 #if 0
         HTDEBUGBREAK("Timer dispatch couldn't find a timer\n");
 #endif
@@ -112,7 +192,7 @@ PRIVATE int Timer_dispatch (HTList * cur, HTList * last)
     if (timer->repetitive)
 	HTTimer_new(timer, timer->cbf, timer->param, timer->millis, YES, YES);
     else
-	HTList_quickRemoveElement(cur, last);
+	Heap_remove(timer);
     HTTRACE(THD_TRACE, "Timer....... Dispatch timer %p\n" _ timer);
     ret = (*timer->cbf) (timer, timer->param, HTEvent_TIMEOUT);
     return ret;
@@ -160,11 +240,9 @@ PUBLIC BOOL HTTimer_isRelative (HTTimer * timer)
 
 PUBLIC BOOL HTTimer_delete (HTTimer * timer)
 {
-    HTList * last;
-    HTList * cur;
+    if (!timer) return NO;
     CHECKME(timer);
-    if ((cur = HTList_elementOf(Timers, (void *)timer, &last)) == NULL) CLEARME(timer);
-    if (HTList_quickRemoveElement(cur, last)) {
+    if (Heap_remove(timer)) {
 	HTTRACE(THD_TRACE, "Timer....... Deleted active timer %p\n" _ timer);
     } else { 
 	HTTRACE(THD_TRACE, "Timer....... Deleted expired timer %p\n" _ timer);
@@ -184,11 +262,9 @@ PUBLIC HTTimer * HTTimer_new (HTTimer * timer, HTTimerCallback * cbf,
 			      void * param, ms_t millis, BOOL relative,
 			      BOOL repetitive)
 {
-    HTList * last;
-    HTList * cur;
     ms_t now = HTGetTimeInMillis();
     ms_t expires;
-    HTTimer * pres;
+    BOOL pending = NO;
 
     CHECKME(timer);
     expires = millis;
@@ -197,42 +273,32 @@ PUBLIC HTTimer * HTTimer_new (HTTimer * timer, HTTimerCallback * cbf,
     else
 	millis = expires-now;
 
-    if (Timers == NULL)
-	Timers = HTList_new();
-
     if (timer) {
 
 	/*	if a timer is specified, it should already exist
 	 */
-	if ((cur = HTList_elementOf(Timers, (void *)timer, &last)) == NULL) {
+	if (timer->index < 0 || timer->index >= TimerCount ||
+	    Timers[timer->index] != timer) {
 	    HTDEBUGBREAK("Timer %p not found\n" _ timer);
 	    CLEARME(timer);
 	    return NULL;
 	}
-	HTList_quickRemoveElement(cur, last);
+	pending = YES;
 	HTTRACE(THD_TRACE, "Timer....... Found timer %p with callback %p, context %p, and %s timeout %d\n" _ 
 		    timer _ cbf _ param _ relative ? "relative" : "absolute" _ millis);
-	/* could optimize by sorting from last when ((HTList *)(last->object))->expires < expires (most common case) */
     } else {
 
 	/*	create a new timer
 	 */
 	if ((timer = (HTTimer *) HT_CALLOC(1, sizeof(HTTimer))) == NULL)
 	    HT_OUTOFMEM("HTTimer_new");
-	last = Timers;
+	timer->index = -1;
 	HTTRACE(THD_TRACE, "Timer....... Created %s timer %p with callback %p, context %p, and %s timeout %d\n" _ 
 		    repetitive ? "repetitive" : "one shot" _ 
 		    timer _ cbf _ param _ 
 		    relative ? "relative" : "absolute" _ millis);
     }
 
-    /*
-    **  Sort new element into list
-    */
-    for (cur = last; 
-	 (pres = (HTTimer *) HTList_nextObject(cur)) != NULL && pres->expires < expires; 
-	 last = cur);
-
     /*
     **  If the expiration is 0 then we still register it but dispatch it immediately.
     */
@@ -244,12 +310,16 @@ PUBLIC HTTimer * HTTimer_new (HTTimer * timer, HTTimerCallback * cbf,
     timer->millis = millis;
     timer->relative = relative;
     timer->repetitive = repetitive;
+    timer->order = TimerOrder++;
     SETME(timer);
 
     /*
-    **	add to list if timer is new
+    **	Move the timer to its new place in the heap or add it if it is new
     */
-    cur = HTList_addList(last, (void *)timer);
+    if (pending)
+	Heap_fix(timer->index);
+    else
+	Heap_add(timer);
 
     /*
     **  Call any platform specific timer handler
@@ -257,7 +327,7 @@ PUBLIC HTTimer * HTTimer_new (HTTimer * timer, HTTimerCallback * cbf,
     if (SetPlatformTimer) SetPlatformTimer(timer);
 
     /* Check if the timer object has already expired. If so then dispatch */
-    if (timer->expires <= now) Timer_dispatch(cur, last);
+    if (timer->expires <= now) Timer_dispatch(timer);
 
     CLEARME(timer);
     return timer;
@@ -275,10 +345,10 @@ PUBLIC BOOL HTTimer_refresh (HTTimer * timer, ms_t now)
 
 PUBLIC BOOL HTTimer_deleteAll (void)
 {
-    HTList * cur = Timers;
-    HTTimer * pres;
+    int cnt;
     if (Timers) {
-	while ((pres = (HTTimer *) HTList_nextObject(cur))) {
+	for (cnt = 0; cnt < TimerCount; cnt++) {
+	    HTTimer * pres = Timers[cnt];
 
 	    /*
 	    **  Call any platform specific timer handler
@@ -286,8 +356,8 @@ PUBLIC BOOL HTTimer_deleteAll (void)
 	    if (DeletePlatformTimer) DeletePlatformTimer(pres);
 	    HT_FREE(pres);
 	}
-	HTList_delete(Timers);
-	Timers = NULL;
+	HT_FREE(Timers);
+	TimerCount = TimerSize = 0;
 	return YES;
     }
     return NO;
@@ -295,10 +365,7 @@ PUBLIC BOOL HTTimer_deleteAll (void)
 
 PUBLIC int HTTimer_dispatch (HTTimer * timer)
 {
-    HTList * cur;
-    HTList * last = Timers;
-    cur = HTList_elementOf(Timers, (void *)timer, &last);
-    return Timer_dispatch(cur, last);
+    return Timer_dispatch(timer);
 }
 
 /*
@@ -311,31 +378,21 @@ PUBLIC BOOL HTTimer_hasTimerExpired (HTTimer * timer)
 
 PUBLIC int HTTimer_next (ms_t * pSoonest)
 {
-    HTList * cur = Timers;
-    HTList * last = Timers;
-    HTTimer * pres;
     ms_t now = HTGetTimeInMillis();
     int ret = HT_OK;
 
     /*
     **  Dispatch all timers that have expired
     */
-    while (Timers && (pres = (HTTimer *) HTList_nextObject(cur))) {
-	if (pres->expires <= now) {
-	    if ((ret = Timer_dispatch(cur, last)) != HT_OK) break;
-	    cur = last = Timers;
-	} else {
-	    last = cur;
-	}	
+    while (TimerCount && Timers[0]->expires <= now) {
+	if ((ret = Timer_dispatch(Timers[0])) != HT_OK) break;
     }
 
     if (pSoonest) {
 	/*
-	**	First element in Timers is the next to expire.
+	**	The top of the heap is the next to expire.
 	*/
-	HTList * cur = Timers;	/* for now */
-	pres = (HTTimer *) HTList_nextObject(cur);
-	*pSoonest = pres ? pres->expires - now : 0;
+	*pSoonest = TimerCount ? Timers[0]->expires - now : 0;
     }
     return ret;
 }
@@ -344,9 +401,9 @@ PUBLIC int HTTimer_next (ms_t * pSoonest)
 extern void CheckSockEvent(HTTimer * timer, HTTimerCallback * cbf, void * param);
 PRIVATE void CheckTimers(void)
 {
-    HTList * cur = Timers;
-    HTTimer * pres;
-    while ((pres = (HTTimer *) HTList_nextObject(cur))) {
+    int cnt;
+    for (cnt = 0; cnt < TimerCount; cnt++) {
+	HTTimer * pres = Timers[cnt];
 	CheckSockEvent(pres, pres->cbf, pres->param);
     }
 }
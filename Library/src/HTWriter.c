@@ -21,6 +21,8 @@
 
 #include "HTHstMan.h"
 
+#define HT_MAX_IOV	16	       /* Buffers handed to writev() at a time */
+
 struct _HTStream {
     const HTStreamClass *	isa;
     /* ... */
@@ -83,14 +85,17 @@ PRIVATE int HTWriter_abort (HTOutputStream * me, HTList * e)
 **	the  pipe  has been read, write() transfers at least
 **	{PIPE_BUF} bytes.
 */
-PRIVATE int HTWriter_write (HTOutputStream * me, const char * buf, int len)
+PRIVATE int write_vector (HTOutputStream * me, const char ** bufs,
+			  const int * lens, int count)
 {
     HTHost * host = me->host;
     SOCKET soc = HTChannel_socket(HTHost_channel(host));
     HTNet * net = HTHost_getWriteNet(host);
+    int written = me->offset;
+    int skip = me->offset;
     int b_write;
-    char * wrtp;
-    const char *limit = buf+len;
+    int idx = 0;
+    int pos;
 
     /* If we don't have a Net object then return right away */
     if (!net) {
@@ -98,34 +103,40 @@ PRIVATE int HTWriter_write (HTOutputStream * me, const char * buf, int len)
 	return HT_ERROR;
     }
 
-#ifdef NOT_ASCII
-    if (len && !me->ascbuf) {			      /* Generate new buffer */
-	const char *orig = buf;
-	char *dest;
-	int cnt;
-	if ((me->ascbuf = (char  *) HT_MALLOC(len)) == NULL)
-	    HT_OUTOFMEM("HTWriter_write");
-	dest = me->ascbuf;
-	for (cnt=0; cnt<len; cnt++) {
-	    *dest = TOASCII(*orig);
-	    dest++, orig++;
-	}
-	wrtp = me->ascbuf;
-	limit = me->ascbuf+len;
-    }
-#else
-    if (!me->offset)
-	wrtp = (char *) buf;
-    else {
-	wrtp = (char *) buf + me->offset;
-	len -= me->offset;
-	me->offset = 0;
-    }
-#endif
+    /*
+    **  Skip what we already wrote before the socket blocked. The offset
+    **  counts bytes from the start of the first buffer across all buffers
+    */
+    while (idx < count && skip >= lens[idx]) skip -= lens[idx++];
+    pos = skip;
+    me->offset = 0;
 
     /* Write data to the network */
-    while (wrtp < limit) {
-	if ((b_write = NETWRITE(soc, wrtp, len)) < 0) {
+    while (idx < count) {
+	if (pos >= lens[idx]) {
+	    idx++;
+	    pos = 0;
+	    continue;
+	}
+#ifdef HAVE_WRITEV
+	if (idx+1 < count) {
+	    struct iovec iov[HT_MAX_IOV];
+	    int cnt = 1;
+	    int i;
+	    iov[0].iov_base = (char *) bufs[idx] + pos;
+	    iov[0].iov_len = lens[idx] - pos;
+	    for (i = idx+1; i < count && cnt < HT_MAX_IOV; i++) {
+		if (lens[i] > 0) {
+		    iov[cnt].iov_base = (char *) bufs[i];
+		    iov[cnt].iov_len = lens[i];
+		    cnt++;
+		}
+	    }
+	    b_write = NETWRITEV(soc, iov, cnt);
+	} else
+#endif /* HAVE_WRITEV */
+	    b_write = NETWRITE(soc, bufs[idx] + pos, lens[idx] - pos);
+	if (b_write < 0) {
 #ifdef EAGAIN
 	    if (socerrno == EAGAIN || socerrno == EWOULDBLOCK)/* POSIX, SVR4 */
 #else
@@ -133,7 +144,7 @@ PRIVATE int HTWriter_write (HTOutputStream * me, const char * buf, int len)
 #endif
 	    {
 		HTHost_register(host, net, HTEvent_WRITE);
-		me->offset = wrtp - buf;
+		me->offset = written;
 		HTTRACE(STREAM_TRACE, "Write Socket WOULD BLOCK %d (offset %d)\n" _ soc _ me->offset);
 		return HT_WOULD_BLOCK;
 #ifdef EINTR
@@ -169,11 +180,20 @@ PRIVATE int HTWriter_write (HTOutputStream * me, const char * buf, int len)
 	}
 
 	/* We do this unconditionally, should we check to see if we ever blocked? */
-	HTTRACEDATA(wrtp, b_write, "Writing to socket %d" _ soc);
 	HTNet_addBytesWritten(net, b_write);
-	wrtp += b_write;
-	len -= b_write;
+	written += b_write;
 	HTTRACE(STREAM_TRACE, "Write Socket %d bytes written to %d\n" _ b_write _ soc);
+	while (b_write > 0) {
+	    int done = lens[idx] - pos;
+	    if (done > b_write) done = b_write;
+	    HTTRACEDATA((char *) bufs[idx] + pos, done, "Writing to socket %d" _ soc);
+	    pos += done;
+	    b_write -= done;
+	    if (pos >= lens[idx]) {
+		idx++;
+		pos = 0;
+	    }
+	}
 	{
 	    HTAlertCallback *cbf = HTAlert_find(HT_PROG_WRITE);
 	    if (cbf) {
@@ -183,10 +203,32 @@ PRIVATE int HTWriter_write (HTOutputStream * me, const char * buf, int len)
 	    }
 	}
     }
+    return HT_OK;
+}
+
+PRIVATE int HTWriter_write (HTOutputStream * me, const char * buf, int len)
+{
 #ifdef NOT_ASCII
-    HT_FREE(me->ascbuf);
+    int status;
+    if (len && !me->ascbuf) {			      /* Generate new buffer */
+	const char *orig = buf;
+	char *dest;
+	int cnt;
+	if ((me->ascbuf = (char  *) HT_MALLOC(len)) == NULL)
+	    HT_OUTOFMEM("HTWriter_write");
+	dest = me->ascbuf;
+	for (cnt=0; cnt<len; cnt++) {
+	    *dest = TOASCII(*orig);
+	    dest++, orig++;
+	}
+    }
+    buf = me->ascbuf;
+    status = write_vector(me, &buf, &len, 1);
+    if (status != HT_WOULD_BLOCK) HT_FREE(me->ascbuf);
+    return status;
+#else
+    return write_vector(me, &buf, &len, 1);
 #endif
-    return HT_OK;
 }
 
 /*	Character handling
@@ -231,6 +273,48 @@ PRIVATE const HTOutputStreamClass HTWriter =
     HTWriter_close
 }; 
 
+/*	Gathered Write
+**	--------------
+**	Write several buffers as one, using writev() if we have it so that
+**	they go out in a single system call without being copied together
+**	first. If the socket blocks then the caller must call us again with
+**	the same data, which may have been copied into a single buffer in
+**	the mean time, as the offset counts across all the buffers.
+*/
+PUBLIC int HTWriter_writev (HTOutputStream * me, const char ** bufs,
+			    const int * lens, int count)
+{
+    if (!me || !bufs || !lens || count < 0) return HT_ERROR;
+    if (me->isa != &HTWriter) {
+	int status = HT_OK;
+	int cnt;
+	for (cnt = 0; cnt < count && status == HT_OK; cnt++)
+	    status = (*me->isa->put_block)(me, bufs[cnt], lens[cnt]);
+	return status;
+    }
+#ifdef NOT_ASCII
+    {
+	int len = 0;
+	int cnt;
+	for (cnt = 0; cnt < count; cnt++) len += lens[cnt];
+	if (len && !me->ascbuf) {
+	    char * dest;
+	    if ((me->ascbuf = (char  *) HT_MALLOC(len)) == NULL)
+		HT_OUTOFMEM("HTWriter_writev");
+	    dest = me->ascbuf;
+	    for (cnt = 0; cnt < count; cnt++) {
+		const char * orig = bufs[cnt];
+		const char * limit = orig + lens[cnt];
+		while (orig < limit) *dest++ = TOASCII(*orig++);
+	    }
+	}
+	return HTWriter_write(me, me->ascbuf, len);
+    }
+#else
+    return write_vector(me, bufs, lens, count);
+#endif
+}
+
 PUBLIC HTOutputStream * HTWriter_new (HTHost * host, HTChannel * ch,
 				      void * param, int mode)
 {
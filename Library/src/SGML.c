@@ -15,6 +15,10 @@
 **	Nov 1996   msa	Strip down the parser to minimal HTML tokenizer,
 **			Stop allocating space for the attribute values,
 **			use pointers to the string chunk instead.
+**
+**	Runs of plain text, quoted attribute values and comments are skipped
+**	in one go, and tag and attribute names are found in perfect hash
+**	tables which are built from the DTD the first time it is used.
 */
 
 #include <assert.h>
@@ -28,6 +32,11 @@
 
 #define INVALID (-1)
 
+#define HASH_SEEDS	64			/* Seeds to try for a size */
+#define HASH_MAX	4096		       /* Largest table we try */
+
+typedef struct _SGMLLookup SGMLLookup;
+
 /*	The State (context) of the parser
 **
 **	This is passed with each call to make the parser reentrant
@@ -60,6 +69,7 @@ struct _HTStream
 	HTTag *current_tag;
 	int current_attribute_number;
 	SGMLContent contents;		/* current content mode */
+	SGMLLookup *lookup;		/* hash tables for the dtd */
 	HTChunk *string;
 	int token;			/* ptr into string buffer */
 	sgml_state state;
@@ -95,6 +105,187 @@ PRIVATE int SGMLFindAttribute  (HTTag* tag, const char * s)
     }
 
 
+/*		Find Tag in DTD tag list
+**		------------------------
+**
+** On entry,
+**	dtd	points to dtd structire including valid tag list
+**	string	points to name of tag in question
+**
+** On exit,
+**	returns:
+**		NULL		tag not found
+**		else		address of tag structure in dtd
+*/
+PRIVATE HTTag * SGMLFindTag (const SGML_dtd* dtd, const char * string)
+    {
+	int high, low, i, diff;
+	for(low=0, high=dtd->number_of_tags;
+	    high > low ;
+	    diff < 0 ? (low = i+1) : (high = i))
+	    {  /* Binary serach */
+		i = (low + (high-low)/2);
+		diff = strcasecomp(dtd->tags[i].name, string);	/* Case insensitive */
+		if (diff==0)
+			/* success: found it */
+			return &dtd->tags[i];
+	    }
+	return NULL;
+    }
+
+/*		Perfect Hash Tables
+**		-------------------
+**
+**	For each DTD we build a hash table of the tag names and one of the
+**	attribute names of each tag. Seeds are tried until no two names
+**	share a slot, so a lookup is one hash and one string compare. Only
+**	the names which the binary searches above can find go into the
+**	tables. Some attribute lists in HTMLPDTD.c aren't quite in order,
+**	and this way we give exactly the same answers as before.
+*/
+typedef struct _SGMLHash {
+    unsigned int	seed;
+    unsigned int	mask;			/* Size - 1, a power of two */
+    short *		slots;		   /* Index + 1, 0 if empty slot */
+} SGMLHash;
+
+struct _SGMLLookup {
+    const SGML_dtd *	dtd;
+    SGMLHash		tags;
+    SGMLHash *		attributes;			  /* One per tag */
+};
+
+PRIVATE HTList * Lookups = NULL;		     /* One per DTD seen */
+
+PRIVATE unsigned int hash_name (const char * s, unsigned int seed)
+    {
+	unsigned int h = 2166136261U ^ seed;
+	while (*s)
+		h = (h ^ (unsigned char) TOLOWER(*s++)) * 16777619U;
+	return h ^ (h >> 15);
+    }
+
+/*
+**	Names set to NULL are left out. If we can't find a seed then there
+**	are no slots and the caller falls back on the binary search.
+*/
+PRIVATE void hash_build (SGMLHash * hash, const char ** names, int count)
+    {
+	unsigned int size = 8;
+	while (size < (unsigned int) count * 2)
+		size <<= 1;
+	hash->slots = NULL;
+	for ( ; size <= HASH_MAX; size <<= 1)
+	    {
+		unsigned int seed;
+		if ((hash->slots = (short *) HT_CALLOC(size, sizeof(short))) == NULL)
+			HT_OUTOFMEM("SGML hash_build");
+		hash->mask = size - 1;
+		for (seed = 0; seed < HASH_SEEDS; seed++)
+		    {
+			int i;
+			for (i = 0; i < count; i++)
+			    {
+				short * slot;
+				if (!names[i]) continue;
+				slot = &hash->slots[hash_name(names[i], seed) & hash->mask];
+				if (*slot) break;
+				*slot = i + 1;
+			    }
+			if (i >= count)
+			    {
+				hash->seed = seed;
+				return;
+			    }
+			memset(hash->slots, 0, size * sizeof(short));
+		    }
+		HT_FREE(hash->slots);
+	    }
+	HTTRACE(SGML_TRACE, "SGML Parser. No perfect hash for %d names\n" _ count);
+    }
+
+/*
+**	The tables are kept until the application exits as DTDs are
+**	normally static. Tags with the same attribute list share a table.
+*/
+PRIVATE SGMLLookup * SGMLLookup_find (const SGML_dtd * dtd)
+    {
+	HTList * cur = Lookups;
+	SGMLLookup * me;
+	const char ** names;
+	int size = dtd->number_of_tags;
+	int t, i;
+
+	while ((me = (SGMLLookup *) HTList_nextObject(cur)))
+		if (me->dtd == dtd) return me;
+
+	if ((me = (SGMLLookup *) HT_CALLOC(1, sizeof(SGMLLookup))) == NULL ||
+	    (me->attributes = (SGMLHash *)
+	     HT_CALLOC(dtd->number_of_tags + 1, sizeof(SGMLHash))) == NULL)
+		HT_OUTOFMEM("SGMLLookup_find");
+	me->dtd = dtd;
+	for (t = 0; t < dtd->number_of_tags; t++)
+		if (dtd->tags[t].number_of_attributes > size)
+			size = dtd->tags[t].number_of_attributes;
+	if ((names = (const char **) HT_MALLOC((size + 1) * sizeof(char *))) == NULL)
+		HT_OUTOFMEM("SGMLLookup_find");
+
+	if (dtd->number_of_tags < 0x7FFF)
+	    {
+		for (t = 0; t < dtd->number_of_tags; t++)
+			names[t] = SGMLFindTag(dtd, dtd->tags[t].name) == &dtd->tags[t] ?
+				dtd->tags[t].name : NULL;
+		hash_build(&me->tags, names, dtd->number_of_tags);
+	    }
+	for (t = 0; t < dtd->number_of_tags; t++)
+	    {
+		HTTag * tag = &dtd->tags[t];
+		for (i = 0; i < t; i++)
+			if (dtd->tags[i].attributes == tag->attributes &&
+			    dtd->tags[i].number_of_attributes == tag->number_of_attributes)
+				break;
+		if (i < t)
+			me->attributes[t] = me->attributes[i];
+		else
+		    {
+			for (i = 0; i < tag->number_of_attributes; i++)
+				names[i] = SGMLFindAttribute(tag, tag->attributes[i].name) == i ?
+					tag->attributes[i].name : NULL;
+			hash_build(&me->attributes[t], names, tag->number_of_attributes);
+		    }
+	    }
+	HT_FREE(names);
+
+	if (!Lookups) Lookups = HTList_new();
+	HTList_addObject(Lookups, me);
+	HTTRACE(SGML_TRACE, "SGML Parser. Built lookup tables for DTD %p\n" _ dtd);
+	return me;
+    }
+
+PRIVATE HTTag * find_tag (HTStream * context, const char * s)
+    {
+	const SGML_dtd * dtd = context->dtd;
+	SGMLHash * hash = &context->lookup->tags;
+	if (hash->slots)
+	    {
+		int i = hash->slots[hash_name(s, hash->seed) & hash->mask] - 1;
+		return (i >= 0 && !strcasecomp(dtd->tags[i].name, s)) ?
+			&dtd->tags[i] : NULL;
+	    }
+	return SGMLFindTag(dtd, s);
+    }
+
+PRIVATE int find_attribute (HTStream * context, HTTag * tag, const char * s)
+    {
+	SGMLHash * hash = &context->lookup->attributes[tag - context->dtd->tags];
+	if (hash->slots)
+	    {
+		int i = hash->slots[hash_name(s, hash->seed) & hash->mask] - 1;
+		return (i >= 0 && !strcasecomp(tag->attributes[i].name, s)) ? i : -1;
+	    }
+	return SGMLFindAttribute(tag, s);
+    }
+
 /*	Handle Attribute
 **	----------------
 */
@@ -107,7 +298,7 @@ PRIVATE void handle_attribute_name (HTStream * context, const char * s)
 	/* Note: if tag==NULL, we are skipping unknown tag... */
 	if (tag)
 	    {
-		int i = SGMLFindAttribute(tag, s);
+		int i = find_attribute(context, tag, s);
 		if (i >= 0)
 		    {
 			context->current_attribute_number = i;
@@ -213,34 +404,6 @@ PRIVATE void start_element (HTStream * context)
     }
 
 
-/*		Find Tag in DTD tag list
-**		------------------------
-**
-** On entry,
-**	dtd	points to dtd structire including valid tag list
-**	string	points to name of tag in question
-**
-** On exit,
-**	returns:
-**		NULL		tag not found
-**		else		address of tag structure in dtd
-*/
-PRIVATE HTTag * SGMLFindTag (const SGML_dtd* dtd, const char * string)
-    {
-	int high, low, i, diff;
-	for(low=0, high=dtd->number_of_tags;
-	    high > low ;
-	    diff < 0 ? (low = i+1) : (high = i))
-	    {  /* Binary serach */
-		i = (low + (high-low)/2);
-		diff = strcasecomp(dtd->tags[i].name, string);	/* Case insensitive */
-		if (diff==0)
-			/* success: found it */
-			return &dtd->tags[i];
-	    }
-	return NULL;
-    }
-
 /*________________________________________________________________________
 **			Public Methods
 */
@@ -271,16 +434,59 @@ PRIVATE int SGML_abort  (HTStream * context, HTList * e)
 	return HT_ERROR;
     }
 
+PRIVATE char TextStop[256];	      /* Characters which end a text run */
+
 PRIVATE int SGML_write (HTStream * context, const char * b, int l)
     {
-	const SGML_dtd	*dtd = context->dtd;
 	HTChunk	*string = context->string;
 	const char *text = b;
+	const char *end = b + l;
 	int count = 0;
 	
-	while (l-- > 0)
+	while (l > 0)
 	    {
-		char c = *b++;
+		const char *run = b;
+		char c;
+
+		/*
+		** Skip runs of characters which don't change the state in
+		** one go: text up to the next '<', '&' or newline, quoted
+		** attribute values up to the quote and comments up to the
+		** next '-'.
+		*/
+		switch(context->state)
+		    {
+		    case S_text:
+			while (run < end && !TextStop[(unsigned char) *run])
+				run++;
+			count += run - b;
+			break;
+
+		    case S_dquoted:
+		    case S_squoted:
+			c = context->state == S_dquoted ? '"' : '\'';
+			while (run < end && *run != c && *run &&
+			       *run != '\n' && *run != '\r')
+				run++;
+			if (run > b)
+				HTChunk_putb(string, b, run - b);
+			break;
+
+		    case S_com:
+			if ((run = (const char *) memchr(b, '-', l)) == NULL)
+				run = end;
+			break;
+
+		    default:
+			break;
+		    }
+		l -= run - b;
+		b = run;
+		if (l <= 0)
+			break;
+
+		c = *b++;
+		l--;
 		switch(context->state)
 		    {
 		    got_element_open:
@@ -525,7 +731,7 @@ PRIVATE int SGML_write (HTStream * context, const char * b, int l)
 				break;
 			    }
 			    HTChunk_terminate(string);
-			    context->current_tag  = SGMLFindTag(dtd, HTChunk_data(string));
+			    context->current_tag  = find_tag(context, HTChunk_data(string));
 			    if (context->current_tag == NULL) {
 				HTTRACE(SGML_TRACE, "*** Unknown element %s\n" _ HTChunk_data(string));
 				(*context->actions->unparsed_begin_element)
@@ -656,7 +862,7 @@ PRIVATE int SGML_write (HTStream * context, const char * b, int l)
 				char * first;
 				HTChunk_terminate(string);
 				if ((first=HTChunk_data(string))!=NULL && *first != '\0')
-				        t = SGMLFindTag(dtd, HTChunk_data(string));
+				        t = find_tag(context, HTChunk_data(string));
 				else
 				    	/* Empty end tag */
 					/* Original code popped here one
@@ -821,12 +1027,19 @@ PUBLIC HTStream *SGML_new(const SGML_dtd * dtd, HTStructured * target)
     context->isa = &SGMLParser;
     context->string = HTChunk_new(128);	/* Grow by this much */
     context->dtd = dtd;
+    context->lookup = SGMLLookup_find(dtd);
     context->target = target;
     context->actions = (HTStructuredClass*)(((HTStream*)target)->isa);
     /* Ugh: no OO */
     context->state = S_text;
     for(i=0; i<MAX_ATTRIBUTES; i++)
 	context->value[i] = 0;
+    if (!TextStop['<']) {
+	TextStop['<'] = TextStop['&'] = TextStop['\n'] = 1;
+#ifdef ISO_2022_JP
+	TextStop['\033'] = 1;
+#endif
+    }
     return context;
 }
 
@@ -18,46 +18,301 @@
 **
 **  History:
 **	Oct 1998	Written
+**
+**	The queue keeps its objects in blocks of pointers linked both ways so
+**	that adding and removing at either end takes constant time. If a
+**	limit is set then objects added to the end of a long queue are
+**	written to a temporary file and read back in batches when the part
+**	in memory has been used up.
 */
 
 #include "HTQueue.h"
 
-HTList * HTQueue_new(void)
+#define QUEUE_BLOCK	256		      /* Number of objects per block */
+
+typedef struct _QueueBlock QueueBlock;
+struct _QueueBlock {
+    QueueBlock *	prev;
+    QueueBlock *	next;
+    void *		objects[QUEUE_BLOCK];
+};
+
+struct _HTQueue {
+    QueueBlock *	head;
+    QueueBlock *	tail;
+    int			first;	       /* Index of first object in head block */
+    int			last;		 /* Index after last object in tail */
+    QueueBlock *	spare;		      /* Keep a block for reuse */
+    int			count;			  /* Objects kept in memory */
+    int			high_water;		  /* Longest queue so far */
+
+    /* Objects kept in a temporary file */
+    int			max_memory;
+    HTQueueFreeze *	freeze;
+    HTQueueThaw *	thaw;
+    void *		context;
+    FILE *		fp;
+    long		read_pos;
+    long		write_pos;
+    BOOL		writing;
+    int			on_disk;
+    unsigned long	frozen;
+};
+
+/* ------------------------------------------------------------------------- */
+
+PRIVATE QueueBlock * new_block (HTQueue * me)
+{
+    QueueBlock * block = me->spare;
+    if (block)
+	me->spare = NULL;
+    else if ((block = (QueueBlock *) HT_MALLOC(sizeof(QueueBlock))) == NULL)
+	HT_OUTOFMEM("HTQueue new_block");
+    block->prev = block->next = NULL;
+    return block;
+}
+
+PRIVATE void free_block (HTQueue * me, QueueBlock * block)
+{
+    if (me->spare) {
+	HT_FREE(block);
+    } else
+	me->spare = block;
+}
+
+PRIVATE void update_high_water (HTQueue * me)
+{
+    int total = me->count + me->on_disk;
+    if (total > me->high_water) me->high_water = total;
+}
+
+PRIVATE BOOL push_back (HTQueue * me, void * object)
+{
+    if (!me->tail) {
+	me->head = me->tail = new_block(me);
+	me->first = me->last = 0;
+    } else if (me->last >= QUEUE_BLOCK) {
+	QueueBlock * block = new_block(me);
+	block->prev = me->tail;
+	me->tail->next = block;
+	me->tail = block;
+	me->last = 0;
+    }
+    me->tail->objects[me->last++] = object;
+    me->count++;
+    return YES;
+}
+
+PRIVATE BOOL push_front (HTQueue * me, void * object)
+{
+    if (!me->head) {
+	me->head = me->tail = new_block(me);
+	me->first = me->last = QUEUE_BLOCK;
+    } else if (me->first <= 0) {
+	QueueBlock * block = new_block(me);
+	block->next = me->head;
+	me->head->prev = block;
+	me->head = block;
+	me->first = QUEUE_BLOCK;
+    }
+    me->head->objects[--me->first] = object;
+    me->count++;
+    return YES;
+}
+
+/*
+**	Write an object to the end of the temporary file. We only seek when
+**	we switch between reading and writing.
+*/
+PRIVATE BOOL freeze_object (HTQueue * me, void * object)
+{
+    char * str;
+    if (!me->fp && (me->fp = tmpfile()) == NULL) {
+	HTTRACE(APP_TRACE, "Queue....... Can't create temporary file\n");
+	return NO;
+    }
+    if ((str = (*me->freeze)(object, me->context)) == NULL) return NO;
+    if (!me->writing) {
+	fseek(me->fp, me->write_pos, SEEK_SET);
+	me->writing = YES;
+    }
+    fputs(str, me->fp);
+    putc('\n', me->fp);
+    HT_FREE(str);
+    me->write_pos = ftell(me->fp);
+    me->on_disk++;
+    me->frozen++;
+    return YES;
+}
+
+/*
+**	Read the next batch of objects back from the temporary file
+*/
+PRIVATE BOOL thaw_objects (HTQueue * me)
+{
+    int batch = me->max_memory > 1 ? me->max_memory / 2 : 1;
+    HTChunk * line = HTChunk_new(128);
+    if (me->writing) {
+	fflush(me->fp);
+	me->writing = NO;
+    }
+    fseek(me->fp, me->read_pos, SEEK_SET);
+    while (batch-- > 0 && me->on_disk > 0) {
+	int ch;
+	void * object;
+	HTChunk_clear(line);
+	while ((ch = getc(me->fp)) != EOF && ch != '\n') HTChunk_putc(line, ch);
+	me->on_disk--;
+	if ((object = (*me->thaw)(HTChunk_data(line), me->context)) != NULL)
+	    push_back(me, object);
+	if (ch == EOF) {
+	    me->on_disk = 0;
+	    break;
+	}
+    }
+    me->read_pos = ftell(me->fp);
+    HTChunk_delete(line);
+
+    /* Start all over in the file when it is empty */
+    if (!me->on_disk) me->read_pos = me->write_pos = 0;
+    return YES;
+}
+
+/* ------------------------------------------------------------------------- */
+
+PUBLIC HTQueue * HTQueue_new (void)
 {
-  return HTList_new();
+    HTQueue * me;
+    if ((me = (HTQueue *) HT_CALLOC(1, sizeof(HTQueue))) == NULL)
+	HT_OUTOFMEM("HTQueue_new");
+    return me;
 }
 
-BOOL HTQueue_delete(HTList *me)
+PUBLIC BOOL HTQueue_delete (HTQueue * me)
 {
-  return HTList_delete(me);
+    if (me) {
+	QueueBlock * block = me->head;
+	while (block) {
+	    QueueBlock * next = block->next;
+	    HT_FREE(block);
+	    block = next;
+	}
+	HT_FREE(me->spare);
+	if (me->fp) fclose(me->fp);
+	HT_FREE(me);
+	return YES;
+    }
+    return NO;
 }
 
-BOOL HTQueue_enqueue(HTList *me,void *newObject)
+/*
+**	Add an object to the end of the queue
+*/
+PUBLIC BOOL HTQueue_enqueue (HTQueue * me, void * newObject)
 {
-  return  HTList_addObject(me,newObject);
+    if (me) {
+	if (me->max_memory > 0 && (me->on_disk || me->count >= me->max_memory)) {
+	    if (freeze_object(me, newObject)) {
+		update_high_water(me);
+		return YES;
+	    }
+
+	    /*
+	    **  The object must stay in memory. Read back what is on disk
+	    **  first so that it doesn't get ahead of older objects
+	    */
+	    if (me->on_disk) {
+		HTTRACE(APP_TRACE, "Queue....... Can't freeze object, reading back %d from disk\n" _ me->on_disk);
+		while (me->on_disk) thaw_objects(me);
+	    }
+	}
+	push_back(me, newObject);
+	update_high_water(me);
+	return YES;
+    }
+    return NO;
 }
-BOOL HTQueue_append(HTList *me,void *newObject)
+
+/*
+**	Add an object to the front of the queue so that it is the next one
+*/
+PUBLIC BOOL HTQueue_append (HTQueue * me, void * newObject)
 {
-  return  HTList_appendObject(me,newObject);
+    if (me) {
+	push_front(me, newObject);
+	update_high_water(me);
+	return YES;
+    }
+    return NO;
 }
 
-BOOL HTQueue_dequeue(HTList *me)
+PUBLIC void * HTQueue_headOfQueue (HTQueue * me)
 {
-  return HTList_removeFirstObject(me) ? YES : NO;
+    if (!me) return NULL;
+    if (!me->count && me->on_disk) thaw_objects(me);
+    return me->count ? me->head->objects[me->first] : NULL;
 }
 
-BOOL HTQueue_isEmpty(HTList *me)
+/*
+**	Remove the object at the front of the queue
+*/
+PUBLIC BOOL HTQueue_dequeue (HTQueue * me)
 {
-  return HTList_isEmpty(me);
+    if (!me) return NO;
+    if (!me->count && me->on_disk) thaw_objects(me);
+    if (!me->count) return NO;
+    me->first++;
+    me->count--;
+    if (!me->count) {
+	free_block(me, me->head);
+	me->head = me->tail = NULL;
+    } else if (me->first >= QUEUE_BLOCK) {
+	QueueBlock * block = me->head;
+	me->head = block->next;
+	me->head->prev = NULL;
+	me->first = 0;
+	free_block(me, block);
+    }
+    return YES;
 }
 
-void * HTQueue_headOfQueue(HTList *me)
+PUBLIC BOOL HTQueue_isEmpty (HTQueue * me)
 {
-  return HTList_firstObject(me);
+    return me ? (!me->count && !me->on_disk) : YES;
 }
 
-int HTQueue_count(HTList *me)
+PUBLIC int HTQueue_count (HTQueue * me)
 {
-  return HTList_count(me);
+    return me ? me->count + me->on_disk : 0;
 }
 
+/*
+**	Keep at most max objects in memory
+*/
+PUBLIC BOOL HTQueue_setLimit (HTQueue * me, int max, HTQueueFreeze * freeze,
+			      HTQueueThaw * thaw, void * context)
+{
+    if (me && freeze && thaw && max >= 0) {
+	me->max_memory = max;
+	me->freeze = freeze;
+	me->thaw = thaw;
+	me->context = context;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC int HTQueue_onDisk (HTQueue * me)
+{
+    return me ? me->on_disk : 0;
+}
+
+PUBLIC unsigned long HTQueue_frozen (HTQueue * me)
+{
+    return me ? me->frozen : 0;
+}
+
+PUBLIC int HTQueue_highWater (HTQueue * me)
+{
+    return me ? me->high_water : 0;
+}
@@ -468,6 +468,30 @@ PRIVATE BOOL calculate_statistics (Robot * mr)
 	}
     }
 
+    /* The set of visited URLs */
+    if (mr->visited && SHOW_REAL_QUIET(mr)) {
+	int count = HTVisited_count(mr->visited);
+	long memory = HTVisited_memory(mr->visited);
+	unsigned long lookups = HTVisited_lookups(mr->visited);
+	HTPrint("\tRemembered %d URL(s) in %ld bytes (%.1f bytes per URL)\n",
+		count, memory, count > 0 ? (double) memory / count : 0.0);
+	if (lookups > 0)
+	    HTPrint("\tThe Bloom filter answered %lu of %lu lookups\n",
+		    HTVisited_filtered(mr->visited), lookups);
+    }
+
+    /* The queue of the breadth first search */
+    if (mr->flags & MR_BFS && mr->cdepth && SHOW_REAL_QUIET(mr)) {
+	int cnt;
+	HTPrint("\tThe queue held at most %d document(s), %lu of them were kept on disk\n",
+		HTQueue_highWater(mr->queue), HTQueue_frozen(mr->queue));
+	for (cnt = 0; cnt <= mr->depth + 1; cnt++) {
+	    if (mr->cdepth[cnt])
+		HTPrint("\tFound %d document(s) at depth %d\n",
+			mr->cdepth[cnt], cnt);
+	}
+    }
+
     /* Create an array of existing anchors */
     if (total_docs > 1) {
 	HTArray * array = HTAnchor_getArray(total_docs);
@@ -811,6 +835,7 @@ PRIVATE BOOL Robot_delete (Robot * mr)
 #endif
 
 	if (mr->queue) HTQueue_delete(mr->queue);
+	if (mr->visited) HTVisited_delete(mr->visited);
 	HT_FREE(mr->cwd);
 	HT_FREE(mr->prefix);
 	HT_FREE(mr->img_prefix);
@@ -1183,6 +1208,53 @@ PUBLIC int bfs_terminate_handler (HTRequest * request, HTResponse * response,
     return HT_OK;
 }
 
+/*
+**  Documents which don't fit in the queue in memory are written to disk
+**  as the method and the address. The HyperDoc object stays in memory
+**  as we need it for the statistics anyway, so we find it again from
+**  the anchor when the document is read back.
+*/
+PRIVATE char * freeze_hyperdoc (void * object, void * context)
+{
+    HyperDoc * hd = (HyperDoc *) object;
+    char * uri = HTAnchor_address((HTAnchor *) hd->anchor);
+    const char * method = HTMethod_name(hd->method);
+    char * line;
+    if ((line = (char *) HT_MALLOC(strlen(method) + strlen(uri) + 2)) == NULL)
+	HT_OUTOFMEM("freeze_hyperdoc");
+    sprintf(line, "%s %s", method, uri);
+    HT_FREE(uri);
+    return line;
+}
+
+PRIVATE void * thaw_hyperdoc (const char * line, void * context)
+{
+    const char * uri = strchr(line, ' ');
+    if (uri) {
+	char method[16];
+	int len = uri - line;
+	HTParentAnchor * anchor = HTAnchor_parent(HTAnchor_findAddress(++uri));
+	HyperDoc * hd = (HyperDoc *) HTAnchor_document(anchor);
+	if (hd && len < (int) sizeof(method)) {
+	    strncpy(method, line, len);
+	    method[len] = '\0';
+	    hd->method = HTMethod_enum(method);
+	    return hd;
+	}
+    }
+    HTTRACE(APP_TRACE, "Robot....... Lost queued document `%s\'\n" _ line);
+    return NULL;
+}
+
+/*
+**  Keep at most max documents of the queue in memory
+*/
+PUBLIC BOOL Robot_setQueueLimit (Robot * mr, int max)
+{
+    return mr ? HTQueue_setLimit(mr->queue, max, freeze_hyperdoc,
+				 thaw_hyperdoc, mr) : NO;
+}
+
 PUBLIC void Serving_queue(Robot *mr)
 {
   BOOL abort = NO;
@@ -1211,11 +1283,11 @@ PUBLIC void Serving_queue(Robot *mr)
 
 	      HTRequest_setParent(newreq,get_last_parent(nhd->anchor));
 
-	      /* @@@ Should be done using a timer and not sleep! @@@ */
-#if 0
-	      if(mr->waits)
-		  sleep(mr->waits);
-#endif
+	      /*
+	      ** We don't wait here. The host manager holds the request
+	      ** back until we are allowed to make another request to that
+	      ** host and serves other hosts meanwhile.
+	      */
 	      
 	      if (HTLoadAnchor((HTAnchor *)nhd->anchor , newreq) != YES) 
 		{
@@ -1310,6 +1382,7 @@ PRIVATE void RHText_foundAnchor (HText * text, HTChildAnchor * anchor)
 	HTParentAnchor * referer = HTRequest_anchor(text->request);
 	BOOL match = text->follow;
 	BOOL check = NO;
+	BOOL seen = NO;
 
 	/* These are new variables */
 	HyperDoc * nhd = NULL;
@@ -1324,9 +1397,15 @@ PRIVATE void RHText_foundAnchor (HText * text, HTChildAnchor * anchor)
 	if (!uri) return;
 	if (SHOW_QUIET(mr)) HTPrint("Robot....... Found `%s\' - \n", uri ? uri : "NULL\n");
 
-        if (hd) {
+	/*
+	** With a visited set we also remember the links that we don't
+	** follow, so they don't need a HyperDoc object.
+	*/
+	if (mr->visited) seen = !HTVisited_add(mr->visited, uri);
+
+        if (hd || seen) {
 	    if (SHOW_QUIET(mr)) HTPrint("............ Already checked\n");
-            hd->hits++;
+            if (hd) hd->hits++;
 #ifdef HT_MYSQL
 	    if (mr->sqllog) {
 		char * ref_addr = HTAnchor_address((HTAnchor *) referer);
@@ -1361,7 +1440,8 @@ PRIVATE void RHText_foundAnchor (HText * text, HTChildAnchor * anchor)
 	  follow = NO;
 
 	/* Test whether we already have a hyperdoc for this document */
-	if (!hd && dest_parent) {
+	if (!hd && dest_parent &&
+	    (!mr->visited || (mr->flags & MR_LINK && match && follow))) {
 	    nhd = HyperDoc_new(mr, dest_parent, depth);
 	    mr->cdepth[depth]++;
 	}
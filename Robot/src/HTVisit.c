@@ -0,0 +1,214 @@
+/*
+**	@(#) $Id$
+**	
+**	W3C Webbot can be found at "http://www.w3.org/Robot/"
+**	
+**	Copyright  1995-1998 World Wide Web Consortium, (Massachusetts
+**	Institute of Technology, Institut National de Recherche en
+**	Informatique et en Automatique, Keio University). All Rights
+**	Reserved. This program is distributed under the W3C's Software
+**	Intellectual Property License. This program is distributed in the hope
+**	that it will be useful, but WITHOUT ANY WARRANTY; without even the
+**	implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+**	PURPOSE. See W3C License http://www.w3.org/Consortium/Legal/ for more
+**	details.
+**
+**  History:
+**	Oct 2026	Written
+**
+**	A set of the URLs the robot has seen. We only keep a 64 bit
+**	fingerprint of each URL in an open addressed hash table, and a
+**	Bloom filter in front of the table tells us cheaply about most of
+**	the URLs which we haven't seen before.
+*/
+
+#include "HTVisit.h"
+
+#define VISIT_MIN_SIZE	1024		       /* Smallest number of slots */
+#define BLOOM_BITS	8		   /* Bits in the filter for each slot */
+#define BLOOM_HASHES	4	      /* Number of bits set for each URL */
+
+typedef struct _Fingerprint {
+    unsigned int	h1;
+    unsigned int	h2;
+} Fingerprint;
+
+struct _HTVisited {
+    Fingerprint *	table;
+    unsigned int	size;			    /* Always a power of two */
+    unsigned int	count;
+    unsigned char *	bloom;
+    unsigned int	bloom_bits;
+    unsigned long	lookups;
+    unsigned long	filtered;	      /* Answered by the Bloom filter */
+};
+
+/* ------------------------------------------------------------------------- */
+
+/*
+**	Two different 32 bit hashes of the URL make up the fingerprint.
+**	A fingerprint of 0,0 marks an empty slot so we never make one.
+*/
+PRIVATE void fingerprint (const char * str, Fingerprint * fp)
+{
+    unsigned int h1 = 2166136261U;
+    unsigned int h2 = 0x9747b28cU;
+    const unsigned char * p;
+    for (p = (const unsigned char *) str; *p; p++) {
+	h1 = (h1 ^ *p) * 16777619U;
+	h2 = (h2 ^ *p) * 0x5bd1e995U;
+	h2 ^= h2 >> 15;
+    }
+    h2 ^= h2 >> 13;
+    h2 *= 0xc2b2ae35U;
+    h2 ^= h2 >> 16;
+    fp->h1 = h1;
+    fp->h2 = h2 ? h2 : 1;
+}
+
+/*
+**	The Bloom filter bits are found by double hashing: h1 + i*h2
+*/
+PRIVATE BOOL bloom_check (HTVisited * me, Fingerprint * fp, BOOL set)
+{
+    unsigned int mask = me->bloom_bits - 1;
+    BOOL found = YES;
+    int cnt;
+    for (cnt = 0; cnt < BLOOM_HASHES; cnt++) {
+	unsigned int bit = (fp->h1 + cnt * fp->h2) & mask;
+	unsigned char byte = 1 << (bit & 7);
+	if (!(me->bloom[bit >> 3] & byte)) {
+	    if (!set) return NO;
+	    me->bloom[bit >> 3] |= byte;
+	    found = NO;
+	}
+    }
+    return found;
+}
+
+PRIVATE Fingerprint * find_slot (HTVisited * me, Fingerprint * fp)
+{
+    unsigned int mask = me->size - 1;
+    unsigned int pos = fp->h1 & mask;
+    for (;;) {
+	Fingerprint * slot = &me->table[pos];
+	if (!slot->h2 || (slot->h1 == fp->h1 && slot->h2 == fp->h2))
+	    return slot;
+	pos = (pos + 1) & mask;
+    }
+}
+
+/*
+**	Allocate the table and the filter for size slots and put all the
+**	fingerprints we have got into them.
+*/
+PRIVATE void resize (HTVisited * me, unsigned int size)
+{
+    Fingerprint * old = me->table;
+    unsigned int old_size = me->size;
+    unsigned int cnt;
+    if ((me->table = (Fingerprint *) HT_CALLOC(size, sizeof(Fingerprint))) == NULL)
+	HT_OUTOFMEM("HTVisited resize");
+    me->size = size;
+    HT_FREE(me->bloom);
+    me->bloom_bits = size * BLOOM_BITS;
+    if ((me->bloom = (unsigned char *) HT_CALLOC(me->bloom_bits / 8, 1)) == NULL)
+	HT_OUTOFMEM("HTVisited resize");
+    for (cnt = 0; cnt < old_size; cnt++) {
+	if (old[cnt].h2) {
+	    *find_slot(me, &old[cnt]) = old[cnt];
+	    bloom_check(me, &old[cnt], YES);
+	}
+    }
+    HT_FREE(old);
+    HTTRACE(APP_TRACE, "Visited..... Set has %u slots for %u URLs\n" _
+	    me->size _ me->count);
+}
+
+/* ------------------------------------------------------------------------- */
+
+PUBLIC HTVisited * HTVisited_new (int expected)
+{
+    HTVisited * me;
+    unsigned int size = VISIT_MIN_SIZE;
+    if ((me = (HTVisited *) HT_CALLOC(1, sizeof(HTVisited))) == NULL)
+	HT_OUTOFMEM("HTVisited_new");
+    while (expected > 0 && size < (unsigned int) expected * 2) size <<= 1;
+    resize(me, size);
+    return me;
+}
+
+PUBLIC BOOL HTVisited_delete (HTVisited * me)
+{
+    if (me) {
+	HT_FREE(me->table);
+	HT_FREE(me->bloom);
+	HT_FREE(me);
+	return YES;
+    }
+    return NO;
+}
+
+/*
+**	Returns YES if the URL is new and has been added, NO if we have
+**	seen it before.
+*/
+PUBLIC BOOL HTVisited_add (HTVisited * me, const char * url)
+{
+    if (me && url) {
+	Fingerprint fp;
+	Fingerprint * slot;
+	fingerprint(url, &fp);
+	me->lookups++;
+	if (bloom_check(me, &fp, YES)) {
+	    slot = find_slot(me, &fp);
+	    if (slot->h2) return NO;
+	} else {
+	    me->filtered++;
+	    slot = find_slot(me, &fp);
+	}
+	*slot = fp;
+	if (++me->count > me->size / 2) resize(me, me->size << 1);
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC BOOL HTVisited_contains (HTVisited * me, const char * url)
+{
+    if (me && url) {
+	Fingerprint fp;
+	fingerprint(url, &fp);
+	me->lookups++;
+	if (!bloom_check(me, &fp, NO)) {
+	    me->filtered++;
+	    return NO;
+	}
+	return find_slot(me, &fp)->h2 ? YES : NO;
+    }
+    return NO;
+}
+
+/*
+**	Statistics
+*/
+PUBLIC int HTVisited_count (HTVisited * me)
+{
+    return me ? (int) me->count : 0;
+}
+
+PUBLIC long HTVisited_memory (HTVisited * me)
+{
+    return me ? sizeof(HTVisited) + me->size * sizeof(Fingerprint) +
+	me->bloom_bits / 8 : 0;
+}
+
+PUBLIC unsigned long HTVisited_lookups (HTVisited * me)
+{
+    return me ? me->lookups : 0;
+}
+
+PUBLIC unsigned long HTVisited_filtered (HTVisited * me)
+{
+    return me ? me->filtered : 0;
+}
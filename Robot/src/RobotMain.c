@@ -214,7 +214,10 @@ int main (int argc, char ** argv)
 	    } else if (!strcmp(argv[arg], "-wait")) {
 		int waits = (arg+1 < argc && *argv[arg+1] != '-') ?
 		    atoi(argv[++arg]) : 0;
-		if (waits > 0) mr->waits = waits;
+		if (waits > 0) {
+		    mr->waits = waits;
+		    HTHost_setDefaultRequestDelay(waits*MILLIES);
+		}
 
 	    /* Force no pipelined requests */
 	    } else if (!strcmp(argv[arg], "-nopipe")) {
@@ -297,6 +300,18 @@ int main (int argc, char ** argv)
 	    } else if (!strcmp(argv[arg], "-bfs")) { 
 		mr->flags |= MR_BFS;
 
+	    /* visited -- Remember the URLs we have seen in a fingerprint set */
+	    } else if (!strcmp(argv[arg], "-visited")) {
+		int expected = (arg+1 < argc && *argv[arg+1] != '-') ?
+		    atoi(argv[++arg]) : 0;
+		if (!mr->visited) mr->visited = HTVisited_new(expected);
+
+	    /* queue -- How many documents of the BFS queue to keep in memory */
+	    } else if (!strcmp(argv[arg], "-queue")) {
+		int max = (arg+1 < argc && *argv[arg+1] != '-') ?
+		    atoi(argv[++arg]) : 0;
+		if (max > 0) Robot_setQueueLimit(mr, max);
+
 	    /* run in quiet mode */
 	    } else if (!strcmp(argv[arg], "-q")) { 
 		mr->flags |= MR_QUIET;
@@ -578,6 +593,8 @@ int main (int argc, char ** argv)
       char *robot_str = get_robots_txt(ruri);
       char *reg_exp_robot = robot_str ? 
 	scan_robots_txt(robot_str,APP_NAME) : NULL;
+      ms_t crawl_delay = robot_str ?
+	scan_crawl_delay(robot_str,APP_NAME) : 0;
       if (SHOW_REAL_QUIET(mr)) HTPrint("robots.txt uri is `%s'\n", ruri);
       if(robot_str)
 	  HT_FREE(robot_str);
@@ -586,6 +603,23 @@ int main (int argc, char ** argv)
 	  mr->exc_robot = get_regtype(mr, reg_exp_robot, W3C_DEFAULT_REGEX_FLAGS);
 	  HT_FREE(reg_exp_robot);
 	}
+
+      /* Honor any Crawl-delay for this host */
+      if(crawl_delay)
+	{
+	  char *hostname = HTParse(ruri, "", PARSE_HOST);
+	  char *ptr;
+	  HTHost *host;
+	  if ((ptr = strrchr(hostname, '@')) != NULL)
+	    memmove(hostname, ptr+1, strlen(ptr+1)+1);
+	  if ((ptr = strchr(hostname, ':')) != NULL)
+	    *ptr = '\0';
+	  if ((host = HTHost_find(hostname)) != NULL)
+	    HTHost_setRequestDelay(host, crawl_delay);
+	  if (SHOW_REAL_QUIET(mr))
+	    HTPrint("robots.txt asks for %lu ms between requests\n", crawl_delay);
+	  HT_FREE(hostname);
+	}
       HT_FREE(ruri);
     }
 #endif
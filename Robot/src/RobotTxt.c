@@ -51,6 +51,20 @@ PUBLIC BOOL set_name_user_agent (UserAgent * ua, char * name)
     return NO;
 }
 
+PUBLIC BOOL set_crawl_delay_user_agent (UserAgent * ua, ms_t delay)
+{
+    if (ua) {
+	ua->crawl_delay = delay;
+	return YES;
+    }
+    return NO;
+}
+
+PUBLIC ms_t get_crawl_delay_user_agent (UserAgent * ua)
+{
+    return ua ? ua->crawl_delay : 0;
+}
+
 PUBLIC BOOL add_disallow_user_agent (UserAgent * ua, char * disallow)
 {
     if (ua && disallow) {
@@ -118,6 +132,30 @@ PUBLIC char * get_regular_expression (HTList * user_agents, char * name_robot)
     return NULL;
 }
 
+PUBLIC ms_t get_crawl_delay (HTList * user_agents, char * name_robot)
+{
+    if (user_agents && name_robot) {
+	HTList *cur = user_agents;
+	UserAgent *pres;
+	ms_t delay = 0;
+	int found = 0;
+
+	while ((pres = (UserAgent *) HTList_nextObject(cur))) {
+	    char *name = get_name_user_agent(pres);
+
+	    if(!strcmp(name,"*") && !found)
+		delay = get_crawl_delay_user_agent(pres);
+
+	    if(!strcmp(name,name_robot)) {
+		delay = get_crawl_delay_user_agent(pres);
+		found = 1;
+	    }
+	}
+	return delay;
+    }
+    return 0;
+}
+
 PUBLIC BOOL put_string_disallow (HTChunk * ch, UserAgent * ua)
 {
     if (ch && ua) {
@@ -223,8 +261,10 @@ PUBLIC BOOL get_user_agents(char * ptr, HTList *user_agents)
 {
   char *uastr = "user-agent:";
   char *disstr = "disallow:";
+  char *delstr = "crawl-delay:";
   int luastr = 10;
   int ldisstr = 9;
+  int ldelstr = 12;
   char name[2000];
   int indices[200];
   int i = 0;
@@ -247,9 +287,30 @@ PUBLIC BOOL get_user_agents(char * ptr, HTList *user_agents)
 	  set_name_user_agent(ua,name);
 	} while(!strncasecomp(ptr,uastr,luastr));
 
-	if(!strncasecomp(ptr, disstr,ldisstr))
+	if(!strncasecomp(ptr, disstr,ldisstr) || !strncasecomp(ptr,delstr,ldelstr))
 	  {
 	    do {
+	      /* Crawl-delay in seconds, possibly with a fraction */
+	      if(!strncasecomp(ptr,delstr,ldelstr))
+		{
+		  ms_t delay;
+		  int j;
+		  ptr += ldelstr;
+		  while(*ptr == ' ' || *ptr == '\t')
+		    ptr++;
+		  scan_name_until_space(ptr,name); 
+		  ptr += strlen(name);
+		  while(isspace((int)*ptr))
+		    ptr++;
+		  ptr = skip_comments(ptr);
+		  delay = (ms_t) (atof(name) * MILLIES);
+		  for(j = 0 ; j < i ; j++)
+		    {
+		      ua = HTList_objectAt(user_agents, indices[j]);
+		      set_crawl_delay_user_agent(ua,delay);
+		    }
+		  continue;
+		}
 	      ptr += ldisstr + 1;
 	      scan_name_until_space(ptr,name); 
 	      ptr += strlen(name) + 1;
@@ -267,7 +328,8 @@ PUBLIC BOOL get_user_agents(char * ptr, HTList *user_agents)
 		      add_disallow_user_agent(ua,name);
 		    }
 		}
-	    } while(!strncasecomp(ptr,disstr,ldisstr));
+	    } while(!strncasecomp(ptr,disstr,ldisstr) ||
+		    !strncasecomp(ptr,delstr,ldelstr));
 	  }
 	else
 	  return NO;
@@ -291,6 +353,17 @@ PUBLIC char * scan_robots_txt(char *rob_str, char *name_robot)
   return reg_exp_exclude;
 }
 
+PUBLIC ms_t scan_crawl_delay(char *rob_str, char *name_robot)
+{
+  ms_t delay = 0;
+  HTList * user_agents = get_all_user_agents(rob_str);
+
+  delay = get_crawl_delay(user_agents, name_robot);
+  delete_all_user_agents(user_agents);
+
+  return delay;
+}
+
 #ifdef ROBOTS_TXT_STANDALONE
 
 int 